@@ -1,6 +1,5 @@
-// Required by compute shaders apparently
-// Process one object per shader invocation (optimisation?)
-layout (local_size_x = 1) in;
+// One invocation per object and per cluster of each object of every batch, see ViewFrustumCullingRenderPass
+layout (local_size_x = 64) in;
 
 layout(std140, binding = 5) readonly buffer BoundingVolumeBlock {
     vec4 spheres[]; // vec4 = (center.xyz, radius)
@@ -9,11 +8,11 @@ layout(std140, binding = 5) readonly buffer BoundingVolumeBlock {
 // Plane defined as: Ax + By + Cz = D
 uniform vec4 frustum_planes[6];
 
-// FIXME: Some objects pop in and out of existence in Sponza ...
+// Sphere (center.xyz, radius) against the plane, see ClusterCulling::is_inside
 uint test(vec4 obj, vec4 plane) {
     const float distance = plane.x * obj.x + plane.y * obj.y + plane.z * obj.z + plane.w;
     if (distance < -obj.w) {
-        return 1; // Negative halfspace
+        return 0; // Negative halfspace
     }
     return 1; // Positive halfspace or on the plane
 }
@@ -37,8 +36,9 @@ layout(std140, binding = 0) buffer DrawCommandsBlock {
     DrawCommand draw_commands[];
 };
 
-// Index of the currently created draw command (into draw_commands)
-uniform uint DRAW_CMD_IDX = 0; // Will be used in the future when all multi draw cmds are one
+// Partition of the draw commands of the frame, the draw commands of every batch share the buffer (see DrawBuffers)
+uniform uint DRAW_CMD_IDX = 0;
+uniform uint NUM_DRAW_COMMANDS;  // Draw commands per partition, see DrawBuffers::draw_cmd_capacity
 
 // Object index which gives shader data later in the pipeline 
 // Note: Using std430 to suppress 16 byte aligned writes 
@@ -46,30 +46,192 @@ layout(std430, binding = 1) writeonly buffer ShaderDataIndexBlock {
     uint index_buffer[];
 };
 
-// Number of indices (a.k.a elements) of the currently created draw command (into draw_commands)
-uniform uint NUM_INDICES;
+// Levels of detail of the batches, see MeshLod and GraphicsBatch::num_draw_commands
+#define MAX_LODS 4
+uniform bool LOD_ENABLED = false;
+uniform float LOD_PIXEL_ERROR = 1.0;   // Largest projected error of a selected LOD
+uniform vec3 CAMERA_POSITION;
+uniform float PROJECTION_SCALE;        // Pixels covered by one unit at distance one
+
+/// Culling parameters of a batch, same as CullingBatch
+struct Batch {
+    uint first_invocation;
+    uint num_objects;
+    uint num_clusters;
+    uint instance_offset;     // Objects of the batch in the shared buffers, see GraphicsBatch::instance_offset
+    uint instance_idx_offset;
+    uint instance_capacity;   // Instances per region of index_buffer of the LOD commands, see GraphicsBatch::num_instance_idxs
+    uint base_vertex;         // Geometry of the batch in the shared vertex, index and cluster buffers
+    uint first_index;
+    uint first_cluster;
+    uint camera_cmd;          // First draw command of the batch per pass within a partition, see DrawBuffers::update_draw_order
+    uint shadow_cmd;
+    uint cluster_cmd;
+    uint voxelization_cmd;
+    uint num_lods;
+    uint cluster_capacity;    // Objects drawn by their clusters, see GraphicsBatch::cluster_capacity
+    uint padding;
+    uint lod_first_index[MAX_LODS];
+    uint lod_num_indices[MAX_LODS];
+    float lod_errors[MAX_LODS];    // Geometric error relative to the bounding sphere radius
+};
+
+// Batches of the partition [FIRST_BATCH, FIRST_BATCH + NUM_BATCHES) ordered by their first invocation
+layout(std430, binding = 3) readonly buffer BatchBlock {
+    Batch batches[];
+};
+
+uniform uint FIRST_BATCH = 0;
+uniform uint NUM_BATCHES = 0;
+uniform uint NUM_INVOCATIONS = 0;
+
+// Clipmaps in order from smallest to largest, voxelization LODs are selected by their voxel sizes
+#define NUM_CLIPMAPS 4
+uniform vec3 CLIPMAP_MINS[NUM_CLIPMAPS];
+uniform vec3 CLIPMAP_MAXS[NUM_CLIPMAPS];
+uniform float VOXEL_SIZES[NUM_CLIPMAPS];
+
+layout(std140, binding = 2) readonly buffer ModelsBlock {
+    mat4 models[];
+};
+
+/// Same as Meshlet, clusters of LOD 0 drawn by a draw command each in the geometry pass
+struct Cluster {
+    vec4 sphere;     // (center.xyz, radius) in model space
+    vec4 cone;       // (axis.xyz, cutoff) backface normal cone, cutoff = 1 is never backfacing
+    uint firstIndex;
+    uint count;
+    uint padding0;
+    uint padding1;
+};
+
+layout(std430, binding = 6) readonly buffer ClusterBlock {
+    Cluster clusters[];
+};
+
+uniform bool CLUSTER_CULLING_ENABLED = true;
+
+/// True if the model matrix scales every direction equally (see ClusterCulling::is_uniformly_scaled)
+bool is_uniformly_scaled(const mat4 model, const float max_scale) {
+    const vec3 x = model[0].xyz;
+    const vec3 y = model[1].xyz;
+    const vec3 z = model[2].xyz;
+    const float tolerance = 1e-3 * max_scale * max_scale;
+    return abs(dot(x, x) - dot(y, y)) <= tolerance && abs(dot(x, x) - dot(z, z)) <= tolerance &&
+           abs(dot(x, y)) <= tolerance && abs(dot(x, z)) <= tolerance && abs(dot(y, z)) <= tolerance;
+}
+
+/// True unless the cluster of the instance is outside the frustum or entirely backfacing the camera (see ClusterCulling)
+bool cluster_visible(const Cluster cluster, const mat4 model) {
+    const vec3 center = (model * vec4(cluster.sphere.xyz, 1.0)).xyz;
+    const float max_scale = sqrt(max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)), dot(model[2].xyz, model[2].xyz)));
+    const float radius = cluster.sphere.w * max_scale;
+    for (int i = 0; i < 6; i++) {
+        if (dot(frustum_planes[i].xyz, center) + frustum_planes[i].w < -radius) { return false; }
+    }
+
+    // NOTE: Non-uniform scaling bends the normals of the cluster away from its cone, never backface culled
+    if (cluster.cone.w < 1.0 && is_uniformly_scaled(model, max_scale)) {
+        const vec3 axis = normalize(mat3(model) * cluster.cone.xyz);
+        const vec3 view = center - CAMERA_POSITION;
+        if (dot(view, axis) >= cluster.cone.w * length(view) + radius) { return false; }
+    }
+    return true;
+}
+
+/// Coarsest LOD of the batch with an error (relative to the bounding sphere radius) within the allowed error
+uint select_lod(const Batch batch, const float allowed_error) {
+    uint lod = 0;
+    if (LOD_ENABLED) {
+        for (uint i = 1; i < batch.num_lods; i++) {
+            if (batch.lod_errors[i] <= allowed_error) { lod = i; }
+        }
+    }
+    return lod;
+}
+
+/// Appends the object to the instances of the draw command (within the current partition) drawing the range of indices
+/// The instances are read from the region of the draw command at the offset (see GraphicsBatch::num_instance_idxs)
+void emit(const Batch batch, const uint cmd, const uint region_offset, const uint first_index, const uint count, const uint idx) {
+    const uint draw_cmd_idx = DRAW_CMD_IDX * NUM_DRAW_COMMANDS + cmd;
+    const uint base_instance = batch.instance_idx_offset + region_offset;
+    draw_commands[draw_cmd_idx].count = count;
+    draw_commands[draw_cmd_idx].firstIndex = batch.first_index + first_index;
+    draw_commands[draw_cmd_idx].baseInstance = base_instance;
+    draw_commands[draw_cmd_idx].baseVertex = batch.base_vertex;
+    draw_commands[draw_cmd_idx].padding0 = 0; // Avoid optimisation 
+    draw_commands[draw_cmd_idx].padding1 = 0;
+    draw_commands[draw_cmd_idx].padding2 = 0;
+
+    const uint INSTANCE_IDX = atomicAdd(draw_commands[draw_cmd_idx].instanceCount, 1);
+    index_buffer[base_instance + INSTANCE_IDX] = batch.instance_offset + idx; // Shader data index (idx) for objects
+}
+
+/// Batch of the invocation, the last batch starting at or before it
+uint batch_of(const uint invocation) {
+    uint first = 0;
+    uint last = NUM_BATCHES - 1;
+    while (first < last) {
+        const uint middle = (first + last + 1) / 2;
+        if (batches[FIRST_BATCH + middle].first_invocation <= invocation) {
+            first = middle;
+        } else {
+            last = middle - 1;
+        }
+    }
+    return FIRST_BATCH + first;
+}
 
 void main() {
-    const uint idx = gl_GlobalInvocationID.y * gl_NumWorkGroups.x + gl_GlobalInvocationID.x; 
+    const uint invocation = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+    if (invocation >= NUM_INVOCATIONS) { return; }
+
+    // Invocations of a batch: one per object followed by one per cluster of each object drawn by its clusters
+    const Batch batch = batches[batch_of(invocation)];
+    const uint local_invocation = invocation - batch.first_invocation;
+    const bool is_cluster = local_invocation >= batch.num_objects;
+    const uint idx = is_cluster ? (local_invocation - batch.num_objects) / batch.num_clusters : local_invocation; // Object of the batch
+    const uint cluster = is_cluster ? (local_invocation - batch.num_objects) % batch.num_clusters : 0;
 
     uint inside = 0; 
     for (int i = 0; i < 6; i++) {
-        inside += test(spheres[idx], frustum_planes[i]) << i;
+        inside += test(spheres[batch.instance_offset + idx], frustum_planes[i]) << i;
     }
 
     const uint INSIDE_ALL_PLANES = 63; // = 0b111111;
     const bool visible = inside == INSIDE_ALL_PLANES;
+    const vec4 sphere = spheres[batch.instance_offset + idx];
     if (visible) {
-        draw_commands[DRAW_CMD_IDX].count = NUM_INDICES;
-        draw_commands[DRAW_CMD_IDX].baseInstance = 0;
-        draw_commands[DRAW_CMD_IDX].baseVertex = 0;
-        draw_commands[DRAW_CMD_IDX].padding0 = 0; // Avoid optimisation 
-        draw_commands[DRAW_CMD_IDX].padding1 = 0;
-        draw_commands[DRAW_CMD_IDX].padding2 = 0;
+        // Projected error in pixels of a LOD grows with the error and shrinks with the distance to the sphere
+        const float view_distance = max(length(sphere.xyz - CAMERA_POSITION) - sphere.w, 0.0001);
+        const float allowed_error = LOD_PIXEL_ERROR * view_distance / (PROJECTION_SCALE * sphere.w);
+        const uint lod = select_lod(batch, allowed_error);
+
+        // LOD 0 is drawn cluster by cluster in the geometry pass and as a whole by the shadow pass, the objects beyond the
+        // cluster capacity are drawn as a whole by both
+        const uint cluster_region = (2 * MAX_LODS + 1) * batch.instance_capacity;
+        if (is_cluster) {
+            const Cluster c = clusters[batch.first_cluster + cluster];
+            if (lod == 0 && (!CLUSTER_CULLING_ENABLED || cluster_visible(c, models[batch.instance_offset + idx]))) {
+                emit(batch, batch.cluster_cmd + cluster, cluster_region + cluster * batch.cluster_capacity, c.firstIndex, c.count, idx);
+            }
+        } else if (lod == 0 && idx < batch.cluster_capacity) {
+            emit(batch, batch.shadow_cmd, 2 * MAX_LODS * batch.instance_capacity, batch.lod_first_index[0], batch.lod_num_indices[0], idx);
+        } else {
+            emit(batch, batch.camera_cmd + lod, lod * batch.instance_capacity, batch.lod_first_index[lod], batch.lod_num_indices[lod], idx);
+        }
+    }
 
-        // 
+    if (is_cluster) { return; }
 
-        const uint INSTANCE_IDX = atomicAdd(draw_commands[DRAW_CMD_IDX].instanceCount, 1);
-        index_buffer[INSTANCE_IDX] = idx; // Shader data index (idx) for objects
+    // Voxelized once with the LOD of the finest clipmap it intersects, error is bounded by half a voxel of that clipmap
+    for (uint i = 0; i < NUM_CLIPMAPS; i++) {
+        const vec3 closest = clamp(sphere.xyz, CLIPMAP_MINS[i], CLIPMAP_MAXS[i]);
+        if (distance(closest, sphere.xyz) <= sphere.w) {
+            const uint lod = select_lod(batch, 0.5 * VOXEL_SIZES[i] / sphere.w);
+            emit(batch, batch.voxelization_cmd + lod, (MAX_LODS + lod) * batch.instance_capacity, batch.lod_first_index[lod],
+                 batch.lod_num_indices[lod], idx);
+            break;
+        }
     }
 }
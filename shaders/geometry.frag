@@ -43,7 +43,14 @@ void main() {
 
     gTangent = fTangent;
     gGeometricNormal = normalize(fGeometricNormal);
+    #ifdef TANGENT_NORMALS_RG
+    // Two channel normal map, z is reconstructed from the unit length of the normal
+    const vec2 tangent_normal_xy = 2.0 * texture(tangent_normal, fTexcoord).rg - vec2(1.0);
+    const float tangent_normal_z = sqrt(max(1.0 - dot(tangent_normal_xy, tangent_normal_xy), 0.0));
+    gTangentNormal = 0.5 * vec3(tangent_normal_xy, tangent_normal_z) + vec3(0.5);
+    #else
     gTangentNormal = texture(tangent_normal, fTexcoord).xyz;
+    #endif
     gPosition = fPosition;
     gShadingModelID = material.shading_model;
     
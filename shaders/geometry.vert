@@ -2,11 +2,12 @@
 uniform mat4 projection;
 uniform mat4 camera_view;
 
-in vec3 position;
-in vec3 normal;
-in vec2 texcoord;
-in vec3 tangent;
-in uint instance_idx; 
+// NOTE: Locations of DrawBuffers::VertexAttribute
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in uint instance_idx; 
 
 layout(std140, binding = 2) readonly buffer ModelsBlock {
     mat4 models[];
@@ -24,14 +25,14 @@ out vec3 local_space_position;
 flat out uint fInstance_idx;
 
 void main() {
-    const vec4 p = models[instance_idx] * vec4(position, 1.0); 
+    const vec4 p = models[instance_idx] * vec4(unpack_position(position, instance_idx), 1.0); 
     gl_Position = camera_view * p;
-    fTangent = tangent;
-    fGeometricNormal = normal;
+    fTangent = unpack_direction(tangent);
+    fGeometricNormal = unpack_direction(normal);
     fPosition = p.xyz;
     fTexcoord = texcoord;
     fInstance_idx = instance_idx;
     #ifdef DIFFUSE_CUBEMAP
-    local_space_position = position;
+    local_space_position = unpack_position(position, instance_idx);
     #endif
 }
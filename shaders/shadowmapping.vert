@@ -1,13 +1,14 @@
 
 uniform mat4 uLight_space_transform; // projection * camera_view (for the light)
 
-in uint instance_idx; 
-in vec3 position;
+// NOTE: Locations of DrawBuffers::VertexAttribute
+layout(location = 4) in uint instance_idx; 
+layout(location = 0) in vec3 position;
 
 layout(std140, binding = 2) readonly buffer ModelsBlock {
     mat4 models[];
 };
 
 void main() {
-    gl_Position = uLight_space_transform * models[instance_idx] * vec4(position, 1.0);
+    gl_Position = uLight_space_transform * models[instance_idx] * vec4(unpack_position(position, instance_idx), 1.0);
 }
@@ -0,0 +1,33 @@
+// NOTE: Unpacking of the quantized vertex layout (see PackedVertex)
+// File: vertex-unpacking-utils.glsl
+
+// Set per vertex layout, positions are unorm16 within the AABB of the mesh and directions octahedral snorm16
+uniform bool packed_vertices = false;
+
+// Dequantization of the positions of every instance, same as VertexFormat
+struct VertexFormat {
+  vec4 position_min;
+  vec4 position_extent;
+};
+
+layout(std430, binding = 7) readonly buffer VertexFormatBlock {
+  VertexFormat vertex_formats[];
+};
+
+vec3 oct_decode(const vec2 e) {
+  vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  const float t = max(-v.z, 0.0);
+  v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+  return normalize(v);
+}
+
+vec3 unpack_position(const vec3 p, const uint instance_idx) {
+  if (!packed_vertices) { return p; }
+  const VertexFormat vertex_format = vertex_formats[instance_idx];
+  return vertex_format.position_min.xyz + p * vertex_format.position_extent.xyz;
+}
+
+vec3 unpack_direction(const vec3 d) {
+  return packed_vertices ? oct_decode(d.xy) : d;
+}
+
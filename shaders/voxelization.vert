@@ -1,7 +1,8 @@
-in vec3 position;
-in vec3 normal;
-in vec2 texcoord;
-in uint instance_idx;
+// NOTE: Locations of DrawBuffers::VertexAttribute
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
+layout(location = 4) in uint instance_idx;
 
 layout(std140, binding = 2) readonly buffer ModelsBlock {
   mat4 models[];
@@ -15,9 +16,9 @@ out VS_OUT {
 } vs_out;
 
 void main() {
-    const vec4 p = models[instance_idx] * vec4(position, 1.0);
+    const vec4 p = models[instance_idx] * vec4(unpack_position(position, instance_idx), 1.0);
     gl_Position = p;
-    vs_out.gsNormal = normal;
+    vs_out.gsNormal = unpack_direction(normal);
     vs_out.gsTextureCoord = texcoord;
     vs_out.gsPosition = p.xyz;
     vs_out.gsInstanceIdx = instance_idx;
@@ -14,11 +14,24 @@
 #include "nodes/skybox.hpp"
 #include "nodes/physics_system.hpp"
 #include "scene/world.hpp"
+#include "scene/sceneloader.hpp"
 #include "rendering/graphicsbatch.hpp"
+#include "rendering/meshmanager.hpp"
+#include "rendering/texturemanager.hpp"
+#include "rendering/texturepool.hpp"
+#include "rendering/texturestreamer.hpp"
+#include "rendering/texturearrayallocator.hpp"
+#include "rendering/drawbuffers.hpp"
+#include "rendering/shadercache.hpp"
+#include "rendering/renderpass/view_frustum_culling_pass.hpp"
+#include "rendering/renderpass/directionalshadow_pass.hpp"
+#include "rendering/renderpass/gbuffer_pass.hpp"
+#include "rendering/renderpass/voxelization_pass.hpp"
 #include "util/filesystem.hpp"
 #include "util/config.hpp"
 #include "util/logging_system.hpp"
 #include "util/mkass.hpp"
+#include "util/benchmark.hpp"
 // #include "network/network_system.hpp"
 
 // TODO: Try to update ImGui some day
@@ -36,6 +49,9 @@ struct {
   bool about_window = false;         // TODO: Displays some information about the application
 } Gui;
 
+// Scene being streamed in, nullptr once loaded
+static SceneLoader* scene_loader = nullptr;
+
 // Helper to display a little (?) mark which shows a tooltip when hovered.
 // In your own code you may want to display an actual icon if you are using a merged icon fonts (see docs/FONTS.txt)
 static void ImGui_HelpMarker(const std::string& str) {
@@ -170,19 +186,62 @@ void MeineKraft::init() {
   bool success = false;
   const auto config = Config::load_config(success);
   if (success) {
+    if (config.contains("mesh_import")) {
+      const auto& mesh_import = config["mesh_import"];
+      MeshManager::import_settings.optimize_vertex_cache = mesh_import.value("optimize_vertex_cache", false);
+      MeshManager::import_settings.quantize_vertices = mesh_import.value("quantize_vertices", false);
+      MeshManager::import_settings.generate_lods = mesh_import.value("generate_lods", false);
+      MeshManager::import_settings.build_meshlets = mesh_import.value("build_meshlets", false);
+    }
+
+    if (config.contains("texture_import")) {
+      const auto& texture_import = config["texture_import"];
+      Texture::import_settings.decode_concurrency = texture_import.value("decode_concurrency", size_t(0));
+      Texture::import_settings.compress = texture_import.value("compress", false);
+      Texture::import_settings.high_quality = texture_import.value("high_quality", false);
+      Texture::import_settings.rgba = texture_import.value("rgba", false);
+      const std::string decoder = texture_import.value("decoder", std::string("stb_image"));
+      Texture::import_settings.decoder = decoder == "sdl_image" ? TextureDecoder::SDLImage : TextureDecoder::STBImage;
+    }
+
+    if (config.contains("texture_streaming")) {
+      const auto& texture_streaming = config["texture_streaming"];
+      Texture::streaming_settings.tail_size = texture_streaming.value("tail_size", uint32_t(0));
+      Texture::streaming_settings.frame_upload_budget = texture_streaming.value("frame_upload_budget_mb", size_t(8)) * 1024 * 1024;
+      Texture::streaming_settings.vram_budget = texture_streaming.value("vram_budget_mb", size_t(1024)) * 1024 * 1024;
+    }
+
+    screenshot_mode = config["screenshot_mode"].get<bool>();
+
     const std::string path = config["scene"]["path"].get<std::string>();
     const std::string name = config["scene"]["name"].get<std::string>();
-    renderer->scene = new Scene(Filesystem::home + path, name);
+    // NOTE: Screenshots and benchmarks are taken of the fully loaded scene
+    const bool streaming = config["scene"].value("streaming", true) && !screenshot_mode && !config.contains("benchmarks");
+    if (streaming) {
+      renderer->scene = new Scene();
+      renderer->scene->aabb = AABB(Vec3f(-1.0f), Vec3f(1.0f)); // Until the meshes are loaded
+      const float frame_budget_ms = config["scene"].value("frame_budget_ms", 4.0f);
+      scene_loader = new SceneLoader(renderer->scene, Filesystem::home + path, name, frame_budget_ms);
+    } else {
+      renderer->scene = new Scene(Filesystem::home + path, name);
+    }
     renderer->scene->camera = Camera(config);
   } else {
     renderer->scene = new Scene();
     Log::warn("Failed to load config.json.");
   }
 
-  screenshot_mode = config["screenshot_mode"].get<bool>();
-
   renderer->init();
   LoggingSystem::instance().init();
+
+  // Benchmarks are run on the scene in config.json once everything is set up
+  if (success && config.contains("benchmarks")) {
+    const std::string path = config["scene"]["path"].get<std::string>();
+    const std::string name = config["scene"]["name"].get<std::string>();
+    for (const auto& benchmark : config["benchmarks"]) {
+      Benchmark::run(benchmark.get<std::string>(), Filesystem::home + path, name);
+    }
+  }
 }
 
 MeineKraft::~MeineKraft() {
@@ -327,6 +386,15 @@ void MeineKraft::mainloop() {
       renderer->render(delta_ms);
     }
 
+    /// Add streamed in parts of the scene for the next frame
+    if (scene_loader) {
+      scene_loader->update();
+      if (scene_loader->is_done()) {
+        delete scene_loader;
+        scene_loader = nullptr;
+      }
+    }
+
     if (screenshot_mode && renderer->state.frame > screenshot_mode_frame_wait) {
       take_screenshot = true;
     }
@@ -398,6 +466,45 @@ void MeineKraft::mainloop() {
           ImGui::Text("Frame: %lu", renderer->state.frame);
           ImGui::Text("Resolution: (%u, %u)", renderer->screen.width, renderer->screen.height);
           ImGui::Text("Render passes: %u", renderer->state.render_passes);
+          const struct { const char* name; const char* calls; const DrawStatistics& statistics; } draw_statistics[] = {
+            {"Culling", "dispatches", renderer->view_frustum_culling_pass->statistics},
+            {"Shadow", "draw calls", renderer->shadow_pass->statistics},
+            {"Geometry", "draw calls", renderer->gbuffer_pass->statistics},
+            {"Voxelization", "draw calls", renderer->voxelization_pass->statistics}
+          };
+          for (const auto& pass : draw_statistics) {
+            ImGui::Text("%s pass: %u %s, %.3f ms CPU submit", pass.name, pass.statistics.draw_calls, pass.calls, pass.statistics.submit_milliseconds);
+          }
+          const ShaderCacheStatistics shader_statistics = ShaderCache::statistics();
+          ImGui::Text("Shader programs: %zu (%zu compiled, %zu loaded from binaries, %zu compilations shared)", shader_statistics.num_programs,
+                      shader_statistics.num_compiled, shader_statistics.num_loaded, shader_statistics.num_shared);
+          const MeshStatistics mesh_statistics = MeshManager::statistics();
+          ImGui::Text("Meshes: %zu (CPU %.1f MB owned, %.1f MB mapped)", mesh_statistics.num_meshes,
+                      mesh_statistics.owned_bytes / (1024.0f * 1024.0f), mesh_statistics.mapped_bytes / (1024.0f * 1024.0f));
+          // NOTE: Every batch costs at least a culling dispatch per frame
+          const DeduplicationStatistics deduplication = renderer->deduplication_statistics();
+          ImGui::Text("Deduplicated meshes: %zu (%zu batches instead of up to %zu, %zu draw commands instead of up to %zu, %.1f MB VRAM saved)",
+                      mesh_statistics.num_duplicates, deduplication.num_batches, deduplication.num_batches_without,
+                      deduplication.num_draw_commands, deduplication.num_draw_commands_without,
+                      deduplication.saved_bytes / (1024.0f * 1024.0f));
+          const TextureStatistics texture_statistics = TextureManager::statistics();
+          const TexturePoolStatistics pool_statistics = TexturePool::statistics();
+          ImGui::Text("Textures: %zu (CPU %.1f MB resident, %.1f MB released after upload, %zu loads shared %.1f MB)",
+                      texture_statistics.num_textures, texture_statistics.bytes / (1024.0f * 1024.0f),
+                      texture_statistics.released_bytes / (1024.0f * 1024.0f), texture_statistics.num_shared,
+                      texture_statistics.shared_bytes / (1024.0f * 1024.0f));
+          ImGui::Text("Texture pool: %.1f MB pooled, %zu of %zu allocations reused", pool_statistics.pooled_bytes / (1024.0f * 1024.0f),
+                      pool_statistics.num_reused, pool_statistics.num_allocations);
+          const TextureArrayStatistics array_statistics = renderer->texture_arrays->statistics();
+          ImGui::Text("Texture arrays: %zu (%zu / %zu layers, %zu planned, %zu grown while loading)", array_statistics.num_arrays,
+                      array_statistics.num_layers, array_statistics.capacity, array_statistics.planned_layers, array_statistics.num_grows);
+          if (Texture::streaming_settings.tail_size != 0) {
+            const TextureStreamingStatistics streaming_statistics = renderer->texture_streamer->statistics();
+            ImGui::Text("Texture streaming: %zu textures, %.1f / %.1f MB VRAM, %zu loads pending, %.1f MB streamed in, %.1f MB evicted",
+                        streaming_statistics.num_streamed, streaming_statistics.resident_bytes / (1024.0f * 1024.0f),
+                        Texture::streaming_settings.vram_budget / (1024.0f * 1024.0f), streaming_statistics.num_pending,
+                        streaming_statistics.uploaded_bytes / (1024.0f * 1024.0f), streaming_statistics.evicted_bytes / (1024.0f * 1024.0f));
+          }
           // TODO: Change resolution, memory usage, textures, render pass execution times, etc
 
           if (ImGui::CollapsingHeader("Global settings")) {
@@ -407,6 +514,13 @@ void MeineKraft::mainloop() {
 
             ImGui::Checkbox("Throttle rendering in background", &throttle_rendering_enabled);
             ImGui::SameLine(); ImGui_HelpMarker("Disables rendering when in the background.");
+
+            ImGui::Checkbox("Level of detail", &renderer->state.lod.enabled);
+            ImGui::SliderFloat("LOD pixel error", &renderer->state.lod.pixel_error, 0.1f, 16.0f);
+            ImGui::SameLine(); ImGui_HelpMarker("Largest projected geometric error in pixels of a selected LOD (requires mesh_import.generate_lods)");
+
+            ImGui::Checkbox("Cluster culling", &renderer->state.culling.clusters);
+            ImGui::SameLine(); ImGui_HelpMarker("Frustum and backface culls the meshlets of the visible instances (requires mesh_import.build_meshlets)");
           }
 
           if (ImGui::CollapsingHeader("Direct shadows")) {
@@ -672,6 +786,8 @@ void MeineKraft::mainloop() {
                   // TODO: Delete the whole batch and all the components
                 }
 
+                ImGui::Text("LODs: %u", batch.num_lods);
+
                 const std::string shader_title = "Shader##" + batch_title;
                 if (ImGui::CollapsingHeader(shader_title.c_str())) {
                   // TODO: Open shader view
@@ -681,7 +797,8 @@ void MeineKraft::mainloop() {
 
                 const std::string member_title = "Members##" + batch_title;
                 if (ImGui::CollapsingHeader(member_title.c_str())) {
-                  for (const auto& [id, idx]  : batch.data_idx) {
+                  for (size_t idx = 0; idx < batch.entity_ids.size(); idx++) {
+                    const ID id = batch.entity_ids[idx];
                     ImGui::Text("Entity id: %lu", id);
 
                     const std::string* name = NameSystem::instance().get_name_from_entity_referenced(id);
@@ -704,10 +821,13 @@ void MeineKraft::mainloop() {
                       // TODO: Show texture used for various properties
                       break;
                     case ShadingModel::PhysicallyBasedScalars:
-                      float* emissive = &batch.gl_material_buffer_ptr[idx].emissive_scalars.x;
-                      ImGui::ColorEdit3("Emissive", emissive);
-                      float* diffuse = &batch.gl_material_buffer_ptr[idx].diffuse_scalars.x;
-                      ImGui::ColorEdit3("Diffuse", diffuse);
+                      Material& material = batch.objects.materials[idx];
+                      const bool emissive_edited = ImGui::ColorEdit3("Emissive", &material.emissive_scalars.x);
+                      const bool diffuse_edited = ImGui::ColorEdit3("Diffuse", &material.diffuse_scalars.x);
+                      if (emissive_edited || diffuse_edited) {
+                        renderer->draw_buffers->materials[batch.instance_offset + idx] = material;
+                        renderer->draw_buffers->mark_instances(uint32_t(batch.instance_offset + idx), 1, DrawBuffers::Materials);
+                      }
                       break;
                     }
 
@@ -6,6 +6,7 @@
 
 #include "../rendering/primitives.hpp"
 #include "../util/logging.hpp"
+#include "../util/jobsystem.hpp"
 
 #include <algorithm>
 #include <functional>
@@ -59,77 +60,6 @@ public:
   }
 };
 
-struct JobSystem {
-  /// Singleton instance
-  static JobSystem& instance() {
-    static JobSystem instance;
-    return instance;
-  }
-
-  struct Worker {
-    enum State { Working = 0, Ready = 1, Idle = 2, Exit = 3 };
-    Semaphore sem; // 0 working, 1 ready, 2 done/idle, 3 exit
-    std::function<void()> workload;
-    std::thread t;
-
-    Worker(): sem(Worker::State::Idle), t(&Worker::execute, this) {}
-    ~Worker() { t.join(); }
-
-    void execute() {
-      while (!sem.try_peeq(Worker::State::Exit)) {
-        if (sem.try_peeq(Worker::State::Ready)) {
-          sem.try_wait();
-          workload();
-          sem.post(Worker::State::Idle);
-        }
-        std::this_thread::yield();
-      }
-    }
-  };
-
-  std::vector<Worker> thread_pool;
-
-  JobSystem() {
-    const size_t num_threads = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
-    Log::info("JobSystem using " + std::to_string(num_threads) + " workers");
-    thread_pool = std::vector<Worker>(num_threads);
-  }
-
-  ~JobSystem() {
-    for (size_t i = 0; i < thread_pool.size(); i++) {
-      thread_pool[i].sem.post(Worker::State::Exit);
-    }
-    wait_on_all();
-  }
-
-  /// Returns Job ID used to poll completion of work
-  ID execute(const std::function<void()>& func) {
-    uint64_t i = 0;
-    while (true) {
-      if (thread_pool[i].sem.try_peeq(Worker::State::Idle)) {
-        thread_pool[i].workload = std::move(func);
-        thread_pool[i].sem.try_wait();
-        return i;
-      }
-      i = (i + 1) % thread_pool.size();
-    }
-  }
-
-  // Blocking
-  void wait_on_all() {
-    uint64_t done = 0; 
-    while (done != thread_pool.size()) {
-      done = 0;
-      for (uint64_t i = 0; i < thread_pool.size(); i++) {
-        if (thread_pool[i].sem.try_peeq(Worker::State::Idle)) {
-          done++;
-        }
-      }
-    }
-  }
-};
-  
-
 /*********************************************************************************/
 
 /// Task for the ActionSystem
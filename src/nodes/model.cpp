@@ -1,6 +1,9 @@
 #include "model.hpp"
 #include "../rendering/meshmanager.hpp"
 #include "transform.hpp"
+#include "../rendering/clusterculling.hpp"
+#include "../rendering/renderer.hpp"
+#include "../rendering/texturearrayallocator.hpp"
 
 Model::Model(const std::string& directory, const std::string& file) {
   NameSystem::instance().add_name_to_entity(file, id);
@@ -18,53 +21,78 @@ Model::Model(const RenderComponent& render) {
   attach_component(render);
 }
 
-static AABB compute_aabb_from(const RenderComponent& render_component) {
-  return compute_aabb_from({render_component});
+Model::Model(const RenderComponent& render, const TransformComponent& transform) {
+  attach_component(transform);
+  attach_component(render);
 }
 
-static AABB compute_aabb_from(const std::vector<RenderComponent>& render_components) {
-  if (render_components.empty()) {
-    Log::error("Tried to compute AABB from a list of zero RenderComponents");
+AABB Scene::compute_aabb_from(const std::vector<RenderComponent>& render_components, const std::vector<MeshInstance>& instances) {
+  if (instances.empty()) {
+    Log::error("Tried to compute AABB from a list of zero instances");
     return AABB();
   }
 
   AABB aabb;
   aabb.min = Vec3f(std::numeric_limits<float>::max());
-  aabb.max = Vec3f(std::numeric_limits<float>::min());
-  for (size_t i = 0; i < render_components.size(); i++) {
-    Vec3f max = Vec3f(std::numeric_limits<float>::min());
-    Vec3f min = Vec3f(std::numeric_limits<float>::max());
-    const Mesh& mesh = MeshManager::mesh_from_id(render_components[i].mesh_id);
-    for (size_t j = 0; j < mesh.vertices.size(); j++) {
-      const Vertex& vertex = mesh.vertices[j];
-      if (max.x < vertex.position.x) { max.x = vertex.position.x; }
-      if (max.y < vertex.position.y) { max.y = vertex.position.y; }
-      if (max.z < vertex.position.z) { max.z = vertex.position.z; }
-      if (vertex.position.x < min.x) { min.x = vertex.position.x; }
-      if (vertex.position.y < min.y) { min.y = vertex.position.y; }
-      if (vertex.position.z < min.z) { min.z = vertex.position.z; }
+  aabb.max = Vec3f(std::numeric_limits<float>::lowest());
+  for (const MeshInstance& instance : instances) {
+    // NOTE: Mesh AABBs are computed once on import (or read from the mesh cache)
+    const AABB mesh_aabb = MeshManager::aabb_from_id(render_components[instance.mesh_idx].mesh_id);
+    const Mat4f transform = compute_transform(compute_transform_component(instance));
+    for (size_t corner = 0; corner < 8; corner++) {
+      const Vec3f p(corner & 1 ? mesh_aabb.max.x : mesh_aabb.min.x,
+                    corner & 2 ? mesh_aabb.max.y : mesh_aabb.min.y,
+                    corner & 4 ? mesh_aabb.max.z : mesh_aabb.min.z);
+      const Vec3f q = ClusterCulling::transform_point(transform, p);
+      if (aabb.max.x < q.x) { aabb.max.x = q.x; }
+      if (aabb.max.y < q.y) { aabb.max.y = q.y; }
+      if (aabb.max.z < q.z) { aabb.max.z = q.z; }
+      if (aabb.min.x > q.x) { aabb.min.x = q.x; }
+      if (aabb.min.y > q.y) { aabb.min.y = q.y; }
+      if (aabb.min.z > q.z) { aabb.min.z = q.z; }
     }
-    if (aabb.max.x < max.x) { aabb.max.x = max.x; }
-    if (aabb.max.y < max.y) { aabb.max.y = max.y; }
-    if (aabb.max.z < max.z) { aabb.max.z = max.z; }
-    if (aabb.min.x > min.x) { aabb.min.x = min.x; }
-    if (aabb.min.y > min.y) { aabb.min.y = min.y; }
-    if (aabb.min.z > min.z) { aabb.min.z = min.z; }
   }
   return aabb;
 }
 
+/// Allocates the layers of the diffuse textures of the components before any of them is added such that the texture
+/// arrays are never grown (and copied) while adding them
+static void reserve_texture_arrays(const std::vector<RenderComponent>& render_components) {
+  std::vector<Texture> textures;
+  for (const RenderComponent& render_component : render_components) { textures.push_back(render_component.diffuse_texture); }
+  TextureArrayAllocator* texture_arrays = MeineKraft::instance().renderer->texture_arrays;
+  texture_arrays->reserve(texture_arrays->plan(textures, true)); // NOTE: Diffuse textures are sRGB (see Renderer::add_component)
+}
+
+/// Adds an Entity for every instance, the render components of all of them are added at once (see Renderer::add_components)
+static void add_instances(const std::vector<RenderComponent>& render_components, const std::vector<MeshInstance>& instances, const std::string& name_prefix) {
+  std::vector<RenderComponent> instance_components;
+  std::vector<ID> entity_ids;
+  instance_components.reserve(instances.size());
+  entity_ids.reserve(instances.size());
+  // NOTE: Every instance holds a reference to the textures of its mesh, the first one the reference of the loaded mesh
+  RenderComponent::share_textures_with_instances(render_components, instances);
+  for (size_t i = 0; i < instances.size(); i++) {
+    RenderComponent render_component = render_components[instances[i].mesh_idx];
+    render_component.set_shading_model(ShadingModel::PhysicallyBased);
+    Entity entity;
+    entity.attach_component(compute_transform_component(instances[i]));
+    NameSystem::instance().add_name_to_entity(name_prefix + std::to_string(i), entity.id);
+    instance_components.push_back(render_component);
+    entity_ids.push_back(entity.id);
+  }
+  MeineKraft::instance().renderer->add_components(instance_components, entity_ids);
+}
+
 Scene::Scene(const std::string& directory, const std::string& file) {
   // Time scene loading
   const auto start = std::chrono::high_resolution_clock::now();
 
-  std::vector<RenderComponent> render_components = RenderComponent::load_scene_models(directory, file);
-  aabb = compute_aabb_from(render_components);
-  for (size_t i = 0; i < render_components.size(); i++) {
-    render_components[i].set_shading_model(ShadingModel::PhysicallyBased);
-    Model model(render_components[i]);
-    NameSystem::instance().add_name_to_entity("mesh-" + std::to_string(i), model.id);
-  }
+  std::vector<MeshInstance> instances;
+  std::vector<RenderComponent> render_components = RenderComponent::load_scene_models(directory, file, &instances);
+  aabb = compute_aabb_from(render_components, instances);
+  reserve_texture_arrays(render_components);
+  add_instances(render_components, instances, "mesh-");
 
   Log::info_indent(1, aabb);
   Log::info_indent(1, "Center: " + aabb.center().to_string());
@@ -81,12 +109,10 @@ Scene::Scene(const std::string& directory, const std::string& file) {
 }
 
 void Scene::load_models_from(const std::string& directory, const std::string& file) { 
-  std::vector<RenderComponent> render_components = RenderComponent::load_scene_models(directory, file);
-  for (size_t i = 0; i < render_components.size(); i++) {
-    render_components[i].set_shading_model(ShadingModel::PhysicallyBased);
-    Model model(render_components[i]);
-    NameSystem::instance().add_name_to_entity("2-mesh-" + std::to_string(i), model.id);
-  }
+  std::vector<MeshInstance> instances;
+  std::vector<RenderComponent> render_components = RenderComponent::load_scene_models(directory, file, &instances);
+  reserve_texture_arrays(render_components);
+  add_instances(render_components, instances, "2-mesh-");
 }
 
 void Scene::reset_camera() {
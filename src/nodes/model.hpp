@@ -5,11 +5,13 @@
 #include "../rendering/camera.hpp"
 #include "../rendering/rendercomponent.hpp"
 #include "entity.hpp"
+#include "transform.hpp"
 
 class Model: public Entity {
 public:
   Model(const std::string& directory, const std::string& file);
   Model(const RenderComponent& render);
+  Model(const RenderComponent& render, const TransformComponent& transform);
 };
 
 struct Scene {
@@ -30,6 +32,9 @@ struct Scene {
 
   /// Moves and positions the camera as it was spawned
   void reset_camera();  
+
+  /// Computes the AABB containing the meshes of the RenderComponents as placed by the instances
+  static AABB compute_aabb_from(const std::vector<RenderComponent>& render_components, const std::vector<MeshInstance>& instances);
 };
 
 #endif // MEINEKRAFT_MODEL_HPP
@@ -2,7 +2,9 @@
 #ifndef MEINEKRAFT_TRANSFORM_HPP
 #define MEINEKRAFT_TRANSFORM_HPP
 
+#include <algorithm>
 #include <unordered_map>
+#include <vector>
 
 #include "../rendering/primitives.hpp"
 #include "../math/quaternion.hpp"
@@ -34,20 +36,53 @@ struct TransformComponent {
   Vec3f position = Vec3f(0.0f, 0.0f, 0.0f); // World position
   float scale = 1.0f;
   Vec3f rotation = Vec3f(0.0f, 0.0f, 0.0f); // Rotation in degrees around (x, y, z) = (roll, pitch, yaw)?
+  Mat4f local;                              // Applied first, e.g. the rotation and scaling of the node placing an imported mesh
 };
 
 // FIXME
 static Mat4f compute_transform(const TransformComponent& comp) {
-  return rotate(comp.rotation).scale(comp.scale).translate(comp.position);
+  return comp.local * rotate(comp.rotation).scale(comp.scale).translate(comp.position);
 }
 
+/// Largest scaling of the transform along any axis, used to scale bounding spheres
+static float compute_max_scale(const TransformComponent& comp) {
+  float max_axis_length = 0.0f;
+  for (size_t i = 0; i < 3; i++) {
+    const Vec4f& axis = comp.local[i];
+    max_axis_length = std::max(max_axis_length, std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z));
+  }
+  return comp.scale * max_axis_length;
+}
+
+/// Places an Entity like the node of the MeshInstance, the translation of the node becomes the position
+static TransformComponent compute_transform_component(const MeshInstance& instance) {
+  TransformComponent comp;
+  comp.position = instance.transform.get_translation();
+  comp.local = instance.transform;
+  comp.local[3] = {0.0f, 0.0f, 0.0f, 1.0f};
+  return comp;
+}
+
+/// Transforms of the Entities, the Entities whose transform was modified during a frame are listed once in the dirty list
+/// of the frame such that the Renderer only reuploads those (see Renderer::update_transforms)
 struct TransformSystem {
 private:
-  std::vector<ID> data_ids;             // Entity ID for each Transform in data
-  std::vector<TransformComponent> data; // Raw data storage
-  std::unordered_map<ID, ID> data_idxs; // Entity ID to index into data
-  size_t dirty_idx = 0;                 // Number of modified Transforms
-  // FIXME: Dirty idx or # of modified Transforms?
+  std::vector<ID> data_ids;                 // Entity ID for each Transform in data
+  std::vector<TransformComponent> data;     // Raw data storage
+  std::vector<uint64_t> dirty_frames;       // Frame each Transform in data was last modified
+  std::vector<uint32_t> dirty_idxs;         // Index of each Transform in data into dirty_ids, valid if modified this frame
+  std::unordered_map<ID, size_t> data_idxs; // Entity ID to index into data
+  std::vector<ID> dirty_ids;                // Entity IDs of the Transforms modified during the current frame
+  uint64_t frame = 1;                       // 0 is never dirty
+
+  /// Lists the Transform in the dirty list of the frame unless it already is
+  void mark_dirty(const size_t idx) {
+    if (dirty_frames[idx] == frame) { return; }
+    dirty_frames[idx] = frame;
+    dirty_idxs[idx] = uint32_t(dirty_ids.size());
+    dirty_ids.push_back(data_ids[idx]);
+  }
+
 public:
   /// Singleton instance of TransformSystem
   static TransformSystem& instance() {
@@ -55,74 +90,72 @@ public:
     return instance;
   }
 
-  // TODO: Document
+  /// Starts a new frame with an empty dirty list, called once per frame after the dirty Transforms have been consumed
   void reset_dirty() {
-    dirty_idx = data.size() - 1;
-    // dirty_idx = 0;
+    dirty_ids.clear();
+    frame++;
   }
 
-  // TODO: Document
-  std::vector<ID> get_dirty_transform_ids() const {
-    if (data_ids.size() == 0) {
-      return {};
-    }
-
-    std::vector<ID> dirty_ids(dirty_idx + 1);
-    for (size_t i = 0; i <= dirty_idx; i++) {
-      dirty_ids[i] = data_ids[i];
-    }
+  /// Entity IDs of the Transforms modified during the current frame, each listed once
+  const std::vector<ID>& get_dirty_transform_ids() const {
     return dirty_ids;
   }
 
-  /// Looking up with a non-existant ID returns the first element in the data, returns copy otherwise
-  TransformComponent lookup(const ID id) {
+  /// Transform of the Entity, the Entity must have a Transform
+  /// NOTE: Does not modify the system thus it is safe to call from multiple threads at once
+  const TransformComponent& lookup(const ID id) const {
     assert(data_idxs.count(id) == 1);
-    return data[data_idxs[id]]; 
+    return data[data_idxs.at(id)];
   }
 
   /// Marks the data as dirty and returns a ptr to it
   TransformComponent* lookup_referenced(const ID id) {
     assert(data_idxs.count(id) == 1);
-    set_transform(data[data_idxs[id]], id); // Marks the data as dirty
-    return &data[data_idxs[id]];
+    const size_t idx = data_idxs[id];
+    mark_dirty(idx);
+    return &data[idx];
   }
 
-  // TODO: Document
-  void set_transform(const TransformComponent& transform, const ID id) { // FIXME: Does not work
-    if (data_idxs[id] <= dirty_idx) { // If transform is already dirty
-      data[data_idxs[id]] = transform;
-      return;
-    }
-    if (dirty_idx < data.size() - 1) {
-      dirty_idx++;
-    }
-    if (data.size() >= 2) {
-      data[data_idxs[id]] = data[dirty_idx]; // Move clean data to previous location
-      data[dirty_idx] = transform;
-      // Swap idxs
-      const ID old_idx = data_idxs[id];
-      data_idxs[id] = dirty_idx;
-      data_idxs[data_ids[dirty_idx]] = old_idx;
-      // Swap Entity IDs
-      std::swap(data_ids[dirty_idx], data_ids[old_idx]);
-    } 
+  /// Replaces the Transform of the Entity and marks it as dirty
+  void set_transform(const TransformComponent& transform, const ID id) {
+    assert(data_idxs.count(id) == 1);
+    const size_t idx = data_idxs[id];
+    data[idx] = transform;
+    mark_dirty(idx);
   }
 
-  // TODO: Document
-  // Overwrites if there already exists a component for the ID
+  /// Adds the Transform of the Entity, the Entity must not already have one
   void add_component(const TransformComponent& component, const ID id) {
-    data.emplace_back(component);
     assert(data_idxs.count(id) == 0);
-    data_idxs[id] = data.size() - 1;
+    data.emplace_back(component);
     data_ids.emplace_back(id);
+    dirty_frames.emplace_back(0);
+    dirty_idxs.emplace_back(0);
+    data_idxs[id] = data.size() - 1;
   }
 
-  // TODO: Document
+  /// Removes the Transform of the Entity if there is one, the last Transform is moved into its place
   void remove_component(const ID id) {
-    if (data_idxs.find(id) == data_idxs.cend()) { return; }
-    data.erase(data.cbegin() + data_idxs[id]);
+    const auto it = data_idxs.find(id);
+    if (it == data_idxs.cend()) { return; }
+    const size_t idx = it->second;
+    if (dirty_frames[idx] == frame) { // The last dirty Entity is moved into its place in the dirty list
+      const uint32_t dirty_idx = dirty_idxs[idx];
+      dirty_ids[dirty_idx] = dirty_ids.back();
+      dirty_idxs[data_idxs[dirty_ids[dirty_idx]]] = dirty_idx;
+      dirty_ids.pop_back();
+    }
+
+    data[idx] = data.back();
+    data_ids[idx] = data_ids.back();
+    dirty_frames[idx] = dirty_frames.back();
+    dirty_idxs[idx] = dirty_idxs.back();
+    data_idxs[data_ids[idx]] = idx;
+    data.pop_back();
+    data_ids.pop_back();
+    dirty_frames.pop_back();
+    dirty_idxs.pop_back();
     data_idxs.erase(id);
-    // resize data?
   }
 };
 
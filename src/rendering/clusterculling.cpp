@@ -0,0 +1,64 @@
+#include "clusterculling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// See: http://gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+ClusterCulling::Frustum ClusterCulling::frustum_planes(const Mat4f& m) {
+  // NOTE: m[i] is the i:th column, row i of the matrix is thus (m[0][i], m[1][i], m[2][i], m[3][i])
+  // Plane = row 3 + sign * row i
+  auto plane = [&m](const int i, const float sign) {
+    const Vec4f p(m[0][3] + sign * m[0][i], m[1][3] + sign * m[1][i], m[2][3] + sign * m[2][i], m[3][3] + sign * m[3][i]);
+    const float length = Vec3f(p.x, p.y, p.z).length();
+    return Vec4f(p.x / length, p.y / length, p.z / length, p.w / length);
+  };
+  return {plane(0, 1.0f), plane(0, -1.0f), plane(1, 1.0f), plane(1, -1.0f), plane(2, 1.0f), plane(2, -1.0f)};
+}
+
+Vec3f ClusterCulling::transform_point(const Mat4f& model, const Vec3f& p) {
+  return Vec3f(model[0]) * p.x + Vec3f(model[1]) * p.y + Vec3f(model[2]) * p.z + Vec3f(model[3]);
+}
+
+float ClusterCulling::max_scale(const Mat4f& model) {
+  return std::sqrt(std::max({Vec3f(model[0]).sqr_length(), Vec3f(model[1]).sqr_length(), Vec3f(model[2]).sqr_length()}));
+}
+
+bool ClusterCulling::is_uniformly_scaled(const Mat4f& model) {
+  // Orthogonal axes of equal length, within a relative tolerance
+  const Vec3f x(model[0]), y(model[1]), z(model[2]);
+  const float tolerance = 1e-3f * max_scale(model) * max_scale(model);
+  return std::abs(x.sqr_length() - y.sqr_length()) <= tolerance && std::abs(x.sqr_length() - z.sqr_length()) <= tolerance &&
+         std::abs(x.dot(y)) <= tolerance && std::abs(x.dot(z)) <= tolerance && std::abs(y.dot(z)) <= tolerance;
+}
+
+bool ClusterCulling::is_inside(const Vec4f& sphere, const Frustum& frustum) {
+  for (const Vec4f& plane : frustum) {
+    if (plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w < -sphere.w) { return false; }
+  }
+  return true;
+}
+
+bool ClusterCulling::is_visible(const Meshlet& meshlet, const Mat4f& model, const Vec3f& camera_position, const Frustum& frustum) {
+  const Vec3f center = transform_point(model, meshlet.center);
+  const float radius = meshlet.radius * max_scale(model);
+  if (!is_inside(Vec4f(center.x, center.y, center.z, radius), frustum)) { return false; }
+
+  // NOTE: Non-uniform scaling bends the normals of the meshlet away from its cone, never backface culled
+  if (meshlet.cone_cutoff < 1.0f && is_uniformly_scaled(model)) {
+    const Vec3f axis = (Vec3f(model[0]) * meshlet.cone_axis.x + Vec3f(model[1]) * meshlet.cone_axis.y + Vec3f(model[2]) * meshlet.cone_axis.z).normalize();
+    const Vec3f view = center - camera_position;
+    if (view.dot(axis) >= meshlet.cone_cutoff * view.length() + radius) { return false; }
+  }
+  return true;
+}
+
+size_t ClusterCulling::cull(const Mesh& mesh, const Mat4f& model, const Vec3f& camera_position, const Frustum& frustum, std::vector<uint32_t>& visible) {
+  visible.clear();
+  size_t num_triangles = 0;
+  for (size_t i = 0; i < mesh.meshlets.size(); i++) {
+    if (!is_visible(mesh.meshlets[i], model, camera_position, frustum)) { continue; }
+    visible.push_back(uint32_t(i));
+    num_triangles += mesh.meshlets[i].num_indices / 3;
+  }
+  return num_triangles;
+}
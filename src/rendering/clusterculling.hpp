@@ -0,0 +1,39 @@
+#pragma once
+#ifndef MEINEKRAFT_CLUSTERCULLING_HPP
+#define MEINEKRAFT_CLUSTERCULLING_HPP
+
+#include "primitives.hpp"
+
+#include <array>
+#include <vector>
+
+/// CPU reference of the cluster culling performed in shaders/culling.comp.glsl
+/// NOTE: Keep in sync with the shader, the CPU side exists in order to test and measure the culling without a GPU
+struct ClusterCulling {
+  /// Frustum planes (a, b, c, d) with ax + by + cz + d >= 0 inside and unit length normals, in order; {left, right, bottom, top, near, far}
+  using Frustum = std::array<Vec4f, 6>;
+
+  /// Extracts the frustum planes from the projection * view matrix (as uploaded to OpenGL, i.e column-major)
+  static Frustum frustum_planes(const Mat4f& projection_view);
+
+  /// Transforms the point with the model matrix (as uploaded to OpenGL, i.e column-major)
+  static Vec3f transform_point(const Mat4f& model, const Vec3f& point);
+
+  /// Largest scaling of the model matrix along any axis, scales the bounding spheres of the meshlets (see compute_max_scale)
+  static float max_scale(const Mat4f& model);
+
+  /// True if the model matrix scales every direction equally, only then are the normal cones of the meshlets transformed
+  /// by the model matrix (and backface culled)
+  static bool is_uniformly_scaled(const Mat4f& model);
+
+  /// True unless the bounding sphere (center.xyz, radius) is entirely outside the frustum, the per instance test
+  static bool is_inside(const Vec4f& sphere, const Frustum& frustum);
+
+  /// True unless the meshlet of the instance is entirely outside the frustum or entirely backfacing the camera
+  static bool is_visible(const Meshlet& meshlet, const Mat4f& model, const Vec3f& camera_position, const Frustum& frustum);
+
+  /// Indices of the visible meshlets of the Mesh instance, returns the number of visible triangles
+  static size_t cull(const Mesh& mesh, const Mat4f& model, const Vec3f& camera_position, const Frustum& frustum, std::vector<uint32_t>& visible);
+};
+
+#endif // MEINEKRAFT_CLUSTERCULLING_HPP
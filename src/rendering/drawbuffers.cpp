@@ -0,0 +1,411 @@
+#include "drawbuffers.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+#ifdef WIN32
+#include <glew.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "graphicsbatch.hpp"
+
+RangeAllocator::RangeAllocator(const uint32_t capacity): capacity(capacity) {
+  if (capacity > 0) { free_ranges.push_back({0, capacity}); }
+}
+
+uint32_t RangeAllocator::allocate(const uint32_t size) {
+  for (size_t i = 0; i < free_ranges.size(); i++) {
+    auto& range = free_ranges[i];
+    if (range.second < size) { continue; }
+    const uint32_t offset = range.first;
+    range.first += size;
+    range.second -= size;
+    if (range.second == 0) { free_ranges.erase(free_ranges.begin() + i); }
+    used += size;
+    return offset;
+  }
+  return NO_RANGE;
+}
+
+void RangeAllocator::release(const uint32_t offset, const uint32_t size) {
+  if (size == 0) { return; }
+  used -= size;
+  auto next = std::lower_bound(free_ranges.begin(), free_ranges.end(), std::make_pair(offset, 0u));
+  next = free_ranges.insert(next, {offset, size});
+
+  // Coalesce with the following and preceding ranges
+  if (next + 1 != free_ranges.end() && next->first + next->second == (next + 1)->first) {
+    next->second += (next + 1)->second;
+    free_ranges.erase(next + 1);
+  }
+  if (next != free_ranges.begin() && (next - 1)->first + (next - 1)->second == next->first) {
+    (next - 1)->second += next->second;
+    free_ranges.erase(next);
+  }
+}
+
+void RangeAllocator::grow(const uint32_t new_capacity) {
+  if (new_capacity <= capacity) { return; }
+  const uint32_t old_capacity = capacity;
+  capacity = new_capacity;
+  used += new_capacity - old_capacity; // Released right away
+  release(old_capacity, new_capacity - old_capacity);
+}
+
+/// Initial capacities, grown geometrically
+static const uint32_t INIT_NUM_VERTICES = 1 << 16;
+static const uint32_t INIT_NUM_INDICES = 1 << 18;
+static const uint32_t INIT_NUM_CLUSTERS = 1 << 12;
+static const uint32_t INIT_NUM_INSTANCES = 1 << 10;
+static const uint32_t INIT_NUM_INSTANCE_IDXS = 1 << 14;
+static const uint32_t INIT_NUM_DRAW_COMMANDS = 1 << 8;
+
+/// Vertex binding points of the VAOs
+static const uint32_t VERTEX_BINDING = 0;
+static const uint32_t INSTANCE_IDX_BINDING = 1;
+
+/// Byte size of a slot of the instance buffers in the order of DrawBuffers::InstanceBuffer
+static const size_t INSTANCE_STRIDES[] = {sizeof(Mat4f), sizeof(BoundingVolume), sizeof(Material), sizeof(VertexFormat)};
+static const char* INSTANCE_LABELS[] = {"Model SSBO", "BoundingVolume SSBO", "Material SSBO", "VertexFormat SSBO"};
+
+static uint32_t vertex_stride(const bool packed) {
+  return packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+/// New buffer of the byte size holding the first copied bytes of the buffer, which is deleted
+static uint32_t reallocate_buffer(const uint32_t gl_buffer, const size_t byte_size, const size_t copied, const char* label) {
+  uint32_t new_gl_buffer = 0;
+  glCreateBuffers(1, &new_gl_buffer);
+  glNamedBufferStorage(new_gl_buffer, byte_size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+  if (copied > 0) { glCopyNamedBufferSubData(gl_buffer, new_gl_buffer, 0, 0, copied); }
+  glObjectLabel(GL_BUFFER, new_gl_buffer, -1, label);
+  if (gl_buffer != 0) { glDeleteBuffers(1, &gl_buffer); }
+  return new_gl_buffer;
+}
+
+/// New persistently mapped buffer of the byte size, the buffer is deleted
+static uint32_t reallocate_mapped_buffer(const uint32_t gl_buffer, const size_t byte_size, uint8_t** ptr, const char* label) {
+  const auto flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
+  uint32_t new_gl_buffer = 0;
+  glCreateBuffers(1, &new_gl_buffer);
+  glNamedBufferStorage(new_gl_buffer, byte_size, nullptr, flags);
+  *ptr = (uint8_t*) glMapNamedBufferRange(new_gl_buffer, 0, byte_size, flags);
+  glObjectLabel(GL_BUFFER, new_gl_buffer, -1, label);
+  if (gl_buffer != 0) { glDeleteBuffers(1, &gl_buffer); } // Unmapped by deletion
+  return new_gl_buffer;
+}
+
+/// Attribute formats of the vertex layout, bound to the vertex and instance idx binding points
+static void setup_vertex_array(const uint32_t gl_vao, const bool packed) {
+  using A = DrawBuffers::VertexAttribute;
+  if (packed) {
+    // NOTE: Octahedral normals/tangents feed vec3 inputs with z = 0, decoded in the shaders
+    glVertexArrayAttribFormat(gl_vao, A::Position, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+    glVertexArrayAttribFormat(gl_vao, A::Normal, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+    glVertexArrayAttribFormat(gl_vao, A::Texcoord, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, tex_coord));
+    glVertexArrayAttribFormat(gl_vao, A::Tangent, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, tangent));
+  } else {
+    glVertexArrayAttribFormat(gl_vao, A::Position, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+    glVertexArrayAttribFormat(gl_vao, A::Normal, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+    glVertexArrayAttribFormat(gl_vao, A::Texcoord, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, tex_coord));
+    glVertexArrayAttribFormat(gl_vao, A::Tangent, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, tangent));
+  }
+  for (const uint32_t attribute : {A::Position, A::Normal, A::Texcoord, A::Tangent}) {
+    glVertexArrayAttribBinding(gl_vao, attribute, VERTEX_BINDING);
+    glEnableVertexArrayAttrib(gl_vao, attribute);
+  }
+
+  glVertexArrayAttribIFormat(gl_vao, A::InstanceIdx, 1, GL_UNSIGNED_INT, 0);
+  glVertexArrayAttribBinding(gl_vao, A::InstanceIdx, INSTANCE_IDX_BINDING);
+  glVertexArrayBindingDivisor(gl_vao, INSTANCE_IDX_BINDING, 1);
+  glEnableVertexArrayAttrib(gl_vao, A::InstanceIdx);
+}
+
+DrawBuffers::DrawBuffers() {
+  glCreateVertexArrays(2, gl_vaos);
+  for (const bool packed : {false, true}) {
+    setup_vertex_array(gl_vaos[packed], packed);
+    vertices[packed].grow(INIT_NUM_VERTICES);
+    gl_vertex_buffers[packed] = reallocate_buffer(0, INIT_NUM_VERTICES * vertex_stride(packed), 0, "Vertex buffer");
+    glVertexArrayVertexBuffer(gl_vaos[packed], VERTEX_BINDING, gl_vertex_buffers[packed], 0, vertex_stride(packed));
+  }
+
+  indices.grow(INIT_NUM_INDICES);
+  gl_index_buffer = reallocate_buffer(0, INIT_NUM_INDICES * sizeof(uint32_t), 0, "Index buffer");
+  for (const uint32_t gl_vao : gl_vaos) { glVertexArrayElementBuffer(gl_vao, gl_index_buffer); }
+
+  clusters.grow(INIT_NUM_CLUSTERS);
+  gl_cluster_buffer = reallocate_buffer(0, INIT_NUM_CLUSTERS * sizeof(Meshlet), 0, "Meshlet SSBO");
+
+  instance_idxs.grow(INIT_NUM_INSTANCE_IDXS);
+  gl_instance_idx_buffer = reallocate_buffer(0, INIT_NUM_INSTANCE_IDXS * sizeof(uint32_t), 0, "Instance idx SSBO");
+  for (const uint32_t gl_vao : gl_vaos) { glVertexArrayVertexBuffer(gl_vao, INSTANCE_IDX_BINDING, gl_instance_idx_buffer, 0, sizeof(uint32_t)); }
+
+  reallocate_instances(INIT_NUM_INSTANCES);
+  reallocate_draw_commands(INIT_NUM_DRAW_COMMANDS);
+}
+
+DrawBuffers::~DrawBuffers() {
+  const uint32_t buffers[] = {gl_vertex_buffers[0], gl_vertex_buffers[1], gl_index_buffer, gl_cluster_buffer, gl_instance_idx_buffer,
+                             gl_draw_cmd_buffer};
+  glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+  for (const InstanceCopies& buffer : instance_buffers) { glDeleteBuffers(NUM_PARTITIONS, buffer.gl_buffers); }
+  glDeleteVertexArrays(2, gl_vaos);
+}
+
+uint32_t DrawBuffers::add_vertices(const bool packed, const void* data, const uint32_t count) {
+  const uint32_t stride = vertex_stride(packed);
+  uint32_t base_vertex = vertices[packed].allocate(count);
+  if (base_vertex == RangeAllocator::NO_RANGE) {
+    // NOTE: Copied as a whole since the ranges in use are scattered over the buffer
+    const uint32_t old_capacity = vertices[packed].capacity;
+    vertices[packed].grow(std::max(old_capacity + count, 2 * old_capacity));
+    gl_vertex_buffers[packed] = reallocate_buffer(gl_vertex_buffers[packed], size_t(vertices[packed].capacity) * stride,
+                                                  size_t(old_capacity) * stride, "Vertex buffer");
+    glVertexArrayVertexBuffer(gl_vaos[packed], VERTEX_BINDING, gl_vertex_buffers[packed], 0, stride);
+    base_vertex = vertices[packed].allocate(count);
+  }
+  glNamedBufferSubData(gl_vertex_buffers[packed], size_t(base_vertex) * stride, size_t(count) * stride, data);
+  return base_vertex;
+}
+
+void DrawBuffers::release_vertices(const bool packed, const uint32_t base_vertex, const uint32_t count) {
+  releases.push_back(Release{&vertices[packed], base_vertex, count, frame});
+}
+
+uint32_t DrawBuffers::allocate_indices(const uint32_t count) {
+  uint32_t first_index = indices.allocate(count);
+  if (first_index == RangeAllocator::NO_RANGE) {
+    const uint32_t old_capacity = indices.capacity;
+    indices.grow(std::max(old_capacity + count, 2 * old_capacity));
+    gl_index_buffer = reallocate_buffer(gl_index_buffer, size_t(indices.capacity) * sizeof(uint32_t), size_t(old_capacity) * sizeof(uint32_t), "Index buffer");
+    for (const uint32_t gl_vao : gl_vaos) { glVertexArrayElementBuffer(gl_vao, gl_index_buffer); }
+    first_index = indices.allocate(count);
+  }
+  return first_index;
+}
+
+void DrawBuffers::release_indices(const uint32_t first_index, const uint32_t count) {
+  releases.push_back(Release{&indices, first_index, count, frame});
+}
+
+void DrawBuffers::write_indices(const uint32_t first_index, const uint32_t* data, const uint32_t count) {
+  glNamedBufferSubData(gl_index_buffer, size_t(first_index) * sizeof(uint32_t), size_t(count) * sizeof(uint32_t), data);
+}
+
+uint32_t DrawBuffers::add_clusters(const Meshlet* meshlets, const uint32_t count) {
+  uint32_t first_cluster = clusters.allocate(count);
+  if (first_cluster == RangeAllocator::NO_RANGE) {
+    const uint32_t old_capacity = clusters.capacity;
+    clusters.grow(std::max(old_capacity + count, 2 * old_capacity));
+    gl_cluster_buffer = reallocate_buffer(gl_cluster_buffer, size_t(clusters.capacity) * sizeof(Meshlet), size_t(old_capacity) * sizeof(Meshlet), "Meshlet SSBO");
+    first_cluster = clusters.allocate(count);
+  }
+  glNamedBufferSubData(gl_cluster_buffer, size_t(first_cluster) * sizeof(Meshlet), size_t(count) * sizeof(Meshlet), meshlets);
+  return first_cluster;
+}
+
+void DrawBuffers::release_clusters(const uint32_t first_cluster, const uint32_t count) {
+  releases.push_back(Release{&clusters, first_cluster, count, frame});
+}
+
+void DrawBuffers::reallocate_instances(const uint32_t capacity) {
+  instances.grow(capacity);
+  for (size_t i = 0; i < 4; i++) {
+    InstanceCopies& buffer = instance_buffers[i];
+    buffer.contents.resize(capacity * INSTANCE_STRIDES[i]);
+    for (uint32_t p = 0; p < NUM_PARTITIONS; p++) {
+      buffer.gl_buffers[p] = reallocate_mapped_buffer(buffer.gl_buffers[p], buffer.contents.size(), &buffer.mapped[p], INSTANCE_LABELS[i]);
+    }
+  }
+  models = (Mat4f*) instance_buffers[0].contents.data();
+  bounding_volumes = (BoundingVolume*) instance_buffers[1].contents.data();
+  materials = (Material*) instance_buffers[2].contents.data();
+  vertex_formats = (VertexFormat*) instance_buffers[3].contents.data();
+
+  // NOTE: The copies are filled from the CPU contents as the frames of their partitions begin
+  for (uint32_t p = 0; p < NUM_PARTITIONS; p++) {
+    instances_outdated[p] = true;
+    dirty_instances[p].clear();
+  }
+}
+
+uint32_t DrawBuffers::allocate_instances(const uint32_t num_instances) {
+  uint32_t offset = instances.allocate(num_instances);
+  if (offset == RangeAllocator::NO_RANGE) {
+    reallocate_instances(std::max(instances.capacity + num_instances, 2 * instances.capacity));
+    offset = instances.allocate(num_instances);
+  }
+  return offset;
+}
+
+void DrawBuffers::mark_instances(const uint32_t offset, const uint32_t num_instances, const uint8_t buffers) {
+  for (uint32_t p = 0; p < NUM_PARTITIONS; p++) {
+    if (instances_outdated[p]) { continue; }
+    // NOTE: Copied as a whole once there are more ranges than slots, e.g when updated without drawing frames
+    if (dirty_instances[p].size() >= instances.capacity) {
+      instances_outdated[p] = true;
+      dirty_instances[p].clear();
+      continue;
+    }
+    dirty_instances[p].push_back(DirtyRange{offset, num_instances, buffers});
+  }
+}
+
+void DrawBuffers::flush_instances(const uint32_t partition) {
+  if (instances_outdated[partition]) {
+    for (const InstanceCopies& buffer : instance_buffers) {
+      std::memcpy(buffer.mapped[partition], buffer.contents.data(), buffer.contents.size());
+    }
+    instances_outdated[partition] = false;
+    return;
+  }
+  for (const DirtyRange& range : dirty_instances[partition]) {
+    for (size_t i = 0; i < 4; i++) {
+      if (!(range.buffers & (1 << i))) { continue; }
+      const size_t offset = range.offset * INSTANCE_STRIDES[i];
+      std::memcpy(instance_buffers[i].mapped[partition] + offset, instance_buffers[i].contents.data() + offset, range.size * INSTANCE_STRIDES[i]);
+    }
+  }
+  dirty_instances[partition].clear();
+}
+
+void DrawBuffers::release_instances(const uint32_t offset, const uint32_t num_instances) {
+  releases.push_back(Release{&instances, offset, num_instances, frame});
+}
+
+uint32_t DrawBuffers::allocate_instance_idxs(const uint32_t num_idxs) {
+  uint32_t offset = instance_idxs.allocate(num_idxs);
+  if (offset == RangeAllocator::NO_RANGE) {
+    // NOTE: Not copied, the instance indices are rewritten by the culling pass every frame
+    const uint32_t capacity = std::max(instance_idxs.capacity + num_idxs, 2 * instance_idxs.capacity);
+    instance_idxs.grow(capacity);
+    gl_instance_idx_buffer = reallocate_buffer(gl_instance_idx_buffer, size_t(capacity) * sizeof(uint32_t), 0, "Instance idx SSBO");
+    for (const uint32_t gl_vao : gl_vaos) { glVertexArrayVertexBuffer(gl_vao, INSTANCE_IDX_BINDING, gl_instance_idx_buffer, 0, sizeof(uint32_t)); }
+    offset = instance_idxs.allocate(num_idxs);
+  }
+  return offset;
+}
+
+void DrawBuffers::release_instance_idxs(const uint32_t offset, const uint32_t num_idxs) {
+  releases.push_back(Release{&instance_idxs, offset, num_idxs, frame});
+}
+
+void DrawBuffers::reallocate_draw_commands(const uint32_t capacity) {
+  draw_cmd_capacity = capacity;
+  const size_t byte_size = NUM_PARTITIONS * size_t(capacity) * sizeof(DrawElementsIndirectCommand);
+  gl_draw_cmd_buffer = reallocate_mapped_buffer(gl_draw_cmd_buffer, byte_size, &gl_draw_cmd_buffer_ptr, "Draw Cmd SSBO");
+  std::memset(gl_draw_cmd_buffer_ptr, 0, byte_size);
+}
+
+void DrawBuffers::begin_frame(const uint64_t frame) {
+  this->frame = frame;
+  partition = uint32_t(frame % NUM_PARTITIONS);
+
+  // NOTE: The frame of the partition is done thus so are the frames before it
+  const auto done = [&](const Release& release) { return release.frame + NUM_PARTITIONS <= frame; };
+  for (const Release& release : releases) {
+    if (done(release)) { release.allocator->release(release.offset, release.size); }
+  }
+  releases.erase(std::remove_if(releases.begin(), releases.end(), done), releases.end());
+
+  flush_instances(partition);
+
+  DrawElementsIndirectCommand* cmds = (DrawElementsIndirectCommand*) gl_draw_cmd_buffer_ptr + partition * draw_cmd_capacity;
+  for (size_t i = 0; i < num_draw_commands; i++) {
+    cmds[i].instanceCount = 0;
+  }
+}
+
+uint64_t DrawBuffers::draw_cmd_offset(const uint32_t cmd) const {
+  return (uint64_t(partition) * draw_cmd_capacity + cmd) * sizeof(DrawElementsIndirectCommand);
+}
+
+/// Batches sharing the key are drawn with one multi-draw by the geometry pass
+static auto geometry_key(const GraphicsBatch& batch) {
+  return std::make_tuple(batch.vertex_format.packed, batch.depth_shader.gl_program, batch.diffuse_array, batch.gl_diffuse_texture_unit,
+                         batch.gl_metallic_roughness_texture, batch.gl_tangent_normal_texture, batch.gl_emissive_texture);
+}
+
+/// Batches sharing the key are drawn with one multi-draw by the voxelization pass
+static auto voxelization_key(const GraphicsBatch& batch) {
+  return std::make_tuple(batch.vertex_format.packed, batch.diffuse_array, batch.gl_diffuse_texture_unit, batch.gl_emissive_texture);
+}
+
+/// Appends the range to the last group if its key is the key of the group, otherwise starts a new group
+template<typename Key>
+static void add_to_groups(std::vector<DrawGroup>& groups, std::vector<Key>& keys, const Key& key, const size_t batch_idx,
+                          const bool packed, const uint32_t range, const DrawRange& draw_range) {
+  if (keys.empty() || !(keys.back() == key)) {
+    keys.push_back(key);
+    DrawGroup group;
+    group.batch_idx = batch_idx;
+    group.packed = packed;
+    group.ranges[0].first = UINT32_MAX;
+    group.ranges[1].first = UINT32_MAX;
+    groups.push_back(group);
+  }
+  DrawRange& group_range = groups.back().ranges[range];
+  if (draw_range.count == 0) { return; }
+  if (group_range.first == UINT32_MAX) { group_range.first = draw_range.first; }
+  group_range.count = draw_range.first + draw_range.count - group_range.first; // Ranges of a group are consecutive
+}
+
+void DrawBuffers::update_draw_order(std::vector<GraphicsBatch>& batches) {
+  if (draw_order_valid) { return; }
+  draw_order_valid = true;
+
+  // Batches sorted by key such that the draw commands of the batches of a group are consecutive
+  std::vector<size_t> geometry_order(batches.size());
+  std::iota(geometry_order.begin(), geometry_order.end(), 0);
+  std::vector<size_t> voxelization_order = geometry_order;
+  std::sort(geometry_order.begin(), geometry_order.end(), [&](const size_t a, const size_t b) {
+    return geometry_key(batches[a]) < geometry_key(batches[b]);
+  });
+  std::sort(voxelization_order.begin(), voxelization_order.end(), [&](const size_t a, const size_t b) {
+    return voxelization_key(batches[a]) < voxelization_key(batches[b]);
+  });
+
+  // Partition: camera LOD commands, LOD 0 commands of the clustered batches, cluster commands and voxelization LOD commands
+  uint32_t cmd = 0;
+  for (const size_t i : geometry_order) { batches[i].camera_cmd = cmd; cmd += Mesh::MAX_LODS; }
+  for (const size_t i : geometry_order) { batches[i].shadow_cmd = cmd; cmd += batches[i].num_clusters > 0 ? 1 : 0; }
+  for (const size_t i : geometry_order) { batches[i].cluster_cmd = cmd; cmd += batches[i].num_clusters; }
+  for (const size_t i : voxelization_order) { batches[i].voxelization_cmd = cmd; cmd += Mesh::MAX_LODS; }
+  num_draw_commands = cmd;
+  if (num_draw_commands > draw_cmd_capacity) {
+    reallocate_draw_commands(std::max(num_draw_commands, 2 * draw_cmd_capacity));
+  }
+
+  shadow_groups.clear();
+  geometry_groups.clear();
+  voxelization_groups.clear();
+  std::vector<bool> shadow_keys;
+  std::vector<decltype(geometry_key(batches[0]))> geometry_keys;
+  std::vector<decltype(voxelization_key(batches[0]))> voxelization_keys;
+  for (const size_t i : geometry_order) {
+    const GraphicsBatch& batch = batches[i];
+    const bool packed = batch.vertex_format.packed;
+    const DrawRange camera_range{batch.camera_cmd, Mesh::MAX_LODS};
+    add_to_groups(shadow_groups, shadow_keys, packed, i, packed, 0, camera_range);
+    add_to_groups(shadow_groups, shadow_keys, packed, i, packed, 1, DrawRange{batch.shadow_cmd, batch.num_clusters > 0 ? 1u : 0u});
+    add_to_groups(geometry_groups, geometry_keys, geometry_key(batch), i, packed, 0, camera_range);
+    add_to_groups(geometry_groups, geometry_keys, geometry_key(batch), i, packed, 1, DrawRange{batch.cluster_cmd, batch.num_clusters});
+  }
+  for (const size_t i : voxelization_order) {
+    const GraphicsBatch& batch = batches[i];
+    add_to_groups(voxelization_groups, voxelization_keys, voxelization_key(batch), i, batch.vertex_format.packed, 0,
+                  DrawRange{batch.voxelization_cmd, Mesh::MAX_LODS});
+  }
+  for (std::vector<DrawGroup>* groups : {&shadow_groups, &geometry_groups, &voxelization_groups}) {
+    for (DrawGroup& group : *groups) {
+      for (DrawRange& range : group.ranges) {
+        if (range.first == UINT32_MAX) { range.first = 0; }
+      }
+    }
+  }
+}
@@ -0,0 +1,226 @@
+#pragma once
+#ifndef MEINEKRAFT_DRAWBUFFERS_HPP
+#define MEINEKRAFT_DRAWBUFFERS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "primitives.hpp"
+
+struct GraphicsBatch;
+struct Material;
+
+/// First fit allocator of ranges of [0, capacity), the free ranges are kept sorted and coalesced
+struct RangeAllocator {
+  explicit RangeAllocator(uint32_t capacity = 0);
+
+  /// Offset of a free range of the size, NO_RANGE if none fits
+  uint32_t allocate(uint32_t size);
+
+  void release(uint32_t offset, uint32_t size);
+
+  /// Appends [capacity, new_capacity) to the free ranges
+  void grow(uint32_t new_capacity);
+
+  uint32_t capacity = 0;
+  uint32_t used = 0;
+
+  static const uint32_t NO_RANGE = UINT32_MAX;
+
+private:
+  std::vector<std::pair<uint32_t, uint32_t>> free_ranges; // (offset, size) ordered by offset
+};
+
+/// Dequantization of the vertices of an instance, shader mirror (see shaders/vertex-unpacking-utils.glsl)
+struct VertexFormat {
+  Vec4f position_min    = Vec4f(0.0f);
+  Vec4f position_extent = Vec4f(1.0f);
+};
+
+/// Draw commands [first, first + count) of a partition of the draw command buffer
+struct DrawRange {
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+/// Consecutive batches drawn with the program, textures and vertex layout of the first of them, one multi-draw per range
+struct DrawGroup {
+  size_t batch_idx = 0;
+  bool packed = false;
+  DrawRange ranges[2]; // Empty ranges are not drawn
+};
+
+/// Draw calls of a pass and the CPU time spent submitting them in the last frame
+struct DrawStatistics {
+  uint32_t draw_calls = 0; // Multi-draws or dispatches
+  double submit_milliseconds = 0.0;
+};
+
+/// Records the draw calls of a pass during its lifetime
+struct DrawStatisticsScope {
+  explicit DrawStatisticsScope(DrawStatistics& statistics): statistics(statistics), start(std::chrono::high_resolution_clock::now()) {
+    statistics.draw_calls = 0;
+  }
+
+  ~DrawStatisticsScope() {
+    const auto end = std::chrono::high_resolution_clock::now();
+    statistics.submit_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  DrawStatistics& statistics;
+  std::chrono::high_resolution_clock::time_point start;
+};
+
+/// Buffers shared by every GraphicsBatch such that a pass draws every batch of a group with one multi-draw
+/// - Geometry: the vertices of every mesh in ranges of one vertex buffer per layout (Vertex or PackedVertex), their
+///   indices in ranges of one index buffer and their meshlets in ranges of one cluster buffer, drawn through one VAO per layout
+/// - Instances: the models, bounding volumes, materials and vertex formats of every batch in ranges of global buffers, with
+///   a copy per frame in flight such that the copy read by a frame is never written while the frame is in flight
+/// - Draw commands: the draw commands of every batch ordered such that the batches of a DrawGroup are contiguous
+/// NOTE: Ranges released are reused after the frames in flight reading them are done (see begin_frame)
+struct DrawBuffers {
+  DrawBuffers();
+  ~DrawBuffers();
+
+  /// Vertex attribute locations, equal to the layout locations of the vertex shaders
+  enum VertexAttribute: uint32_t {
+    Position    = 0,
+    Normal      = 1,
+    Texcoord    = 2,
+    Tangent     = 3,
+    InstanceIdx = 4
+  };
+
+  /// Partitions of the draw command buffer, one per frame in flight
+  static const uint32_t NUM_PARTITIONS = 3;
+
+  /// Writes the vertices (Vertex or PackedVertex) to a free range of the vertex buffer of the layout, returns their base vertex
+  uint32_t add_vertices(bool packed, const void* vertices, uint32_t num_vertices);
+  void release_vertices(bool packed, uint32_t base_vertex, uint32_t num_vertices);
+
+  /// First index of num_indices free indices of the index buffer, the buffer is grown with its contents when full
+  uint32_t allocate_indices(uint32_t num_indices);
+  void release_indices(uint32_t first_index, uint32_t num_indices);
+
+  /// Writes the indices to [first_index, first_index + num_indices) of the index buffer
+  void write_indices(uint32_t first_index, const uint32_t* indices, uint32_t num_indices);
+
+  /// Writes the meshlets to a free range of the cluster buffer read by the culling pass, returns the first cluster
+  uint32_t add_clusters(const Meshlet* meshlets, uint32_t num_clusters);
+  void release_clusters(uint32_t first_cluster, uint32_t num_clusters);
+
+  /// VAO of the vertex layout reading the instance indices as an instanced attribute
+  uint32_t gl_vao(const bool packed) const { return gl_vaos[packed]; }
+
+  /// Offset of num_instances slots of the instance buffers, the buffers are grown with their contents when full
+  uint32_t allocate_instances(uint32_t num_instances);
+  void release_instances(uint32_t offset, uint32_t num_instances);
+
+  /// Offset of num_idxs instance indices (written by the culling pass)
+  uint32_t allocate_instance_idxs(uint32_t num_idxs);
+  void release_instance_idxs(uint32_t offset, uint32_t num_idxs);
+
+  /// Instance buffers, bit flags
+  enum InstanceBuffer: uint8_t {
+    Models          = 1 << 0,
+    BoundingVolumes = 1 << 1,
+    Materials       = 1 << 2,
+    VertexFormats   = 1 << 3
+  };
+
+  /// CPU copies of the instance buffers, indexed by GraphicsBatch::instance_offset + index of the object in the batch
+  /// NOTE: Written slots are marked (see mark_instances) and copied to the GPU copy of every partition as its frame begins
+  Mat4f* models = nullptr;
+  BoundingVolume* bounding_volumes = nullptr;
+  Material* materials = nullptr;
+  VertexFormat* vertex_formats = nullptr;
+
+  /// Marks the slots [offset, offset + num_instances) of the instance buffers (InstanceBuffer flags) as written
+  void mark_instances(uint32_t offset, uint32_t num_instances, uint8_t buffers);
+
+  /// Instance buffers read by the frame of the current partition
+  uint32_t gl_model_buffer() const { return instance_buffers[0].gl_buffers[partition]; }
+  uint32_t gl_bounding_volume_buffer() const { return instance_buffers[1].gl_buffers[partition]; }
+  uint32_t gl_material_buffer() const { return instance_buffers[2].gl_buffers[partition]; }
+  uint32_t gl_vertex_format_buffer() const { return instance_buffers[3].gl_buffers[partition]; }
+
+  /// Reorders the draw commands and groups after batches were added or removed
+  void invalidate_draw_order() { draw_order_valid = false; }
+
+  /// Assigns the draw commands of the batches and forms the draw groups of every pass if invalidated
+  void update_draw_order(std::vector<GraphicsBatch>& batches);
+
+  /// Selects the partition of the frame, releases the ranges no longer read by frames in flight, copies the instances
+  /// written since the partition was last drawn and resets the draw commands of the partition, called once the frame in
+  /// flight of the partition is done
+  void begin_frame(uint64_t frame);
+
+  /// Byte offset into the draw command buffer of the draw command of the current partition
+  uint64_t draw_cmd_offset(uint32_t cmd) const;
+
+  uint32_t gl_vertex_buffers[2] = {};  // Vertex and PackedVertex
+  uint32_t gl_index_buffer = 0;
+  uint32_t gl_cluster_buffer = 0;
+  uint32_t gl_instance_idx_buffer = 0;
+  uint32_t gl_draw_cmd_buffer = 0;
+
+  uint32_t num_draw_commands = 0;     // Draw commands used per partition
+  uint32_t draw_cmd_capacity = 0;     // Draw commands allocated per partition
+  uint32_t partition = 0;             // Partition of the current frame
+
+  std::vector<DrawGroup> shadow_groups;       // Camera LOD commands then the LOD 0 commands of the clustered batches
+  std::vector<DrawGroup> geometry_groups;     // Camera LOD commands then the cluster commands
+  std::vector<DrawGroup> voxelization_groups; // Voxelization LOD commands
+
+private:
+  uint32_t gl_vaos[2] = {};
+  RangeAllocator vertices[2]; // Vertex and PackedVertex
+  RangeAllocator indices;
+  RangeAllocator clusters;
+
+  /// Instance buffer with a persistently mapped copy per partition and the latest contents on the CPU
+  struct InstanceCopies {
+    uint32_t gl_buffers[NUM_PARTITIONS] = {};
+    uint8_t* mapped[NUM_PARTITIONS] = {};
+    std::vector<uint8_t> contents;
+  };
+  InstanceCopies instance_buffers[4]; // In the order of InstanceBuffer
+
+  /// Slots written since the partition was last drawn
+  struct DirtyRange {
+    uint32_t offset;
+    uint32_t size;
+    uint8_t buffers; // InstanceBuffer flags
+  };
+  std::vector<DirtyRange> dirty_instances[NUM_PARTITIONS];
+  bool instances_outdated[NUM_PARTITIONS] = {}; // Copy of the partition copied as a whole instead of by dirty ranges
+
+  RangeAllocator instances;
+  RangeAllocator instance_idxs;
+  uint8_t* gl_draw_cmd_buffer_ptr = nullptr;
+  bool draw_order_valid = true;
+
+  /// Ranges released, reused once the frame they were released in is no longer in flight
+  struct Release {
+    RangeAllocator* allocator;
+    uint32_t offset;
+    uint32_t size;
+    uint64_t frame;
+  };
+  std::vector<Release> releases;
+  uint64_t frame = 0;
+
+  /// Reallocates the instance buffers with the capacity
+  void reallocate_instances(uint32_t capacity);
+
+  /// Copies the instances written since the partition was last drawn to its copy of the instance buffers
+  void flush_instances(uint32_t partition);
+
+  /// Reallocates the draw command buffer with the capacity per partition, zeroed
+  void reallocate_draw_commands(uint32_t capacity);
+};
+
+#endif // MEINEKRAFT_DRAWBUFFERS_HPP
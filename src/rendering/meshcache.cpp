@@ -0,0 +1,272 @@
+#include "meshcache.hpp"
+#include "../util/mappedfile.hpp"
+#include "../util/filesystem.hpp"
+#include "../util/logging.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <type_traits>
+
+// NOTE: Vertices and indices are written and mapped as raw bytes
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable<PackedVertex>::value, "PackedVertex must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable<MeshLod>::value, "MeshLod must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable<Meshlet>::value, "Meshlet must be trivially copyable to be cached");
+static_assert(sizeof(Mat4f) == 16 * sizeof(float), "Mat4f must be tightly packed to be cached");
+
+static const char MAGIC[4] = {'M', 'K', 'M', 'C'};
+
+struct Header {
+  char magic[4]           = {};
+  uint32_t version        = 0;
+  int64_t source_mtime    = 0;
+  uint64_t import_flags   = 0;
+  uint64_t file_size      = 0;  // Guards against truncated files
+  uint32_t num_meshes     = 0;
+  uint32_t source_filepath_length = 0;
+  uint32_t num_instances  = 0;
+  uint32_t padding        = 0;
+};
+
+struct MeshRecord {
+  uint64_t vertices_offset = 0;
+  uint64_t num_vertices    = 0;
+  uint64_t indices_offset  = 0;
+  uint64_t num_indices     = 0;
+  uint64_t packed_vertices_offset = 0;
+  uint64_t num_packed_vertices = 0; // Either zero or num_vertices
+  uint64_t lod_indices_offset = 0;
+  uint64_t num_lod_indices = 0;
+  uint64_t lods_offset = 0;
+  uint64_t num_lods = 0;            // Coarser LODs only (see Mesh::lods)
+  uint64_t meshlets_offset = 0;
+  uint64_t num_meshlets = 0;
+  uint64_t textures_offset = 0; // Texture records: (uint32_t type, uint32_t length, char[length]) 4B aligned
+  uint64_t content_hash[2] = {}; // See MeshCache::ContentHash
+  uint32_t num_textures    = 0;
+  uint32_t padding         = 0;
+  float aabb_min[3]        = {};
+  float aabb_max[3]        = {};
+};
+
+struct InstanceRecord {
+  uint32_t mesh_idx = 0;
+  uint32_t padding  = 0;
+  float transform[16] = {};
+};
+
+static inline uint64_t align_to(const uint64_t offset, const uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/// Modification time of the file, returns false if it can not be queried
+/// NOTE: The file clock epoch is implementation defined so the time might be negative
+static bool modification_time(const std::string& filepath, int64_t& mtime) {
+  std::error_code error;
+  const auto time = std::filesystem::last_write_time(filepath, error);
+  if (error) { return false; }
+  mtime = int64_t(time.time_since_epoch().count());
+  return true;
+}
+
+std::string MeshCache::filepath_for(const std::string& source_filepath) {
+  std::stringstream str;
+  str << std::hex << std::setw(16) << std::setfill('0') << std::hash<std::string>{}(source_filepath);
+  return Filesystem::tmp + "meshcache/" + str.str() + ".mkmc";
+}
+
+void MeshCache::invalidate(const std::string& source_filepath) {
+  std::error_code error;
+  std::filesystem::remove(filepath_for(source_filepath), error);
+}
+
+std::shared_ptr<MappedFile> MeshCache::load(const std::string& source_filepath, const uint64_t import_flags, std::vector<Entry>& entries,
+                                            std::vector<MeshInstance>& instances) {
+  int64_t mtime = 0;
+  if (!modification_time(source_filepath, mtime)) { return nullptr; }
+
+  auto file = std::make_shared<MappedFile>();
+  if (!file->open(filepath_for(source_filepath))) { return nullptr; }
+
+  const uint8_t* data = file->data;
+  const uint64_t size = file->size;
+  auto in_bounds = [size](const uint64_t offset, const uint64_t bytes) {
+    return offset <= size && bytes <= size - offset;
+  };
+
+  Header header;
+  if (!in_bounds(0, sizeof(Header))) { return nullptr; }
+  std::memcpy(&header, data, sizeof(Header));
+
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.file_size != size) {
+    Log::warn("Mesh cache of " + source_filepath + " is invalid or outdated, reimporting");
+    return nullptr;
+  }
+
+  // Stale cache, source has been modified or imported differently since
+  if (header.source_mtime != mtime || header.import_flags != import_flags) { return nullptr; }
+
+  uint64_t offset = sizeof(Header);
+  if (!in_bounds(offset, header.source_filepath_length)) { return nullptr; }
+  const std::string cached_filepath(reinterpret_cast<const char*>(data + offset), header.source_filepath_length);
+  if (cached_filepath != source_filepath) { return nullptr; } // Hash collision
+  offset = align_to(offset + header.source_filepath_length, 8);
+
+  if (!in_bounds(offset, uint64_t(header.num_meshes) * sizeof(MeshRecord))) { return nullptr; }
+
+  std::vector<Entry> loaded(header.num_meshes);
+  for (size_t i = 0; i < header.num_meshes; i++) {
+    MeshRecord record;
+    std::memcpy(&record, data + offset + i * sizeof(MeshRecord), sizeof(MeshRecord));
+
+    if (!in_bounds(record.vertices_offset, record.num_vertices * sizeof(Vertex)) ||
+        !in_bounds(record.indices_offset, record.num_indices * sizeof(uint32_t)) ||
+        !in_bounds(record.packed_vertices_offset, record.num_packed_vertices * sizeof(PackedVertex)) ||
+        !in_bounds(record.lod_indices_offset, record.num_lod_indices * sizeof(uint32_t)) ||
+        !in_bounds(record.lods_offset, record.num_lods * sizeof(MeshLod)) || record.num_lods >= Mesh::MAX_LODS ||
+        !in_bounds(record.meshlets_offset, record.num_meshlets * sizeof(Meshlet)) ||
+        (record.num_packed_vertices != 0 && record.num_packed_vertices != record.num_vertices)) {
+      Log::warn("Mesh cache of " + source_filepath + " is corrupt, reimporting");
+      return nullptr;
+    }
+
+    Entry& entry = loaded[i];
+    entry.mesh = Mesh::from_view(reinterpret_cast<const Vertex*>(data + record.vertices_offset), record.num_vertices,
+                                 reinterpret_cast<const uint32_t*>(data + record.indices_offset), record.num_indices);
+    if (record.num_packed_vertices != 0) {
+      entry.mesh.view.packed_vertices = reinterpret_cast<const PackedVertex*>(data + record.packed_vertices_offset);
+    }
+    entry.mesh.view.lod_indices = reinterpret_cast<const uint32_t*>(data + record.lod_indices_offset);
+    entry.mesh.view.num_lod_indices = record.num_lod_indices;
+    entry.mesh.lods.resize(record.num_lods);
+    std::memcpy(entry.mesh.lods.data(), data + record.lods_offset, record.num_lods * sizeof(MeshLod));
+    entry.mesh.meshlets.resize(record.num_meshlets);
+    std::memcpy(entry.mesh.meshlets.data(), data + record.meshlets_offset, record.num_meshlets * sizeof(Meshlet));
+    entry.aabb = AABB(Vec3f(record.aabb_min[0], record.aabb_min[1], record.aabb_min[2]),
+                      Vec3f(record.aabb_max[0], record.aabb_max[1], record.aabb_max[2]));
+    entry.content_hash.low = record.content_hash[0];
+    entry.content_hash.high = record.content_hash[1];
+
+    uint64_t texture_offset = record.textures_offset;
+    for (size_t j = 0; j < record.num_textures; j++) {
+      uint32_t texture[2]; // (type, length)
+      if (!in_bounds(texture_offset, sizeof(texture))) { return nullptr; }
+      std::memcpy(texture, data + texture_offset, sizeof(texture));
+      texture_offset += sizeof(texture);
+      if (!in_bounds(texture_offset, texture[1])) { return nullptr; }
+      const std::string texture_filepath(reinterpret_cast<const char*>(data + texture_offset), texture[1]);
+      entry.texture_info.push_back({Texture::Type(texture[0]), texture_filepath});
+      texture_offset = align_to(texture_offset + texture[1], 4);
+    }
+  }
+
+  offset += uint64_t(header.num_meshes) * sizeof(MeshRecord);
+  if (!in_bounds(offset, uint64_t(header.num_instances) * sizeof(InstanceRecord))) { return nullptr; }
+  std::vector<MeshInstance> loaded_instances(header.num_instances);
+  for (size_t i = 0; i < header.num_instances; i++) {
+    InstanceRecord record;
+    std::memcpy(&record, data + offset + i * sizeof(InstanceRecord), sizeof(InstanceRecord));
+    if (record.mesh_idx >= header.num_meshes) {
+      Log::warn("Mesh cache of " + source_filepath + " is corrupt, reimporting");
+      return nullptr;
+    }
+    loaded_instances[i].mesh_idx = record.mesh_idx;
+    std::memcpy(&loaded_instances[i].transform, record.transform, sizeof(record.transform));
+  }
+
+  entries = std::move(loaded);
+  instances = std::move(loaded_instances);
+  return file;
+}
+
+bool MeshCache::save(const std::string& source_filepath, const uint64_t import_flags, const std::vector<Entry>& entries,
+                     const std::vector<MeshInstance>& instances) {
+  int64_t mtime = 0;
+  if (!modification_time(source_filepath, mtime)) { return false; }
+
+  // Compute the layout up front in order to write the file in one go
+  std::vector<MeshRecord> records(entries.size());
+  const uint64_t records_offset = align_to(sizeof(Header) + source_filepath.size(), 8);
+  const uint64_t instances_offset = records_offset + records.size() * sizeof(MeshRecord);
+  uint64_t offset = instances_offset + instances.size() * sizeof(InstanceRecord);
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry& entry = entries[i];
+    MeshRecord& record = records[i];
+    record.vertices_offset = offset;
+    record.num_vertices = entry.mesh.num_vertices();
+    offset = align_to(offset + entry.mesh.byte_size_of_vertices(), 8);
+    record.indices_offset = offset;
+    record.num_indices = entry.mesh.num_indices();
+    offset = align_to(offset + entry.mesh.byte_size_of_indices(), 8);
+    record.packed_vertices_offset = offset;
+    record.num_packed_vertices = entry.mesh.has_packed_vertices() ? entry.mesh.num_vertices() : 0;
+    offset = align_to(offset + entry.mesh.byte_size_of_packed_vertices(), 8);
+    record.lod_indices_offset = offset;
+    record.num_lod_indices = entry.mesh.num_lod_indices();
+    offset = align_to(offset + entry.mesh.byte_size_of_lod_indices(), 8);
+    record.lods_offset = offset;
+    record.num_lods = entry.mesh.lods.size();
+    offset = align_to(offset + entry.mesh.lods.size() * sizeof(MeshLod), 8);
+    record.meshlets_offset = offset;
+    record.num_meshlets = entry.mesh.meshlets.size();
+    offset = align_to(offset + entry.mesh.meshlets.size() * sizeof(Meshlet), 8);
+    record.textures_offset = offset;
+    record.num_textures = uint32_t(entry.texture_info.size());
+    for (const auto& texture : entry.texture_info) {
+      offset = align_to(offset + 2 * sizeof(uint32_t) + texture.second.size(), 4);
+    }
+    offset = align_to(offset, 8);
+    record.content_hash[0] = entry.content_hash.low;
+    record.content_hash[1] = entry.content_hash.high;
+    record.aabb_min[0] = entry.aabb.min.x; record.aabb_min[1] = entry.aabb.min.y; record.aabb_min[2] = entry.aabb.min.z;
+    record.aabb_max[0] = entry.aabb.max.x; record.aabb_max[1] = entry.aabb.max.y; record.aabb_max[2] = entry.aabb.max.z;
+  }
+
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.source_mtime = mtime;
+  header.import_flags = import_flags;
+  header.file_size = offset;
+  header.num_meshes = uint32_t(entries.size());
+  header.source_filepath_length = uint32_t(source_filepath.size());
+  header.num_instances = uint32_t(instances.size());
+
+  std::vector<uint8_t> buffer(offset, 0);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), source_filepath.data(), source_filepath.size());
+  std::memcpy(buffer.data() + records_offset, records.data(), records.size() * sizeof(MeshRecord));
+  for (size_t i = 0; i < instances.size(); i++) {
+    InstanceRecord record;
+    record.mesh_idx = instances[i].mesh_idx;
+    std::memcpy(record.transform, &instances[i].transform, sizeof(record.transform));
+    std::memcpy(buffer.data() + instances_offset + i * sizeof(InstanceRecord), &record, sizeof(InstanceRecord));
+  }
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry& entry = entries[i];
+    const MeshRecord& record = records[i];
+    std::memcpy(buffer.data() + record.vertices_offset, entry.mesh.vertex_data(), entry.mesh.byte_size_of_vertices());
+    std::memcpy(buffer.data() + record.indices_offset, entry.mesh.index_data(), entry.mesh.byte_size_of_indices());
+    if (entry.mesh.has_packed_vertices()) {
+      std::memcpy(buffer.data() + record.packed_vertices_offset, entry.mesh.packed_vertex_data(), entry.mesh.byte_size_of_packed_vertices());
+    }
+    if (entry.mesh.num_lod_indices() > 0) {
+      std::memcpy(buffer.data() + record.lod_indices_offset, entry.mesh.lod_index_data(), entry.mesh.byte_size_of_lod_indices());
+      std::memcpy(buffer.data() + record.lods_offset, entry.mesh.lods.data(), entry.mesh.lods.size() * sizeof(MeshLod));
+    }
+    if (!entry.mesh.meshlets.empty()) {
+      std::memcpy(buffer.data() + record.meshlets_offset, entry.mesh.meshlets.data(), entry.mesh.meshlets.size() * sizeof(Meshlet));
+    }
+    uint64_t texture_offset = record.textures_offset;
+    for (const auto& texture : entry.texture_info) {
+      const uint32_t info[2] = {uint32_t(texture.first), uint32_t(texture.second.size())};
+      std::memcpy(buffer.data() + texture_offset, info, sizeof(info));
+      std::memcpy(buffer.data() + texture_offset + sizeof(info), texture.second.data(), texture.second.size());
+      texture_offset = align_to(texture_offset + sizeof(info) + texture.second.size(), 4);
+    }
+  }
+
+  return Filesystem::write_atomically(filepath_for(source_filepath), buffer.data(), buffer.size());
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef MEINEKRAFT_MESHCACHE_HPP
+#define MEINEKRAFT_MESHCACHE_HPP
+
+#include "primitives.hpp"
+#include "texture.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct MappedFile;
+
+/// Versioned binary cache of imported model files stored in Filesystem::tmp
+/// Keyed by the source filepath, the modification time of the source file and the import flags used
+/// Layout: Header, source filepath, MeshRecord[num_meshes], InstanceRecord[num_instances],
+///         vertex/index/packed vertex/LOD/meshlet/texture data (8B aligned)
+struct MeshCache {
+  /// Bump whenever the layout of the cache, Vertex or the import changes
+  static const uint32_t VERSION = 7;
+
+  /// 128-bit digest of the content of a Mesh (see MeshManager), used to deduplicate Meshes across model files
+  struct ContentHash {
+    uint64_t low = 0;  // Meshes are looked up by it
+    uint64_t high = 0; // Hashed independently of low
+
+    bool operator==(const ContentHash& other) const { return low == other.low && high == other.high; }
+  };
+
+  /// Mesh as stored in the cache
+  struct Entry {
+    Mesh mesh;
+    AABB aabb;
+    ContentHash content_hash;
+    std::vector<std::pair<Texture::Type, std::string>> texture_info;
+  };
+
+  /// Memory maps the cache of the source file, fills entries with Meshes viewing the mapping and the node instances of the Meshes
+  /// Returns the mapping which must outlive the Meshes or nullptr on a cache miss
+  static std::shared_ptr<MappedFile> load(const std::string& source_filepath, uint64_t import_flags, std::vector<Entry>& entries,
+                                          std::vector<MeshInstance>& instances);
+
+  /// Writes the cache of the source file, returns true on success
+  static bool save(const std::string& source_filepath, uint64_t import_flags, const std::vector<Entry>& entries,
+                   const std::vector<MeshInstance>& instances);
+
+  /// Removes the cache of the source file (if any)
+  static void invalidate(const std::string& source_filepath);
+
+  /// Filepath of the cache of the source file
+  static std::string filepath_for(const std::string& source_filepath);
+};
+
+#endif // MEINEKRAFT_MESHCACHE_HPP
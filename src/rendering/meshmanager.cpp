@@ -3,17 +3,305 @@
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
 #include <assimp/pbrmaterial.h>
+#include "meshcache.hpp"
+#include "meshoptimizer.hpp"
 #include "../util/filesystem.hpp"
 #include "../util/logging.hpp"
+#include "../util/mappedfile.hpp"
+#include "../util/jobsystem.hpp"
+#include "../util/profiler.hpp"
 
-#include <numeric> // std::iota
 #include <cassert> // assert
+#include <memory>  // std::shared_ptr
+#include <limits>  // std::numeric_limits
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
 
 #define VERBOSE_LEVEL_0
 // #define VERBOSE_LEVEL_1
 // #define VERBOSE_LEVEL_2
 
-static std::vector<Mesh> loaded_meshes{Cube(), Cube(true), Sphere()};
+/// Flags passed to Assimp when importing model files
+static const uint32_t ASSIMP_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices;
+
+/// Flags of the optional import stages (see MeshImportSettings), above the Assimp flags
+static const uint64_t IMPORT_OPTIMIZE_VERTEX_CACHE = uint64_t(1) << 32;
+static const uint64_t IMPORT_QUANTIZE_VERTICES     = uint64_t(1) << 33;
+static const uint64_t IMPORT_GENERATE_LODS         = uint64_t(1) << 34;
+static const uint64_t IMPORT_BUILD_MESHLETS        = uint64_t(1) << 35;
+
+MeshImportSettings MeshManager::import_settings;
+
+/// Computes the AABB of the Mesh in model space
+static AABB compute_aabb(const Mesh& mesh) {
+  AABB aabb(Vec3f(std::numeric_limits<float>::max()), Vec3f(std::numeric_limits<float>::lowest()));
+  const Vertex* vertices = mesh.vertex_data();
+  for (size_t i = 0; i < mesh.num_vertices(); i++) {
+    const Vec3f& position = vertices[i].position;
+    aabb.min = Vec3f(std::min(aabb.min.x, position.x), std::min(aabb.min.y, position.y), std::min(aabb.min.z, position.z));
+    aabb.max = Vec3f(std::max(aabb.max.x, position.x), std::max(aabb.max.y, position.y), std::max(aabb.max.z, position.z));
+  }
+  return aabb;
+}
+
+/// Computes the largest sphere radius fully containing the mesh [Ritter's algorithm]
+static BoundingVolume compute_bounding_volume(const Mesh& mesh) {
+  // Compute extreme values along the axis
+  float min_x = std::numeric_limits<float>::max();
+  float min_y = std::numeric_limits<float>::max();
+  float min_z = std::numeric_limits<float>::max();
+  float max_x = std::numeric_limits<float>::lowest();
+  float max_y = std::numeric_limits<float>::lowest();
+  float max_z = std::numeric_limits<float>::lowest();
+  std::array<Vec3f, 6> extremes = {}; // (minx, miny, minz, maxx, maxy, maxz)
+  const Vertex* vertices = mesh.vertex_data();
+  const size_t num_vertices = mesh.num_vertices();
+  for (size_t i = 0; i < num_vertices; i++) {
+    const Vertex& vert = vertices[i];
+    if (vert.position.x < min_x) { min_x = vert.position.x; extremes[0] = vert.position; }
+    if (vert.position.y < min_y) { min_y = vert.position.y; extremes[1] = vert.position; }
+    if (vert.position.z < min_z) { min_z = vert.position.z; extremes[2] = vert.position; }
+    if (vert.position.x > max_x) { max_x = vert.position.x; extremes[3] = vert.position; }
+    if (vert.position.y > max_y) { max_y = vert.position.y; extremes[4] = vert.position; }
+    if (vert.position.z > max_z) { max_z = vert.position.z; extremes[5] = vert.position; }
+  }
+
+  // Find pair with the maximum distance between them
+  float max_distance = std::numeric_limits<float>::min();
+  std::array<Vec3f, 2> initial_sphere_points = {};
+  for (const Vec3f& vert0 : extremes) {
+    for (const Vec3f& vert1 : extremes) {
+      if (vert0 == vert1) { continue; }
+      const float distance = (vert0 - vert1).sqr_length();
+      if (distance > max_distance) { 
+        max_distance = distance; 
+        initial_sphere_points[0] = vert0;
+        initial_sphere_points[1] = vert1;
+      }
+    }
+  }
+
+  // Place sphere at the midpoint between them with radius as half the distance between them
+  BoundingVolume sphere;
+  sphere.position = (initial_sphere_points[0] + initial_sphere_points[1]) / 2.0;
+  sphere.radius = (initial_sphere_points[0] - initial_sphere_points[1]).length() / 2.0f;
+
+  // Adjust initial sphere in order to cover all vertices
+  for (size_t i = 0; i < num_vertices; i++) {
+    const Vertex& vert = vertices[i];
+    const float d = (vert.position - sphere.position).length();
+    if (d > sphere.radius) {
+      // Move the center towards the vertex such that the sphere touches both it and the opposite side of the old sphere
+      sphere.position = sphere.position + (vert.position - sphere.position) * ((d - sphere.radius) / (2.0f * d));
+      sphere.radius = (d + sphere.radius) / 2.0f;
+    }
+  }
+  // Log::info("Bounding Volume sphere: " + sphere.position.to_string() + ", " + std::to_string(sphere.radius));
+  return sphere;
+}
+
+/// 64-bit hash of the bytes continued from the hash, 8 bytes at a time and independent of std::hash (MurmurHash3 mixing)
+static uint64_t hash_words(const void* data, const size_t size, uint64_t hash) {
+  auto mix = [&hash](uint64_t word) {
+    word *= 0x87c37b91114253d5ull;
+    hash ^= (word << 31) | (word >> 33);
+    hash = ((hash << 27) | (hash >> 37)) * 5 + 0x52dce729;
+  };
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  size_t i = 0;
+  for (; data && i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(uint64_t));
+    mix(word);
+  }
+  uint64_t tail = 0;
+  if (data && i < size) { std::memcpy(&tail, bytes + i, size - i); }
+  mix(tail ^ size);
+  return hash;
+}
+
+/// Digest of the vertex and index data of the Mesh (including its LODs), equal Meshes have equal digests
+static MeshCache::ContentHash compute_content_hash(const Mesh& mesh) {
+  auto hash_bytes = [](const void* data, const size_t size) {
+    return std::hash<std::string_view>{}(std::string_view(static_cast<const char*>(data), data ? size : 0));
+  };
+  size_t hash = 0;
+  hash_combine(hash, mesh.num_vertices());
+  hash_combine(hash, mesh.num_indices());
+  hash_combine(hash, mesh.num_lod_indices());
+  hash_combine(hash, hash_bytes(mesh.vertex_data(), mesh.byte_size_of_vertices()));
+  hash_combine(hash, hash_bytes(mesh.index_data(), mesh.byte_size_of_indices()));
+  hash_combine(hash, hash_bytes(mesh.packed_vertex_data(), mesh.byte_size_of_packed_vertices()));
+  hash_combine(hash, hash_bytes(mesh.lod_index_data(), mesh.byte_size_of_lod_indices()));
+  hash_combine(hash, hash_bytes(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod)));
+  hash_combine(hash, hash_bytes(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet)));
+
+  uint64_t words = 0;
+  words = hash_words(mesh.vertex_data(), mesh.byte_size_of_vertices(), words);
+  words = hash_words(mesh.index_data(), mesh.byte_size_of_indices(), words);
+  words = hash_words(mesh.packed_vertex_data(), mesh.byte_size_of_packed_vertices(), words);
+  words = hash_words(mesh.lod_index_data(), mesh.byte_size_of_lod_indices(), words);
+  words = hash_words(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod), words);
+  words = hash_words(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet), words);
+
+  // Finalized such that every bit of the words affects every bit of the digest (splitmix64)
+  words ^= words >> 30; words *= 0xbf58476d1ce4e5b9ull;
+  words ^= words >> 27; words *= 0x94d049bb133111ebull;
+  words ^= words >> 31;
+  return MeshCache::ContentHash{uint64_t(hash), words};
+}
+
+/// True if the Meshes have the same content, assumes equal content hashes
+/// NOTE: Meshes whose vertex data has been released are compared by their sizes and their 128-bit content hashes
+static bool same_content(const Mesh& a, const MeshCache::ContentHash& a_hash, const Mesh& b, const MeshCache::ContentHash& b_hash) {
+  if (a.num_vertices() != b.num_vertices() || a.num_indices() != b.num_indices() || a.num_lod_indices() != b.num_lod_indices() ||
+      a.has_packed_vertices() != b.has_packed_vertices() || a.lods.size() != b.lods.size()) {
+    return false;
+  }
+  if (!a.has_vertex_data() || !b.has_vertex_data()) { return a_hash == b_hash; }
+  return std::memcmp(a.vertex_data(), b.vertex_data(), a.byte_size_of_vertices()) == 0 &&
+         std::memcmp(a.index_data(), b.index_data(), a.byte_size_of_indices()) == 0 &&
+         (a.num_lod_indices() == 0 || std::memcmp(a.lod_index_data(), b.lod_index_data(), a.byte_size_of_lod_indices()) == 0);
+}
+
+static MeshInformation primitive(const Mesh& mesh) {
+  MeshInformation mesh_info;
+  mesh_info.mesh = mesh;
+  mesh_info.aabb = compute_aabb(mesh);
+  mesh_info.bounding_volume = compute_bounding_volume(mesh);
+  return mesh_info;
+}
+
+/// Geometry of the Mesh uploaded by the Renderer, the quantized vertices replace the full vertices when present
+static size_t uploaded_byte_size(const Mesh& mesh) {
+  const size_t vertex_bytes = mesh.has_packed_vertices() ? mesh.byte_size_of_packed_vertices() : mesh.byte_size_of_vertices();
+  return vertex_bytes + mesh.byte_size_of_indices() + mesh.byte_size_of_lod_indices() + mesh.meshlets.size() * sizeof(Meshlet);
+}
+
+/// Slot of a loaded Mesh
+struct MeshSlot {
+  MeshInformation info;
+  std::shared_ptr<MappedFile> mapping; // Mesh cache viewed by the Mesh (if any), unmapped along with the last Mesh viewing it
+  uint32_t generation = 0;             // Bumped every time the slot is freed, part of the ID
+  uint32_t refcount = 0;
+  MeshCache::ContentHash content_hash; // See compute_content_hash
+  MeshDuplicates duplicates;           // Loads resolved to the Mesh
+  bool alive = false;
+};
+
+/// Pages of MeshSlots, pages are allocated on demand and never move or shrink which keeps Mesh ptrs stable
+struct MeshStorage {
+  static const size_t PAGE_SIZE = 256;   // In # of slots
+  static const size_t MAX_PAGES = 4096;
+
+  std::array<std::unique_ptr<MeshSlot[]>, MAX_PAGES> pages;
+  size_t num_slots = 0;              // # slots handed out, free or not
+  std::vector<uint32_t> free_slots;  // Freed slots reused before new ones are handed out
+  std::mutex mutex;                  // Guards the slots, their reference counts and the content hashes
+
+  std::unordered_multimap<uint64_t, ID> content_ids; // Low content hash of every loaded Mesh (except the primitives)
+  static const ID NUM_PRIMITIVES = 3;               // Pinned slots of the MeshPrimitives
+
+  MeshStorage() {
+    // NOTE: Inserted in the order of MeshPrimitive and pinned
+    for (const Mesh& mesh : {Mesh(Cube()), Mesh(Cube(true)), Mesh(Sphere())}) {
+      const ID id = insert(primitive(mesh), nullptr);
+      lookup(id)->refcount = 1;
+    }
+  }
+
+  static inline ID make_id(const uint32_t slot, const uint32_t generation) { return (ID(generation) << 32) | slot; }
+
+  ID insert(MeshInformation&& info, std::shared_ptr<MappedFile> mapping) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return insert_locked(std::move(info), std::move(mapping));
+  }
+
+  /// NOTE: Requires the mutex to be held
+  ID insert_locked(MeshInformation&& info, std::shared_ptr<MappedFile> mapping) {
+    uint32_t slot_idx = 0;
+    if (!free_slots.empty()) {
+      slot_idx = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      if (num_slots == PAGE_SIZE * MAX_PAGES) {
+        Log::error("Out of Mesh slots (" + std::to_string(num_slots) + ")"); exit(-1);
+      }
+      slot_idx = uint32_t(num_slots++);
+      if (!pages[slot_idx / PAGE_SIZE]) {
+        pages[slot_idx / PAGE_SIZE].reset(new MeshSlot[PAGE_SIZE]);
+      }
+    }
+    MeshSlot& slot = pages[slot_idx / PAGE_SIZE][slot_idx % PAGE_SIZE];
+    slot.info = std::move(info);
+    slot.mapping = std::move(mapping);
+    slot.refcount = 0;
+    slot.content_hash = MeshCache::ContentHash();
+    slot.duplicates = MeshDuplicates();
+    slot.alive = true;
+    return make_id(slot_idx, slot.generation);
+  }
+
+  /// Returns the ID of an already loaded Mesh with the same content as the Mesh (see compute_content_hash) or inserts it
+  /// NOTE: Looked up and inserted under one lock, concurrent loads of the same content resolve to one Mesh
+  ID insert_unique(MeshInformation&& info, std::shared_ptr<MappedFile> mapping, const MeshCache::ContentHash& content_hash, bool& duplicate) {
+    std::lock_guard<std::mutex> lock(mutex);
+    duplicate = false;
+    const auto range = content_ids.equal_range(content_hash.low);
+    for (auto it = range.first; it != range.second; it++) {
+      MeshSlot* slot = lookup(it->second);
+      if (slot && same_content(slot->info.mesh, slot->content_hash, info.mesh, content_hash)) {
+        slot->duplicates.num_duplicates++;
+        slot->duplicates.bytes += uploaded_byte_size(info.mesh);
+        duplicate = true;
+        return it->second;
+      }
+    }
+    const ID id = insert_locked(std::move(info), std::move(mapping));
+    lookup(id)->content_hash = content_hash;
+    content_ids.emplace(content_hash.low, id);
+    return id;
+  }
+
+  /// Slot of the Mesh, nullptr if the ID does not refer to a loaded Mesh
+  /// NOTE: Requires the mutex to be held, slots freed by one thread are reused by the loads of another (see SceneLoader)
+  MeshSlot* lookup(const ID id) {
+    const size_t slot_idx = id & 0xFFFFFFFF;
+    if (slot_idx >= PAGE_SIZE * MAX_PAGES || !pages[slot_idx / PAGE_SIZE]) { return nullptr; }
+    MeshSlot& slot = pages[slot_idx / PAGE_SIZE][slot_idx % PAGE_SIZE];
+    if (!slot.alive || slot.generation != uint32_t(id >> 32)) { return nullptr; }
+    return &slot;
+  }
+
+  /// Frees the Mesh (and the mesh cache mapping if it was the last Mesh viewing it), the ID becomes invalid
+  /// NOTE: Requires the mutex to be held
+  void free(const ID id) {
+    MeshSlot* slot = lookup(id);
+    const auto range = content_ids.equal_range(slot->content_hash.low);
+    for (auto it = range.first; it != range.second; it++) {
+      if (it->second == id) { content_ids.erase(it); break; }
+    }
+    slot->info = MeshInformation();
+    slot->mapping.reset();
+    slot->generation++;
+    slot->alive = false;
+    free_slots.push_back(uint32_t(id & 0xFFFFFFFF));
+  }
+};
+
+static MeshStorage storage;
+
+uint64_t MeshManager::import_flags() {
+  uint64_t flags = ASSIMP_IMPORT_FLAGS;
+  if (import_settings.optimize_vertex_cache) { flags |= IMPORT_OPTIMIZE_VERTEX_CACHE; }
+  if (import_settings.quantize_vertices) { flags |= IMPORT_QUANTIZE_VERTICES; }
+  if (import_settings.generate_lods) { flags |= IMPORT_GENERATE_LODS; }
+  if (import_settings.build_meshlets) { flags |= IMPORT_BUILD_MESHLETS; }
+  return flags;
+}
 
 // NOTE: Assuming the metallic-roughness material model of models loaded with GLTF.
 // NOTE: Loads root node of whatever model format the file is
@@ -22,7 +310,7 @@ MeshManager::load_mesh(const std::string& directory, const std::string& file) {
     const std::string loaded_from_filepath = directory + file;
 
     Assimp::Importer importer;
-    auto scene = importer.ReadFile(loaded_from_filepath.c_str(), aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+    auto scene = importer.ReadFile(loaded_from_filepath.c_str(), ASSIMP_IMPORT_FLAGS);
 
     if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
       Log::error(std::string(importer.GetErrorString()));
@@ -36,6 +324,7 @@ MeshManager::load_mesh(const std::string& directory, const std::string& file) {
     #endif
 
     std::vector<std::pair<Texture::Type, std::string>> texture_info;
+    ID mesh_id = 0;
     MeshInformation mesh_info;
     mesh_info.loaded_from_filepath = directory + file;
     if (scene->HasMeshes()) {
@@ -76,7 +365,9 @@ MeshManager::load_mesh(const std::string& directory, const std::string& file) {
           mesh_info.mesh.indices.push_back(index);
         }
       } 
-      loaded_meshes.push_back(mesh_info.mesh);
+      mesh_info.aabb = compute_aabb(mesh_info.mesh);
+      mesh_info.bounding_volume = compute_bounding_volume(mesh_info.mesh);
+      mesh_id = storage.insert(std::move(mesh_info), nullptr);
 
       if (scene->HasMaterials()) {
         auto material = scene->mMaterials[mesh->mMaterialIndex];
@@ -170,219 +461,411 @@ MeshManager::load_mesh(const std::string& directory, const std::string& file) {
       }
     }
 
-    return {loaded_meshes.size() - 1, texture_info};
+    return {mesh_id, texture_info};
 }
 
-// Loads all the meshes in a given model file
-std::pair<std::vector<ID>, std::vector<std::vector<std::pair<Texture::Type, std::string>>>>
-MeshManager::load_meshes(const std::string& directory, const std::string& file) {
-  const std::string loaded_from_filepath = directory + file;
+/// Converts the mesh with its material of the Assimp scene, returns false on failure
+/// NOTE: Called from multiple threads at once, only reads the scene and writes to mesh_info
+static bool convert_mesh(const aiScene* scene, const size_t mesh_idx, const std::string& directory, MeshCache::Entry& mesh_info) {
+  const aiMesh* mesh = scene->mMeshes[mesh_idx];
 
-  Assimp::Importer importer;
-  auto scene = importer.ReadFile(loaded_from_filepath.c_str(), aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+  #ifdef VERBOSE_LEVEL_1
+  Log::info("\t ... loading mesh with name: " + std::string(mesh->mName.data));
+  #endif
 
-  if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
-    Log::error(std::string(importer.GetErrorString()));
-    return {};
+  // Load all vertices
+  const bool has_tex_coords = mesh->HasTextureCoords(0);
+  const bool has_normals = mesh->HasNormals();
+  const bool has_tangents = mesh->HasTangentsAndBitangents();
+  std::vector<Vertex>& vertices = mesh_info.mesh.vertices;
+  vertices.resize(mesh->mNumVertices);
+  for (size_t j = 0; j < mesh->mNumVertices; j++) {
+    Vertex& vertex = vertices[j];
+
+    const auto pos = mesh->mVertices[j];
+    vertex.position = { pos.x, pos.y, pos.z };
+
+    if (has_tex_coords) {
+      const auto tex_coord = mesh->mTextureCoords[0][j];
+      vertex.tex_coord = { tex_coord.x, -tex_coord.y }; // glTF (& .obj) has a flipped texture coordinate system compared to OpenGL 
+    }
+
+    if (has_normals) {
+      const auto normal = mesh->mNormals[j];
+      vertex.normal = { normal.x, normal.y, normal.z };
+    }
+
+    if (has_tangents) {
+      const auto tangent = mesh->mTangents[j];
+      vertex.tangent = { tangent.x, tangent.y, tangent.z };
+    }
   }
 
-  if (!scene->HasMeshes()) {
-    if (std::strlen(importer.GetErrorString()) != 0) {
-      Log::error(std::string(importer.GetErrorString()));
+  // Load all indices from the faces
+  std::vector<uint32_t>& indices = mesh_info.mesh.indices;
+  indices.resize(size_t(mesh->mNumFaces) * 3);
+  for (size_t j = 0; j < mesh->mNumFaces; j++) {
+    const aiFace& face = mesh->mFaces[j];
+    if (face.mNumIndices != 3) {
+      Log::warn("Not 3 vertices per face in model.");
+      return false;
     }
-    Log::error("Tried to load a Scene without any meshes from " + loaded_from_filepath);
-    return {};
+    indices[3 * j + 0] = face.mIndices[0];
+    indices[3 * j + 1] = face.mIndices[1];
+    indices[3 * j + 2] = face.mIndices[2];
   }
 
-  #ifdef VERBOSE_LEVEL_0
-  Log::info("Loading scene: " + file);
-  Log::info_indent(1, "# meshes " + std::to_string(scene->mNumMeshes));
-  Log::info_indent(1, "# materials " + std::to_string(scene->mNumMaterials));
-  #endif
-  
-  std::vector<std::vector<std::pair<Texture::Type, std::string>>> texture_infos;
-  if (scene->HasMeshes()) {
-    // FIXME: Assumes the mesh is a single mesh and not a hierarchy
-    for (size_t mesh_idx = 0; mesh_idx < scene->mNumMeshes; mesh_idx++) {
-      MeshInformation mesh_info; 
+  if (scene->HasMaterials()) {
+    auto material = scene->mMaterials[mesh->mMaterialIndex];
 
-      auto mesh = scene->mMeshes[mesh_idx];
+    aiColor3D bcf;
+    if (material->Get(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_BASE_COLOR_FACTOR, bcf) == AI_SUCCESS) {
+      const auto base_color_factor = Vec3f(bcf[0], bcf[1], bcf[2]);
+      #ifdef VERBOSE_LEVEL_2
+      Log::info("\t ... base color factor (R, G, B): (" + std::to_string(bcf[0]) + ", " + std::to_string(bcf[1]) + ", " + std::to_string(bcf[2]) + ")");
+      #endif
+    }
 
-      #ifdef VERBOSE_LEVEL_1
-      Log::info("\t ... loading mesh with name: " + std::string(mesh->mName.data));
+    #ifdef VERBOSE_LEVEL_1
+    aiString material_name;
+    if (material->Get(AI_MATKEY_NAME, material_name) == AI_SUCCESS) {
+      Log::info("\t ... loading material: " + std::string(material_name.C_Str()));
+    } else {
+      Log::info("\t ... loading material of unknown name");
+    }
+    #endif
+
+    auto& texture_info = mesh_info.texture_info;
+
+    aiString diffuse_filepath;
+    if (material->GetTexture(aiTextureType_DIFFUSE, 0, &diffuse_filepath) == AI_SUCCESS) {
+      #ifdef VERBOSE_LEVEL_2
+      Log::info("Diffuse texture name: " + std::string(directory.c_str()) + std::string(diffuse_filepath.data));
       #endif
+      std::string texture_filepath(diffuse_filepath.data);
+      texture_filepath.insert(0, directory);
+      texture_info.push_back({ Texture::Type::Diffuse, texture_filepath });
+    }
 
-      // Load all vertices
-      mesh_info.mesh.vertices.reserve(mesh->mNumVertices);
-      for (size_t j = 0; j < mesh->mNumVertices; j++) {
-        Vertex vertex;
+    aiString specular_filepath;
+    if (material->GetTexture(aiTextureType_SPECULAR, 0, &specular_filepath) == AI_SUCCESS) {
+      Log::info("Specular texture name: " + std::string(directory.c_str()) + std::string(specular_filepath.data));
+    }
 
-        const auto pos = mesh->mVertices[j];
-        vertex.position = { pos.x, pos.y, pos.z };
+    aiString ambient_filepath;
+    if (material->GetTexture(aiTextureType_AMBIENT, 0, &ambient_filepath) == AI_SUCCESS) {
+      Log::info("Ambient occlusion texture name: " + std::string(directory.c_str()) + std::string(ambient_filepath.data));
+    }
 
-        if (mesh->HasTextureCoords(0)) {
-          const auto tex_coord = mesh->mTextureCoords[0][j];
-          vertex.tex_coord = { tex_coord.x, -tex_coord.y }; // glTF (& .obj) has a flipped texture coordinate system compared to OpenGL 
-        }
+    aiString shininess_filepath;
+    if (material->GetTexture(aiTextureType_SHININESS, 0, &shininess_filepath) == AI_SUCCESS) {
+      Log::info("Shininess texture name: " + std::string(directory.c_str()) + std::string(shininess_filepath.data));
+    }
 
-        if (mesh->HasNormals()) {
-          const auto normal = mesh->mNormals[j];
-          vertex.normal = { normal.x, normal.y, normal.z };
-        }
+    aiString emissive_filepath;
+    if (material->GetTexture(aiTextureType_EMISSIVE, 0, &emissive_filepath) == AI_SUCCESS) {
+      Log::info("Emissive texture name: " + std::string(directory.c_str()) + std::string(emissive_filepath.data));
+      std::string texture_filepath(emissive_filepath.data);
+      texture_filepath.insert(0, directory);
+      texture_info.push_back({ Texture::Type::Emissive, texture_filepath });
+      // TODO: Fetch emissive factor as well 
+    }
 
-        if (mesh->HasTangentsAndBitangents()) {
-          const auto tangent = mesh->mTangents[j];
-          vertex.tangent = { tangent.x, tangent.y, tangent.z };
-        }
+    // NOTE: A.k.a bump map ...
+    aiString displacement_filepath;
+    if (material->GetTexture(aiTextureType_DISPLACEMENT, 0, &displacement_filepath) == AI_SUCCESS) {
+      Log::info("Displacement texture name: " + std::string(directory.c_str()) + std::string(displacement_filepath.data));
+    }
 
-        mesh_info.mesh.vertices.push_back(vertex);
-      }
+    aiString height_filepath;
+    if (material->GetTexture(aiTextureType_HEIGHT, 0, &height_filepath) == AI_SUCCESS) {
+      Log::info("Bumpmap texture name: " + std::string(directory.c_str()) + std::string(height_filepath.data));
+    }
 
-      // Load all indices from the faces
-      mesh_info.mesh.indices.reserve(size_t(mesh->mNumFaces) * 3);
-      for (size_t j = 0; j < mesh->mNumFaces; j++) {
-        auto face = &mesh->mFaces[j];
-        if (face->mNumIndices != 3) {
-          Log::warn("Not 3 vertices per face in model.");
-          return {};
-        }
-        for (size_t k = 0; k < 3; k++) {
-          mesh_info.mesh.indices.push_back(face->mIndices[k]);
-        }
-      }
-      loaded_meshes.push_back(mesh_info.mesh);
+    // NOTE: Lightmap is usually the ambient occlusion map ...
+    // NOTE: .. and some times the (occlusion, roughness, metallic) parameter texture for glTF models ...
+    aiString lightmap_filepath;
+    if (material->GetTexture(aiTextureType_LIGHTMAP, 0, &lightmap_filepath) == AI_SUCCESS) {
+      Log::info("Lightmap texture name: " + std::string(directory.c_str()) + std::string(lightmap_filepath.data));
+      std::string texture_filepath(lightmap_filepath.data);
+      texture_filepath.insert(0, directory);
+      texture_info.push_back({ Texture::Type::MetallicRoughness, texture_filepath });
+    }
 
-      if (scene->HasMaterials()) {
-        auto material = scene->mMaterials[mesh->mMaterialIndex];
+    aiString normals_filepath;
+    if (material->GetTexture(aiTextureType_NORMALS, 0, &normals_filepath) == AI_SUCCESS) {
+      #ifdef VERBOSE_LEVEL_2
+      Log::info("Normals texture name: " + std::string(directory.c_str()) + std::string(normals_filepath.data));
+      #endif
+      std::string texture_filepath(normals_filepath.data);
+      texture_filepath.insert(0, directory);
+      texture_info.push_back({ Texture::Type::TangentNormal, texture_filepath });
+    }
 
-        aiColor3D bcf;
-        if (material->Get(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_BASE_COLOR_FACTOR, bcf) == AI_SUCCESS) {
-          const auto base_color_factor = Vec3f(bcf[0], bcf[1], bcf[2]);
-          #ifdef VERBOSE_LEVEL_2
-          Log::info("\t ... base color factor (R, G, B): (" + std::to_string(bcf[0]) + ", " + std::to_string(bcf[1]) + ", " + std::to_string(bcf[2]) + ")");
-          #endif
-        }
+    aiString reflection_filepath;
+    if (material->GetTexture(aiTextureType_REFLECTION, 0, &reflection_filepath) == AI_SUCCESS) {
+      Log::info("Reflection texture name: " + std::string(directory.c_str()) + std::string(reflection_filepath.data));
+    }
 
-        #ifdef VERBOSE_LEVEL_1
-        aiString material_name;
-        if (material->Get(AI_MATKEY_NAME, material_name) == AI_SUCCESS) {
-          Log::info("\t ... loading material: " + std::string(material_name.C_Str()));
-        } else {
-          Log::info("\t ... loading material of unknown name");
-        }
-        #endif
+    aiString opacity_filepath;
+    if (material->GetTexture(aiTextureType_OPACITY, 0, &opacity_filepath) == AI_SUCCESS) {
+      Log::info("Opacity texture name: " + std::string(directory.c_str()) + std::string(opacity_filepath.data));
+    }
 
-        std::vector<std::pair<Texture::Type, std::string>> texture_info;
+    aiString diffuse_roughness_filepath;
+    if (material->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &diffuse_roughness_filepath) == AI_SUCCESS) {
+      Log::info("Diffuse roughness texture name: " + std::string(directory.c_str()) + std::string(diffuse_roughness_filepath.data));
+    }
 
-        aiString diffuse_filepath;
-        if (material->GetTexture(aiTextureType_DIFFUSE, 0, &diffuse_filepath) == AI_SUCCESS) {
-          #ifdef VERBOSE_LEVEL_2
-          Log::info("Diffuse texture name: " + std::string(directory.c_str()) + std::string(diffuse_filepath.data));
-          #endif
-          std::string texture_filepath(diffuse_filepath.data);
-          texture_filepath.insert(0, directory);
-          texture_info.push_back({ Texture::Type::Diffuse, texture_filepath });
-        }
+    aiString metallic_filepath;
+    if (material->GetTexture(aiTextureType_METALNESS, 0, &metallic_filepath) == AI_SUCCESS) {
+      Log::info("Metallic texture name: " + std::string(directory.c_str()) + std::string(metallic_filepath.data));
+    }
 
-        aiString specular_filepath;
-        if (material->GetTexture(aiTextureType_SPECULAR, 0, &specular_filepath) == AI_SUCCESS) {
-          Log::info("Specular texture name: " + std::string(directory.c_str()) + std::string(specular_filepath.data));
-        }
+    // NOTE: Roughness metallic textures are not detected so here we are assuming this is the unknown texture of the material.
+    aiString unknown_filepath;
+    if (material->GetTexture(aiTextureType_UNKNOWN, 0, &unknown_filepath) == AI_SUCCESS) {
+      #ifdef VERBOSE_LEVEL_2
+      Log::info("PBR parameter texture name: " + std::string(directory.c_str()) + std::string(unknown_filepath.data));
+      #endif
+      std::string texture_filepath(unknown_filepath.data);
+      texture_filepath.insert(0, directory);
+      texture_info.push_back({ Texture::Type::MetallicRoughness, texture_filepath });
+    }
+  }
+  return true;
+}
 
-        aiString ambient_filepath;
-        if (material->GetTexture(aiTextureType_AMBIENT, 0, &ambient_filepath) == AI_SUCCESS) {
-          Log::info("Ambient occlusion texture name: " + std::string(directory.c_str()) + std::string(ambient_filepath.data));
-        }
+/// Inserts the Meshes of a model file, Meshes with the same content as an already loaded Mesh share its ID if deduplicated
+static std::pair<std::vector<ID>, std::vector<std::vector<std::pair<Texture::Type, std::string>>>>
+insert_meshes(std::vector<MeshCache::Entry>& entries, const std::string& loaded_from_filepath, const std::shared_ptr<MappedFile>& mapping,
+              const bool deduplicate) {
+  std::vector<ID> mesh_ids(entries.size());
+  std::vector<std::vector<std::pair<Texture::Type, std::string>>> texture_infos(entries.size());
+  size_t num_duplicates = 0;
+  size_t duplicate_bytes = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    MeshInformation mesh_info;
+    mesh_info.mesh = std::move(entries[i].mesh);
+    mesh_info.aabb = entries[i].aabb;
+    {
+      ProfileScope scope("aabb");
+      mesh_info.bounding_volume = compute_bounding_volume(mesh_info.mesh);
+    }
+    mesh_info.loaded_from_filepath = loaded_from_filepath;
+    if (!deduplicate) {
+      mesh_ids[i] = storage.insert(std::move(mesh_info), mapping);
+      texture_infos[i] = std::move(entries[i].texture_info);
+      continue;
+    }
+    const size_t bytes = uploaded_byte_size(mesh_info.mesh);
+    bool duplicate = false;
+    mesh_ids[i] = storage.insert_unique(std::move(mesh_info), mapping, entries[i].content_hash, duplicate);
+    if (duplicate) {
+      num_duplicates++;
+      duplicate_bytes += bytes;
+    }
+    texture_infos[i] = std::move(entries[i].texture_info);
+  }
 
-        aiString shininess_filepath;
-        if (material->GetTexture(aiTextureType_SHININESS, 0, &shininess_filepath) == AI_SUCCESS) {
-          Log::info("Shininess texture name: " + std::string(directory.c_str()) + std::string(shininess_filepath.data));
-        }
+  if (num_duplicates > 0) {
+    Log::info_indent(1, "Deduplicated " + std::to_string(num_duplicates) + " of " + std::to_string(entries.size()) + " meshes (" +
+                        std::to_string(duplicate_bytes / 1024) + " KB of geometry)");
+  }
+  return { mesh_ids, texture_infos };
+}
 
-        aiString emissive_filepath;
-        if (material->GetTexture(aiTextureType_EMISSIVE, 0, &emissive_filepath) == AI_SUCCESS) {
-          Log::info("Emissive texture name: " + std::string(directory.c_str()) + std::string(emissive_filepath.data));
-          std::string texture_filepath(emissive_filepath.data);
-          texture_filepath.insert(0, directory);
-          texture_info.push_back({ Texture::Type::Emissive, texture_filepath });
-          // TODO: Fetch emissive factor as well 
-        }
+/// Converts the Assimp matrix (row major, column vectors) to the layout of the model matrices (Mat4f rows are GL columns)
+static Mat4f to_mat4f(const aiMatrix4x4& m) {
+  Mat4f matrix;
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      matrix[i][j] = m[j][i];
+    }
+  }
+  return matrix;
+}
 
-        // NOTE: A.k.a bump map ...
-        aiString displacement_filepath;
-        if (material->GetTexture(aiTextureType_DISPLACEMENT, 0, &displacement_filepath) == AI_SUCCESS) {
-          Log::info("Displacement texture name: " + std::string(directory.c_str()) + std::string(displacement_filepath.data));
-        }
+/// Walks the node hierarchy depth first and emits an instance per mesh referenced by a node with the world transform of the node
+static void collect_instances(const aiNode* node, const aiMatrix4x4& parent_transform, std::vector<MeshInstance>& instances) {
+  const aiMatrix4x4 transform = parent_transform * node->mTransformation;
+  for (size_t i = 0; i < node->mNumMeshes; i++) {
+    MeshInstance instance;
+    instance.mesh_idx = node->mMeshes[i];
+    instance.transform = to_mat4f(transform);
+    instances.push_back(instance);
+  }
+  for (size_t i = 0; i < node->mNumChildren; i++) {
+    collect_instances(node->mChildren[i], transform, instances);
+  }
+}
 
-        aiString height_filepath;
-        if (material->GetTexture(aiTextureType_HEIGHT, 0, &height_filepath) == AI_SUCCESS) {
-          Log::info("Bumpmap texture name: " + std::string(directory.c_str()) + std::string(height_filepath.data));
-        }
+// Loads all the meshes in a given model file
+std::pair<std::vector<ID>, std::vector<std::vector<std::pair<Texture::Type, std::string>>>>
+MeshManager::load_meshes(const std::string& directory, const std::string& file, std::vector<MeshInstance>* instances,
+                         const bool deduplicate) {
+  const std::string loaded_from_filepath = directory + file;
 
-        // NOTE: Lightmap is usually the ambient occlusion map ...
-        // NOTE: .. and some times the (occlusion, roughness, metallic) parameter texture for glTF models ...
-        aiString lightmap_filepath;
-        if (material->GetTexture(aiTextureType_LIGHTMAP, 0, &lightmap_filepath) == AI_SUCCESS) {
-          Log::info("Lightmap texture name: " + std::string(directory.c_str()) + std::string(lightmap_filepath.data));
-          std::string texture_filepath(lightmap_filepath.data);
-          texture_filepath.insert(0, directory);
-          texture_info.push_back({ Texture::Type::MetallicRoughness, texture_filepath });
-        }
+  // Warm start, view the meshes straight from the memory mapped cache
+  std::vector<MeshCache::Entry> entries;
+  std::vector<MeshInstance> mesh_instances;
+  std::shared_ptr<MappedFile> mapping;
+  {
+    ProfileScope scope("mesh_cache_load");
+    mapping = MeshCache::load(loaded_from_filepath, import_flags(), entries, mesh_instances);
+  }
+  if (mapping) {
+    #ifdef VERBOSE_LEVEL_0
+    Log::info("Loading scene: " + file);
+    Log::info_indent(1, "# meshes " + std::to_string(entries.size()) + " (from mesh cache)");
+    Log::info_indent(1, "# instances " + std::to_string(mesh_instances.size()));
+    #endif
+    if (instances) { *instances = std::move(mesh_instances); }
 
-        aiString normals_filepath;
-        if (material->GetTexture(aiTextureType_NORMALS, 0, &normals_filepath) == AI_SUCCESS) {
-          #ifdef VERBOSE_LEVEL_2
-          Log::info("Normals texture name: " + std::string(directory.c_str()) + std::string(normals_filepath.data));
-          #endif
-          std::string texture_filepath(normals_filepath.data);
-          texture_filepath.insert(0, directory);
-          texture_info.push_back({ Texture::Type::TangentNormal, texture_filepath });
-        }
+    return insert_meshes(entries, loaded_from_filepath, mapping, deduplicate);
+  }
 
-        aiString reflection_filepath;
-        if (material->GetTexture(aiTextureType_REFLECTION, 0, &reflection_filepath) == AI_SUCCESS) {
-          Log::info("Reflection texture name: " + std::string(directory.c_str()) + std::string(reflection_filepath.data));
-        }
+  Assimp::Importer importer;
+  const aiScene* scene = nullptr;
+  {
+    ProfileScope scope("assimp_parse");
+    scene = importer.ReadFile(loaded_from_filepath.c_str(), ASSIMP_IMPORT_FLAGS);
+  }
 
-        aiString opacity_filepath;
-        if (material->GetTexture(aiTextureType_OPACITY, 0, &opacity_filepath) == AI_SUCCESS) {
-          Log::info("Opacity texture name: " + std::string(directory.c_str()) + std::string(opacity_filepath.data));
-        }
+  if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
+    Log::error(std::string(importer.GetErrorString()));
+    return {};
+  }
 
-        aiString diffuse_roughness_filepath;
-        if (material->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &diffuse_roughness_filepath) == AI_SUCCESS) {
-          Log::info("Diffuse roughness texture name: " + std::string(directory.c_str()) + std::string(diffuse_roughness_filepath.data));
-        }
+  if (!scene->HasMeshes()) {
+    if (std::strlen(importer.GetErrorString()) != 0) {
+      Log::error(std::string(importer.GetErrorString()));
+    }
+    Log::error("Tried to load a Scene without any meshes from " + loaded_from_filepath);
+    return {};
+  }
 
-        aiString metallic_filepath;
-        if (material->GetTexture(aiTextureType_METALNESS, 0, &metallic_filepath) == AI_SUCCESS) {
-          Log::info("Metallic texture name: " + std::string(directory.c_str()) + std::string(metallic_filepath.data));
-        }
+  #ifdef VERBOSE_LEVEL_0
+  Log::info("Loading scene: " + file);
+  Log::info_indent(1, "# meshes " + std::to_string(scene->mNumMeshes));
+  Log::info_indent(1, "# materials " + std::to_string(scene->mNumMaterials));
+  #endif
+  
+  // Meshes referenced by several nodes are loaded once and placed by an instance per node
+  if (scene->mRootNode) {
+    collect_instances(scene->mRootNode, aiMatrix4x4(), mesh_instances);
+  } else {
+    for (uint32_t i = 0; i < scene->mNumMeshes; i++) {
+      MeshInstance instance;
+      instance.mesh_idx = i;
+      mesh_instances.push_back(instance);
+    }
+  }
+  #ifdef VERBOSE_LEVEL_0
+  Log::info_indent(1, "# instances " + std::to_string(mesh_instances.size()));
+  #endif
 
-        // NOTE: Roughness metallic textures are not detected so here we are assuming this is the unknown texture of the material.
-        aiString unknown_filepath;
-        if (material->GetTexture(aiTextureType_UNKNOWN, 0, &unknown_filepath) == AI_SUCCESS) {
-          #ifdef VERBOSE_LEVEL_2
-          Log::info("PBR parameter texture name: " + std::string(directory.c_str()) + std::string(unknown_filepath.data));
-          #endif
-          std::string texture_filepath(unknown_filepath.data);
-          texture_filepath.insert(0, directory);
-          texture_info.push_back({ Texture::Type::MetallicRoughness, texture_filepath });
-        }
-        texture_infos.push_back(texture_info);
+  // NOTE: Meshes are converted in parallel into preallocated slots in order to keep the IDs deterministic
+  entries.resize(scene->mNumMeshes);
+  std::vector<uint8_t> converted(scene->mNumMeshes, 0);
+  std::vector<std::pair<MeshOptimizer::VertexCacheStatistics, MeshOptimizer::VertexCacheStatistics>> vertex_cache_statistics(scene->mNumMeshes);
+  JobSystem::instance().parallel_for(scene->mNumMeshes, [&](const size_t mesh_idx) {
+    {
+      ProfileScope scope("vertex_conversion");
+      converted[mesh_idx] = convert_mesh(scene, mesh_idx, directory, entries[mesh_idx]);
+    }
+
+    if (converted[mesh_idx]) {
+      ProfileScope scope("aabb");
+      entries[mesh_idx].aabb = compute_aabb(entries[mesh_idx].mesh);
+    }
+
+    ProfileScope scope("mesh_optimization");
+    if (converted[mesh_idx] && import_settings.optimize_vertex_cache) {
+      Mesh& mesh = entries[mesh_idx].mesh;
+      vertex_cache_statistics[mesh_idx].first = MeshOptimizer::analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+      MeshOptimizer::optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+      MeshOptimizer::optimize_vertex_fetch(mesh.vertices, mesh.indices);
+      vertex_cache_statistics[mesh_idx].second = MeshOptimizer::analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+    }
+
+    if (converted[mesh_idx] && import_settings.generate_lods) {
+      MeshOptimizer::generate_lods(entries[mesh_idx].mesh, import_settings.optimize_vertex_cache);
+    }
+
+    // NOTE: Reorders the triangles of LOD 0 (the LODs have index lists of their own)
+    if (converted[mesh_idx] && import_settings.build_meshlets) {
+      Mesh& mesh = entries[mesh_idx].mesh;
+      mesh.meshlets = MeshOptimizer::build_meshlets(mesh.vertices, mesh.indices);
+    }
+
+    // NOTE: Quantized last since the optimizations above reorder the vertices
+    if (converted[mesh_idx] && import_settings.quantize_vertices) {
+      MeshCache::Entry& entry = entries[mesh_idx];
+      entry.mesh.packed_vertices = MeshOptimizer::quantize_vertices(entry.mesh.vertices, entry.aabb);
+    }
+  });
+  if (std::find(converted.begin(), converted.end(), 0) != converted.end()) {
+    return {};
+  }
+
+  // NOTE: Hashed once the Meshes are final, the hashes are cached such that warm starts do not rehash the mapped data
+  JobSystem::instance().parallel_for(entries.size(), [&](const size_t mesh_idx) {
+    ProfileScope scope("content_hash");
+    entries[mesh_idx].content_hash = compute_content_hash(entries[mesh_idx].mesh);
+  });
+
+  if (import_settings.optimize_vertex_cache) {
+    Log::info_indent(1, "Vertex cache optimization (FIFO cache of " + std::to_string(MeshOptimizer::VERTEX_CACHE_SIZE) + " vertices)");
+    for (size_t i = 0; i < vertex_cache_statistics.size(); i++) {
+      const auto& before = vertex_cache_statistics[i].first;
+      const auto& after = vertex_cache_statistics[i].second;
+      Log::info_indent(2, "mesh " + std::to_string(i) + ": ACMR " + std::to_string(before.acmr) + " -> " + std::to_string(after.acmr) +
+                          ", ATVR " + std::to_string(before.atvr) + " -> " + std::to_string(after.atvr));
+    }
+  }
+
+  if (import_settings.generate_lods) {
+    Log::info_indent(1, "Levels of detail (triangles, error relative to mesh extent)");
+    for (size_t i = 0; i < entries.size(); i++) {
+      const Mesh& mesh = entries[i].mesh;
+      std::string lods;
+      for (size_t level = 0; level < mesh.num_lods(); level++) {
+        const MeshLod lod = mesh.lod(level);
+        lods += " " + std::to_string(lod.num_indices / 3) + " (" + std::to_string(lod.error) + ")";
       }
+      Log::info_indent(2, "mesh " + std::to_string(i) + ":" + lods);
     }
   }
 
-  std::vector<ID> mesh_ids(scene->mNumMeshes);
-  std::iota(mesh_ids.begin(), mesh_ids.end(), loaded_meshes.size() - mesh_ids.size());
-  assert(mesh_ids.size() == texture_infos.size());
-  return { mesh_ids, texture_infos };
+  if (import_settings.build_meshlets) {
+    Log::info_indent(1, "Meshlets (at most " + std::to_string(Meshlet::MAX_VERTICES) + " vertices, " + std::to_string(Meshlet::MAX_TRIANGLES) + " triangles)");
+    for (size_t i = 0; i < entries.size(); i++) {
+      const Mesh& mesh = entries[i].mesh;
+      size_t num_cones = 0;
+      for (const Meshlet& meshlet : mesh.meshlets) { num_cones += meshlet.cone_cutoff < 1.0f; }
+      Log::info_indent(2, "mesh " + std::to_string(i) + ": " + std::to_string(mesh.meshlets.size()) + " meshlets, " +
+                          std::to_string(num_cones) + " backface cullable, " +
+                          std::to_string(float(mesh.num_indices()) / 3.0f / float(std::max<size_t>(mesh.meshlets.size(), 1))) + " triangles/meshlet");
+    }
+  }
+
+  // Cold start, write the cache so that the next load can skip Assimp
+  {
+    ProfileScope scope("mesh_cache_save");
+    if (!MeshCache::save(loaded_from_filepath, import_flags(), entries, mesh_instances)) {
+      Log::warn("Failed to cache meshes of " + loaded_from_filepath);
+    }
+  }
+
+  if (instances) { *instances = std::move(mesh_instances); }
+  return insert_meshes(entries, loaded_from_filepath, nullptr, deduplicate);
 }
 
 Mesh MeshManager::mesh_from_id(const ID id) {
-  if (id < loaded_meshes.size()) {
-    return loaded_meshes[id];
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (const MeshSlot* slot = storage.lookup(id)) {
+    return slot->info.mesh;
   } else {
     Log::error("Non existent Mesh id provided.");
   }
@@ -390,10 +873,94 @@ Mesh MeshManager::mesh_from_id(const ID id) {
 }
 
 const Mesh* MeshManager::mesh_ptr_from_id(const ID id) {
-  if (id < loaded_meshes.size()) {
-    return &loaded_meshes[id];
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (const MeshSlot* slot = storage.lookup(id)) {
+    return &slot->info.mesh;
   } else {
     Log::error("Non existent Mesh id provided.");
   }
   return nullptr;
 }
+
+AABB MeshManager::aabb_from_id(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (const MeshSlot* slot = storage.lookup(id)) {
+    return slot->info.aabb;
+  } else {
+    Log::error("Non existent Mesh id provided.");
+  }
+  return {};
+}
+
+BoundingVolume MeshManager::bounding_volume_from_id(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (const MeshSlot* slot = storage.lookup(id)) {
+    return slot->info.bounding_volume;
+  } else {
+    Log::error("Non existent Mesh id provided.");
+  }
+  return {};
+}
+
+bool MeshManager::is_valid(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  return storage.lookup(id) != nullptr;
+}
+
+void MeshManager::retain(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (MeshSlot* slot = storage.lookup(id)) {
+    slot->refcount++;
+  } else {
+    Log::error("Retained non existent Mesh id " + std::to_string(id));
+  }
+}
+
+void MeshManager::release(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  MeshSlot* slot = storage.lookup(id);
+  if (slot == nullptr || slot->refcount == 0) {
+    Log::error("Released non existent or unreferenced Mesh id " + std::to_string(id));
+    return;
+  }
+  if (--slot->refcount == 0) {
+    storage.free(id);
+  }
+}
+
+void MeshManager::release_vertex_data(const ID id) {
+  // NOTE: The MeshPrimitives are never freed thus keep their vertex data to be uploaded again after their geometry is freed
+  if (id < MeshStorage::NUM_PRIMITIVES) { return; }
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  if (MeshSlot* slot = storage.lookup(id)) {
+    slot->info.mesh.release_vertex_data();
+    slot->mapping.reset(); // Unmaps the mesh cache once no Mesh views it
+  }
+}
+
+MeshStatistics MeshManager::statistics() {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  MeshStatistics statistics;
+  for (size_t i = 0; i < storage.num_slots; i++) {
+    const MeshSlot& slot = storage.pages[i / MeshStorage::PAGE_SIZE][i % MeshStorage::PAGE_SIZE];
+    if (!slot.alive) { continue; }
+    const Mesh& mesh = slot.info.mesh;
+    statistics.num_meshes++;
+    statistics.num_duplicates += slot.duplicates.num_duplicates;
+    statistics.duplicate_bytes += slot.duplicates.bytes;
+    statistics.owned_bytes += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(uint32_t) +
+                              mesh.packed_vertices.capacity() * sizeof(PackedVertex) + mesh.lod_indices.capacity() * sizeof(uint32_t) +
+                              mesh.meshlets.capacity() * sizeof(Meshlet);
+    if (mesh.vertices.empty() && mesh.view.vertices != nullptr) {
+      statistics.mapped_bytes += mesh.byte_size_of_vertices() + mesh.byte_size_of_indices() +
+                                 mesh.byte_size_of_packed_vertices() + mesh.byte_size_of_lod_indices();
+    }
+  }
+  return statistics;
+}
+
+MeshDuplicates MeshManager::duplicates_of(const ID id) {
+  std::lock_guard<std::mutex> lock(storage.mutex);
+  const MeshSlot* slot = storage.lookup(id);
+  return slot ? slot->duplicates : MeshDuplicates();
+}
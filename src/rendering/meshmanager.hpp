@@ -10,22 +10,85 @@
 struct MeshInformation {
     Mesh mesh;
     std::string loaded_from_filepath;
+    AABB aabb; // Model space AABB of the mesh
+    BoundingVolume bounding_volume; // Model space bounding sphere of the mesh
 };
 
+/// Memory held by the loaded Meshes on the CPU
+struct MeshStatistics {
+  size_t num_meshes = 0;
+  size_t owned_bytes = 0;   // Vertex/index data owned by the Meshes
+  size_t mapped_bytes = 0;  // Vertex/index data viewed in memory mapped mesh caches
+  size_t num_duplicates = 0;  // Loads resolved to an already loaded Mesh (see MeshDuplicates)
+  size_t duplicate_bytes = 0; // Geometry of the duplicates neither stored nor uploaded again
+};
+
+/// Loads resolved to a Mesh by its content instead of loading a Mesh of their own
+struct MeshDuplicates {
+  size_t num_duplicates = 0;
+  size_t bytes = 0; // Geometry in the layout uploaded by the Renderer (vertices, indices, LOD indices and meshlets)
+};
+
+/// Optional processing of meshes on import, part of the mesh cache key
+/// Governed by "mesh_import" in config.json
+struct MeshImportSettings {
+  bool optimize_vertex_cache = false; // Reorders triangles for the post-transform vertex cache and vertices for fetch locality
+  bool quantize_vertices = false;     // Uploads the quantized vertex layout instead of full floats (see PackedVertex)
+  bool generate_lods = false;         // Simplified levels of detail selected per instance by the culling pass (see MeshLod)
+  bool build_meshlets = false;        // Clusters of LOD 0 frustum and backface culled per instance by the culling pass (see Meshlet)
+};
+
+/// Owns every loaded Mesh, Meshes are stored in fixed size pages and never move once loaded
+/// Mesh IDs are handles (generation << 32 | slot), IDs of released Meshes are detected and rejected
+/// NOTE: The MeshPrimitives are the first slots with generation 0 and thus their own IDs
+/// NOTE: Thread safe, Meshes are loaded on the JobSystem while others are drawn and freed (see SceneLoader)
 struct MeshManager {
+  static MeshImportSettings import_settings;
+
+  // Adds a reference to the Mesh, Meshes are freed when their last reference is released
+  // NOTE: Meshes which have never been retained are kept until retained and released
+  static void retain(ID id);
+  static void release(ID id);
+
+  // Frees the vertex data of the Mesh on the CPU once it has been uploaded, the Mesh keeps its counts and LODs
+  // NOTE: The MeshPrimitives keep their vertex data
+  static void release_vertex_data(ID id);
+
+  // True if the id refers to a loaded Mesh
+  static bool is_valid(ID id);
+
   // Loads the root node of a model file
   static std::pair<ID, std::vector<std::pair<Texture::Type, std::string>>>
   load_mesh(const std::string& directory, const std::string& file);
 
-  // Loads all the meshs and materials in a model file
+  // Loads all the meshs and materials in a model file, each mesh is loaded once
+  // Fills instances (if given) with an instance per node referencing a mesh, indexing the returned meshes
+  // Meshes with the same content as an already loaded Mesh share its ID unless deduplicate is false
+  // NOTE: Served from the binary mesh cache (see MeshCache) when it is up to date
   static std::pair<std::vector<ID>, std::vector<std::vector<std::pair<Texture::Type, std::string>>>>
-  load_meshes(const std::string& directory, const std::string& file);
+  load_meshes(const std::string& directory, const std::string& file, std::vector<MeshInstance>* instances = nullptr,
+              bool deduplicate = true);
 
   // Returns the Mesh associated with the id
   static Mesh mesh_from_id(ID id);
 
   // Returns a ptr to the Mesh associated with the id
   static const Mesh* mesh_ptr_from_id(ID id);
+
+  // Returns the model space AABB of the Mesh associated with the id
+  static AABB aabb_from_id(ID id);
+
+  // Returns the model space bounding sphere of the Mesh associated with the id
+  static BoundingVolume bounding_volume_from_id(ID id);
+
+  // Memory held by the loaded Meshes
+  static MeshStatistics statistics();
+
+  // Loads resolved to the Mesh associated with the id as duplicates
+  static MeshDuplicates duplicates_of(ID id);
+
+  // Flags which the imported meshes depend on, part of the mesh cache key
+  static uint64_t import_flags();
 };
 
 #endif // MEINEKRAFT_MESHMANAGER_HPP
@@ -0,0 +1,566 @@
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::analyze_vertex_cache(const std::vector<uint32_t>& indices, const size_t num_vertices, const uint32_t cache_size) {
+  VertexCacheStatistics statistics;
+  if (indices.empty() || num_vertices == 0) { return statistics; }
+
+  // NOTE: A vertex is in the FIFO cache if less than cache_size vertices have been transformed since it was
+  std::vector<uint32_t> cache_time(num_vertices, 0);
+  uint32_t time = cache_size + 1;
+  size_t transformed = 0;
+  for (const uint32_t index : indices) {
+    if (time - cache_time[index] > cache_size) {
+      cache_time[index] = time++;
+      transformed++;
+    }
+  }
+
+  statistics.acmr = float(transformed) / float(indices.size() / 3);
+  statistics.atvr = float(transformed) / float(num_vertices);
+  return statistics;
+}
+
+// [Sander07]: Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, Sander et al. 2007
+void MeshOptimizer::optimize_vertex_cache(std::vector<uint32_t>& indices, const size_t num_vertices, const uint32_t cache_size) {
+  const size_t num_triangles = indices.size() / 3;
+  if (num_triangles == 0 || num_vertices == 0) { return; }
+
+  // Vertex-triangle adjacency, triangles of vertex v are adjacency[offsets[v], offsets[v + 1])
+  std::vector<uint32_t> live_triangles(num_vertices, 0);
+  for (const uint32_t index : indices) { live_triangles[index]++; }
+
+  std::vector<uint32_t> offsets(num_vertices + 1, 0);
+  for (size_t v = 0; v < num_vertices; v++) {
+    offsets[v + 1] = offsets[v] + live_triangles[v];
+  }
+
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t t = 0; t < num_triangles; t++) {
+    for (size_t k = 0; k < 3; k++) {
+      adjacency[fill[indices[3 * t + k]]++] = uint32_t(t);
+    }
+  }
+
+  std::vector<uint32_t> cache_time(num_vertices, 0);
+  std::vector<uint8_t> emitted(num_triangles, 0);
+  std::vector<uint32_t> dead_end_stack;
+  dead_end_stack.reserve(indices.size());
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+
+  int64_t time = cache_size + 1;
+  size_t cursor = 0; // Scans for any vertex with live triangles when stuck
+  int64_t fanning_vertex = indices[0];
+  while (fanning_vertex >= 0) {
+    // Emit all the remaining triangles of the fanning vertex
+    candidates.clear();
+    for (uint32_t i = offsets[fanning_vertex]; i < offsets[fanning_vertex + 1]; i++) {
+      const uint32_t t = adjacency[i];
+      if (emitted[t]) { continue; }
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t v = indices[3 * t + k];
+        output.push_back(v);
+        dead_end_stack.push_back(v);
+        candidates.push_back(v);
+        live_triangles[v]--;
+        if (time - cache_time[v] > cache_size) {
+          cache_time[v] = uint32_t(time);
+          time++;
+        }
+      }
+      emitted[t] = 1;
+    }
+
+    // Next fanning vertex is the candidate furthest back in the cache which stays in the cache while fanning
+    int64_t next_vertex = -1;
+    int64_t best_priority = -1;
+    for (const uint32_t v : candidates) {
+      if (live_triangles[v] == 0) { continue; }
+      int64_t priority = 0;
+      if (time - cache_time[v] + 2 * int64_t(live_triangles[v]) <= int64_t(cache_size)) {
+        priority = time - cache_time[v];
+      }
+      if (priority > best_priority) {
+        best_priority = priority;
+        next_vertex = v;
+      }
+    }
+
+    // Dead end, prefer recently used vertices before scanning for any vertex left
+    while (next_vertex == -1 && !dead_end_stack.empty()) {
+      const uint32_t v = dead_end_stack.back();
+      dead_end_stack.pop_back();
+      if (live_triangles[v] > 0) { next_vertex = v; }
+    }
+    while (next_vertex == -1 && cursor < num_vertices) {
+      if (live_triangles[cursor] > 0) { next_vertex = int64_t(cursor); }
+      cursor++;
+    }
+
+    fanning_vertex = next_vertex;
+  }
+
+  indices.swap(output);
+}
+
+void MeshOptimizer::optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  const uint32_t UNMAPPED = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> remap(vertices.size(), UNMAPPED);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+  for (uint32_t& index : indices) {
+    if (remap[index] == UNMAPPED) {
+      remap[index] = uint32_t(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(reordered);
+}
+
+Vec3f MeshOptimizer::quantization_extent(const AABB& aabb) {
+  const Vec3f extent = aabb.max - aabb.min;
+  const float epsilon = std::numeric_limits<float>::epsilon();
+  return Vec3f(std::max(extent.x, epsilon), std::max(extent.y, epsilon), std::max(extent.z, epsilon));
+}
+
+// [Cigolle14]: A Survey of Efficient Representations for Independent Unit Vectors, Cigolle et al. 2014
+Vec2f MeshOptimizer::octahedral_encode(const Vec3f& direction) {
+  const float l1_norm = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+  if (l1_norm == 0.0f) { return Vec2f(0.0f); } // Missing normals/tangents decode to +z
+  Vec2f encoded(direction.x / l1_norm, direction.y / l1_norm);
+  if (direction.z < 0.0f) {
+    encoded = Vec2f((1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f),
+                    (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return encoded;
+}
+
+Vec3f MeshOptimizer::octahedral_decode(const Vec2f& encoded) {
+  Vec3f direction(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  const float t = std::max(-direction.z, 0.0f);
+  direction.x += direction.x >= 0.0f ? -t : t;
+  direction.y += direction.y >= 0.0f ? -t : t;
+  return direction.normalize();
+}
+
+uint16_t MeshOptimizer::float_to_half(const float value) {
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(float));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const int32_t exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+  uint32_t mantissa = bits & 0x007FFFFF;
+
+  if (((bits >> 23) & 0xFF) == 0xFF) { // Inf or NaN
+    return uint16_t(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+  }
+  if (exponent >= 0x1F) { return uint16_t(sign | 0x7C00); } // Overflow to inf
+  if (exponent <= 0) {
+    if (exponent < -10) { return uint16_t(sign); } // Underflow to zero
+    // Denormal half, round to nearest
+    mantissa |= 0x00800000;
+    const uint32_t shift = uint32_t(14 - exponent);
+    const uint32_t rounded = (mantissa + (1u << (shift - 1))) >> shift;
+    return uint16_t(sign | rounded);
+  }
+  // Round to nearest, a carry into the exponent is correct behaviour
+  const uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+  return uint16_t(half + ((mantissa >> 12) & 1));
+}
+
+std::vector<PackedVertex> MeshOptimizer::quantize_vertices(const std::vector<Vertex>& vertices, const AABB& aabb) {
+  auto unorm16 = [](const float value) {
+    return uint16_t(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+  };
+  auto snorm16 = [](const float value) {
+    return int16_t(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+  };
+
+  const Vec3f extent = quantization_extent(aabb);
+  std::vector<PackedVertex> packed(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& p = packed[i];
+
+    const Vec3f position = vertex.position - aabb.min;
+    p.position[0] = unorm16(position.x / extent.x);
+    p.position[1] = unorm16(position.y / extent.y);
+    p.position[2] = unorm16(position.z / extent.z);
+
+    const Vec2f normal = octahedral_encode(vertex.normal);
+    p.normal[0] = snorm16(normal.x);
+    p.normal[1] = snorm16(normal.y);
+
+    const Vec2f tangent = octahedral_encode(vertex.tangent);
+    p.tangent[0] = snorm16(tangent.x);
+    p.tangent[1] = snorm16(tangent.y);
+
+    p.tex_coord[0] = float_to_half(vertex.tex_coord.x);
+    p.tex_coord[1] = float_to_half(vertex.tex_coord.y);
+  }
+  return packed;
+}
+
+/// Sum of squared distances to planes weighted by the area of the triangles they stem from
+struct Quadric {
+  double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0; // Symmetric 3x3
+  double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+  double c = 0.0;
+  double weight = 0.0;
+
+  /// Plane n.p + d = 0 with unit normal n
+  static Quadric from_plane(const Vec3f& n, const float d, const double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+    q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& q) {
+    a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+    b0 += q.b0; b1 += q.b1; b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+    return *this;
+  }
+
+  /// Weighted sum of squared distances to the planes from the point
+  double evaluate(const Vec3f& p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    const double v = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                     2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(v, 0.0);
+  }
+};
+
+// [Garland97]: Surface Simplification Using Quadric Error Metrics, Garland et al. 1997
+std::vector<uint32_t> MeshOptimizer::simplify(const Vertex* vertices, const size_t num_vertices, const std::vector<uint32_t>& indices,
+                                              const size_t target_num_indices, const float target_error, float* result_error) {
+  std::vector<uint32_t> result = indices;
+  if (result_error) { *result_error = 0.0f; }
+  if (result.size() <= target_num_indices || num_vertices == 0) { return result; }
+
+  // Vertices only differing in attributes (wedges) share the quadric of their position
+  std::vector<uint32_t> canonical(num_vertices);
+  std::vector<uint32_t> num_wedges(num_vertices, 0);
+  {
+    std::vector<uint8_t> referenced(num_vertices, 0);
+    for (const uint32_t index : indices) { referenced[index] = 1; }
+    std::unordered_map<Vec3f, uint32_t> positions;
+    for (size_t v = 0; v < num_vertices; v++) {
+      canonical[v] = positions.emplace(vertices[v].position, uint32_t(v)).first->second;
+      if (referenced[v]) { num_wedges[canonical[v]]++; }
+    }
+  }
+
+  AABB aabb;
+  aabb.min = Vec3f(std::numeric_limits<float>::max());
+  aabb.max = Vec3f(std::numeric_limits<float>::lowest());
+  for (const uint32_t index : indices) {
+    const Vec3f& p = vertices[index].position;
+    aabb.min = Vec3f(std::min(aabb.min.x, p.x), std::min(aabb.min.y, p.y), std::min(aabb.min.z, p.z));
+    aabb.max = Vec3f(std::max(aabb.max.x, p.x), std::max(aabb.max.y, p.y), std::max(aabb.max.z, p.z));
+  }
+  const float extent = aabb.max_axis();
+  if (extent <= 0.0f) { return result; }
+
+  std::vector<Quadric> quadrics(num_vertices);
+  for (size_t t = 0; t < indices.size() / 3; t++) {
+    const Vec3f& p0 = vertices[indices[3 * t + 0]].position;
+    const Vec3f& p1 = vertices[indices[3 * t + 1]].position;
+    const Vec3f& p2 = vertices[indices[3 * t + 2]].position;
+    const Vec3f normal = (p1 - p0).cross(p2 - p0);
+    const float length = normal.length();
+    if (length == 0.0f) { continue; }
+    const Vec3f n = normal / length;
+    const Quadric quadric = Quadric::from_plane(n, -n.dot(p0), 0.5 * length);
+    for (size_t k = 0; k < 3; k++) { quadrics[canonical[indices[3 * t + k]]] += quadric; }
+  }
+
+  // NOTE: Vertices on borders, non-manifold edges and attribute seams are locked in order to never open cracks
+  std::vector<uint8_t> locked(num_vertices, 0);
+  {
+    std::unordered_map<uint64_t, uint32_t> edges;
+    for (size_t t = 0; t < indices.size() / 3; t++) {
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t a = canonical[indices[3 * t + k]];
+        const uint32_t b = canonical[indices[3 * t + (k + 1) % 3]];
+        if (a == b) { continue; }
+        edges[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+      }
+    }
+    for (const auto& [edge, count] : edges) {
+      if (count == 2) { continue; }
+      locked[edge >> 32] = 1;
+      locked[edge & 0xFFFFFFFF] = 1;
+    }
+    for (size_t v = 0; v < num_vertices; v++) {
+      if (num_wedges[v] > 1) { locked[v] = 1; }
+    }
+  }
+
+  struct Collapse {
+    uint32_t from = 0;
+    uint32_t to = 0;
+    double error = 0.0; // Absolute distance
+  };
+
+  const double max_error = double(target_error) * extent;
+  double error = 0.0;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(num_vertices);
+  std::vector<uint8_t> touched(num_vertices);
+
+  // NOTE: Each pass collapses the cheapest edges not sharing any triangles, then the triangles are rebuilt
+  while (result.size() > target_num_indices) {
+    const size_t num_triangles = result.size() / 3;
+
+    // Vertex-triangle adjacency, unlocked vertices are their own canonical vertex so wedge adjacency is enough
+    offsets.assign(num_vertices + 1, 0);
+    for (const uint32_t index : result) { offsets[index + 1]++; }
+    for (size_t v = 0; v < num_vertices; v++) { offsets[v + 1] += offsets[v]; }
+    adjacency.resize(result.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < num_triangles; t++) {
+      for (size_t k = 0; k < 3; k++) { adjacency[fill[result[3 * t + k]]++] = uint32_t(t); }
+    }
+
+    collapses.clear();
+    for (size_t t = 0; t < num_triangles; t++) {
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t from = result[3 * t + k];
+        if (locked[canonical[from]]) { continue; }
+        for (size_t j = 1; j < 3; j++) {
+          const uint32_t to = result[3 * t + (k + j) % 3];
+          if (canonical[from] == canonical[to]) { continue; }
+          Quadric quadric = quadrics[canonical[from]];
+          quadric += quadrics[canonical[to]];
+          const double distance = std::sqrt(quadric.evaluate(vertices[to].position) / std::max(quadric.weight, 1e-12));
+          collapses.push_back({from, to, distance});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+    for (size_t v = 0; v < num_vertices; v++) { remap[v] = uint32_t(v); }
+    std::fill(touched.begin(), touched.end(), 0);
+
+    size_t triangles_left = num_triangles;
+    size_t num_collapsed = 0;
+    for (const Collapse& collapse : collapses) {
+      if (collapse.error > max_error || triangles_left * 3 <= target_num_indices) { break; }
+      const uint32_t from = canonical[collapse.from];
+      const uint32_t to = canonical[collapse.to];
+      if (touched[from] || touched[to]) { continue; }
+
+      // Reject collapses flipping or degenerating the remaining triangles around the vertex
+      const Vec3f& target = vertices[collapse.to].position;
+      bool flips = false;
+      size_t removed = 0;
+      for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; i++) {
+        const uint32_t* triangle = &result[3 * adjacency[i]];
+        if (canonical[triangle[0]] == to || canonical[triangle[1]] == to || canonical[triangle[2]] == to) {
+          removed++;
+          continue;
+        }
+        Vec3f p[3] = {vertices[triangle[0]].position, vertices[triangle[1]].position, vertices[triangle[2]].position};
+        const Vec3f before = (p[1] - p[0]).cross(p[2] - p[0]);
+        for (size_t k = 0; k < 3; k++) {
+          if (triangle[k] == collapse.from) { p[k] = target; }
+        }
+        const Vec3f after = (p[1] - p[0]).cross(p[2] - p[0]);
+        flips = before.dot(after) <= 0.25f * before.length() * after.length();
+      }
+      if (flips) { continue; }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[to] += quadrics[from];
+      touched[from] = touched[to] = 1;
+      for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+        for (size_t k = 0; k < 3; k++) { touched[canonical[result[3 * adjacency[i] + k]]] = 1; }
+      }
+      triangles_left -= removed;
+      error = std::max(error, collapse.error);
+      num_collapsed++;
+    }
+    if (num_collapsed == 0) { break; }
+
+    size_t num_indices = 0;
+    for (size_t t = 0; t < num_triangles; t++) {
+      const uint32_t a = remap[result[3 * t + 0]];
+      const uint32_t b = remap[result[3 * t + 1]];
+      const uint32_t c = remap[result[3 * t + 2]];
+      if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) { continue; }
+      result[num_indices++] = a;
+      result[num_indices++] = b;
+      result[num_indices++] = c;
+    }
+    result.resize(num_indices);
+  }
+
+  if (result_error) { *result_error = float(error / extent); }
+  return result;
+}
+
+void MeshOptimizer::generate_lods(Mesh& mesh, const bool optimize_vertex_cache) {
+  mesh.lod_indices.clear();
+  mesh.lods.clear();
+
+  std::vector<uint32_t> previous = mesh.indices;
+  float error = 0.0f;
+  for (size_t level = 1; level < Mesh::MAX_LODS; level++) {
+    const size_t target_num_indices = previous.size() / 6 * 3;
+    float level_error = 0.0f;
+    std::vector<uint32_t> lod = simplify(mesh.vertices.data(), mesh.vertices.size(), previous, target_num_indices, LOD_TARGET_ERRORS[level - 1], &level_error);
+
+    // Not worth a level of its own unless a significant amount of triangles are removed
+    if (lod.empty() || lod.size() > previous.size() * 9 / 10) { break; }
+
+    // NOTE: Simplified from the previous level thus the errors accumulate
+    error += level_error;
+    if (optimize_vertex_cache) { MeshOptimizer::optimize_vertex_cache(lod, mesh.vertices.size()); }
+
+    MeshLod mesh_lod;
+    mesh_lod.first_index = uint32_t(mesh.indices.size() + mesh.lod_indices.size());
+    mesh_lod.num_indices = uint32_t(lod.size());
+    mesh_lod.error = error;
+    mesh.lods.push_back(mesh_lod);
+    mesh.lod_indices.insert(mesh.lod_indices.end(), lod.begin(), lod.end());
+    previous.swap(lod);
+  }
+}
+
+/// Bounding sphere and backface normal cone of the triangles of the meshlet
+static void compute_meshlet_bounds(const std::vector<Vertex>& vertices, const uint32_t* indices, Meshlet& meshlet) {
+  Vec3f min(std::numeric_limits<float>::max());
+  Vec3f max(std::numeric_limits<float>::lowest());
+  for (size_t i = 0; i < meshlet.num_indices; i++) {
+    const Vec3f& p = vertices[indices[i]].position;
+    min = Vec3f(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+    max = Vec3f(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+  }
+  meshlet.center = (min + max) / 2.0f;
+  meshlet.radius = 0.0f;
+  for (size_t i = 0; i < meshlet.num_indices; i++) {
+    meshlet.radius = std::max(meshlet.radius, (vertices[indices[i]].position - meshlet.center).length());
+  }
+
+  // NOTE: Triangle normals rather than vertex normals since it is the winding which is backface culled
+  std::vector<Vec3f> normals;
+  normals.reserve(meshlet.num_indices / 3);
+  Vec3f axis(0.0f);
+  for (size_t t = 0; t < meshlet.num_indices / 3; t++) {
+    const Vec3f& p0 = vertices[indices[3 * t + 0]].position;
+    const Vec3f& p1 = vertices[indices[3 * t + 1]].position;
+    const Vec3f& p2 = vertices[indices[3 * t + 2]].position;
+    const Vec3f normal = (p1 - p0).cross(p2 - p0);
+    const float length = normal.length();
+    if (length == 0.0f) { continue; }
+    normals.push_back(normal / length);
+    axis = axis + normals.back();
+  }
+
+  meshlet.cone_axis = Vec3f(0.0f, 0.0f, 1.0f);
+  meshlet.cone_cutoff = 1.0f;
+  const float axis_length = axis.length();
+  if (normals.empty() || axis_length == 0.0f) { return; }
+  axis = axis / axis_length;
+
+  float min_dot = 1.0f;
+  for (const Vec3f& normal : normals) { min_dot = std::min(min_dot, normal.dot(axis)); }
+
+  // Cones wider than ~85 degrees are practically never entirely backfacing
+  if (min_dot <= 0.1f) { return; }
+  meshlet.cone_axis = axis;
+  meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+std::vector<Meshlet> MeshOptimizer::build_meshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  const size_t num_triangles = indices.size() / 3;
+  const size_t num_vertices = vertices.size();
+  std::vector<Meshlet> meshlets;
+  if (num_triangles == 0) { return meshlets; }
+
+  // Vertex-triangle adjacency, triangles of vertex v are adjacency[offsets[v], offsets[v + 1])
+  std::vector<uint32_t> offsets(num_vertices + 1, 0);
+  for (const uint32_t index : indices) { offsets[index + 1]++; }
+  for (size_t v = 0; v < num_vertices; v++) { offsets[v + 1] += offsets[v]; }
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t t = 0; t < num_triangles; t++) {
+    for (size_t k = 0; k < 3; k++) { adjacency[fill[indices[3 * t + k]]++] = uint32_t(t); }
+  }
+
+  const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> vertex_meshlet(num_vertices, NONE); // Meshlet the vertex last was added to
+  std::vector<uint8_t> emitted(num_triangles, 0);
+  std::vector<uint32_t> meshlet_vertices;
+  meshlet_vertices.reserve(Meshlet::MAX_VERTICES);
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+
+  size_t cursor = 0; // Seeds new meshlets in the original triangle order
+  while (true) {
+    while (cursor < num_triangles && emitted[cursor]) { cursor++; }
+    if (cursor == num_triangles) { break; }
+
+    const uint32_t id = uint32_t(meshlets.size());
+    Meshlet meshlet;
+    meshlet.first_index = uint32_t(output.size());
+    meshlet_vertices.clear();
+
+    uint32_t triangle = uint32_t(cursor);
+    size_t num_meshlet_triangles = 0;
+    while (triangle != NONE) {
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t v = indices[3 * triangle + k];
+        output.push_back(v);
+        if (vertex_meshlet[v] != id) {
+          vertex_meshlet[v] = id;
+          meshlet_vertices.push_back(v);
+        }
+      }
+      emitted[triangle] = 1;
+      if (++num_meshlet_triangles == Meshlet::MAX_TRIANGLES) { break; }
+
+      // Grow along the triangle adding the least new vertices, the meshlet ends when no neighbour fits
+      triangle = NONE;
+      size_t best_new_vertices = 4;
+      for (size_t i = 0; i < meshlet_vertices.size() && best_new_vertices > 0; i++) {
+        const uint32_t v = meshlet_vertices[i];
+        for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+          const uint32_t t = adjacency[j];
+          if (emitted[t]) { continue; }
+          size_t new_vertices = 0;
+          for (size_t k = 0; k < 3; k++) { new_vertices += vertex_meshlet[indices[3 * t + k]] != id; }
+          if (meshlet_vertices.size() + new_vertices > Meshlet::MAX_VERTICES) { continue; }
+          if (new_vertices < best_new_vertices) {
+            best_new_vertices = new_vertices;
+            triangle = t;
+            if (new_vertices == 0) { break; }
+          }
+        }
+      }
+    }
+
+    meshlet.num_indices = uint32_t(output.size()) - meshlet.first_index;
+    compute_meshlet_bounds(vertices, output.data() + meshlet.first_index, meshlet);
+    meshlets.push_back(meshlet);
+  }
+
+  indices.swap(output);
+  return meshlets;
+}
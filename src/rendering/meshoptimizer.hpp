@@ -0,0 +1,59 @@
+#pragma once
+#ifndef MEINEKRAFT_MESHOPTIMIZER_HPP
+#define MEINEKRAFT_MESHOPTIMIZER_HPP
+
+#include "primitives.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// Import time optimizations of indexed triangle meshes
+struct MeshOptimizer {
+  /// Size of the simulated FIFO post-transform vertex cache
+  static const uint32_t VERTEX_CACHE_SIZE = 16;
+
+  struct VertexCacheStatistics {
+    float acmr = 0.0f; // Average cache miss ratio, transformed vertices per triangle (0.5 best, 3.0 worst)
+    float atvr = 0.0f; // Average transformed vertex ratio, transformed vertices per vertex (1.0 best)
+  };
+
+  /// Simulates a FIFO vertex cache of cache_size vertices on the index buffer
+  static VertexCacheStatistics analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t num_vertices, uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+  /// Reorders the triangles for the post-transform vertex cache [Sander07, Tipsify]
+  static void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t num_vertices, uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+  /// Reorders the vertices in the order they are first referenced by the indices, unreferenced vertices are removed
+  static void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+  /// Geometric error budget of each simplified LOD relative to the largest extent of the mesh
+  static constexpr float LOD_TARGET_ERRORS[Mesh::MAX_LODS - 1] = {0.005f, 0.02f, 0.05f};
+
+  /// Simplifies the triangles by quadric error metric edge collapses until target_num_indices or target_error is reached [Garland97]
+  /// Vertices are never moved or added, the result indexes the same vertices. Borders and attribute seams are kept intact
+  /// Error is relative to the largest extent of the mesh
+  static std::vector<uint32_t> simplify(const Vertex* vertices, size_t num_vertices, const std::vector<uint32_t>& indices,
+                                        size_t target_num_indices, float target_error, float* result_error = nullptr);
+
+  /// Generates the chain of coarser LODs of the mesh, each half the triangles of the previous one within LOD_TARGET_ERRORS
+  static void generate_lods(Mesh& mesh, bool optimize_vertex_cache);
+
+  /// Partitions the triangles into clusters of at most Meshlet::MAX_VERTICES vertices and Meshlet::MAX_TRIANGLES triangles
+  /// Triangles are reordered such that each cluster is contiguous in the indices, clusters grow along shared vertices
+  static std::vector<Meshlet> build_meshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+  /// Quantizes the vertices into the packed layout, positions are normalized to the AABB containing them
+  static std::vector<PackedVertex> quantize_vertices(const std::vector<Vertex>& vertices, const AABB& aabb);
+
+  /// Extent used to dequantize positions within the AABB, never zero along an axis
+  static Vec3f quantization_extent(const AABB& aabb);
+
+  /// Octahedral encoding of a unit vector into [-1, 1]^2 [Cigolle14]
+  static Vec2f octahedral_encode(const Vec3f& direction);
+  static Vec3f octahedral_decode(const Vec2f& encoded);
+
+  /// IEEE 754 half precision float conversion
+  static uint16_t float_to_half(float value);
+};
+
+#endif // MEINEKRAFT_MESHOPTIMIZER_HPP
@@ -57,6 +57,15 @@ struct Vertex {
   }
 };
 
+/// Quantized vertex layout, 20 bytes compared to the 44 bytes of Vertex
+/// Dequantized in the vertex shaders (see shaders/vertex-unpacking-utils.glsl)
+struct PackedVertex {
+  uint16_t position[4]  = {}; // Unsigned normalized position within the mesh AABB, w is padding
+  int16_t normal[2]     = {}; // Signed normalized octahedral encoded normal
+  int16_t tangent[2]    = {}; // Signed normalized octahedral encoded tangent
+  uint16_t tex_coord[2] = {}; // Half floats
+};
+
 /// The name says it all really
 inline void hash_combine(size_t& seed, const size_t hash) {
   seed ^= hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
@@ -122,23 +131,145 @@ enum class MeshPrimitive: uint32_t {
   Cube, CubeCounterClockWinding, Sphere, Quad
 };
 
+/// Cluster of the triangles of a Mesh culled as a whole, its indices are contiguous in the indices of the Mesh
+/// NOTE: Mirrored in shaders/culling.comp.glsl (std430), 16 byte aligned
+struct Meshlet {
+  static const uint32_t MAX_VERTICES  = 64;
+  static const uint32_t MAX_TRIANGLES = 124;
+
+  Vec3f center;              // Bounding sphere in model space
+  float radius = 0.0f;
+  Vec3f cone_axis;           // Backface normal cone, all the triangle normals are within the cone
+  float cone_cutoff = 1.0f;  // Sine of the cone half angle, 1.0 means never backface culled
+  uint32_t first_index = 0;
+  uint32_t num_indices = 0;
+  uint32_t padding0 = 0;
+  uint32_t padding1 = 0;
+};
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout of the culling shader");
+
+/// Simplified level of detail of a Mesh indexing the same vertices as the Mesh
+struct MeshLod {
+  uint32_t first_index = 0; // Offset into the element buffer (indices followed by the LOD indices)
+  uint32_t num_indices = 0;
+  float error = 0.0f;       // Geometric error relative to the largest extent of the Mesh
+};
+
 struct Mesh {
+  /// Number of levels of detail including the full detail Mesh
+  static const uint32_t MAX_LODS = 4;
+
   std::vector<Vertex> vertices  = {};
   std::vector<uint32_t> indices = {};
 
+  /// Optional quantized copy of the vertices uploaded instead of the vertices (see PackedVertex)
+  std::vector<PackedVertex> packed_vertices = {};
+
+  /// Optional coarser levels of detail, their indices are stored one after another after the indices
+  std::vector<uint32_t> lod_indices = {};
+  std::vector<MeshLod> lods = {};
+
+  /// Optional clusters partitioning the indices (LOD 0)
+  std::vector<Meshlet> meshlets = {};
+
+  /// Non-owning view of vertex/index data owned by someone else (e.g a memory mapped mesh cache)
+  /// NOTE: Only used when the Mesh does not own any vertices, the owner must outlive the Mesh
+  struct {
+    const Vertex* vertices   = nullptr;
+    size_t num_vertices      = 0;
+    const uint32_t* indices  = nullptr;
+    size_t num_indices       = 0;
+    const PackedVertex* packed_vertices = nullptr; // Same number as vertices
+    const uint32_t* lod_indices = nullptr;
+    size_t num_lod_indices      = 0;
+  } view;
+
   Mesh() = default;
-  Mesh(const Mesh& mesh): vertices(mesh.vertices), indices(mesh.indices) {};
+  Mesh(const Mesh& mesh) = default;
+  Mesh(Mesh&& mesh) = default;
+  Mesh& operator=(const Mesh& mesh) = default;
+  Mesh& operator=(Mesh&& mesh) = default;
   Mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices): vertices(vertices), indices(indices) {};
 
+  /// Mesh viewing vertex/index data owned by someone else
+  static Mesh from_view(const Vertex* vertices, const size_t num_vertices, const uint32_t* indices, const size_t num_indices) {
+    Mesh mesh;
+    mesh.view.vertices = vertices;
+    mesh.view.num_vertices = num_vertices;
+    mesh.view.indices = indices;
+    mesh.view.num_indices = num_indices;
+    return mesh;
+  }
+
+  /// Vertices of the Mesh regardless of them being owned or viewed
+  inline const Vertex* vertex_data() const { return vertices.empty() ? view.vertices : vertices.data(); }
+  inline size_t num_vertices() const { return vertices.empty() ? view.num_vertices : vertices.size(); }
+
+  /// Quantized vertices of the Mesh regardless of them being owned or viewed, nullptr if there are none
+  inline const PackedVertex* packed_vertex_data() const { return packed_vertices.empty() ? view.packed_vertices : packed_vertices.data(); }
+  inline bool has_packed_vertices() const { return packed_vertex_data() != nullptr; }
+
+  /// Indices of the Mesh regardless of them being owned or viewed
+  inline const uint32_t* index_data() const { return indices.empty() ? view.indices : indices.data(); }
+  inline size_t num_indices() const { return indices.empty() ? view.num_indices : indices.size(); }
+
+  /// LOD indices of the Mesh regardless of them being owned or viewed
+  inline const uint32_t* lod_index_data() const { return lod_indices.empty() ? view.lod_indices : lod_indices.data(); }
+  inline size_t num_lod_indices() const { return lod_indices.empty() ? view.num_lod_indices : lod_indices.size(); }
+
+  /// Number of levels of detail including the full detail Mesh (LOD 0)
+  inline size_t num_lods() const { return 1 + lods.size(); }
+  inline MeshLod lod(const size_t level) const {
+    if (level == 0) { return MeshLod{0, uint32_t(num_indices()), 0.0f}; }
+    return lods[level - 1];
+  }
+
   /// Byte size of vertices to upload to OpenGL
   inline size_t byte_size_of_vertices() const {
-      return sizeof(Vertex) * vertices.size();
+      return sizeof(Vertex) * num_vertices();
+  }
+
+  /// Byte size of quantized vertices to upload to OpenGL
+  inline size_t byte_size_of_packed_vertices() const {
+      return has_packed_vertices() ? sizeof(PackedVertex) * num_vertices() : 0;
   }
 
   /// Byte size of indices to upload to OpenGL
   inline size_t byte_size_of_indices() const {
-      return sizeof(uint32_t) * indices.size();
+      return sizeof(uint32_t) * num_indices();
+  }
+
+  /// Byte size of the LOD indices to upload to OpenGL after the indices
+  inline size_t byte_size_of_lod_indices() const {
+      return sizeof(uint32_t) * num_lod_indices();
   }
+
+  /// True unless the vertices have been released (see release_vertex_data)
+  inline bool has_vertex_data() const { return vertex_data() != nullptr; }
+
+  /// Frees the vertices, indices and meshlets (owned or viewed) while keeping their counts and the LODs
+  /// NOTE: Used once the Mesh lives on the GPU, the data pointers are nullptr afterwards
+  void release_vertex_data() {
+    const size_t vertex_count = num_vertices();
+    const size_t index_count = num_indices();
+    const size_t lod_index_count = num_lod_indices();
+    std::vector<Vertex>().swap(vertices);
+    std::vector<uint32_t>().swap(indices);
+    std::vector<PackedVertex>().swap(packed_vertices);
+    std::vector<uint32_t>().swap(lod_indices);
+    std::vector<Meshlet>().swap(meshlets);
+    view = {};
+    view.num_vertices = vertex_count;
+    view.num_indices = index_count;
+    view.num_lod_indices = lod_index_count;
+  }
+};
+
+/// Placement of a Mesh by a node in the node hierarchy of a model file
+/// NOTE: Meshes referenced by several nodes are loaded once and instanced
+struct MeshInstance {
+  uint32_t mesh_idx = 0; // Index of the Mesh among the meshes of the model file
+  Mat4f transform;       // World transform of the node (same layout as the model matrices)
 };
 
 /// Unit cube
@@ -341,8 +472,15 @@ struct RenderState {
 
   struct {
     bool enabled = true;
+    bool clusters = true;      // Per meshlet frustum and backface culling of the visible instances
   } culling;
 
+  // Level of detail selection (performed by the culling pass)
+  struct {
+    bool enabled = true;
+    float pixel_error = 1.0f;  // Largest projected geometric error of a selected LOD in pixels
+  } lod;
+
   // Voxelization related (used by VCT pass)
   struct {
     bool always_voxelize = true;
@@ -439,6 +577,13 @@ struct DirectionalLight {
   }
 };
 
+// TODO: Remove, this is a sphere, call it and use it for what it is
+/// Bounding volume in the shape of a sphere
+struct BoundingVolume {
+  Vec3f position;      // Center position of the sphere         
+  float radius = 1.0f; // Computed by the MeshManager on load
+};
+
 struct AABB {
   float scaling_factor = 1.0f;
 	Vec3f max;
@@ -4,98 +4,123 @@
 #include "renderer.hpp"
 #include "../nodes/entity.hpp"
 #include "meshmanager.hpp"
+#include "texturemanager.hpp"
 
-namespace TextureManager {
-  static std::unordered_map<ID, RawTexture> textures{};
-};
+#include <chrono>
+#include <unordered_set>
 
 void RenderComponent::set_mesh(const std::string& directory, const std::string& file) {
   std::vector<std::pair<Texture::Type, std::string>> texture_info;
   std::tie(mesh_id, texture_info) = MeshManager::load_mesh(directory, file);
+  load_textures(texture_info);
+}
+
+void RenderComponent::set_texture(const Texture::Type texture_type, const Texture& texture) {
+  switch (texture_type) {
+    case Texture::Type::Diffuse:
+      diffuse_texture.data = texture.data;
+      diffuse_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY; // FIXME: Assumes texture format
+      diffuse_texture.id = texture.id;
+      break;
+    case Texture::Type::MetallicRoughness:
+      metallic_roughness_texture.data = texture.data;
+      metallic_roughness_texture.gl_texture_target = GL_TEXTURE_2D; // FIXME: Assumes texture format
+      metallic_roughness_texture.id = texture.id;
+      break;
+    case Texture::Type::AmbientOcclusion:
+      ambient_occlusion_texture.data = texture.data;
+      ambient_occlusion_texture.gl_texture_target = GL_TEXTURE_2D;
+      ambient_occlusion_texture.id = texture.id;
+      break;   
+    case Texture::Type::Emissive:
+      emissive_texture.data = texture.data;
+      emissive_texture.gl_texture_target = GL_TEXTURE_2D;
+      emissive_texture.id = texture.id;
+      break;
+    case Texture::Type::TangentNormal:
+      normal_texture.data = texture.data;
+      normal_texture.gl_texture_target = GL_TEXTURE_2D;
+      normal_texture.id = texture.id;
+      break;
+     default:
+      Log::warn("Tried to load unsupported texture: " + std::to_string(texture.id));
+  }
+}
+
+void RenderComponent::retain_textures() const {
+  for (const Texture* texture : textures()) {
+    if (texture->id != 0) { TextureManager::retain(texture->id); }
+  }
+}
+
+void RenderComponent::release_textures() const {
+  for (const Texture* texture : textures()) {
+    if (texture->id != 0) { TextureManager::release(texture->id); }
+  }
+}
+
+void RenderComponent::share_textures_with_instances(const std::vector<RenderComponent>& components, const std::vector<MeshInstance>& instances) {
+  std::vector<size_t> num_instances(components.size(), 0);
+  for (const MeshInstance& instance : instances) { num_instances[instance.mesh_idx]++; }
+  for (size_t i = 0; i < components.size(); i++) {
+    if (num_instances[i] == 0) { components[i].release_textures(); }
+    for (size_t j = 1; j < num_instances[i]; j++) { components[i].retain_textures(); }
+  }
+}
+
+/// Resource of the texture file encoded as textures of its type are
+static TextureResource resource_for(const std::pair<Texture::Type, std::string>& texture_info) {
+  TextureResource resource{texture_info.second};
+  resource.encoding = Texture::encoding_for(texture_info.first);
+  resource.is_sRGB = texture_info.first == Texture::Type::Diffuse; // NOTE: Only diffuse textures are uploaded as sRGB
+  return resource;
+}
+
+void RenderComponent::load_textures(const std::vector<std::pair<Texture::Type, std::string>>& texture_info) {
+  std::vector<TextureResource> resources;
   for (const auto& pair : texture_info) {
-    auto texture_type = pair.first;
-    auto texture_file = pair.second;
-    const auto resource = TextureResource{texture_file};
-    switch (texture_type) {
-      case Texture::Type::Diffuse:
-        diffuse_texture.data = Texture::load_textures(resource);
-        diffuse_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY; // FIXME: Assumes texture format
-        diffuse_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::MetallicRoughness:
-        metallic_roughness_texture.data = Texture::load_textures(resource);
-        metallic_roughness_texture.gl_texture_target = GL_TEXTURE_2D; // FIXME: Assumes texture format
-        metallic_roughness_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::AmbientOcclusion:
-        ambient_occlusion_texture.data = Texture::load_textures(resource);
-        ambient_occlusion_texture.gl_texture_target = GL_TEXTURE_2D;
-        ambient_occlusion_texture.id = resource.to_hash();
-        break;   
-      case Texture::Type::Emissive:
-        emissive_texture.data = Texture::load_textures(resource);
-        emissive_texture.gl_texture_target = GL_TEXTURE_2D;
-        emissive_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::TangentNormal:
-        normal_texture.data = Texture::load_textures(resource);
-        normal_texture.gl_texture_target = GL_TEXTURE_2D;
-        normal_texture.id = resource.to_hash();
-        break;
-       default:
-        Log::warn("Tried to load unsupported texture: " + texture_file);
-    }
+    resources.push_back(resource_for(pair));
+  }
+  const std::vector<Texture> textures = TextureManager::load(resources);
+  for (size_t i = 0; i < texture_info.size(); i++) {
+    set_texture(texture_info[i].first, textures[i]);
   }
 }
 
 std::vector<RenderComponent> 
-RenderComponent::load_scene_models(const std::string& directory, const std::string& file) {
+RenderComponent::load_scene_models(const std::string& directory, const std::string& file, std::vector<MeshInstance>* instances) {
   std::vector<RenderComponent> render_components;
 
   std::vector<std::vector<std::pair<Texture::Type, std::string>>> texture_infos;
   std::vector<ID> mesh_ids;
-  std::tie(mesh_ids, texture_infos) = MeshManager::load_meshes(directory, file);
-    
+  std::tie(mesh_ids, texture_infos) = MeshManager::load_meshes(directory, file, instances);
+
+  // NOTE: Every texture of the scene is loaded at once in order to keep all the decode threads busy
+  // Textures shared between meshes are decoded once (see TextureManager)
+  std::vector<TextureResource> resources;
+  for (const auto& texture_info : texture_infos) {
+    for (const auto& pair : texture_info) {
+      resources.push_back(resource_for(pair));
+    }
+  }
+  const auto start = std::chrono::high_resolution_clock::now();
+  const std::vector<Texture> textures = TextureManager::load(resources);
+  const auto end = std::chrono::high_resolution_clock::now();
+  if (!resources.empty()) {
+    std::unordered_set<ID> unique_ids;
+    for (const Texture& texture : textures) { unique_ids.insert(texture.id); }
+    Log::info_indent(1, "Loaded " + std::to_string(resources.size()) + " textures (" + std::to_string(unique_ids.size()) + " unique) in " +
+                        std::to_string(std::chrono::duration<double, std::milli>(end - start).count()) + " ms");
+  }
+
+  size_t texture_idx = 0;
   for (size_t i = 0; i < mesh_ids.size(); i++) {
     RenderComponent render_component;
     render_component.mesh_id = mesh_ids[i];
-
-    // Load textures
     for (const auto& pair : texture_infos[i]) {
-      auto texture_type = pair.first;
-      auto texture_file = pair.second;
-      const auto resource = TextureResource{ texture_file };
-      switch (texture_type) {
-      case Texture::Type::Diffuse:
-        render_component.diffuse_texture.data = Texture::load_textures(resource);
-        render_component.diffuse_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY; // FIXME: Assumes texture format
-        render_component.diffuse_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::MetallicRoughness:
-        render_component.metallic_roughness_texture.data = Texture::load_textures(resource);
-        render_component.metallic_roughness_texture.gl_texture_target = GL_TEXTURE_2D; // FIXME: Assumes texture format
-        render_component.metallic_roughness_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::AmbientOcclusion:
-        render_component.ambient_occlusion_texture.data = Texture::load_textures(resource);
-        render_component.ambient_occlusion_texture.gl_texture_target = GL_TEXTURE_2D;
-        render_component.ambient_occlusion_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::Emissive:
-        render_component.emissive_texture.data = Texture::load_textures(resource);
-        render_component.emissive_texture.gl_texture_target = GL_TEXTURE_2D;
-        render_component.emissive_texture.id = resource.to_hash();
-        break;
-      case Texture::Type::TangentNormal:
-        render_component.normal_texture.data = Texture::load_textures(resource);
-        render_component.normal_texture.gl_texture_target = GL_TEXTURE_2D;
-        render_component.normal_texture.id = resource.to_hash();
-        break;
-      default:
-        Log::warn("Tried to load unsupported texture: " + texture_file);
-      }
+      render_component.set_texture(pair.first, textures[texture_idx]);
+      texture_idx++;
     }
-
     render_components.push_back(render_component);
   }
 
@@ -106,12 +131,8 @@ void RenderComponent::set_cube_map_texture(const std::array<std::string, 6>& fac
   // FIXME: Assumes the diffuse texture?
   std::vector<std::string> rsrcs(faces.size());
   std::copy(faces.begin(), faces.end(), rsrcs.begin());
-  const auto resource = TextureResource{rsrcs};
-  diffuse_texture.id = resource.to_hash();
-  diffuse_texture.data = TextureManager::textures[diffuse_texture.id];
+  auto resource = TextureResource{rsrcs};
+  resource.is_sRGB = true;
+  diffuse_texture = TextureManager::load(resource);
   diffuse_texture.gl_texture_target = GL_TEXTURE_CUBE_MAP_ARRAY;
-  if (!diffuse_texture.data.pixels) {
-    TextureManager::textures[diffuse_texture.id] = Texture::load_textures(resource);
-    Log::info("Loading new cube map textures with id:" + std::to_string(diffuse_texture.id));
-  }
 }
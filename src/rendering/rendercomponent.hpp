@@ -5,6 +5,8 @@
 #include "primitives.hpp"
 #include "texture.hpp"
 
+#include <array>
+
 /// RenderComponents is the visual representation of a Entity.
 /// All of the configurations that are supported by the engine is provided
 /// with this struct and attached to a Entity. The Renderer will then determine
@@ -26,8 +28,32 @@ struct RenderComponent {
   /// Loads and sets the relevant textures from the loaded material in the model
   void set_mesh(const std::string& directory, const std::string& file);
 
-  /// Loads all meshes in a file and returns multiple RenderComponents
-  static std::vector<RenderComponent> load_scene_models(const std::string& directory, const std::string& file);
+  /// Loads and sets the textures of the material of a mesh, decoded in parallel unless already loaded (blocking)
+  void load_textures(const std::vector<std::pair<Texture::Type, std::string>>& texture_info);
+
+  /// Sets the texture (see TextureManager) as the texture of the type
+  void set_texture(const Texture::Type texture_type, const Texture& texture);
+
+  /// Every texture of the component, loaded or not
+  std::array<const Texture*, 5> textures() const {
+    return {&diffuse_texture, &metallic_roughness_texture, &ambient_occlusion_texture, &emissive_texture, &normal_texture};
+  }
+
+  /// Adds a reference to each loaded texture, every copy of the RenderComponent handed to the Renderer holds one
+  /// NOTE: The Renderer confirms the upload of each reference after which the pixels might be released (see TextureManager)
+  void retain_textures() const;
+
+  /// Releases the reference to each loaded texture
+  void release_textures() const;
+
+  /// Hands the references of the loaded textures of each component (see load_scene_models) to its first instance and adds
+  /// one for every other instance, the textures of components without instances are released
+  /// NOTE: Every instance then holds exactly one reference which is confirmed once uploaded (see TextureManager::uploaded)
+  static void share_textures_with_instances(const std::vector<RenderComponent>& components, const std::vector<MeshInstance>& instances);
+
+  /// Loads all meshes in a file and returns a RenderComponent per mesh
+  /// Fills instances (if given) with the placement of the meshes by the nodes of the file (see MeshInstance)
+  static std::vector<RenderComponent> load_scene_models(const std::string& directory, const std::string& file, std::vector<MeshInstance>* instances = nullptr);
 
   /// Sets the cube map texture to the bounded mesh
   /// order; right, left, top, bot, back, front
@@ -15,6 +15,9 @@
 #include "../nodes/entity.hpp"
 
 #include "../util/filesystem.hpp"
+#include "../util/jobsystem.hpp"
+#include "../util/profiler.hpp"
+#include "../util/simd.hpp"
 
 #include "renderpass/downsample_pass.hpp"
 #include "renderpass/gbuffer_pass.hpp"
@@ -29,10 +32,16 @@
 #include "renderpass/bilateral_upsampling_pass.hpp"
 
 #include "camera.hpp"
+#include "clusterculling.hpp"
 #include "debug_opengl.hpp"
+#include "drawbuffers.hpp"
 #include "graphicsbatch.hpp"
 #include "meshmanager.hpp"
+#include "meshoptimizer.hpp"
 #include "rendercomponent.hpp"
+#include "texturemanager.hpp"
+#include "texturestreamer.hpp"
+#include "texturearrayallocator.hpp"
 
 #include <glm/common.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -80,18 +89,17 @@ uint32_t Renderer::get_next_free_image_unit(bool peek) {
 }
 
 void Renderer::load_environment_map(const std::array<std::string, 6>& faces) {
-  Texture texture;
   const auto resource = TextureResource{{faces[0], faces[1], faces[2], faces[3], faces[4], faces[5]}};
-  texture.data = Texture::load_textures(resource);
+  Texture texture = TextureManager::load(resource);
   if (texture.data.pixels) {
     texture.gl_texture_target = GL_TEXTURE_CUBE_MAP_ARRAY;
-    texture.id = resource.to_hash();
 
     // TODO: Environment map support
     Log::info("Image based lighting is not implemented");
   } else {
     Log::warn("Could not load environment map");
   }
+  TextureManager::release(texture.id);
 }
 
 // NOTE: AABB passed is assumed to be the Scene AABB
@@ -148,9 +156,17 @@ std::vector<AABB> generate_clipmaps_from_scene_aabb(const AABB& scene,
   return clipmaps;
 }
 
-Renderer::~Renderer() = default;
+Renderer::~Renderer() {
+  delete texture_streamer;
+  delete texture_arrays;
+  delete draw_buffers;
+}
 
 Renderer::Renderer(const Resolution& screen): screen(screen), graphics_batches{} {
+  texture_streamer = new TextureStreamer();
+  texture_arrays = new TextureArrayAllocator();
+  draw_buffers = new DrawBuffers();
+
   // Rendergraph construction and setup
   gbuffer_pass = new GbufferRenderPass();
   downsample_pass = new DownsampleRenderPass();
@@ -229,6 +245,11 @@ static Mat4f perspective(const float fovy, const Resolution& screen, const float
 }
 
 bool Renderer::init() {
+  update_clipmaps();
+  return true;
+}
+
+void Renderer::update_clipmaps() {
   const std::vector<AABB> aabbs = generate_clipmaps_from_scene_aabb(scene->aabb, NUM_CLIPMAPS);
   for (size_t i = 0; i < NUM_CLIPMAPS; i++) {
     clipmaps.aabb[i] = aabbs[i];
@@ -240,7 +261,6 @@ bool Renderer::init() {
     Log::info("Voxel size: "    + std::to_string(aabbs[i].max_axis() / clipmaps.size[i]));
     Log::info("Voxel d^3: "     + std::to_string(clipmaps.size[i]));
   }
-  return true;
 }
 
 void Renderer::render(const uint32_t delta) {
@@ -257,12 +277,10 @@ void Renderer::render(const uint32_t delta) {
 
   camera_transform = projection_matrix * scene->camera.transform(); // TODO: Camera handling needs to be reworked
 
-  /// Renderer caches the transforms of components thus we need to fetch the ones who changed during the last frame
-  // FIXME: This is a bad design?
-  // update_transforms();
-  TransformSystem::instance().reset_dirty();
+  texture_streamer->update(*this);
 
-  static GLsync syncs[3] = {nullptr, nullptr, nullptr};
+  // NOTE: Once the frame of the partition is done its draw commands and copy of the instance buffers are rewritten (see DrawBuffers)
+  static GLsync syncs[DrawBuffers::NUM_PARTITIONS] = {nullptr, nullptr, nullptr};
 
   if (syncs[state.frame % 3]) {
     while (true) {
@@ -271,17 +289,13 @@ void Renderer::render(const uint32_t delta) {
     }
   }
 
-  // Update all ptr indices in all of the batches
-  for (size_t i = 0; i < graphics_batches.size(); i++) {
-    auto& batch = graphics_batches[i];
-    batch.gl_curr_ibo_idx = state.frame % batch.gl_ibo_count;
-  }
+  /// Renderer caches the transforms of components thus the ones who changed during the last frame are reuploaded
+  update_transforms();
+  TransformSystem::instance().reset_dirty();
 
-  // Reset the draw commands
-  for (size_t i = 0; i < graphics_batches.size(); i++) {
-    const auto& batch = graphics_batches[i];
-    ((DrawElementsIndirectCommand*)batch.gl_ibo_ptr)[batch.gl_curr_ibo_idx].instanceCount = 0;
-  }
+  // Draw commands of the batches added or removed since the last frame, reset in the partition of the frame
+  draw_buffers->update_draw_order(graphics_batches);
+  draw_buffers->begin_frame(state.frame);
 
   if (state.culling.enabled) {
     view_frustum_culling_pass->render(this);
@@ -354,350 +368,459 @@ void Renderer::render(const uint32_t delta) {
 }
 
 void Renderer::link_batch(GraphicsBatch& batch) {
-  /// Geometry pass setup
-  {
-    /// Shaderbindings
-    const auto program = batch.depth_shader.gl_program;
-    glUseProgram(program);
-
-    glUniform1i(glGetUniformLocation(program, "diffuse"), batch.gl_diffuse_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "pbr_parameters"), batch.gl_metallic_roughness_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "emissive"), batch.gl_emissive_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "tangent_normal"), batch.gl_tangent_normal_texture_unit);
-
-    glGenVertexArrays(1, &batch.gl_depth_vao);
-    glBindVertexArray(batch.gl_depth_vao);
-
-    glGenBuffers(1, &batch.gl_depth_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_depth_vbo);
-    glBufferData(GL_ARRAY_BUFFER, batch.mesh->byte_size_of_vertices(), batch.mesh->vertices.data(), GL_STATIC_DRAW);
-    glObjectLabel(GL_BUFFER, batch.gl_depth_vbo, -1, "Batch gl_depth_vbo");
-
-    // Element buffer
-    glGenBuffers(1, &batch.gl_ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.gl_ebo);
-    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, batch.mesh->byte_size_of_indices(), batch.mesh->indices.data(), 0);
-    glObjectLabel(GL_BUFFER, batch.gl_ebo, -1, "Elements SSBO");
-
-    const auto position_attrib = glGetAttribLocation(program, "position");
-    glVertexAttribPointer(position_attrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *) offsetof(Vertex, position));
-    glEnableVertexAttribArray(position_attrib);
-
-    const auto normal_attrib = glGetAttribLocation(program, "normal");
-    glVertexAttribPointer(normal_attrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *) offsetof(Vertex, normal));
-    glEnableVertexAttribArray(normal_attrib);
-
-    const auto texcoord_attrib = glGetAttribLocation(program, "texcoord");
-    glVertexAttribPointer(texcoord_attrib, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *) offsetof(Vertex, tex_coord));
-    glEnableVertexAttribArray(texcoord_attrib);
-
-    const auto tangent_attrib = glGetAttribLocation(program, "tangent");
-    glVertexAttribPointer(tangent_attrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, tangent));
-    glEnableVertexAttribArray(tangent_attrib);
-
-    const auto flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
-
-    // Bounding volume buffer
-    glGenBuffers(1, &batch.gl_bounding_volume_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.gl_bounding_volume_buffer);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(BoundingVolume), nullptr, flags);
-    batch.gl_bounding_volume_buffer_ptr = (uint8_t*) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(BoundingVolume), flags);
-    glObjectLabel(GL_BUFFER, batch.gl_bounding_volume_buffer, -1, "BoundingVolume SSBO");
-
-    // Buffer for all the model matrices
-    glGenBuffers(1, &batch.gl_depth_model_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.gl_depth_model_buffer);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(Mat4f), nullptr, flags);
-    batch.gl_depth_model_buffer_ptr = (uint8_t*) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(Mat4f), flags);
-    glObjectLabel(GL_BUFFER, batch.gl_depth_model_buffer, -1, "Model SSBO");
-
-    // Material buffer
-    glGenBuffers(1, &batch.gl_material_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.gl_material_buffer);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(Material), nullptr, flags);
-    batch.gl_material_buffer_ptr = (Material*) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(Material), flags);
-    glObjectLabel(GL_BUFFER, batch.gl_material_buffer, -1, "Material SSBO");
-
-    // Setup GL_DRAW_INDIRECT_BUFFER for indirect drawing (basically a command buffer)
-    glGenBuffers(1, &batch.gl_ibo);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch.gl_ibo);
-    glBufferStorage(GL_DRAW_INDIRECT_BUFFER, batch.gl_ibo_count * sizeof(DrawElementsIndirectCommand), nullptr, flags);
-    batch.gl_ibo_ptr = (uint8_t*) glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, batch.gl_ibo_count * sizeof(DrawElementsIndirectCommand), flags);
-    glObjectLabel(GL_BUFFER, batch.gl_ibo, -1, "Draw Cmd SSBO");
-
-    // Batch instance idx buffer
-    glGenBuffers(1, &batch.gl_instance_idx_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.gl_instance_idx_buffer);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER, GraphicsBatch::INIT_BUFFER_SIZE * sizeof(GLuint), nullptr, 0);
-    glObjectLabel(GL_BUFFER, batch.gl_instance_idx_buffer, -1, "Instance idx SSBO");
-
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_instance_idx_buffer);
-    glVertexAttribIPointer(glGetAttribLocation(program, "instance_idx"), 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "instance_idx"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "instance_idx"), 1);
-  }
-
-  /// Shadowmap pass setup
-  {
-    const auto program = shadow_pass->shadowmapping_shader->gl_program;
-    glUseProgram(program);
+  // NOTE: The program is shared with the other batches of the same defines thus its texture units are set when drawn (see GbufferRenderPass)
+
+  // NOTE: Batches of the same Mesh share its geometry since the Mesh no longer has it on the CPU once uploaded
+  MeshManager::retain(batch.mesh_id);
+  const auto uploaded = mesh_geometries.find(batch.mesh_id);
+  if (uploaded != mesh_geometries.end()) {
+    MeshGeometry& geometry = uploaded->second;
+    geometry.num_batches++;
+    batch.vertex_format.packed = geometry.packed;
+    batch.vertex_format.position_min = geometry.position_min;
+    batch.vertex_format.position_extent = geometry.position_extent;
+    batch.base_vertex = geometry.base_vertex;
+    batch.first_index = geometry.first_index;
+    batch.num_clusters = geometry.num_clusters;
+    batch.first_cluster = geometry.first_cluster;
+  } else {
+    // NOTE: The quantized vertices are uploaded instead of the full vertices when imported with them
+    const uint32_t num_vertices = uint32_t(batch.mesh->num_vertices());
+    batch.vertex_format.packed = batch.mesh->has_packed_vertices();
+    if (batch.vertex_format.packed) {
+      const AABB aabb = MeshManager::aabb_from_id(batch.mesh_id);
+      batch.vertex_format.position_min = aabb.min;
+      batch.vertex_format.position_extent = MeshOptimizer::quantization_extent(aabb);
+      batch.base_vertex = draw_buffers->add_vertices(true, batch.mesh->packed_vertex_data(), num_vertices);
+    } else {
+      batch.base_vertex = draw_buffers->add_vertices(false, batch.mesh->vertex_data(), num_vertices);
+    }
 
-    glGenVertexArrays(1, &batch.gl_shadowmapping_vao);
-    glBindVertexArray(batch.gl_shadowmapping_vao);
+    // The indices followed by the indices of the coarser LODs, relative to the base vertex
+    const uint32_t num_indices = uint32_t(batch.mesh->num_indices() + batch.mesh->num_lod_indices());
+    batch.first_index = draw_buffers->allocate_indices(num_indices);
+    draw_buffers->write_indices(batch.first_index, batch.mesh->index_data(), uint32_t(batch.mesh->num_indices()));
+    if (batch.mesh->num_lod_indices() > 0) {
+      draw_buffers->write_indices(batch.first_index + uint32_t(batch.mesh->num_indices()), batch.mesh->lod_index_data(),
+                                  uint32_t(batch.mesh->num_lod_indices()));
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_depth_vbo);   // Reuse geometry
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.gl_ebo); // Reuse indices
+    // Meshlets, one culling invocation per meshlet and instance within the cluster capacity (see GraphicsBatch)
+    const size_t MAX_CLUSTERS = 65535;
+    if (!batch.mesh->meshlets.empty() && batch.mesh->meshlets.size() <= MAX_CLUSTERS) {
+      batch.num_clusters = uint32_t(batch.mesh->meshlets.size());
+      batch.first_cluster = draw_buffers->add_clusters(batch.mesh->meshlets.data(), batch.num_clusters);
+    } else if (!batch.mesh->meshlets.empty()) {
+      Log::warn("Mesh " + std::to_string(batch.mesh_id) + " has too many meshlets to be culled, drawn as a whole");
+    }
 
-    glVertexAttribPointer(glGetAttribLocation(program, "position"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *) offsetof(Vertex, position));
-    glEnableVertexAttribArray(glGetAttribLocation(program, "position"));
-    
-    // Batch instance idx buffer
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_instance_idx_buffer);
-    glVertexAttribIPointer(glGetAttribLocation(program, "instance_idx"), 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "instance_idx"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "instance_idx"), 1);
+    MeshManager::release_vertex_data(batch.mesh_id);
+
+    // NOTE: Holds a reference to the Mesh until the last batch of the Mesh is removed (see unlink_batch)
+    MeshManager::retain(batch.mesh_id);
+    MeshGeometry& geometry = mesh_geometries[batch.mesh_id];
+    geometry.packed = batch.vertex_format.packed;
+    geometry.position_min = batch.vertex_format.position_min;
+    geometry.position_extent = batch.vertex_format.position_extent;
+    geometry.base_vertex = batch.base_vertex;
+    geometry.num_vertices = num_vertices;
+    geometry.first_index = batch.first_index;
+    geometry.num_indices = num_indices;
+    geometry.num_clusters = batch.num_clusters;
+    geometry.first_cluster = batch.first_cluster;
+    geometry.num_batches = 1;
+  }
+
+  // LOD errors are relative to the mesh extent while the culling pass measures them relative to the bounding volume
+  batch.num_lods = uint32_t(batch.mesh->num_lods());
+  const float mesh_extent = MeshManager::aabb_from_id(batch.mesh_id).max_axis();
+  for (size_t lod = 0; lod < batch.num_lods; lod++) {
+    batch.lod_errors[lod] = batch.mesh->lod(lod).error * mesh_extent / batch.bounding_volume.radius;
   }
+}
 
-  /// Voxelization pass setup
-  {
-    const auto program = voxelization_pass->shader->gl_program;
-    glUseProgram(program);
+void Renderer::unlink_batch(const GraphicsBatch& batch) {
+  const auto uploaded = mesh_geometries.find(batch.mesh_id);
+  if (uploaded == mesh_geometries.end() || --uploaded->second.num_batches > 0) { return; }
+
+  // NOTE: The ranges are reused once the frames in flight drawing them are done
+  const MeshGeometry& geometry = uploaded->second;
+  draw_buffers->release_vertices(geometry.packed, geometry.base_vertex, geometry.num_vertices);
+  draw_buffers->release_indices(geometry.first_index, geometry.num_indices);
+  draw_buffers->release_clusters(geometry.first_cluster, geometry.num_clusters);
+  mesh_geometries.erase(uploaded);
+  MeshManager::release(batch.mesh_id);
+}
 
-    glGenVertexArrays(1, &batch.gl_voxelization_vao);
-    glBindVertexArray(batch.gl_voxelization_vao);
+/// Uploads the texture to a new 2D texture bound to the texture unit as is with its prebuilt mips (see TextureEncoder),
+/// returns its residency
+/// NOTE: Streamed textures hold the levels from their tail on (see RawTexture::base_level), the tail is GL level 0
+static TextureResidency upload_texture_2d(const Texture& texture, const uint32_t gl_texture_unit, uint32_t& gl_texture) {
+  const TextureResidency residency = TextureStreamer::residency_of(texture, gl_internal_format(texture.data, false));
+  gl_texture = TextureStreamer::create_storage(residency, residency.base_level, 1, gl_texture_unit);
+  for (uint32_t level = residency.base_level; level < residency.num_levels; level++) {
+    TextureStreamer::upload_level(residency, level, 0, texture.data.pixels + TextureEncoder::level_offset(texture.data, level));
+  }
+  return residency;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_depth_vbo);   // Reuse geometry
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.gl_ebo); // Reuse indices
+/// Confirms the upload of every texture reference of the component, their pixels are no longer read (see TextureManager)
+static void textures_uploaded(const RenderComponent& comp) {
+  for (const Texture* texture : comp.textures()) {
+    if (texture->id != 0) { TextureManager::uploaded(texture->id); }
+  }
+}
+
+void Renderer::add_component(const RenderComponent comp, const ID entity_id) {
+  Material material;
+  const size_t batch_idx = batch_of(comp, material);
+  if (batch_idx == NO_BATCH) {
+    textures_uploaded(comp); // Never uploaded but no longer read either
+    return;
+  }
+  add_graphics_state(batch_idx, comp, material, entity_id);
+  textures_uploaded(comp);
+}
 
-    glVertexAttribPointer(glGetAttribLocation(program, "position"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, position));
-    glEnableVertexAttribArray(glGetAttribLocation(program, "position"));
+void Renderer::add_components(const std::vector<RenderComponent>& comps, const std::vector<ID>& entity_ids) {
+  // Batches of every component first such that each batch is grown at most once
+  std::vector<size_t> comp_batch_idxs(comps.size());
+  std::vector<Material> materials(comps.size());
+  for (size_t i = 0; i < comps.size(); i++) {
+    comp_batch_idxs[i] = batch_of(comps[i], materials[i]);
+  }
 
-    glVertexAttribPointer(glGetAttribLocation(program,"normal"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(glGetAttribLocation(program, "normal"));
+  std::vector<uint32_t> num_added(graphics_batches.size(), 0);
+  for (const size_t batch_idx : comp_batch_idxs) {
+    if (batch_idx != NO_BATCH) { num_added[batch_idx]++; }
+  }
+  for (size_t batch_idx = 0; batch_idx < graphics_batches.size(); batch_idx++) {
+    if (num_added[batch_idx] > 0) { reserve_entities(batch_idx, uint32_t(graphics_batches[batch_idx].entity_ids.size()) + num_added[batch_idx]); }
+  }
 
-    glVertexAttribPointer(glGetAttribLocation(program, "texcoord"), 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, tex_coord));
-    glEnableVertexAttribArray(glGetAttribLocation(program, "texcoord"));
-    
-    // Batch instance idx buffer
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_instance_idx_buffer);
-    glVertexAttribIPointer(glGetAttribLocation(program, "instance_idx"), 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "instance_idx"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "instance_idx"), 1);
+  for (size_t i = 0; i < comps.size(); i++) {
+    if (comp_batch_idxs[i] != NO_BATCH) { add_graphics_state(comp_batch_idxs[i], comps[i], materials[i], entity_ids[i]); }
+    textures_uploaded(comps[i]);
   }
 }
 
-void Renderer::add_component(const RenderComponent comp, const ID entity_id) {
+size_t Renderer::batch_of(const RenderComponent& comp, Material& material) {
   // Handle the config of the Shader from the component
-  std::set<Shader::Defines> comp_shader_config;
-  Material material;
+  uint32_t comp_shader_config = 0; // Mask of Shader::Defines
 
   if (comp.diffuse_texture.data.pixels) {
     switch (comp.diffuse_texture.gl_texture_target) {
     case GL_TEXTURE_2D_ARRAY:
-      comp_shader_config.insert(Shader::Defines::Diffuse2D);
+      comp_shader_config |= Shader::bit(Shader::Defines::Diffuse2D);
       break;
     case GL_TEXTURE_CUBE_MAP_ARRAY:
-      comp_shader_config.insert(Shader::Defines::DiffuseCubemap);
+      comp_shader_config |= Shader::bit(Shader::Defines::DiffuseCubemap);
       break;
     default:
       Log::error("Depth shader diffuse texture type not handled.");
-      return;
+      return NO_BATCH;
     }
 
     if (comp.diffuse_texture.data.bytes_per_pixel == 3) {
-      comp_shader_config.insert(Shader::Defines::DiffuseRGB);
+      comp_shader_config |= Shader::bit(Shader::Defines::DiffuseRGB);
     } else {
-      comp_shader_config.insert(Shader::Defines::DiffuseRGBA);
+      comp_shader_config |= Shader::bit(Shader::Defines::DiffuseRGBA);
     }
   } else if (comp.diffuse_scalars != Vec3f::zero()) {
-    comp_shader_config.insert(Shader::Defines::DiffuseScalars);
+    comp_shader_config |= Shader::bit(Shader::Defines::DiffuseScalars);
     material.diffuse_scalars = comp.diffuse_scalars;
   }
 
   if (comp.emissive_texture.data.pixels) {
-    comp_shader_config.insert(Shader::Defines::Emissive);
+    comp_shader_config |= Shader::bit(Shader::Defines::Emissive);
   } else if (comp.emissive_scalars != Vec3f::zero()) {
-    comp_shader_config.insert(Shader::Defines::EmissiveScalars);
+    comp_shader_config |= Shader::bit(Shader::Defines::EmissiveScalars);
     material.emissive_scalars = comp.emissive_scalars;
   }
 
+  if (comp.normal_texture.data.format == BlockFormat::BC5) {
+    comp_shader_config |= Shader::bit(Shader::Defines::TangentNormalsRG);
+  }
+
   // TODO: Tangent normals state 
   // if (comp.normal_texture.data.pixels) {
-  //   comp_shader_config.insert(Shader::Defines:Emissive:TangentNormals);
+  //   comp_shader_config |= Shader::bit(Shader::Defines::TangentNormals);
   // }
 
-  // Shader configuration and mesh id defines the uniqueness of a GBatch
-  // FIXME: Does not take every texture into account ...
-  for (auto& batch : graphics_batches) {
-    if (batch.mesh_id != comp.mesh_id) { continue; }
-    if (comp_shader_config != batch.depth_shader.defines) { continue; }
-    if (comp.diffuse_texture.data.pixels) {
-      const bool batch_contains_texture = batch.layer_idxs.count(comp.diffuse_texture.id) != 0;
-      if (batch_contains_texture) {
-        material.diffuse_layer_idx = batch.layer_idxs[comp.diffuse_texture.id];
-      } else {
-        const bool is_sRGB = true; // FIXME: Assumes that diffuse textures are sRGB due to glTF2 material model
-
-        /// Expand texture buffer if needed
-        if (batch.diffuse_textures_count + 1 > batch.diffuse_textures_capacity) {
-          batch.expand_texture_buffer(comp.diffuse_texture, &batch.gl_diffuse_texture_array, &batch.diffuse_textures_capacity, batch.gl_diffuse_texture_unit, is_sRGB);
-        }
-
-        /// Update the mapping from texture id to layer idx and increment count
-        batch.layer_idxs[comp.diffuse_texture.id] = batch.diffuse_textures_count++;
-        material.diffuse_layer_idx = batch.layer_idxs[comp.diffuse_texture.id];
-
-        /// Upload the texture to OpenGL
-        batch.upload(comp.diffuse_texture, batch.gl_diffuse_texture_unit, batch.gl_diffuse_texture_array);
-      }
-    }
-    add_graphics_state(batch, comp, material, entity_id);
-    return;
+  // Diffuse textures are layers of arrays shared between the batches, uploaded once on first use (see TextureArrayAllocator)
+  const uint32_t next_free_texture_unit = get_next_free_texture_unit(true);
+  uint32_t diffuse_array = TextureArrayAllocator::NO_ARRAY;
+  if (comp.diffuse_texture.data.pixels) {
+    const bool is_sRGB = true; // FIXME: Assumes that diffuse textures are sRGB due to glTF2 material model
+    std::tie(diffuse_array, material.diffuse_layer_idx) = texture_arrays->add(comp.diffuse_texture, is_sRGB, next_free_texture_unit);
   }
 
+  // Shader configuration, mesh id and diffuse array defines the uniqueness of a GBatch
+  // FIXME: Does not take every texture into account ...
+  const GraphicsBatchKey key{comp.mesh_id, comp_shader_config, diffuse_array};
+  const auto batch_idx = batch_idxs.find(key);
+  if (batch_idx != batch_idxs.end()) { return batch_idx->second; }
+
   GraphicsBatch batch{comp.mesh_id};
 
   /// Batch shader prepass (depth pass) shader creation process
+  /// NOTE: Shared with the batches of the same defines, compiled once per defines at most (see ShaderCache)
   batch.depth_shader = Shader{ Filesystem::base + "shaders/geometry.vert", Filesystem::base + "shaders/geometry.frag" };
   batch.depth_shader.defines = comp_shader_config;
+  batch.depth_shader.add(Filesystem::read_file(Filesystem::base + "shaders/vertex-unpacking-utils.glsl"));
 
   std::string err_msg;
   bool success;
   std::tie(success, err_msg) = batch.depth_shader.compile();
   if (!success) {
     Log::error("Shader compilation failed; " + err_msg);
-    return;
+    return NO_BATCH;
   }
 
-  const uint32_t next_free_texture_unit = get_next_free_texture_unit(true);
-  if (comp.diffuse_texture.data.pixels) {
-    batch.gl_diffuse_texture_unit = next_free_texture_unit;
-
-    const bool is_sRGB = true; // FIXME: Assumes that diffuse textures are in sRGB
-    batch.init_buffer(comp.diffuse_texture, &batch.gl_diffuse_texture_array, batch.gl_diffuse_texture_unit, &batch.diffuse_textures_capacity, is_sRGB);
-
-    /// Update the mapping from texture id to layer idx and increment count
-    batch.layer_idxs[comp.diffuse_texture.id] = batch.diffuse_textures_count++;
-    material.diffuse_layer_idx = batch.layer_idxs[comp.diffuse_texture.id];
-
-    /// Upload the texture to OpenGL
-    batch.upload(comp.diffuse_texture, batch.gl_diffuse_texture_unit, batch.gl_diffuse_texture_array);
-  }
+  batch.diffuse_array = diffuse_array;
+  batch.gl_diffuse_texture_unit = next_free_texture_unit;
 
   if (comp.metallic_roughness_texture.data.pixels) {
-    const Texture& texture = comp.metallic_roughness_texture;
     batch.gl_metallic_roughness_texture_unit = next_free_texture_unit + 1;
-    glActiveTexture(GL_TEXTURE0 + batch.gl_metallic_roughness_texture_unit);
-    glGenTextures(1, &batch.gl_metallic_roughness_texture);
-    glBindTexture(texture.gl_texture_target, batch.gl_metallic_roughness_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    batch.residency(TextureSlot::MetallicRoughness) = upload_texture_2d(comp.metallic_roughness_texture, batch.gl_metallic_roughness_texture_unit, batch.gl_metallic_roughness_texture);
   }
 
   if (comp.normal_texture.data.pixels) {
-    const Texture& texture = comp.normal_texture;
     batch.gl_tangent_normal_texture_unit = next_free_texture_unit + 2;
-    glActiveTexture(GL_TEXTURE0 + batch.gl_tangent_normal_texture_unit);
-    glGenTextures(1, &batch.gl_tangent_normal_texture);
-    glBindTexture(texture.gl_texture_target, batch.gl_tangent_normal_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    batch.residency(TextureSlot::TangentNormal) = upload_texture_2d(comp.normal_texture, batch.gl_tangent_normal_texture_unit, batch.gl_tangent_normal_texture);
   }
 
   if (comp.emissive_texture.data.pixels) {
-    const Texture& texture = comp.emissive_texture;
     batch.gl_emissive_texture_unit = next_free_texture_unit + 3;
-    glActiveTexture(GL_TEXTURE0 + batch.gl_emissive_texture_unit);
-    glGenTextures(1, &batch.gl_emissive_texture);
-    glBindTexture(texture.gl_texture_target, batch.gl_emissive_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
+    batch.residency(TextureSlot::Emissive) = upload_texture_2d(comp.emissive_texture, batch.gl_emissive_texture_unit, batch.gl_emissive_texture);
   }
 
   link_batch(batch);
 
-  add_graphics_state(batch, comp, material, entity_id);
+  batch_idxs[key] = graphics_batches.size();
   graphics_batches.emplace_back(std::move(batch));
+  draw_buffers->invalidate_draw_order();
+  return graphics_batches.size() - 1;
 }
 
 void Renderer::remove_component(const ID eid) {
-  for (auto& batch : graphics_batches) {
-    for (auto& id : batch.entity_ids) {
-      if (id == eid) {
-        // FIXME: Remove the Entity rendercomponent data from the objects struct in GBatch as well
-        // FIXME: Delegate to the GBatch perhaps makes more sense?
-        std::swap(id, batch.entity_ids.back());
-        batch.entity_ids.pop_back();
-
-        if (batch.entity_ids.empty()) {
-          // TODO: Remove an empty GraphicsBatch ...
-          // std::swap(batch, graphics_batches.back());
-          graphics_batches.pop_back();
-        }
-
-        return;
-      }
+  const auto location = entity_locations.find(eid);
+  if (location == entity_locations.end()) { return; }
+  const size_t batch_idx = location->second.batch_idx;
+  const size_t idx = location->second.idx;
+  entity_locations.erase(location);
+  GraphicsBatch& batch = graphics_batches[batch_idx];
+
+  // Swap the object data of the last Entity into the slot of the removed one, CPU mirrors and mapped buffers alike
+  const size_t last = batch.entity_ids.size() - 1;
+  if (idx != last) {
+    const ID last_eid = batch.entity_ids[last];
+    batch.entity_ids[idx] = last_eid;
+    entity_locations[last_eid].idx = uint32_t(idx);
+
+    const size_t slot = batch.instance_offset + idx;
+    batch.objects.transforms[idx] = batch.objects.transforms[last];
+    draw_buffers->models[slot] = batch.objects.transforms[idx];
+
+    batch.objects.bounding_volumes[idx] = batch.objects.bounding_volumes[last];
+    draw_buffers->bounding_volumes[slot] = batch.objects.bounding_volumes[idx];
+
+    batch.objects.materials[idx] = batch.objects.materials[last];
+    draw_buffers->materials[slot] = batch.objects.materials[idx];
+    draw_buffers->mark_instances(uint32_t(slot), 1, DrawBuffers::Models | DrawBuffers::BoundingVolumes | DrawBuffers::Materials);
+  }
+
+  batch.entity_ids.pop_back();
+  batch.objects.transforms.pop_back();
+  batch.objects.bounding_volumes.pop_back();
+  batch.objects.materials.pop_back();
+
+  if (batch.entity_ids.empty()) { remove_batch(batch_idx); }
+}
+
+void Renderer::remove_batch(const size_t batch_idx) {
+  GraphicsBatch& batch = graphics_batches[batch_idx];
+  batch_idxs.erase(GraphicsBatchKey{batch.mesh_id, batch.depth_shader.defines, batch.diffuse_array});
+
+  // NOTE: The geometry is shared with the other batches of the Mesh (see unlink_batch), the diffuse texture array
+  // with the other batches drawing its textures and the program with every batch of the same defines (see ShaderCache), deleted GL objects in use by frames in flight are freed once unused
+  if (batch.buffer_size > 0) {
+    draw_buffers->release_instances(batch.instance_offset, batch.buffer_size);
+    draw_buffers->release_instance_idxs(batch.instance_idx_offset, batch.num_instance_idxs());
+  }
+  draw_buffers->invalidate_draw_order();
+  const uint32_t textures[] = {batch.gl_metallic_roughness_texture, batch.gl_tangent_normal_texture, batch.gl_emissive_texture};
+  glDeleteTextures(sizeof(textures) / sizeof(textures[0]), textures);
+  unlink_batch(batch);
+  MeshManager::release(batch.mesh_id);
+
+  // Move the last batch into the slot of the removed one
+  const size_t last = graphics_batches.size() - 1;
+  if (batch_idx != last) {
+    batch = std::move(graphics_batches[last]);
+    batch_idxs[GraphicsBatchKey{batch.mesh_id, batch.depth_shader.defines, batch.diffuse_array}] = batch_idx;
+    for (const ID entity_id : batch.entity_ids) { entity_locations[entity_id].batch_idx = uint32_t(batch_idx); }
+
+    // Levels loaded for the batch at its previous index are dropped (see TextureStreamer::update)
+    for (TextureResidency& residency : batch.texture_residency) {
+      residency.generation = TextureStreamer::next_generation();
+      residency.pending = false;
     }
   }
+  graphics_batches.pop_back();
 }
 
-void Renderer::add_graphics_state(GraphicsBatch& batch, const RenderComponent& comp, Material material, ID entity_id) {
-  if (batch.entity_ids.size() + 1 >= batch.buffer_size) {
-    Log::warn("GraphicsBatch MAX_OBJECTS REACHED");
-    batch.increase_entity_buffers(10);
-  }
+DeduplicationStatistics Renderer::deduplication_statistics() const {
+  DeduplicationStatistics statistics;
+  std::unordered_map<ID, MeshDuplicates> duplicates; // Of every drawn Mesh
+  for (const GraphicsBatch& batch : graphics_batches) {
+    auto mesh_duplicates = duplicates.find(batch.mesh_id);
+    if (mesh_duplicates == duplicates.end()) {
+      mesh_duplicates = duplicates.emplace(batch.mesh_id, MeshManager::duplicates_of(batch.mesh_id)).first;
+      statistics.saved_bytes += mesh_duplicates->second.bytes;
+    }
+    // NOTE: Without deduplication each duplicate is a Mesh of its own and thus in batches of its own
+    const size_t num_meshes = 1 + mesh_duplicates->second.num_duplicates;
+    statistics.num_batches++;
+    statistics.num_batches_without += num_meshes;
+    statistics.num_draw_commands += batch.num_draw_commands();
+    statistics.num_draw_commands_without += num_meshes * batch.num_draw_commands();
+  }
+  return statistics;
+}
+
+void Renderer::reserve_entities(const size_t batch_idx, const uint32_t num_entities) {
+  GraphicsBatch& batch = graphics_batches[batch_idx];
+  if (num_entities < batch.buffer_size) { return; }
+
+  // Geometric growth such that adding N entities one by one grows the buffers O(log N) times
+  const uint32_t buffer_size = std::max({num_entities + 1, 2 * batch.buffer_size, GraphicsBatch::INIT_BUFFER_SIZE});
+  batch.entity_ids.reserve(buffer_size);
+  batch.objects.transforms.reserve(buffer_size);
+  batch.objects.bounding_volumes.reserve(buffer_size);
+  batch.objects.materials.reserve(buffer_size);
+
+  // Moves the objects to larger ranges of the shared buffers, the instance indices are rewritten by the culling pass every frame
+  if (batch.buffer_size > 0) {
+    draw_buffers->release_instances(batch.instance_offset, batch.buffer_size);
+    draw_buffers->release_instance_idxs(batch.instance_idx_offset, batch.num_instance_idxs());
+  }
+  batch.buffer_size = buffer_size;
+  batch.instance_offset = draw_buffers->allocate_instances(buffer_size);
+  batch.instance_idx_offset = draw_buffers->allocate_instance_idxs(batch.num_instance_idxs());
+  upload_instances(batch);
+}
+
+void Renderer::upload_instances(const GraphicsBatch& batch) const {
+  if (batch.buffer_size == 0) { return; }
+  const size_t num_objects = batch.objects.transforms.size();
+  std::copy_n(batch.objects.transforms.data(), num_objects, draw_buffers->models + batch.instance_offset);
+  std::copy_n(batch.objects.bounding_volumes.data(), num_objects, draw_buffers->bounding_volumes + batch.instance_offset);
+  std::copy_n(batch.objects.materials.data(), num_objects, draw_buffers->materials + batch.instance_offset);
+
+  // NOTE: Written for every slot such that the objects added later share it
+  VertexFormat vertex_format;
+  vertex_format.position_min = Vec4f(batch.vertex_format.position_min, 0.0f);
+  vertex_format.position_extent = Vec4f(batch.vertex_format.position_extent, 0.0f);
+  std::fill_n(draw_buffers->vertex_formats + batch.instance_offset, batch.buffer_size, vertex_format);
+  draw_buffers->mark_instances(batch.instance_offset, batch.buffer_size,
+                               DrawBuffers::Models | DrawBuffers::BoundingVolumes | DrawBuffers::Materials | DrawBuffers::VertexFormats);
+}
+
+/// World transform of the Entity, equal to compute_transform with the scaling and translation folded into the product
+/// NOTE: local * rotate(rotation).scale(scale).translate(position) = local * B where the rows of B are the scaled
+/// rotation rows and (position, 1)
+static Mat4f world_transform(const TransformComponent& comp) {
+#if defined(MEINEKRAFT_SSE2)
+  const Mat4f r = rotate(comp.rotation);
+  const __m128 scale = _mm_set1_ps(comp.scale);
+  const __m128 b0 = _mm_mul_ps(_mm_loadu_ps(&r[0].x), scale);
+  const __m128 b1 = _mm_mul_ps(_mm_loadu_ps(&r[1].x), scale);
+  const __m128 b2 = _mm_mul_ps(_mm_loadu_ps(&r[2].x), scale);
+  const __m128 b3 = _mm_setr_ps(comp.position.x, comp.position.y, comp.position.z, 1.0f);
+  Mat4f transform;
+  for (int i = 0; i < 4; i++) {
+    const Vec4f& l = comp.local[i];
+    const __m128 row = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.x), b0), _mm_mul_ps(_mm_set1_ps(l.y), b1)),
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.z), b2), _mm_mul_ps(_mm_set1_ps(l.w), b3)));
+    _mm_storeu_ps(&transform[i].x, row);
+  }
+  return transform;
+#else
+  return compute_transform(comp);
+#endif
+}
 
+/// Bounding sphere of the Entity in world space from the bounding sphere of its mesh
+static BoundingVolume world_bounding_volume(const Mat4f& transform, const TransformComponent& comp, const BoundingVolume& mesh_bounding_volume) {
+  BoundingVolume bounding_volume;
+#if defined(MEINEKRAFT_SSE2)
+  static_assert(sizeof(BoundingVolume) == 4 * sizeof(float), "BoundingVolume is expected to be (x, y, z, radius)");
+  const Vec3f& p = mesh_bounding_volume.position;
+  const __m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), _mm_loadu_ps(&transform[0].x)), _mm_mul_ps(_mm_set1_ps(p.y), _mm_loadu_ps(&transform[1].x))),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z), _mm_loadu_ps(&transform[2].x)), _mm_loadu_ps(&transform[3].x)));
+  _mm_storeu_ps(&bounding_volume.position.x, position); // Lane w is overwritten by the radius
+#else
+  bounding_volume.position = ClusterCulling::transform_point(transform, mesh_bounding_volume.position);
+#endif
+  bounding_volume.radius = mesh_bounding_volume.radius * compute_max_scale(comp);
+  return bounding_volume;
+}
+
+void Renderer::add_graphics_state(const size_t batch_idx, const RenderComponent& comp, Material material, ID entity_id) {
+  reserve_entities(batch_idx, uint32_t(graphics_batches[batch_idx].entity_ids.size()) + 1);
+  GraphicsBatch& batch = graphics_batches[batch_idx];
+
+  entity_locations[entity_id] = EntityLocation{uint32_t(batch_idx), uint32_t(batch.entity_ids.size())};
   batch.entity_ids.push_back(entity_id);
-  batch.data_idx[entity_id] = batch.entity_ids.size() - 1;
 
-  const TransformComponent transform_comp = TransformSystem::instance().lookup(entity_id);
-  const Mat4f transform = compute_transform(transform_comp);
+  const TransformComponent& transform_comp = TransformSystem::instance().lookup(entity_id);
+  const Mat4f transform = world_transform(transform_comp);
+  const size_t slot = batch.instance_offset + batch.objects.transforms.size();
   batch.objects.transforms.push_back(transform);
-  uint8_t* dest = batch.gl_depth_model_buffer_ptr + (batch.objects.transforms.size() - 1) * sizeof(Mat4f);
-  std::memcpy(dest, &batch.objects.transforms.back(), sizeof(Mat4f));
+  draw_buffers->models[slot] = transform;
 
   // Calculate a bounding volume for the object
-  BoundingVolume bounding_volume;
-  bounding_volume.radius = batch.bounding_volume.radius * transform_comp.scale;
-  bounding_volume.position = Vec3f(transform * Vec4f(batch.bounding_volume.position, 1.0f));
-  batch.objects.bounding_volumes.push_back(bounding_volume);
-  dest = batch.gl_bounding_volume_buffer_ptr + (batch.objects.bounding_volumes.size() - 1) * sizeof(BoundingVolume);
-  std::memcpy(dest, &batch.objects.bounding_volumes.back(), sizeof(BoundingVolume));
+  batch.objects.bounding_volumes.push_back(world_bounding_volume(transform, transform_comp, batch.bounding_volume));
+  draw_buffers->bounding_volumes[slot] = batch.objects.bounding_volumes.back();
 
   material.pbr_scalar_parameters = Vec2f(comp.pbr_scalar_parameters.y, comp.pbr_scalar_parameters.z);
   material.shading_model = comp.shading_model;
 
   batch.objects.materials.push_back(material);
-  dest = (uint8_t*) &batch.gl_material_buffer_ptr[batch.objects.materials.size() - 1];
-  std::memcpy(dest, &batch.objects.materials.back(), sizeof(Material));
+  draw_buffers->materials[slot] = material;
+  draw_buffers->mark_instances(uint32_t(slot), 1, DrawBuffers::Models | DrawBuffers::BoundingVolumes | DrawBuffers::Materials);
 }
 
 void Renderer::update_transforms() {
-  const std::vector<ID> t_ids = TransformSystem::instance().get_dirty_transform_ids();
-  for (size_t i = 0; i < graphics_batches.size(); i++) {
-    auto& batch = graphics_batches[i];
-    for (const auto& t_id : t_ids) {
-      const auto idx = batch.data_idx.find(t_id);
-      if (idx == batch.data_idx.cend()) { continue; }
-
-      // Update the bounding volume for the object
-      const TransformComponent transform_comp = TransformSystem::instance().lookup(t_id);
-      const Mat4f transform = compute_transform(transform_comp);
-
-      BoundingVolume bounding_volume;
-      bounding_volume.radius = batch.bounding_volume.radius * transform_comp.scale;
-      bounding_volume.position = Vec3f(transform * Vec4f(batch.bounding_volume.position, 1.0f));
-      batch.objects.bounding_volumes[idx->second] = bounding_volume;
-      std::memcpy(batch.gl_bounding_volume_buffer_ptr + idx->second * sizeof(BoundingVolume), &batch.objects.bounding_volumes[idx->second], sizeof(BoundingVolume));
-
-      batch.objects.transforms[idx->second] = transform;
-      std::memcpy(batch.gl_depth_model_buffer_ptr + idx->second * sizeof(Mat4f), &batch.objects.transforms[idx->second], sizeof(Mat4f));
+  ProfileScope scope("update_transforms");
+  const TransformSystem& transforms = TransformSystem::instance();
+  const std::vector<ID>& dirty_ids = transforms.get_dirty_transform_ids();
+
+  // NOTE: Every Entity owns one slot of one batch thus the chunks never write to the same memory, the maps are only read
+  std::vector<uint32_t> slots(dirty_ids.size(), RangeAllocator::NO_RANGE); // Written slot of each dirty Entity
+  const size_t CHUNK_SIZE = 1024;
+  const size_t num_chunks = (dirty_ids.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  JobSystem::instance().parallel_for(num_chunks, [&](const size_t chunk) {
+    const size_t end = std::min(dirty_ids.size(), (chunk + 1) * CHUNK_SIZE);
+    for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+      const auto location = entity_locations.find(dirty_ids[i]);
+      if (location == entity_locations.cend()) { continue; } // Entity without a RenderComponent
+      GraphicsBatch& batch = graphics_batches[location->second.batch_idx];
+      const size_t idx = location->second.idx;
+
+      const TransformComponent& transform_comp = transforms.lookup(dirty_ids[i]);
+      batch.objects.transforms[idx] = world_transform(transform_comp);
+      draw_buffers->models[batch.instance_offset + idx] = batch.objects.transforms[idx];
+
+      batch.objects.bounding_volumes[idx] = world_bounding_volume(batch.objects.transforms[idx], transform_comp, batch.bounding_volume);
+      draw_buffers->bounding_volumes[batch.instance_offset + idx] = batch.objects.bounding_volumes[idx];
+      slots[i] = uint32_t(batch.instance_offset + idx);
     }
+  });
+
+  for (const uint32_t slot : slots) {
+    if (slot != RangeAllocator::NO_RANGE) { draw_buffers->mark_instances(slot, 1, DrawBuffers::Models | DrawBuffers::BoundingVolumes); }
   }
 }
 
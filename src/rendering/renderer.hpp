@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <unordered_map>
 
 #include "texture.hpp"
 #include "light.hpp"
@@ -33,6 +34,9 @@ struct ViewFrustumCullingRenderPass;
 struct BilinearUpsamplingRenderPass;
 struct BilateralFilteringRenderPass;
 struct BilateralUpsamplingRenderPass;
+struct TextureStreamer;
+struct TextureArrayAllocator;
+struct DrawBuffers;
 
 // GOAL WITH RENDERPASS REFACTOR:
 // - Nothing about the render passes shall be exposed through the Renderer interface
@@ -47,6 +51,57 @@ struct BilateralUpsamplingRenderPass;
 //  - Manages a set of RenderPasses s.t their inputs and outputs are satisfied
 //  - Manages the RenderPass ordering (and resources?)
 
+/// Components of the same mesh, shader configuration and diffuse texture array share a GraphicsBatch
+struct GraphicsBatchKey {
+  ID mesh_id = 0;
+  uint32_t defines = 0;       // Mask of Shader::Defines
+  uint32_t diffuse_array = 0; // See TextureArrayAllocator
+
+  bool operator==(const GraphicsBatchKey& other) const {
+    return mesh_id == other.mesh_id && defines == other.defines && diffuse_array == other.diffuse_array;
+  }
+};
+
+struct GraphicsBatchKeyHash {
+  size_t operator()(const GraphicsBatchKey& key) const {
+    uint64_t hash = key.mesh_id;
+    hash = hash * 0x9e3779b97f4a7c15 + key.defines;
+    hash = hash * 0x9e3779b97f4a7c15 + key.diffuse_array;
+    return size_t(hash ^ (hash >> 32));
+  }
+};
+
+/// Batch of an entity and index of the entity into the objects of the batch
+struct EntityLocation {
+  uint32_t batch_idx = 0;
+  uint32_t idx = 0;
+};
+
+/// Geometry of a Mesh on the GPU shared by the batches of the Mesh since the Mesh releases its vertex data once
+/// uploaded (see MeshManager::release_vertex_data), freed along with the last batch of the Mesh
+struct MeshGeometry {
+  bool packed = false; // See GraphicsBatch::vertex_format
+  Vec3f position_min = Vec3f(0.0f);
+  Vec3f position_extent = Vec3f(1.0f);
+  uint32_t base_vertex = 0; // Into the shared vertex buffer of the layout (see DrawBuffers)
+  uint32_t num_vertices = 0;
+  uint32_t first_index = 0; // Into the shared index buffer, the indices followed by the indices of the coarser LODs
+  uint32_t num_indices = 0; // Including the indices of the coarser LODs
+  uint32_t first_cluster = 0; // Into the shared cluster buffer
+  uint32_t num_clusters = 0;
+  uint32_t num_batches = 0;   // Batches drawing the geometry
+};
+
+/// Batches and draw commands per frame of the Meshes deduplicated by content (see MeshManager::duplicates_of) and as
+/// if every duplicate had been loaded as a Mesh of its own
+struct DeduplicationStatistics {
+  size_t num_batches = 0;
+  size_t num_batches_without = 0;       // At most, every duplicate drawn in every batch of its Mesh
+  size_t num_draw_commands = 0;
+  size_t num_draw_commands_without = 0; // At most
+  size_t saved_bytes = 0;               // Geometry of the duplicates of the drawn Meshes not uploaded again
+};
+
 struct Renderer {
   /// Create a renderer with a given window/screen size/resolution 
   Renderer(const Resolution& screen);
@@ -55,15 +110,27 @@ struct Renderer {
   /// Post allocation initialization called at engine startup
   bool init();
 
+  /// Places the voxel clipmaps from the scene AABB, called whenever the scene AABB changes
+  void update_clipmaps();
+
   /// Renders one frame function using the Renderstate in 'state'
   void render(const uint32_t delta);
   
   /// Adds the data of a RenderComponent to a internal batch
   void add_component(const RenderComponent comp, const ID entity_id);
 
-  /// Removes the RenderComponent associated with the EID if there exists one
+  /// Adds the RenderComponents of the entities, each batch is grown at most once for all of them
+  void add_components(const std::vector<RenderComponent>& comps, const std::vector<ID>& entity_ids);
+
+  /// Removes the RenderComponent associated with the EID if there exists one, batches left empty are removed
   void remove_component(ID entity_id);
 
+  /// Frees the GPU resources of the batch and moves the last batch into its place
+  void remove_batch(size_t batch_idx);
+
+  /// Batches and draw commands saved by the deduplication of the Meshes
+  DeduplicationStatistics deduplication_statistics() const;
+
   // TODO: Document ...
   void load_environment_map(const std::array<std::string, 6>& faces);
 
@@ -74,6 +141,9 @@ struct Renderer {
   RenderState state;
   Resolution screen;
   std::vector<GraphicsBatch> graphics_batches;
+  std::unordered_map<GraphicsBatchKey, size_t, GraphicsBatchKeyHash> batch_idxs; // Index of each batch in graphics_batches
+  std::unordered_map<ID, EntityLocation> entity_locations; // Location of the objects of every entity in the batches
+  std::unordered_map<ID, MeshGeometry> mesh_geometries;    // Geometry of every Mesh drawn by a batch
   std::vector<PointLight> pointlights; // FIXME: Unused for now
 
   DownsampleRenderPass* downsample_pass = nullptr;
@@ -89,6 +159,10 @@ struct Renderer {
   BilateralUpsamplingRenderPass* bilateral_upsampling_pass = nullptr;
   std::vector<RenderPass*> render_passes;
 
+  TextureStreamer* texture_streamer = nullptr; // Streams in the finer levels of the textures (see TextureStreamingSettings)
+  TextureArrayAllocator* texture_arrays = nullptr; // Diffuse texture arrays shared between the batches
+  DrawBuffers* draw_buffers = nullptr; // Geometry, instances and draw commands of every batch
+
   glm::mat4 camera_transform; // TODO
   glm::mat4 projection_matrix; // TODO
 
@@ -124,14 +198,27 @@ struct Renderer {
   // TODO: Document
   uint32_t get_next_free_image_unit(bool peek = false);
 
-  // TODO: Document
-  void add_graphics_state(GraphicsBatch& batch, const RenderComponent& comp, Material material, ID entity_id);
+  /// Batch drawing the component which is created if needed, returns NO_BATCH on failure
+  size_t batch_of(const RenderComponent& comp, Material& material);
+  static const size_t NO_BATCH = SIZE_MAX;
 
-  // TODO: Document
+  /// Grows the Entity buffers of the batch geometrically such that they fit num_entities
+  void reserve_entities(size_t batch_idx, uint32_t num_entities);
+
+  /// Writes the objects of the batch to its slots of the instance buffers
+  void upload_instances(const GraphicsBatch& batch) const;
+
+  /// Appends the Entity to the batch
+  void add_graphics_state(size_t batch_idx, const RenderComponent& comp, Material material, ID entity_id);
+
+  /// Recomputes the transforms and bounding volumes of the Entities whose Transform was modified this frame in parallel
   void update_transforms();
 
   // TODO: Document
   void link_batch(GraphicsBatch& batch);
+
+  /// Frees the geometry of the Mesh of the batch unless drawn by other batches
+  void unlink_batch(const GraphicsBatch& batch);
 };
 
 #endif // MEINEKRAFT_RENDERER_HPP
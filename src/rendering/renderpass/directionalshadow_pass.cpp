@@ -38,6 +38,7 @@ bool DirectionalShadowRenderPass::setup(Renderer* render) {
 
   shadowmapping_shader = new Shader(Filesystem::base + "shaders/shadowmapping.vert",
                                     Filesystem::base + "shaders/shadowmapping.frag");
+  shadowmapping_shader->add(Filesystem::read_file(Filesystem::base + "shaders/vertex-unpacking-utils.glsl"));
   const auto [ok, err_msg] = shadowmapping_shader->compile();
   if (!ok) {
     Log::error("Shadowmapping shader error: " + err_msg);
@@ -59,16 +60,26 @@ bool DirectionalShadowRenderPass::render(Renderer* render) {
   glUseProgram(program);
   glUniformMatrix4fv(glGetUniformLocation(program, "uLight_space_transform"), 1, GL_FALSE, glm::value_ptr(light_space_transform));
 
-  for (size_t i = 0; i < render->graphics_batches.size(); i++) {
-    const auto& batch = render->graphics_batches[i];
-    glBindVertexArray(batch.gl_shadowmapping_vao);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch.gl_ibo); // GL_DRAW_INDIRECT_BUFFER is global context state
-
-    const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, batch.gl_depth_model_buffer);
-
-    const uint64_t draw_cmd_offset = batch.gl_curr_ibo_idx * sizeof(DrawElementsIndirectCommand);
-    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) draw_cmd_offset, 1, sizeof(DrawElementsIndirectCommand));
+  DrawStatisticsScope scope(statistics);
+  const DrawBuffers* draw_buffers = render->draw_buffers;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_buffers->gl_draw_cmd_buffer); // GL_DRAW_INDIRECT_BUFFER is global context state
+
+  const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, draw_buffers->gl_model_buffer());
+
+  const uint32_t gl_vertex_format_binding_point = 7; // Defaults to 7 in vertex-unpacking-utils.glsl
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_vertex_format_binding_point, draw_buffers->gl_vertex_format_buffer());
+
+  // One group per vertex layout, the camera LODs followed by LOD 0 of the batches drawn by clusters in the geometry pass
+  for (const DrawGroup& group : draw_buffers->shadow_groups) {
+    glBindVertexArray(draw_buffers->gl_vao(group.packed));
+    glUniform1i(glGetUniformLocation(program, "packed_vertices"), group.packed);
+    for (const DrawRange& range : group.ranges) {
+      if (range.count == 0) { continue; }
+      const uint64_t draw_cmd_offset = draw_buffers->draw_cmd_offset(range.first);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) draw_cmd_offset, range.count, sizeof(DrawElementsIndirectCommand));
+      statistics.draw_calls++;
+    }
   }
 
   glViewport(0, 0, render->screen.width, render->screen.height);
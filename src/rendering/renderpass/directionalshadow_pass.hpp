@@ -2,6 +2,7 @@
 #define DIRECTIONAL_SHADOW_RENDERPASS_HPP
 
 #include "renderpass.hpp"
+#include "../drawbuffers.hpp"
 
 #include <stdint.h>
 
@@ -21,6 +22,8 @@ struct DirectionalShadowRenderPass: public RenderPass {
 
   glm::mat4 light_space_transform;
 
+  DrawStatistics statistics; // Of the last frame
+
   virtual bool setup(Renderer* render);
   virtual bool render(Renderer* render);
 
@@ -2,6 +2,7 @@
 
 #include "../graphicsbatch.hpp"
 #include "../renderer.hpp"
+#include "../texturearrayallocator.hpp"
 #include "../shader.hpp"
 #include "../../math/vector.hpp"
 #include "../../rendering/primitives.hpp"
@@ -155,24 +156,41 @@ bool GbufferRenderPass::render(Renderer* render) {
 
   glBindFramebuffer(GL_FRAMEBUFFER, gl_depth_fbo);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  for (size_t i = 0; i < render->graphics_batches.size(); i++) {
-    const auto& batch = render->graphics_batches[i];
-    const auto program = batch.depth_shader.gl_program;
-    glUseProgram(program);
-    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(render->projection_matrix));
-    glBindVertexArray(batch.gl_depth_vao);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch.gl_ibo); // GL_DRAW_INDIRECT_BUFFER is global context state
 
-    glUniformMatrix4fv(glGetUniformLocation(program, "camera_view"), 1, GL_FALSE, glm::value_ptr(render->camera_transform));
-
-    const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, batch.gl_depth_model_buffer);
+  DrawStatisticsScope scope(statistics);
+  const DrawBuffers* draw_buffers = render->draw_buffers;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_buffers->gl_draw_cmd_buffer); // GL_DRAW_INDIRECT_BUFFER is global context state
+
+  const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, draw_buffers->gl_model_buffer());
+
+  const uint32_t gl_material_binding_point = 3; // Defaults to 3 in geometry.frag shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_material_binding_point, draw_buffers->gl_material_buffer());
+
+  const uint32_t gl_vertex_format_binding_point = 7; // Defaults to 7 in vertex-unpacking-utils.glsl
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_vertex_format_binding_point, draw_buffers->gl_vertex_format_buffer());
+
+  // One multi-draw per range of each group, every batch of a group shares its program, textures and vertex layout
+  // NOTE: Programs are shared between batches with different texture units thus the units are set per group
+  uint32_t program = 0;
+  for (const DrawGroup& group : draw_buffers->geometry_groups) {
+    const auto& batch = render->graphics_batches[group.batch_idx];
+    if (batch.depth_shader.gl_program != program) {
+      program = batch.depth_shader.gl_program;
+      glUseProgram(program);
+      glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(render->projection_matrix));
+      glUniformMatrix4fv(glGetUniformLocation(program, "camera_view"), 1, GL_FALSE, glm::value_ptr(render->camera_transform));
+    }
+    glBindVertexArray(draw_buffers->gl_vao(group.packed));
+    glUniform1i(glGetUniformLocation(program, "packed_vertices"), group.packed);
 
-    const uint32_t gl_material_binding_point = 3; // Defaults to 3 in geometry.frag shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_material_binding_point, batch.gl_material_buffer);
+    glUniform1i(glGetUniformLocation(program, "diffuse"), batch.gl_diffuse_texture_unit);
+    glUniform1i(glGetUniformLocation(program, "pbr_parameters"), batch.gl_metallic_roughness_texture_unit);
+    glUniform1i(glGetUniformLocation(program, "emissive"), batch.gl_emissive_texture_unit);
+    glUniform1i(glGetUniformLocation(program, "tangent_normal"), batch.gl_tangent_normal_texture_unit);
 
     glActiveTexture(GL_TEXTURE0 + batch.gl_diffuse_texture_unit);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, batch.gl_diffuse_texture_array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, render->texture_arrays->gl_texture(batch.diffuse_array));
 
     if (batch.gl_metallic_roughness_texture != 0) {
       glActiveTexture(GL_TEXTURE0 + batch.gl_metallic_roughness_texture_unit); // TODO: Replace with DSA
@@ -187,8 +205,13 @@ bool GbufferRenderPass::render(Renderer* render) {
     glActiveTexture(GL_TEXTURE0 + batch.gl_emissive_texture_unit); // TODO: Replace with DSA
     glBindTexture(GL_TEXTURE_2D, batch.gl_emissive_texture);
 
-    const uint64_t draw_cmd_offset = batch.gl_curr_ibo_idx * sizeof(DrawElementsIndirectCommand);
-    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) draw_cmd_offset, 1, sizeof(DrawElementsIndirectCommand));
+    // Camera LODs followed by the clusters, LOD 0 of the clustered batches is drawn by their visible clusters instead
+    for (const DrawRange& range : group.ranges) {
+      if (range.count == 0) { continue; }
+      const uint64_t draw_cmd_offset = draw_buffers->draw_cmd_offset(range.first);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) draw_cmd_offset, range.count, sizeof(DrawElementsIndirectCommand));
+      statistics.draw_calls++;
+    }
   }
 
   render->pass_ended();
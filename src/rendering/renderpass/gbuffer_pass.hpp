@@ -2,6 +2,7 @@
 #define  GBUFFER_RENDERPASS_HPP
 
 #include "renderpass.hpp"
+#include "../drawbuffers.hpp"
 
 #include <stdint.h>
 
@@ -42,6 +43,8 @@ struct GbufferRenderPass:  public RenderPass {
   uint32_t gl_direct_radiance_texture_unit = 0;
   uint32_t gl_direct_radiance_texture = 0;
 
+  DrawStatistics statistics; // Of the last frame
+
   virtual bool setup(Renderer* render);
   virtual bool render(Renderer* render);
 };
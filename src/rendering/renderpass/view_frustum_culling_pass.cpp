@@ -10,6 +10,7 @@
 #include "gbuffer_pass.hpp"
 #include "../shader.hpp"
 
+#include <algorithm>
 #include <array>
 
 #ifdef WIN32
@@ -54,42 +55,157 @@ std::array<glm::vec4, 6> extract_planes(const glm::mat4& mat) {
     mat[3][1] - mat[2][1],
     mat[3][2] - mat[2][2],
     mat[3][3] - mat[2][3]);
-  return { normalize(left_plane), normalize(right_plane), normalize(bot_plane), normalize(top_plane), normalize(near_plane), normalize(far_plane) };
+  // NOTE: Normalized by the length of the normal (not the whole vec4) in order for the plane equation to yield distances
+  const auto normalize_plane = [](const glm::vec4& plane) { return plane / glm::length(glm::vec3(plane)); };
+  return { normalize_plane(left_plane), normalize_plane(right_plane), normalize_plane(bot_plane), normalize_plane(top_plane), normalize_plane(near_plane), normalize_plane(far_plane) };
 }
 
+/// Invocations per work group of the culling shader, see local_size_x in shaders/culling.comp.glsl
+static const uint32_t WORK_GROUP_SIZE = 64;
+
+/// Work groups per dispatch along x, the minimum of GL_MAX_COMPUTE_WORK_GROUP_COUNT
+static const uint32_t MAX_WORK_GROUPS = 65535;
+
 bool ViewFrustumCullingRenderPass::setup(Renderer* render) {
   shader = new ComputeShader(Filesystem::base + "shaders/culling.comp.glsl");
   // TODO: Error checking?
+
+  const uint32_t program = shader->gl_program;
+  uniforms.frustum_planes = glGetUniformLocation(program, "frustum_planes");
+  uniforms.lod_enabled = glGetUniformLocation(program, "LOD_ENABLED");
+  uniforms.lod_pixel_error = glGetUniformLocation(program, "LOD_PIXEL_ERROR");
+  uniforms.projection_scale = glGetUniformLocation(program, "PROJECTION_SCALE");
+  uniforms.camera_position = glGetUniformLocation(program, "CAMERA_POSITION");
+  uniforms.cluster_culling_enabled = glGetUniformLocation(program, "CLUSTER_CULLING_ENABLED");
+  uniforms.clipmap_mins = glGetUniformLocation(program, "CLIPMAP_MINS");
+  uniforms.clipmap_maxs = glGetUniformLocation(program, "CLIPMAP_MAXS");
+  uniforms.voxel_sizes = glGetUniformLocation(program, "VOXEL_SIZES");
+  uniforms.draw_cmd_idx = glGetUniformLocation(program, "DRAW_CMD_IDX");
+  uniforms.num_draw_commands = glGetUniformLocation(program, "NUM_DRAW_COMMANDS");
+  uniforms.first_batch = glGetUniformLocation(program, "FIRST_BATCH");
+  uniforms.num_batches = glGetUniformLocation(program, "NUM_BATCHES");
+  uniforms.num_invocations = glGetUniformLocation(program, "NUM_INVOCATIONS");
+
+  reallocate_batches(64);
   return true;
 }
 
+void ViewFrustumCullingRenderPass::reallocate_batches(const uint32_t capacity) {
+  // NOTE: Deleted while read by the frames in flight, the GL frees it once they are done
+  if (gl_batch_buffer != 0) { glDeleteBuffers(1, &gl_batch_buffer); }
+  const auto flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
+  const size_t byte_size = DrawBuffers::NUM_PARTITIONS * size_t(capacity) * sizeof(CullingBatch);
+  glCreateBuffers(1, &gl_batch_buffer);
+  glNamedBufferStorage(gl_batch_buffer, byte_size, nullptr, flags);
+  batch_buffer_ptr = (CullingBatch*) glMapNamedBufferRange(gl_batch_buffer, 0, byte_size, flags);
+  glObjectLabel(GL_BUFFER, gl_batch_buffer, -1, "Culling batch SSBO");
+  batch_capacity = capacity;
+}
+
 bool ViewFrustumCullingRenderPass::render(Renderer* render) {
   render->pass_started("Culling pass");
 
   // NOTE: Extraction of frustum planes are performed on the transpose (because of column/row-major difference).
   // FIXME: Use the Direct3D way of extraction instead since GLM appears to store the matrix in a row-major way.
-  const glm::mat4 proj_view = render->projection_matrix * render->camera_transform;
+  // NOTE: camera_transform already includes the projection
+  const glm::mat4 proj_view = render->camera_transform;
   const std::array<glm::vec4, 6> frustum = extract_planes(glm::transpose(proj_view));
 
-  glUseProgram(shader->gl_program);
-  glUniform4fv(glGetUniformLocation(shader->gl_program, "frustum_planes"), 6, glm::value_ptr(frustum[0]));
-  for (size_t i = 0; i < render->graphics_batches.size(); i++) {
-    const auto& batch = render->graphics_batches[i];
+  const uint32_t program = shader->gl_program;
+  glUseProgram(program);
+  glUniform4fv(uniforms.frustum_planes, 6, glm::value_ptr(frustum[0]));
+
+  // LOD selection, projection_matrix[1][1] = 1 / tan(fov / 2)
+  const float projection_scale = render->projection_matrix[1][1] * render->screen.height * 0.5f;
+  glUniform1i(uniforms.lod_enabled, render->state.lod.enabled);
+  glUniform1f(uniforms.lod_pixel_error, render->state.lod.pixel_error);
+  glUniform1f(uniforms.projection_scale, projection_scale);
+  glUniform3fv(uniforms.camera_position, 1, &render->scene->camera.position.x);
+  glUniform1i(uniforms.cluster_culling_enabled, render->state.culling.clusters);
+
+  Vec3f clipmap_mins[Renderer::NUM_CLIPMAPS];
+  Vec3f clipmap_maxs[Renderer::NUM_CLIPMAPS];
+  float voxel_sizes[Renderer::NUM_CLIPMAPS];
+  for (size_t i = 0; i < Renderer::NUM_CLIPMAPS; i++) {
+    clipmap_mins[i] = render->clipmaps.aabb[i].min;
+    clipmap_maxs[i] = render->clipmaps.aabb[i].max;
+    voxel_sizes[i] = render->clipmaps.aabb[i].max_axis() / render->clipmaps.size[i];
+  }
+  glUniform3fv(uniforms.clipmap_mins, Renderer::NUM_CLIPMAPS, &clipmap_mins[0].x);
+  glUniform3fv(uniforms.clipmap_maxs, Renderer::NUM_CLIPMAPS, &clipmap_maxs[0].x);
+  glUniform1fv(uniforms.voxel_sizes, Renderer::NUM_CLIPMAPS, voxel_sizes);
+
+  DrawStatisticsScope scope(statistics);
+  const DrawBuffers* draw_buffers = render->draw_buffers;
+
+  // Parameters of every batch written to the copy of the partition, the batches of the previous frames are in flight
+  if (render->graphics_batches.size() > batch_capacity) {
+    reallocate_batches(std::max(uint32_t(render->graphics_batches.size()), 2 * batch_capacity));
+  }
+  CullingBatch* batches = batch_buffer_ptr + size_t(draw_buffers->partition) * batch_capacity;
+  uint32_t num_batches = 0;
+  uint32_t num_invocations = 0;
+  for (const GraphicsBatch& batch : render->graphics_batches) {
+    const uint32_t num_objects = uint32_t(batch.objects.transforms.size());
+    if (num_objects == 0) { continue; }
+    CullingBatch& culling_batch = batches[num_batches++];
+    culling_batch.first_invocation = num_invocations;
+    culling_batch.num_objects = num_objects;
+    culling_batch.num_clusters = batch.num_clusters;
+    culling_batch.instance_offset = batch.instance_offset;
+    culling_batch.instance_idx_offset = batch.instance_idx_offset;
+    culling_batch.instance_capacity = batch.buffer_size;
+    culling_batch.base_vertex = batch.base_vertex;
+    culling_batch.first_index = batch.first_index;
+    culling_batch.first_cluster = batch.first_cluster;
+    culling_batch.camera_cmd = batch.camera_cmd;
+    culling_batch.shadow_cmd = batch.shadow_cmd;
+    culling_batch.cluster_cmd = batch.cluster_cmd;
+    culling_batch.voxelization_cmd = batch.voxelization_cmd;
+    culling_batch.num_lods = batch.num_lods;
+    culling_batch.cluster_capacity = batch.cluster_capacity();
+    for (size_t lod = 0; lod < Mesh::MAX_LODS; lod++) {
+      const bool valid = lod < batch.num_lods;
+      culling_batch.lod_first_index[lod] = valid ? batch.mesh->lod(lod).first_index : 0;
+      culling_batch.lod_num_indices[lod] = valid ? batch.mesh->lod(lod).num_indices : 0;
+      culling_batch.lod_errors[lod] = batch.lod_errors[lod];
+    }
+
+    // One invocation per object followed by one per cluster of each object drawn by its clusters
+    num_invocations += num_objects + std::min(num_objects, culling_batch.cluster_capacity) * batch.num_clusters;
+  }
+
+  // NOTE: The draw commands, objects and clusters of every batch share the buffers (see DrawBuffers)
+  const uint32_t gl_draw_cmd_binding_point = 0; // Defaults to 0 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_draw_cmd_binding_point, draw_buffers->gl_draw_cmd_buffer);
+
+  const uint32_t gl_instance_idx_binding_point = 1; // Defaults to 1 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_instance_idx_binding_point, draw_buffers->gl_instance_idx_buffer);
+
+  const uint32_t gl_models_binding_point = 2; // Defaults to 2 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, draw_buffers->gl_model_buffer());
 
-    // Rebind the draw cmd SSBO for the compute shader to the current batch
-    const uint32_t gl_draw_cmd_binding_point = 0; // Defaults to 0 in the culling compute shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_draw_cmd_binding_point, batch.gl_ibo);
+  const uint32_t gl_batch_binding_point = 3; // Defaults to 3 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_batch_binding_point, gl_batch_buffer);
 
-    const uint32_t gl_instance_idx_binding_point = 1; // Defaults to 1 in the culling compute shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_instance_idx_binding_point, batch.gl_instance_idx_buffer);
+  const uint32_t gl_bounding_volume_binding_point = 5; // Defaults to 5 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_bounding_volume_binding_point, draw_buffers->gl_bounding_volume_buffer());
 
-    const uint32_t gl_bounding_volume_binding_point = 5; // Defaults to 5 in the culling compute shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_bounding_volume_binding_point, batch.gl_bounding_volume_buffer);
+  const uint32_t gl_cluster_binding_point = 6; // Defaults to 6 in the culling compute shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_cluster_binding_point, draw_buffers->gl_cluster_buffer);
 
-    glUniform1ui(glGetUniformLocation(shader->gl_program, "NUM_INDICES"), batch.mesh->indices.size());
-    glUniform1ui(glGetUniformLocation(shader->gl_program, "DRAW_CMD_IDX"), batch.gl_curr_ibo_idx);
+  glUniform1ui(uniforms.draw_cmd_idx, draw_buffers->partition);
+  glUniform1ui(uniforms.num_draw_commands, draw_buffers->draw_cmd_capacity);
+  glUniform1ui(uniforms.first_batch, draw_buffers->partition * batch_capacity);
+  glUniform1ui(uniforms.num_batches, num_batches);
+  glUniform1ui(uniforms.num_invocations, num_invocations);
 
-    glDispatchCompute(batch.objects.transforms.size(), 1, 1);
+  // Every batch in one dispatch, the work groups are laid out in rows of MAX_WORK_GROUPS
+  if (num_invocations > 0) {
+    const uint32_t num_work_groups = (num_invocations + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE;
+    const uint32_t num_rows = (num_work_groups + MAX_WORK_GROUPS - 1) / MAX_WORK_GROUPS;
+    glDispatchCompute(std::min(num_work_groups, MAX_WORK_GROUPS), num_rows, 1);
+    statistics.draw_calls++;
   }
   // TODO: Is this barrier required?
   glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT); // Buffer objects affected by this bit are derived from the GL_DRAW_INDIRECT_BUFFER binding.
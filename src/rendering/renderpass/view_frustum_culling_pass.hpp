@@ -2,15 +2,69 @@
 #define VIEW_FRUSTUM_CULLING_RENDERPASS
 
 #include "renderpass.hpp"
+#include "../drawbuffers.hpp"
 
 struct ComputeShader;
 
+/// Culling parameters of a GraphicsBatch, shader mirror (see Batch in shaders/culling.comp.glsl, std430)
+struct CullingBatch {
+  uint32_t first_invocation = 0;    // Invocations of the batch are [first_invocation, first_invocation + num_invocations)
+  uint32_t num_objects = 0;
+  uint32_t num_clusters = 0;
+  uint32_t instance_offset = 0;     // See GraphicsBatch
+  uint32_t instance_idx_offset = 0;
+  uint32_t instance_capacity = 0;   // GraphicsBatch::buffer_size
+  uint32_t base_vertex = 0;
+  uint32_t first_index = 0;
+  uint32_t first_cluster = 0;
+  uint32_t camera_cmd = 0;
+  uint32_t shadow_cmd = 0;
+  uint32_t cluster_cmd = 0;
+  uint32_t voxelization_cmd = 0;
+  uint32_t num_lods = 1;
+  uint32_t cluster_capacity = 0;    // See GraphicsBatch::cluster_capacity
+  uint32_t padding = 0;
+  uint32_t lod_first_index[Mesh::MAX_LODS] = {};
+  uint32_t lod_num_indices[Mesh::MAX_LODS] = {};
+  float lod_errors[Mesh::MAX_LODS] = {};
+};
+
+/// Culls the objects and clusters of every batch and selects their LODs with one dispatch, the parameters of the
+/// batches are read from a copy per partition of the batch buffer (see DrawBuffers::NUM_PARTITIONS)
 struct ViewFrustumCullingRenderPass: public RenderPass {
 
   ComputeShader* shader = nullptr;
 
+  DrawStatistics statistics; // Dispatches of the last frame
+
+  /// Persistently mapped, batch_capacity CullingBatches per partition
+  uint32_t gl_batch_buffer = 0;
+  CullingBatch* batch_buffer_ptr = nullptr;
+  uint32_t batch_capacity = 0;
+
+  /// Uniform locations of the culling shader, looked up once
+  struct {
+    int32_t frustum_planes = -1;
+    int32_t lod_enabled = -1;
+    int32_t lod_pixel_error = -1;
+    int32_t projection_scale = -1;
+    int32_t camera_position = -1;
+    int32_t cluster_culling_enabled = -1;
+    int32_t clipmap_mins = -1;
+    int32_t clipmap_maxs = -1;
+    int32_t voxel_sizes = -1;
+    int32_t draw_cmd_idx = -1;
+    int32_t num_draw_commands = -1;
+    int32_t first_batch = -1;
+    int32_t num_batches = -1;
+    int32_t num_invocations = -1;
+  } uniforms;
+
   virtual bool setup(Renderer* render);
   virtual bool render(Renderer* render);
+
+  /// Reallocates the batch buffer with the capacity per partition
+  void reallocate_batches(uint32_t capacity);
 };
 
 #endif // VIEW_FRUSTUM_CULLING_RENDERPASS
@@ -2,6 +2,7 @@
 
 #include "../graphicsbatch.hpp"
 #include "../renderer.hpp"
+#include "../texturearrayallocator.hpp"
 #include "../shader.hpp"
 #include "../../math/vector.hpp"
 #include "../../rendering/primitives.hpp"
@@ -23,6 +24,7 @@ bool VoxelizationRenderPass::setup(Renderer* render) {
 
   const std::string includes = Filesystem::read_file(Filesystem::base + "shaders/voxel-cone-tracing-utils.glsl");
   shader->add(includes);
+  shader->add(Filesystem::read_file(Filesystem::base + "shaders/vertex-unpacking-utils.glsl"));
 
   const auto [ok, err_msg] = shader->compile();
   if (!ok) {
@@ -149,27 +151,38 @@ bool VoxelizationRenderPass::render(Renderer* render) {
   }
   glViewportArrayv(0, NUM_CLIPMAPS, &viewports[0].x);
 
-  for (size_t i = 0; i < render->graphics_batches.size(); i++) {
-    const auto &batch = render->graphics_batches[i];
-    glBindVertexArray(batch.gl_voxelization_vao);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch.gl_ibo); // GL_DRAW_INDIRECT_BUFFER is global context state
+  DrawStatisticsScope scope(statistics);
+  const DrawBuffers* draw_buffers = render->draw_buffers;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_buffers->gl_draw_cmd_buffer); // GL_DRAW_INDIRECT_BUFFER is global context state
+
+  const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, draw_buffers->gl_model_buffer());
+
+  const uint32_t gl_material_binding_point = 3; // Defaults to 3 in geometry.frag shader
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_material_binding_point, draw_buffers->gl_material_buffer());
+
+  const uint32_t gl_vertex_format_binding_point = 7; // Defaults to 7 in vertex-unpacking-utils.glsl
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_vertex_format_binding_point, draw_buffers->gl_vertex_format_buffer());
+
+  // One group per vertex layout, diffuse array and emissive texture
+  for (const DrawGroup& group : draw_buffers->voxelization_groups) {
+    const auto& batch = render->graphics_batches[group.batch_idx];
+    glBindVertexArray(draw_buffers->gl_vao(group.packed));
+    glUniform1i(glGetUniformLocation(program, "packed_vertices"), group.packed);
 
     glActiveTexture(GL_TEXTURE0 + batch.gl_diffuse_texture_unit);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, batch.gl_diffuse_texture_array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, render->texture_arrays->gl_texture(batch.diffuse_array));
     glUniform1i(glGetUniformLocation(program, "uDiffuse"), batch.gl_diffuse_texture_unit);
 
     glActiveTexture(GL_TEXTURE0 + batch.gl_emissive_texture_unit);
     glBindTexture(GL_TEXTURE_2D, batch.gl_emissive_texture);
     glUniform1i(glGetUniformLocation(program, "uEmissive"), batch.gl_emissive_texture_unit);
 
-    const uint32_t gl_models_binding_point = 2; // Defaults to 2 in geometry.vert shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_models_binding_point, batch.gl_depth_model_buffer);
-
-    const uint32_t gl_material_binding_point = 3; // Defaults to 3 in geometry.frag shader
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_material_binding_point, batch.gl_material_buffer);
-
-    const uint64_t draw_cmd_offset = batch.gl_curr_ibo_idx * sizeof(DrawElementsIndirectCommand);
-    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)draw_cmd_offset, 1, sizeof(DrawElementsIndirectCommand));
+    // NOTE: Voxelization LODs are selected by the voxel size of the finest clipmap containing the instance
+    const DrawRange& range = group.ranges[0];
+    const uint64_t draw_cmd_offset = draw_buffers->draw_cmd_offset(range.first);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)draw_cmd_offset, range.count, sizeof(DrawElementsIndirectCommand));
+    statistics.draw_calls++;
   }
 
   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Due to incoherent mem. access need to sync read and usage of voxel data
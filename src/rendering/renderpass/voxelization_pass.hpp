@@ -2,6 +2,7 @@
 #define VOXELIZATION_RENDERPASS_HPP
 
 #include "renderpass.hpp"
+#include "../drawbuffers.hpp"
 
 #include <stdint.h>
 
@@ -17,6 +18,8 @@ struct VoxelizationRenderPass: public RenderPass {
   Shader* shader = nullptr;
   uint32_t gl_voxelization_fbo = 0;
 
+  DrawStatistics statistics; // Of the last voxelization
+
   virtual bool setup(Renderer* render);
   virtual bool render(Renderer* render);
 };
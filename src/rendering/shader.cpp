@@ -2,6 +2,7 @@
 
 #include "../util/filesystem.hpp"
 #include "debug_opengl.hpp"
+#include "shadercache.hpp"
 
 #include <cassert>
 #include <string>
@@ -43,12 +44,24 @@ static std::string shader_define_to_string(const Shader::Defines define) {
   case Shader::Defines::TangentNormals:
     return "#define HAS_TANGENT_NORMALS \n";
     break;
+  case Shader::Defines::TangentNormalsRG:
+    return "#define TANGENT_NORMALS_RG \n";
+    break;
   default:
     Log::error("Invalid shader define passed");
     return "This will ensure that shader compilation does not work :)";
   }
 }
 
+/// Source code defines of the mask of shader config flags
+static std::string shader_defines_to_string(const uint32_t defines) {
+  std::string str;
+  for (uint32_t define = 0; define < 32; define++) {
+    if (defines & Shader::bit(Shader::Defines(define))) { str += shader_define_to_string(Shader::Defines(define)); }
+  }
+  return str;
+}
+
 /// NOTE: Tries to parse out where and what went wrong in the shader
 static std::string try_to_parse_shader_err_msg(const std::string& shader_src, const std::string& err_msg) {
   return err_msg; // TODO: Implement ...
@@ -72,7 +85,6 @@ static std::string shader_compilation_err_msg(const GLuint shader) {
 // exit(-1))
 ComputeShader::ComputeShader(const std::string &compute_filepath,
                              const std::vector<std::string> &defines) {
-  GLuint gl_comp_shader = glCreateShader(GL_COMPUTE_SHADER);
   std::string comp_src = Filesystem::read_file(compute_filepath);
 
   if (comp_src.empty()) {
@@ -86,6 +98,19 @@ ComputeShader::ComputeShader(const std::string &compute_filepath,
 
   comp_src.insert(0, GLSL_VERSION);
 
+  // NOTE: The defines are part of the sources (see Shader::compile)
+  const ShaderCache::Key key{ShaderCache::hash(comp_src), 0};
+  gl_program = ShaderCache::find(key);
+  if (gl_program != 0) { return; }
+
+  gl_program = ShaderCache::load(key);
+  if (gl_program != 0) {
+    glObjectLabel(GL_PROGRAM, gl_program, -1, compute_filepath.c_str());
+    ShaderCache::insert(key, gl_program);
+    return;
+  }
+
+  GLuint gl_comp_shader = glCreateShader(GL_COMPUTE_SHADER);
   const char *raw_str_ptr = comp_src.c_str();
   glShaderSource(gl_comp_shader, 1, &raw_str_ptr, nullptr);
   glCompileShader(gl_comp_shader);
@@ -106,6 +131,7 @@ ComputeShader::ComputeShader(const std::string &compute_filepath,
 
   gl_program = glCreateProgram();
   glAttachShader(gl_program, gl_comp_shader);
+  glProgramParameteri(gl_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(gl_program);
 
   GLint program_linked = 0;
@@ -119,6 +145,9 @@ ComputeShader::ComputeShader(const std::string &compute_filepath,
     Log::warn(try_to_parse_shader_err_msg(comp_src, std::string(program_err_msg)));
 
     glDeleteProgram(gl_program);
+  } else {
+    ShaderCache::save(key, gl_program);
+    ShaderCache::insert(key, gl_program);
   }
 
   glObjectLabel(GL_PROGRAM, gl_program, -1, compute_filepath.c_str());
@@ -137,6 +166,11 @@ Shader::Shader(const std::string &vertex_filepath,
                const std::string &fragment_filepath)
     : vertex_filepath(vertex_filepath), fragment_filepath(fragment_filepath) {}
 
+/// Source of the shader stage as compiled: version, includes, defines then the file
+static std::string stage_source(const std::string& include_src, const uint32_t defines, const std::string& file_src) {
+  return GLSL_VERSION + include_src + shader_defines_to_string(defines) + file_src;
+}
+
 std::pair<bool, std::string> Shader::compile() {
   if (compiled_successfully) {
     return {false, "This shader has already been compiled."};
@@ -146,26 +180,75 @@ std::pair<bool, std::string> Shader::compile() {
   const bool geometry_included = !geometry_filepath.empty();
   const bool fragment_included = !fragment_filepath.empty();
 
-  gl_program = glCreateProgram();
+  std::string vertex_src;
+  std::string geometry_src;
+  std::string fragment_src;
 
-  GLint vertex_shader_compiled = GL_FALSE;
-  GLint geometry_shader_compiled = GL_FALSE;
-  GLint fragment_shader_compiled = GL_FALSE;
+  // NOTE: The sources hash covers every stage but the defines which are keyed separately (see ShaderCache::Key)
+  ShaderCache::Key key;
+  key.sources_hash = ShaderCache::hash(GLSL_VERSION);
+  key.defines = defines;
 
-  if (!vertex_filepath.empty()) {
-    std::string vertex_src = Filesystem::read_file(vertex_filepath);
+  if (vertex_included) {
+    vertex_src = Filesystem::read_file(vertex_filepath);
 
     if (vertex_src.empty()) {
       return {false, "Vertex shader passed could not be opened or is empty"};
     }
 
-    for (const auto &define : defines) {
-      vertex_src.insert(0, shader_define_to_string(define));
+    key.sources_hash = ShaderCache::hash(vertex_src, ShaderCache::hash(include_vertex_src + "\nvertex\n", key.sources_hash));
+    vertex_src = stage_source(include_vertex_src, defines, vertex_src);
+  }
+
+  if (geometry_included) {
+    geometry_src = Filesystem::read_file(geometry_filepath);
+
+    if (geometry_src.empty()) {
+      return {false, "Geometry shader passed could not be opened or is empty"};
+    }
+
+    key.sources_hash = ShaderCache::hash(geometry_src, ShaderCache::hash(include_geometry_src + "\ngeometry\n", key.sources_hash));
+    geometry_src = stage_source(include_geometry_src, defines, geometry_src);
+  }
+
+  if (fragment_included) {
+    fragment_src = Filesystem::read_file(fragment_filepath);
+
+    if (fragment_src.empty()) {
+      return {false, "Fragment shader passed could not be opened or is empty"};
     }
 
-    vertex_src.insert(0, include_vertex_src);
-    vertex_src.insert(0, GLSL_VERSION);
+    key.sources_hash = ShaderCache::hash(fragment_src, ShaderCache::hash(include_fragment_src + "\nfragment\n", key.sources_hash));
+    fragment_src = stage_source(include_fragment_src, defines, fragment_src);
+  }
+
+  const std::string program_label =
+      (vertex_included ? vertex_filepath + ", " : "") +
+      (geometry_included ? geometry_filepath + ", " : "") +
+      (fragment_included ? fragment_filepath + ", " : "");
+
+  // Programs of the same sources and defines are shared, linked programs are loaded from their program binary if cached
+  gl_program = ShaderCache::find(key);
+  if (gl_program != 0) {
+    compiled_successfully = true;
+    return {true, ""};
+  }
+
+  gl_program = ShaderCache::load(key);
+  if (gl_program != 0) {
+    glObjectLabel(GL_PROGRAM, gl_program, -1, program_label.c_str());
+    ShaderCache::insert(key, gl_program);
+    compiled_successfully = true;
+    return {true, ""};
+  }
+
+  gl_program = glCreateProgram();
+
+  GLint vertex_shader_compiled = GL_FALSE;
+  GLint geometry_shader_compiled = GL_FALSE;
+  GLint fragment_shader_compiled = GL_FALSE;
 
+  if (vertex_included) {
     const auto raw_str = vertex_src.c_str();
     gl_vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(gl_vertex_shader, 1, &raw_str, nullptr);
@@ -178,20 +261,7 @@ std::pair<bool, std::string> Shader::compile() {
     glGetShaderiv(gl_vertex_shader, GL_COMPILE_STATUS, &vertex_shader_compiled);
   }
 
-  if (!geometry_filepath.empty()) {
-    std::string geometry_src = Filesystem::read_file(geometry_filepath);
-
-    if (geometry_src.empty()) {
-      return {false, "Geometry shader passed could not be opened or is empty"};
-    }
-
-    for (const auto &define : defines) {
-      geometry_src.insert(0, shader_define_to_string(define));
-    }
-
-    geometry_src.insert(0, include_geometry_src);
-    geometry_src.insert(0, GLSL_VERSION);
-
+  if (geometry_included) {
     const auto raw_str = geometry_src.c_str();
     gl_geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
     glShaderSource(gl_geometry_shader, 1, &raw_str, nullptr);
@@ -205,20 +275,7 @@ std::pair<bool, std::string> Shader::compile() {
                   &geometry_shader_compiled);
   }
 
-  if (!fragment_filepath.empty()) {
-    std::string fragment_src = Filesystem::read_file(fragment_filepath);
-
-    if (fragment_src.empty()) {
-      return {false, "Fragment shader passed could not be opened or is empty"};
-    }
-
-    for (const auto &define : defines) {
-      fragment_src.insert(0, shader_define_to_string(define));
-    }
-
-    fragment_src.insert(0, include_fragment_src);
-    fragment_src.insert(0, GLSL_VERSION);
-
+  if (fragment_included) {
     const auto raw_str = fragment_src.c_str();
     gl_fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(gl_fragment_shader, 1, &raw_str, nullptr);
@@ -232,10 +289,6 @@ std::pair<bool, std::string> Shader::compile() {
                   &fragment_shader_compiled);
   }
 
-  const std::string program_label =
-      (vertex_included ? vertex_filepath + ", " : "") +
-      (geometry_included ? geometry_filepath + ", " : "") +
-      (fragment_included ? fragment_filepath + ", " : "");
   glObjectLabel(GL_PROGRAM, gl_program, -1, program_label.c_str());
 
   const bool all_shaders_compiled =
@@ -278,6 +331,7 @@ std::pair<bool, std::string> Shader::compile() {
     return {false, total_err_msg};
   }
 
+  glProgramParameteri(gl_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(gl_program);
 
   std::string err_msg = "";
@@ -311,6 +365,9 @@ std::pair<bool, std::string> Shader::compile() {
 
   if (!program_linked) {
     glDeleteProgram(gl_program);
+  } else {
+    ShaderCache::save(key, gl_program);
+    ShaderCache::insert(key, gl_program);
   }
 
   compiled_successfully = (program_linked == GL_TRUE);
@@ -319,7 +376,7 @@ std::pair<bool, std::string> Shader::compile() {
 
 bool Shader::add(const Shader::Defines define) {
   if (!compiled_successfully) {
-    defines.insert(define);
+    defines |= bit(define);
   }
   return !compiled_successfully;
 }
@@ -2,13 +2,14 @@
 #ifndef MEINEKRAFT_SHADER_HPP
 #define MEINEKRAFT_SHADER_HPP
 
-#include <set>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 /// Shader implementation is meant to be used immutable.
 /// Load the shader files needed, append some includes on them and compile.
 /// It is an error to compile a Shader twice if it has succeded.
+/// NOTE: Shaders of the same sources and defines share their program which must not be deleted (see ShaderCache)
 struct Shader {
 
   /// Shader definition for various types of textures handled
@@ -21,8 +22,12 @@ struct Shader {
     Emissive,       // Has emissive texture
     EmissiveScalars,// Emissive scalars instead of texture
     TangentNormals, // Has tangent normals
+    TangentNormalsRG, // Tangent normals in two channels (BC5), z is reconstructed
   };
 
+  /// Bit of the define in a mask of defines
+  static constexpr uint32_t bit(const Shader::Defines define) { return 1u << uint32_t(define); }
+
   Shader() = default;
   Shader(const std::string &vert_shader_file,
          const std::string &frag_shader_file);
@@ -37,6 +42,7 @@ struct Shader {
   bool add(const std::string &str);
 
   /// Loads and compiles shader sources returns compile error msg
+  /// The program is shared with an earlier Shader of the same sources or loaded from its cached program binary if possible
   std::pair<bool, std::string> compile();
 
   /// Equality operator according to the unique defines
@@ -54,8 +60,8 @@ struct Shader {
   uint32_t gl_geometry_shader = 0;
   uint32_t gl_fragment_shader = 0;
 
-  /// Configuration of the shader a la Ubershader
-  std::set<Shader::Defines> defines{};
+  /// Configuration of the shader a la Ubershader, mask of Shader::Defines (see Shader::bit)
+  uint32_t defines = 0;
 
 private:
   /// Set by compile()
@@ -0,0 +1,156 @@
+#include "shadercache.hpp"
+#include "../util/mappedfile.hpp"
+#include "../util/filesystem.hpp"
+#include "../util/logging.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <glew.h>
+#else
+#include <GL/glew.h>
+#endif
+
+static const char MAGIC[4] = {'M', 'K', 'S', 'C'};
+
+struct Header {
+  char magic[4]          = {};
+  uint32_t version       = 0;
+  uint64_t sources_hash  = 0;
+  uint64_t file_size     = 0;
+  uint32_t defines       = 0;
+  uint32_t binary_format = 0;
+  uint32_t binary_size   = 0;
+  uint32_t driver_length = 0;
+};
+
+/// Linked programs of the process by their key
+static std::map<std::pair<uint64_t, uint32_t>, uint32_t> programs;
+static ShaderCacheStatistics cache_statistics;
+
+/// Identifies the driver that links the programs, program binaries of other drivers are invalid
+static const std::string& driver() {
+  static std::string driver;
+  if (driver.empty()) {
+    for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+      const GLubyte* str = glGetString(name);
+      driver += (str ? reinterpret_cast<const char*>(str) : "") + std::string("\n");
+    }
+  }
+  return driver;
+}
+
+/// Whether or not the driver supports any program binary format
+static bool program_binaries_supported() {
+  static const bool supported = [] {
+    int32_t num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return num_formats > 0;
+  }();
+  return supported;
+}
+
+uint64_t ShaderCache::hash(const std::string& str, uint64_t hash) {
+  for (const char c : str) {
+    hash ^= uint8_t(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string ShaderCache::filepath_for(const Key& key) {
+  std::stringstream str;
+  str << std::hex << std::setw(16) << std::setfill('0') << hash(driver() + std::to_string(key.defines), key.sources_hash);
+  return Filesystem::tmp + "shadercache/" + str.str() + ".mksc";
+}
+
+void ShaderCache::invalidate(const Key& key) {
+  std::error_code error;
+  std::filesystem::remove(filepath_for(key), error);
+}
+
+uint32_t ShaderCache::find(const Key& key) {
+  const auto program = programs.find({key.sources_hash, key.defines});
+  if (program == programs.end()) { return 0; }
+  cache_statistics.num_shared++;
+  return program->second;
+}
+
+void ShaderCache::insert(const Key& key, const uint32_t gl_program) {
+  if (programs.emplace(std::make_pair(key.sources_hash, key.defines), gl_program).second) { cache_statistics.num_programs++; }
+}
+
+uint32_t ShaderCache::load(const Key& key) {
+  if (!program_binaries_supported()) { return 0; }
+
+  MappedFile file;
+  if (!file.open(filepath_for(key))) { return 0; }
+
+  Header header;
+  if (file.size < sizeof(Header)) { return 0; }
+  std::memcpy(&header, file.data, sizeof(Header));
+
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.file_size != file.size ||
+      uint64_t(sizeof(Header)) + header.driver_length + header.binary_size != file.size) {
+    Log::warn("Shader cache " + filepath_for(key) + " is invalid or outdated, recompiling");
+    return 0;
+  }
+
+  // Hash collision or a binary of another driver
+  const std::string cached_driver(reinterpret_cast<const char*>(file.data + sizeof(Header)), header.driver_length);
+  if (header.sources_hash != key.sources_hash || header.defines != key.defines || cached_driver != driver()) { return 0; }
+
+  const uint32_t gl_program = glCreateProgram();
+  glProgramBinary(gl_program, header.binary_format, file.data + sizeof(Header) + header.driver_length, header.binary_size);
+
+  // NOTE: Drivers reject binaries of other driver versions even when the driver string did not change
+  GLint program_linked = 0;
+  glGetProgramiv(gl_program, GL_LINK_STATUS, &program_linked);
+  if (!program_linked) {
+    glDeleteProgram(gl_program);
+    file.close();
+    invalidate(key);
+    return 0;
+  }
+
+  cache_statistics.num_loaded++;
+  return gl_program;
+}
+
+bool ShaderCache::save(const Key& key, const uint32_t gl_program) {
+  if (!program_binaries_supported()) { return false; }
+
+  GLint binary_size = 0;
+  glGetProgramiv(gl_program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+  if (binary_size <= 0) { return false; }
+
+  const std::string& driver_str = driver();
+  std::vector<uint8_t> buffer(sizeof(Header) + driver_str.size() + binary_size, 0);
+  GLenum binary_format = 0;
+  glGetProgramBinary(gl_program, binary_size, &binary_size, &binary_format, buffer.data() + sizeof(Header) + driver_str.size());
+
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.sources_hash = key.sources_hash;
+  header.file_size = buffer.size();
+  header.defines = key.defines;
+  header.binary_format = binary_format;
+  header.binary_size = uint32_t(binary_size);
+  header.driver_length = uint32_t(driver_str.size());
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), driver_str.data(), driver_str.size());
+
+  return Filesystem::write_atomically(filepath_for(key), buffer.data(), buffer.size());
+}
+
+ShaderCacheStatistics ShaderCache::statistics() {
+  ShaderCacheStatistics statistics = cache_statistics;
+  statistics.num_compiled = statistics.num_programs - statistics.num_loaded;
+  return statistics;
+}
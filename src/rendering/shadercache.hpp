@@ -0,0 +1,55 @@
+#pragma once
+#ifndef MEINEKRAFT_SHADERCACHE_HPP
+#define MEINEKRAFT_SHADERCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ShaderCacheStatistics {
+  size_t num_programs = 0; // Distinct programs linked or loaded
+  size_t num_shared = 0;   // Compilations served by a program already in the process
+  size_t num_loaded = 0;   // Programs loaded from their program binary
+  size_t num_compiled = 0; // Programs compiled from their sources
+};
+
+/// Linked shader programs shared within the process and cached as program binaries in Filesystem::tmp
+/// Keyed by the hash of the stage sources and the mask of Shader::Defines, program binaries are additionally keyed by
+/// the driver (GL_VENDOR, GL_RENDERER and GL_VERSION) since a binary is only valid for the driver that linked it
+/// Layout: Header, driver string, program binary
+/// NOTE: Programs of the cache are shared by every Shader compiled from the same sources thus never deleted
+struct ShaderCache {
+  /// Bump whenever the layout of the cache changes
+  static const uint32_t VERSION = 1;
+
+  struct Key {
+    uint64_t sources_hash = 0; // See hash
+    uint32_t defines = 0;      // Mask of Shader::Defines
+  };
+
+  /// Linked program of the key in the process, 0 if there is none
+  static uint32_t find(const Key& key);
+
+  /// Shares the linked program under the key with later lookups
+  static void insert(const Key& key, uint32_t gl_program);
+
+  /// Creates the program from the program binary of the key, returns 0 on a cache miss or if the driver rejects the binary
+  static uint32_t load(const Key& key);
+
+  /// Writes the program binary of the linked program, returns true on success
+  /// NOTE: The program must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+  static bool save(const Key& key, uint32_t gl_program);
+
+  /// Removes the program binary of the key (if any)
+  static void invalidate(const Key& key);
+
+  /// Filepath of the program binary of the key
+  static std::string filepath_for(const Key& key);
+
+  /// 64-bit FNV-1a hash of the string continued from the hash of the preceding strings (if any)
+  static uint64_t hash(const std::string& str, uint64_t hash = 0xcbf29ce484222325ull);
+
+  static ShaderCacheStatistics statistics();
+};
+
+#endif // MEINEKRAFT_SHADERCACHE_HPP
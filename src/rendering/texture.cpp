@@ -1,5 +1,6 @@
 #include "texture.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -8,8 +9,95 @@
 #include <SDL2/SDL_image.h>
 
 #include "../util/logging.hpp"
+#include "../util/profiler.hpp"
+#include "../util/jobsystem.hpp"
+#include "texturecache.hpp"
+#include "textureencoder.hpp"
+#include "texturepool.hpp"
 
-RawTexture Texture::load_textures(const TextureResource& resource) {
+// NOTE: stb_image allocates from the TexturePool such that decoded images are adopted as the pixels without a copy
+#define STBI_MALLOC(size) TexturePool::allocate(size)
+#define STBI_REALLOC(pixels, size) TexturePool::reallocate((uint8_t*) (pixels), size)
+#define STBI_FREE(pixels) TexturePool::release((uint8_t*) (pixels))
+#define STB_IMAGE_IMPLEMENTATION
+#include "../util/stb_image.h"
+
+TextureImportSettings Texture::import_settings;
+TextureStreamingSettings Texture::streaming_settings;
+
+/// Decodes the files with stb_image straight into the upload format (RGB8 or RGBA8)
+/// Single file textures are the decoded image as is, faces of cube maps are copied into place
+static RawTexture decode_stb_image(const TextureResource& resource) {
+  RawTexture texture{};
+  if (resource.files.empty()) { return texture; }
+
+  // NOTE: The format is decided from the headers up front such that every face is decoded straight into it
+  // Faces with alpha make the whole texture RGBA, grey is decoded as RGB
+  std::vector<int> channels(resource.files.size(), 0);
+  uint8_t bytes_per_pixel = Texture::import_settings.rgba ? 4 : 3;
+  for (size_t i = 0; i < resource.files.size(); i++) {
+    int width = 0, height = 0;
+    if (stbi_info(resource.files[i].c_str(), &width, &height, &channels[i]) && (channels[i] == 2 || channels[i] == 4)) {
+      bytes_per_pixel = 4;
+    }
+  }
+
+  for (size_t i = 0; i < resource.files.size(); i++) {
+    // RGB files of RGBA textures are expanded after decoding, faster than the conversion of stb_image
+    const bool expand = bytes_per_pixel == 4 && channels[i] == 3;
+    int width = 0, height = 0, num_channels = 0;
+    uint8_t* pixels = nullptr;
+    {
+      ProfileScope scope("texture_decode");
+      pixels = stbi_load(resource.files[i].c_str(), &width, &height, &num_channels, expand ? 3 : bytes_per_pixel);
+    }
+    if (!pixels) {
+      // NOTE: The failure reason of stb_image is shared between threads and might be of a concurrent decode
+      Log::error("Could not load texture " + resource.files[i] + ": " + std::string(stbi_failure_reason()));
+      continue;
+    }
+
+    if (!texture.pixels) {
+      texture.width = uint32_t(width);
+      texture.height = uint32_t(height);
+      texture.bytes_per_pixel = bytes_per_pixel;
+      texture.size = texture.bytes_per_pixel * texture.width * texture.height;
+      texture.faces = uint32_t(resource.files.size());
+      if (resource.files.size() == 1 && !expand) {
+        texture.pixels = pixels;
+        return texture;
+      }
+      // Allocate all the memory on the first decoded file, faces failing to decode are black
+      texture.pixels = TexturePool::allocate(size_t(texture.size) * resource.files.size());
+      if (!texture.pixels) {
+        Log::error("Could not allocate texture " + resource.files[i]);
+        TexturePool::release(pixels);
+        return RawTexture();
+      }
+      std::memset(texture.pixels, 0, size_t(texture.size) * resource.files.size());
+    }
+
+    if (uint32_t(width) != texture.width || uint32_t(height) != texture.height) {
+      Log::error("Texture " + resource.files[i] + " differs in size from the other faces");
+      TexturePool::release(pixels);
+      continue;
+    }
+
+    uint8_t* face = texture.pixels + size_t(texture.size) * i;
+    if (expand) {
+      ProfileScope scope("texture_conversion");
+      TextureEncoder::expand_rgb_to_rgba(pixels, size_t(texture.width) * texture.height, face);
+    } else {
+      std::memcpy(face, pixels, texture.size);
+    }
+    TexturePool::release(pixels);
+  }
+
+  return texture;
+}
+
+/// Decodes the files with SDL_image and converts the surfaces to RGB24 or RGBA32 when needed
+static RawTexture decode_sdl_image(const TextureResource& resource) {
   RawTexture texture{};
 
   if (resource.files.empty()) { return texture; }
@@ -17,20 +105,32 @@ RawTexture Texture::load_textures(const TextureResource& resource) {
   // Load all the files into a linear memory region
   // NOTE: Assumes that the files are the same size, in right order, same encoding, etc
   for (size_t i = 0; i < resource.files.size(); i++) {
-    SDL_Surface* image = IMG_Load(resource.files[i].c_str());
+    SDL_Surface* image = nullptr;
+    {
+      ProfileScope scope("texture_decode");
+      image = IMG_Load(resource.files[i].c_str());
+    }
     if (!image) {
-      Log::error("Could not load texture: " + std::string(IMG_GetError()));
+      Log::error("Could not load texture " + resource.files[i] + ": " + std::string(IMG_GetError()));
       continue;
     }
     texture.width = static_cast<uint32_t>(image->w);
     texture.height = static_cast<uint32_t>(image->h);
     texture.bytes_per_pixel = image->format->BytesPerPixel;
     texture.size = texture.bytes_per_pixel * texture.width * texture.height;
-    if (i == 0) { // Allocate all the memory on the first iteration
-      texture.pixels = static_cast<uint8_t*>(std::calloc(1, texture.size * resource.files.size()));
+    if (!texture.pixels) { // Allocate all the memory on the first decoded file, faces failing to decode are black
+      texture.faces = uint32_t(resource.files.size());
+      texture.pixels = TexturePool::allocate(size_t(texture.size) * resource.files.size());
+      if (!texture.pixels) {
+        Log::error("Could not allocate texture " + resource.files[i]);
+        SDL_FreeSurface(image);
+        return RawTexture();
+      }
+      std::memset(texture.pixels, 0, size_t(texture.size) * resource.files.size());
     }
 
     // Convert it to OpenGL friendly format if needed
+    ProfileScope scope("texture_conversion");
     const auto desired_img_format = texture.bytes_per_pixel == 3 ? SDL_PIXELFORMAT_RGB24 : SDL_PIXELFORMAT_RGBA32;
     if (image->format->format == desired_img_format) {
       std::memcpy(texture.pixels + texture.size * i, image->pixels, texture.size);
@@ -40,12 +140,141 @@ RawTexture Texture::load_textures(const TextureResource& resource) {
         std::memcpy(texture.pixels + texture.size * i, conv->pixels, texture.size);
         SDL_FreeSurface(conv);
       } else {
-        Log::error("RawTexture loading failed: " + std::string(SDL_GetError()));
+        Log::error("RawTexture conversion of " + resource.files[i] + " failed: " + std::string(SDL_GetError()));
       }
     }
     SDL_FreeSurface(image);
-    texture.faces++;
   }
 
   return texture;
 }
+
+RawTexture Texture::load_textures(const TextureResource& resource) {
+  if (import_settings.decoder == TextureDecoder::SDLImage) { return decode_sdl_image(resource); }
+  return decode_stb_image(resource);
+}
+
+TextureEncoding Texture::encoding_for(const Type type) {
+  if (!import_settings.compress) { return TextureEncoding::Uncompressed; }
+  return type == Type::TangentNormal ? TextureEncoding::TwoChannel : TextureEncoding::Color;
+}
+
+/// Decodes the texture and generates its mip chain, the decoded base level is freed
+static RawTexture load_mips(const TextureResource& resource) {
+  const RawTexture decoded = Texture::load_textures(resource);
+  if (!decoded.pixels) { return decoded; }
+  const RawTexture mips = TextureEncoder::generate_mips(decoded, resource.is_sRGB);
+  if (!mips.pixels) { return decoded; } // Uploaded without mips instead
+  TexturePool::release(decoded.pixels);
+  return mips;
+}
+
+/// Block format of the encoded texture given the bytes per pixel of the decoded texture
+static BlockFormat format_for(const TextureResource& resource, const uint8_t bytes_per_pixel) {
+  switch (resource.encoding) {
+    case TextureEncoding::Uncompressed: return BlockFormat::None;
+    case TextureEncoding::TwoChannel: return BlockFormat::BC5;
+    default: return Texture::import_settings.high_quality ? BlockFormat::BC7 : (bytes_per_pixel == 4 ? BlockFormat::BC3 : BlockFormat::BC1);
+  }
+}
+
+/// Loads the block compressed texture from the TextureCache or decodes, encodes and caches it
+static RawTexture load_encoded(const TextureResource& resource) {
+  RawTexture texture;
+  if (TextureCache::load(resource, texture)) { return texture; }
+
+  const RawTexture mips = load_mips(resource);
+  if (!mips.pixels) { return mips; }
+
+  texture = TextureEncoder::encode(mips, format_for(resource, mips.bytes_per_pixel));
+  if (!texture.pixels) { return mips; } // Uploaded uncompressed instead
+  TexturePool::release(mips.pixels);
+
+  TextureCache::save(resource, texture);
+  return texture;
+}
+
+/// Loads the full mip chain of the texture, uncompressed chains are cached as well when streaming since their levels
+/// are read on demand (see Texture::load_levels)
+static RawTexture load_chain(const TextureResource& resource) {
+  if (resource.encoding != TextureEncoding::Uncompressed) { return load_encoded(resource); }
+  const bool streaming = Texture::streaming_settings.tail_size != 0;
+  RawTexture texture;
+  if (streaming && TextureCache::load(resource, texture)) { return texture; }
+  texture = load_mips(resource);
+  if (streaming && texture.pixels) { TextureCache::save(resource, texture); }
+  return texture;
+}
+
+/// Loads the mip tail of the texture (see TextureStreamingSettings::tail_size), the rest of the chain is only cached
+static RawTexture load_tail(const TextureResource& resource) {
+  const uint32_t tail_size = Texture::streaming_settings.tail_size;
+  RawTexture tail;
+  if (TextureCache::load(resource, tail, tail_size)) { return tail; }
+
+  const RawTexture chain = load_chain(resource);
+  if (!chain.pixels) { return chain; }
+  const uint32_t tail_level = std::min(TextureEncoder::tail_level(chain.width, chain.height, tail_size), chain.levels - 1);
+  if (tail_level == 0) { return chain; }
+  tail = TextureEncoder::copy_levels(chain, tail_level, chain.levels);
+  if (!tail.pixels) { return chain; }
+  TexturePool::release(chain.pixels);
+  return tail;
+}
+
+std::vector<RawTexture> Texture::load_textures(const std::vector<TextureResource>& resources) {
+  // NOTE: Decoding is independent per resource, stb_image and IMG_Load are thread safe
+  std::vector<RawTexture> textures(resources.size());
+  JobSystem::instance().parallel_for(resources.size(), [&](const size_t i) {
+    if (streaming_settings.tail_size != 0) {
+      textures[i] = load_tail(resources[i]);
+    } else if (resources[i].encoding == TextureEncoding::Uncompressed) {
+      textures[i] = load_mips(resources[i]);
+    } else {
+      textures[i] = load_encoded(resources[i]);
+    }
+  }, import_settings.decode_concurrency);
+  return textures;
+}
+
+RawTexture Texture::layout_of(const TextureResource& resource) {
+  RawTexture layout;
+  if (resource.files.empty()) { return layout; }
+
+  // NOTE: Mirrors decode_stb_image, faces with alpha make the whole texture RGBA
+  uint8_t bytes_per_pixel = import_settings.rgba ? 4 : 3;
+  int width = 0, height = 0;
+  for (const auto& file : resource.files) {
+    int channels = 0;
+    if (!stbi_info(file.c_str(), &width, &height, &channels)) { return RawTexture(); }
+    if (channels == 2 || channels == 4) { bytes_per_pixel = 4; }
+  }
+
+  layout.width = uint32_t(width);
+  layout.height = uint32_t(height);
+  layout.faces = uint32_t(resource.files.size());
+  layout.bytes_per_pixel = bytes_per_pixel;
+  layout.format = format_for(resource, bytes_per_pixel);
+  layout.levels = TextureEncoder::num_levels(layout.width, layout.height);
+  if (streaming_settings.tail_size != 0) {
+    layout.base_level = std::min(TextureEncoder::tail_level(layout.width, layout.height, streaming_settings.tail_size), layout.levels - 1);
+    layout.levels -= layout.base_level;
+  }
+  layout.size = 0;
+  for (uint32_t level = layout.base_level; level < layout.base_level + layout.levels; level++) {
+    layout.size += uint32_t(TextureEncoder::level_byte_size(layout, level));
+  }
+  return layout;
+}
+
+RawTexture Texture::load_levels(const TextureResource& resource, const uint32_t first_level, const uint32_t last_level) {
+  RawTexture levels;
+  if (TextureCache::load_levels(resource, first_level, last_level, levels)) { return levels; }
+
+  // NOTE: Cache miss (e.g evicted or never written), decoded again as a whole and cached on the way
+  const RawTexture chain = load_chain(resource);
+  if (!chain.pixels) { return chain; }
+  levels = TextureEncoder::copy_levels(chain, first_level, std::min(last_level, chain.levels));
+  TexturePool::release(chain.pixels);
+  return levels;
+}
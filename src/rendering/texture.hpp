@@ -18,27 +18,60 @@
 /// Opaque ID type used to reference resources throughout the engine
 typedef uint64_t ID; // FIXME: Wtf, double defined?
 
+/// Block compressed formats of 4x4 texel blocks (see TextureEncoder)
+enum class BlockFormat: uint32_t {
+  None, // Uncompressed
+  BC1,  // RGB, 8 bytes per block
+  BC3,  // RGBA, BC1 color and BC4 alpha, 16 bytes per block
+  BC5,  // RG, two BC4 blocks, 16 bytes per block
+  BC7   // RGBA, 16 bytes per block
+};
+
+/// Encoding of a texture in GPU memory, decided by the type of the texture (see Texture::encoding_for)
+enum class TextureEncoding: uint8_t {
+  Uncompressed,
+  Color,      // BC1 (RGB) or BC3 (RGBA), BC7 if TextureImportSettings::high_quality
+  TwoChannel  // BC5 of the red and green channels, z of tangent space normals is reconstructed in the shader
+};
+
+/// NOTE: Textures with mips hold their mip chain level by level, every level holds all the faces (see TextureEncoder)
+/// Streamed textures hold the coarse end of the chain from base_level (see TextureStreamingSettings)
 struct RawTexture {
   uint8_t* pixels = nullptr;
-  uint8_t  bytes_per_pixel = 0;
-  uint32_t size   = 0; // Byte size per face
-  uint32_t width  = 0; // Measured in pixels
+  uint8_t  bytes_per_pixel = 0; // Of the decoded source for block compressed textures
+  uint32_t size   = 0; // Byte size per face (of all the levels)
+  uint32_t width  = 0; // Measured in pixels, of level 0 regardless of base_level
   uint32_t height = 0; 
   uint32_t faces  = 0; // Number of faces, used for cube maps
+  BlockFormat format = BlockFormat::None;
+  uint32_t levels = 1; // Mip levels held in pixels
+  uint32_t base_level = 0; // Level of the chain first held in pixels
   RawTexture() = default;
 };
 
 struct TextureResource {
   std::vector<std::string> files;
+  TextureEncoding encoding = TextureEncoding::Uncompressed;
+  bool is_sRGB = false; // Color is sRGB encoded, mips are filtered in linear space (see TextureEncoder::generate_mips)
+  bool keep_resident = false; // Pixels are kept on the CPU after upload (e.g for readback), not part of the key (see TextureManager)
   
   explicit TextureResource(const std::string& file): files{file} {};
   explicit TextureResource(const std::vector<std::string>& files): files{files} {};
   
+  /// 64-bit FNV-1a of the files in order, the encoding and the color space, files are separated such that ("ab", "c") and ("a", "bc") differ
+  /// NOTE: Used as the key of the TextureManager which checks the files on lookup in order to detect collisions
   uint64_t to_hash() const {
-    uint64_t hash = 0;
+    uint64_t hash = 0xcbf29ce484222325;
+    auto hash_byte = [&](const uint8_t byte) {
+      hash ^= byte;
+      hash *= 0x100000001b3;
+    };
     for (const auto& file : files) {
-      hash += std::hash<std::string>{}(file);
+      for (const char c : file) { hash_byte(uint8_t(c)); }
+      hash_byte(0);
     }
+    hash_byte(uint8_t(encoding));
+    hash_byte(uint8_t(is_sRGB));
     return hash;
   }
 };
@@ -53,8 +86,50 @@ enum class TextureFormat {
   R32F
 };
 
+/// Image decoder of the texture files
+enum class TextureDecoder: uint8_t {
+  STBImage, // Decodes straight into the upload format in TexturePool memory
+  SDLImage  // Decodes to an SDL_Surface which is converted and copied, kept for comparison
+};
+
+/// Governed by "texture_import" in config.json
+struct TextureImportSettings {
+  TextureDecoder decoder = TextureDecoder::STBImage; // "stb_image" or "sdl_image"
+  size_t decode_concurrency = 0; // Max number of textures decoded at once, 0 means every JobSystem worker and the calling thread
+  bool compress = false;         // Block compresses textures with their mips, cached in Filesystem::tmp (see TextureCache)
+  bool high_quality = false;     // BC7 instead of BC1/BC3 for color textures, slower to encode
+  bool rgba = false;             // Expands RGB textures to RGBA on decode, the native upload format of most GPUs (stb_image only)
+};
+
+/// Governed by "texture_streaming" in config.json
+struct TextureStreamingSettings {
+  uint32_t tail_size = 0;                           // Textures are loaded with the levels of at most this size, 0 disables streaming
+  size_t frame_upload_budget = 8 * 1024 * 1024;     // Bytes of finer levels uploaded per frame (see TextureStreamer)
+  size_t vram_budget = size_t(1024) * 1024 * 1024;  // Bytes of streamed textures resident on the GPU before levels are evicted
+};
+
 struct Texture {
+  static TextureImportSettings import_settings;
+  static TextureStreamingSettings streaming_settings;
+
+  /// Decodes the files of the resource as faces of one texture (see TextureImportSettings::decoder)
+  /// Faces which fail to decode are left black
   static RawTexture load_textures(const TextureResource& resource);
+
+  /// Decodes the resources and generates their mips in parallel on the JobSystem (see TextureImportSettings), blocking
+  /// Resources with an encoding are loaded from the TextureCache or decoded, block compressed and cached
+  /// Only the mip tail is loaded when streaming (see TextureStreamingSettings), the whole chain is cached
+  /// Resources which fail to decode are reported per file and result in an empty RawTexture
+  static std::vector<RawTexture> load_textures(const std::vector<TextureResource>& resources);
+
+  /// Loads the levels [first_level, last_level) of the full mip chain of the resource, used to stream in finer levels
+  /// Read from the TextureCache, decoded (and cached) again on a miss, returns an empty RawTexture on failure
+  static RawTexture load_levels(const TextureResource& resource, uint32_t first_level, uint32_t last_level);
+
+  /// Layout of the texture the resource loads as (format, dimensions and levels) read from the headers of the files
+  /// without decoding them, pixels are never set, returns an empty RawTexture if the files can not be read
+  /// NOTE: Predicts the loaded texture, e.g a texture failing to encode is loaded uncompressed instead
+  static RawTexture layout_of(const TextureResource& resource);
   
   /// Texture id
   ID id = 0;
@@ -73,6 +148,9 @@ struct Texture {
     Emissive,             // Emission texture
     TangentNormal         // Tangent space normal map/texture
   };
+
+  /// Encoding of textures of the type given the TextureImportSettings
+  static TextureEncoding encoding_for(const Type type);
 };
 
 #endif // MEINEKRAFT_TEXTURE_HPP
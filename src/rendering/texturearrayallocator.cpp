@@ -0,0 +1,200 @@
+#include "texturearrayallocator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+#ifdef WIN32
+#include <glew.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "../util/logging.hpp"
+#include "graphicsbatch.hpp"
+#include "textureencoder.hpp"
+#include "texturemanager.hpp"
+
+/// Key of the texture of the layout uploaded as the target
+static TextureArrayKey key_of(const RawTexture& layout, const uint32_t target, const bool is_sRGB) {
+  TextureArrayKey key;
+  key.target = target;
+  key.internal_format = gl_internal_format(layout, is_sRGB);
+  key.format = layout.format;
+  key.bytes_per_pixel = layout.bytes_per_pixel;
+  key.width = layout.width;
+  key.height = layout.height;
+  key.faces = layout.faces;
+  key.num_levels = layout.base_level + layout.levels;
+  key.tail_level = layout.base_level;
+  return key;
+}
+
+TextureArrayKey TextureArrayKey::of(const Texture& texture, const bool is_sRGB) {
+  return key_of(texture.data, texture.gl_texture_target, is_sRGB);
+}
+
+/// Adds layers of the key to the plan
+static void add_to(TextureArrayPlan& plan, const TextureArrayKey& key, const uint32_t layers) {
+  for (auto& pair : plan) {
+    if (pair.first == key) { pair.second += layers; return; }
+  }
+  plan.push_back({key, layers});
+}
+
+static uint32_t max_layers() {
+  int32_t max_array_layers = 0;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_array_layers);
+  return uint32_t(std::max(max_array_layers, 1));
+}
+
+TextureArrayPlan TextureArrayAllocator::plan(const std::vector<Texture>& textures, const bool is_sRGB) const {
+  TextureArrayPlan plan;
+  std::unordered_set<ID> planned;
+  for (const Texture& texture : textures) {
+    if (!texture.data.pixels || !planned.insert(texture.id).second) { continue; }
+    const bool allocated = std::any_of(arrays.begin(), arrays.end(), [&](const TextureArray& array) { return array.layer_idxs.count(texture.id) != 0; });
+    if (!allocated) { add_to(plan, TextureArrayKey::of(texture, is_sRGB), 1); }
+  }
+  return plan;
+}
+
+TextureArrayPlan TextureArrayAllocator::plan(const std::vector<std::vector<std::pair<Texture::Type, std::string>>>& manifest) {
+  TextureArrayPlan plan;
+  std::unordered_set<std::string> planned;
+  for (const auto& texture_infos : manifest) {
+    for (const auto& pair : texture_infos) {
+      if (pair.first != Texture::Type::Diffuse || !planned.insert(pair.second).second) { continue; }
+      // NOTE: Diffuse textures are loaded as sRGB and bound as 2D arrays (see RenderComponent::set_texture)
+      TextureResource resource{pair.second};
+      resource.encoding = Texture::encoding_for(Texture::Type::Diffuse);
+      resource.is_sRGB = true;
+      const RawTexture layout = Texture::layout_of(resource);
+      if (layout.width == 0) { continue; }
+      add_to(plan, key_of(layout, GL_TEXTURE_2D_ARRAY, true), 1);
+    }
+  }
+  return plan;
+}
+
+uint32_t TextureArrayAllocator::allocate(const TextureArrayKey& key, const uint32_t capacity, const uint32_t gl_texture_unit) {
+  TextureArray array;
+  array.key = key;
+  array.capacity = capacity;
+  array.gl_texture_unit = gl_texture_unit;
+
+  Texture texture;
+  texture.gl_texture_target = key.target;
+  texture.data.format = key.format;
+  texture.data.bytes_per_pixel = key.bytes_per_pixel;
+  texture.data.width = key.width;
+  texture.data.height = key.height;
+  texture.data.faces = key.faces;
+  texture.data.base_level = key.tail_level;
+  texture.data.levels = key.num_levels - key.tail_level;
+  array.residency = TextureStreamer::residency_of(texture, key.internal_format);
+  array.residency.streamed = false; // Until a layer is added
+
+  array.gl_texture = TextureStreamer::create_storage(array.residency, key.tail_level, capacity, gl_texture_unit);
+
+  arrays.push_back(array);
+  return uint32_t(arrays.size() - 1);
+}
+
+void TextureArrayAllocator::reserve(const TextureArrayPlan& plan) {
+  const uint32_t max_array_layers = max_layers();
+  for (const auto& pair : plan) {
+    const TextureArrayKey& key = pair.first;
+    uint32_t layers = pair.second;
+    planned_layers += layers;
+
+    // Free layers of the arrays of the key are used first, arrays are only grown before any texture is uploaded to them
+    for (TextureArray& array : arrays) {
+      if (!(array.key == key) || layers == 0) { continue; }
+      layers -= std::min(layers, array.capacity - array.count);
+      if (array.count == 0 && layers > 0 && array.capacity < max_array_layers) {
+        const uint32_t grown = std::min(array.capacity + layers, max_array_layers);
+        TextureStreamer::reallocate(array.storage(), array.residency.base_level, grown);
+        layers -= grown - array.capacity;
+        array.capacity = grown;
+      }
+    }
+
+    while (layers > 0) {
+      const uint32_t capacity = std::min(layers, max_array_layers);
+      allocate(key, capacity, 0);
+      layers -= capacity;
+    }
+  }
+}
+
+/// Uploads the texture to the layer of the array as is with its prebuilt mips (see TextureEncoder)
+/// NOTE: Levels of the texture finer than those held by the array are skipped
+static void upload(const Texture& texture, TextureArray& array, const uint32_t layer) {
+  const RawTexture& data = texture.data;
+  glActiveTexture(GL_TEXTURE0 + array.gl_texture_unit);
+  glBindTexture(array.key.target, array.gl_texture);
+  for (uint32_t level = std::max(data.base_level, array.residency.base_level); level < data.base_level + data.levels; level++) {
+    TextureStreamer::upload_level(array.residency, level, layer, data.pixels + TextureEncoder::level_offset(data, level));
+  }
+}
+
+std::pair<uint32_t, uint32_t> TextureArrayAllocator::add(const Texture& texture, const bool is_sRGB, const uint32_t gl_texture_unit) {
+  for (uint32_t i = 0; i < arrays.size(); i++) {
+    const auto it = arrays[i].layer_idxs.find(texture.id);
+    if (it != arrays[i].layer_idxs.end()) { return {i, it->second}; }
+  }
+
+  // First array of the key with a free layer, grown by 1.5x when the plan did not cover the texture
+  const TextureArrayKey key = TextureArrayKey::of(texture, is_sRGB);
+  const uint32_t max_array_layers = max_layers();
+  uint32_t array_idx = NO_ARRAY;
+  for (uint32_t i = 0; i < arrays.size(); i++) {
+    if (arrays[i].key == key && arrays[i].count < arrays[i].capacity) { array_idx = i; break; }
+  }
+  if (array_idx == NO_ARRAY) {
+    for (uint32_t i = 0; i < arrays.size(); i++) {
+      TextureArray& array = arrays[i];
+      if (!(array.key == key) || array.capacity >= max_array_layers) { continue; }
+      const uint32_t grown = std::min(std::max(array.capacity + 1, uint32_t(std::ceil(array.capacity * 1.5f))), max_array_layers);
+      TextureStreamer::reallocate(array.storage(), array.residency.base_level, grown);
+      array.capacity = grown;
+      num_grows++;
+      array_idx = i;
+      break;
+    }
+  }
+  if (array_idx == NO_ARRAY) { array_idx = allocate(key, 1, gl_texture_unit); }
+
+  TextureArray& array = arrays[array_idx];
+  array.gl_texture_unit = gl_texture_unit;
+  TextureResidency& residency = array.residency;
+  TextureResource resource{std::vector<std::string>{}};
+  const bool streamable = TextureManager::resource_of(texture.id, resource) && residency.tail_level > 0;
+  residency.streamed = (array.count == 0 || residency.streamed) && streamable;
+  residency.layers.push_back(resource);
+
+  // NOTE: Layers are uploaded with the levels they were loaded with, the array can not hold finer levels than them
+  if (residency.base_level < texture.data.base_level) {
+    TextureStreamer::reallocate(array.storage(), texture.data.base_level, array.capacity);
+  }
+  residency.generation = TextureStreamer::next_generation(); // Loads in flight lack the new layer
+  residency.pending = false;
+
+  const uint32_t layer = array.count++;
+  array.layer_idxs[texture.id] = layer;
+  upload(texture, array, layer);
+  return {array_idx, layer};
+}
+
+TextureArrayStatistics TextureArrayAllocator::statistics() const {
+  TextureArrayStatistics statistics;
+  statistics.num_arrays = arrays.size();
+  for (const TextureArray& array : arrays) {
+    statistics.num_layers += array.count;
+    statistics.capacity += array.capacity;
+  }
+  statistics.planned_layers = planned_layers;
+  statistics.num_grows = num_grows;
+  return statistics;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef MEINEKRAFT_TEXTUREARRAYALLOCATOR_HPP
+#define MEINEKRAFT_TEXTUREARRAYALLOCATOR_HPP
+
+#include "texture.hpp"
+#include "texturestreamer.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Format and dimensions shared by the layers of a TextureArray
+struct TextureArrayKey {
+  uint32_t target = 0;          // GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY
+  uint32_t internal_format = 0;
+  BlockFormat format = BlockFormat::None;
+  uint8_t bytes_per_pixel = 0;
+  uint32_t width = 0;           // Of level 0
+  uint32_t height = 0;
+  uint32_t faces = 0;
+  uint32_t num_levels = 0;      // Of the full chain
+  uint32_t tail_level = 0;      // First level loaded (see RawTexture::base_level)
+
+  /// Key of the texture as uploaded
+  static TextureArrayKey of(const Texture& texture, bool is_sRGB);
+
+  bool operator==(const TextureArrayKey& other) const {
+    return target == other.target && internal_format == other.internal_format && format == other.format &&
+      bytes_per_pixel == other.bytes_per_pixel && width == other.width && height == other.height && faces == other.faces &&
+      num_levels == other.num_levels && tail_level == other.tail_level;
+  }
+};
+
+/// Texture array holding the diffuse textures of one format and dimensions of every GraphicsBatch
+struct TextureArray {
+  TextureArrayKey key;
+  TextureResidency residency;   // Levels held by every layer (see TextureStreamer)
+  uint32_t gl_texture = 0;
+  uint32_t gl_texture_unit = 0; // Used while uploading, batches bind the array to their own unit
+  uint32_t capacity = 0;        // Layers allocated
+  uint32_t count = 0;           // Layers holding a texture
+  std::unordered_map<ID, uint32_t> layer_idxs; // Texture ID to layer
+
+  TextureStorage storage() {
+    TextureStorage storage;
+    storage.residency = &residency;
+    storage.gl_texture = &gl_texture;
+    storage.gl_texture_unit = gl_texture_unit;
+    storage.num_layers = capacity;
+    return storage;
+  }
+};
+
+/// Layers planned per format and dimensions (see TextureArrayAllocator::plan)
+typedef std::vector<std::pair<TextureArrayKey, uint32_t>> TextureArrayPlan;
+
+struct TextureArrayStatistics {
+  size_t num_arrays = 0;
+  size_t num_layers = 0;     // Layers holding a texture
+  size_t capacity = 0;       // Layers allocated
+  size_t planned_layers = 0; // Layers allocated from plans
+  size_t num_grows = 0;      // Arrays grown (and copied) since no plan covered the texture
+};
+
+/// Allocates the diffuse textures of every GraphicsBatch as layers of texture arrays grouped by format and dimensions
+/// Arrays are sized from the texture manifest of a scene before any texture is uploaded (see plan and reserve) such that
+/// loading a scene never has to grow an array, growing copies every layer and level to new storage
+/// NOTE: Textures stay in their layer once uploaded, each texture is uploaded once however many batches draw it
+struct TextureArrayAllocator {
+  /// Layers needed by the unique textures, which are not already allocated
+  TextureArrayPlan plan(const std::vector<Texture>& textures, bool is_sRGB) const;
+
+  /// Layers needed by the unique diffuse textures of the manifest (texture files of every mesh, see MeshManager::load_meshes)
+  /// NOTE: The textures are not decoded, their layout is read from the headers of the files (see Texture::layout_of)
+  static TextureArrayPlan plan(const std::vector<std::vector<std::pair<Texture::Type, std::string>>>& manifest);
+
+  /// Allocates layers for the plan, blocking
+  void reserve(const TextureArrayPlan& plan);
+
+  /// Array and layer of the texture, the texture is uploaded to a layer of an array of its key on first use
+  /// gl_texture_unit is used while uploading
+  std::pair<uint32_t, uint32_t> add(const Texture& texture, bool is_sRGB, uint32_t gl_texture_unit);
+
+  /// OpenGL handle of the array, 0 for NO_ARRAY
+  uint32_t gl_texture(const uint32_t array) const { return array < arrays.size() ? arrays[array].gl_texture : 0; }
+
+  TextureArrayStatistics statistics() const;
+
+  static const uint32_t NO_ARRAY = UINT32_MAX;
+
+  std::vector<TextureArray> arrays;
+
+private:
+  size_t planned_layers = 0;
+  size_t num_grows = 0;
+
+  /// Allocates an array of the key with the capacity
+  uint32_t allocate(const TextureArrayKey& key, uint32_t capacity, uint32_t gl_texture_unit);
+};
+
+#endif // MEINEKRAFT_TEXTUREARRAYALLOCATOR_HPP
@@ -0,0 +1,181 @@
+#include "texturecache.hpp"
+#include "textureencoder.hpp"
+#include "texturepool.hpp"
+#include "../util/filesystem.hpp"
+#include "../util/logging.hpp"
+#include "../util/profiler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+static const char MAGIC[4] = {'M', 'K', 'T', 'C'};
+
+struct Header {
+  char magic[4]           = {};
+  uint32_t version        = 0;
+  int64_t source_mtime    = 0;  // Combined modification times of the source files
+  uint64_t import_flags   = 0;  // See encode_flags
+  uint64_t file_size      = 0;
+  uint32_t format         = 0;  // BlockFormat
+  uint32_t bytes_per_pixel = 0;
+  uint32_t width          = 0;
+  uint32_t height         = 0;
+  uint32_t faces          = 0;
+  uint32_t levels         = 0;
+  uint32_t size           = 0;  // Byte size per face of all the levels
+  uint32_t sources_length = 0;
+};
+
+static inline uint64_t align_to(const uint64_t offset, const uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/// Combined modification time of the files, returns false if any of them can not be queried
+static bool modification_time(const std::vector<std::string>& files, int64_t& mtime) {
+  uint64_t combined = 0;
+  for (const auto& file : files) {
+    std::error_code error;
+    const auto time = std::filesystem::last_write_time(file, error);
+    if (error) { return false; }
+    combined ^= uint64_t(time.time_since_epoch().count()) + 0x9e3779b97f4a7c15 + (combined << 6) + (combined >> 2);
+  }
+  mtime = int64_t(combined);
+  return true;
+}
+
+/// Settings which the cached textures depend on
+static uint64_t encode_flags() {
+  return (Texture::import_settings.high_quality ? 1 : 0) | (Texture::import_settings.rgba ? 2 : 0);
+}
+
+static std::string sources_of(const TextureResource& resource) {
+  std::string sources;
+  for (const auto& file : resource.files) { sources += file + "\n"; }
+  return sources;
+}
+
+static const std::string directory = Filesystem::tmp + "texturecache/";
+
+std::string TextureCache::filepath_for(const TextureResource& resource) {
+  std::stringstream str;
+  str << std::hex << std::setw(16) << std::setfill('0') << resource.to_hash();
+  return directory + str.str() + ".mktc";
+}
+
+void TextureCache::invalidate(const TextureResource& resource) {
+  std::error_code error;
+  std::filesystem::remove(filepath_for(resource), error);
+}
+
+void TextureCache::invalidate_all() {
+  std::error_code error;
+  std::filesystem::remove_all(directory, error);
+}
+
+/// Reads the levels [first_level, last_level) clamped to the levels of the cached texture, first_level is raised to the
+/// level of at most max_size texels unless max_size is 0
+static bool read(const TextureResource& resource, RawTexture& texture, const uint32_t max_size, uint32_t first_level, uint32_t last_level) {
+  ProfileScope scope("texture_cache_load");
+  int64_t mtime = 0;
+  if (!modification_time(resource.files, mtime)) { return false; }
+
+  std::ifstream ifs(TextureCache::filepath_for(resource), std::ios::binary | std::ios::ate);
+  if (!ifs) { return false; }
+  const uint64_t size = uint64_t(ifs.tellg());
+  ifs.seekg(0);
+
+  Header header;
+  if (size < sizeof(Header) || !ifs.read(reinterpret_cast<char*>(&header), sizeof(Header))) { return false; }
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != TextureCache::VERSION || header.file_size != size) {
+    Log::warn("Texture cache of " + resource.files.front() + " is invalid or outdated, reencoding");
+    return false;
+  }
+
+  // Stale cache, source has been modified or encoded differently since
+  if (header.source_mtime != mtime || header.import_flags != encode_flags()) { return false; }
+
+  const std::string sources = sources_of(resource);
+  const uint64_t pixels_offset = align_to(sizeof(Header) + header.sources_length, 8);
+  const uint64_t pixels_size = uint64_t(header.size) * header.faces;
+  if (header.sources_length != sources.size() || pixels_offset + pixels_size != size) { return false; }
+  std::string cached_sources(header.sources_length, '\0');
+  if (!ifs.read(&cached_sources[0], cached_sources.size()) || cached_sources != sources) { return false; } // Hash collision
+
+  RawTexture cached;
+  cached.format = BlockFormat(header.format);
+  cached.bytes_per_pixel = uint8_t(header.bytes_per_pixel);
+  cached.width = header.width;
+  cached.height = header.height;
+  cached.faces = header.faces;
+  if (header.levels == 0) { return false; }
+  if (max_size != 0) {
+    // NOTE: Chains without mips hold only level 0 which is then the tail
+    first_level = std::max(first_level, std::min(TextureEncoder::tail_level(header.width, header.height, max_size), header.levels - 1));
+  }
+  last_level = std::min(last_level, header.levels);
+  if (first_level >= last_level) { return false; }
+  cached.base_level = first_level;
+  cached.levels = last_level - first_level;
+  cached.size = 0;
+  for (uint32_t level = first_level; level < last_level; level++) { cached.size += uint32_t(TextureEncoder::level_byte_size(cached, level)); }
+
+  // NOTE: Read straight into the pixels handed out, upload is a plain copy from here on
+  uint64_t levels_offset = pixels_offset;
+  for (uint32_t level = 0; level < first_level; level++) { levels_offset += TextureEncoder::level_byte_size(cached, level) * header.faces; }
+  const uint64_t levels_size = uint64_t(cached.size) * cached.faces;
+  uint8_t* pixels = TexturePool::allocate(levels_size);
+  ifs.seekg(levels_offset);
+  if (!pixels || !ifs.read(reinterpret_cast<char*>(pixels), levels_size)) {
+    TexturePool::release(pixels);
+    return false;
+  }
+
+  cached.pixels = pixels;
+  texture = cached;
+  return true;
+}
+
+bool TextureCache::load(const TextureResource& resource, RawTexture& texture, const uint32_t max_size) {
+  return read(resource, texture, max_size, 0, UINT32_MAX);
+}
+
+bool TextureCache::load_levels(const TextureResource& resource, const uint32_t first_level, const uint32_t last_level, RawTexture& texture) {
+  return read(resource, texture, 0, first_level, last_level);
+}
+
+bool TextureCache::save(const TextureResource& resource, const RawTexture& texture) {
+  ProfileScope scope("texture_cache_save");
+  int64_t mtime = 0;
+  if (!texture.pixels || texture.base_level != 0 || !modification_time(resource.files, mtime)) { return false; }
+
+  const std::string sources = sources_of(resource);
+  const uint64_t pixels_offset = align_to(sizeof(Header) + sources.size(), 8);
+  const uint64_t pixels_size = uint64_t(texture.size) * texture.faces;
+
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.source_mtime = mtime;
+  header.import_flags = encode_flags();
+  header.file_size = pixels_offset + pixels_size;
+  header.format = uint32_t(texture.format);
+  header.bytes_per_pixel = texture.bytes_per_pixel;
+  header.width = texture.width;
+  header.height = texture.height;
+  header.faces = texture.faces;
+  header.levels = texture.levels;
+  header.size = texture.size;
+  header.sources_length = uint32_t(sources.size());
+
+  std::vector<uint8_t> buffer(pixels_offset, 0);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), sources.data(), sources.size());
+
+  // NOTE: The same texture might be encoded and written by concurrent loads
+  return Filesystem::write_atomically(filepath_for(resource), {{buffer.data(), buffer.size()}, {texture.pixels, pixels_size}});
+}
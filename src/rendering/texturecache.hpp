@@ -0,0 +1,38 @@
+#pragma once
+#ifndef MEINEKRAFT_TEXTURECACHE_HPP
+#define MEINEKRAFT_TEXTURECACHE_HPP
+
+#include "texture.hpp"
+
+#include <string>
+
+/// Versioned binary cache of block compressed textures and their mips stored in Filesystem::tmp
+/// Uncompressed mip chains are cached as well when streaming (see TextureStreamingSettings)
+/// Keyed by the TextureResource (files, encoding and color space), the modification times of the files and the TextureImportSettings
+/// Layout: Header, source files ('\n' separated), pixels (see RawTexture) 8B aligned
+struct TextureCache {
+  /// Bump whenever the layout of the cache or the encoding changes
+  static const uint32_t VERSION = 2;
+
+  /// Reads the cached texture of the resource into texture (pixels allocated from the TexturePool), returns false on a cache miss
+  /// Only the levels of at most max_size texels in width and height are read unless max_size is 0
+  static bool load(const TextureResource& resource, RawTexture& texture, uint32_t max_size = 0);
+
+  /// Reads the levels [first_level, last_level) of the cached texture of the resource, returns false on a cache miss
+  /// NOTE: Levels are stored one after another thus this is a single read (see RawTexture)
+  static bool load_levels(const TextureResource& resource, uint32_t first_level, uint32_t last_level, RawTexture& texture);
+
+  /// Writes the full mip chain of the texture of the resource, returns true on success
+  static bool save(const TextureResource& resource, const RawTexture& texture);
+
+  /// Removes the cache of the resource (if any)
+  static void invalidate(const TextureResource& resource);
+
+  /// Removes the caches of every texture
+  static void invalidate_all();
+
+  /// Filepath of the cache of the resource
+  static std::string filepath_for(const TextureResource& resource);
+};
+
+#endif // MEINEKRAFT_TEXTURECACHE_HPP
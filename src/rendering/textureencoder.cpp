@@ -0,0 +1,601 @@
+#include "textureencoder.hpp"
+#include "texturepool.hpp"
+#include "../util/logging.hpp"
+#include "../util/profiler.hpp"
+#include "../util/simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+uint32_t TextureEncoder::block_byte_size(const BlockFormat format) {
+  switch (format) {
+    case BlockFormat::BC1: return 8;
+    case BlockFormat::BC3: return 16;
+    case BlockFormat::BC5: return 16;
+    case BlockFormat::BC7: return 16;
+    default: return 0;
+  }
+}
+
+uint32_t TextureEncoder::num_levels(const uint32_t width, const uint32_t height) {
+  uint32_t levels = 1;
+  uint32_t size = std::max(width, height);
+  while (size > 1) {
+    size /= 2;
+    levels++;
+  }
+  return levels;
+}
+
+size_t TextureEncoder::level_byte_size(const BlockFormat format, const uint32_t width, const uint32_t height, const uint32_t level) {
+  const size_t level_width = std::max(width >> level, 1u);
+  const size_t level_height = std::max(height >> level, 1u);
+  return ((level_width + 3) / 4) * ((level_height + 3) / 4) * block_byte_size(format);
+}
+
+/// Endpoints of the block on the principal axis of the texels (first num_channels channels of RGBA8 texels)
+/// NOTE: The principal axis is found by power iteration of the covariance matrix
+static void principal_endpoints(const uint8_t texels[64], const size_t num_channels, float e0[4], float e1[4]) {
+  float mean[4] = {};
+  for (size_t i = 0; i < 16; i++) {
+    for (size_t c = 0; c < num_channels; c++) { mean[c] += texels[4 * i + c]; }
+  }
+  for (size_t c = 0; c < num_channels; c++) { mean[c] /= 16.0f; }
+
+  float covariance[4][4] = {};
+  for (size_t i = 0; i < 16; i++) {
+    float d[4] = {};
+    for (size_t c = 0; c < num_channels; c++) { d[c] = texels[4 * i + c] - mean[c]; }
+    for (size_t r = 0; r < num_channels; r++) {
+      for (size_t c = 0; c < num_channels; c++) { covariance[r][c] += d[r] * d[c]; }
+    }
+  }
+
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (size_t iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    for (size_t r = 0; r < num_channels; r++) {
+      for (size_t c = 0; c < num_channels; c++) { next[r] += covariance[r][c] * axis[c]; }
+    }
+    float length = 0.0f;
+    for (size_t c = 0; c < num_channels; c++) { length = std::max(length, std::abs(next[c])); }
+    if (length == 0.0f) { break; } // Uniform block, any axis works
+    for (size_t c = 0; c < num_channels; c++) { axis[c] = next[c] / length; }
+  }
+
+  float min_t = 0.0f;
+  float max_t = 0.0f;
+  float axis_length2 = 0.0f;
+  for (size_t c = 0; c < num_channels; c++) { axis_length2 += axis[c] * axis[c]; }
+  for (size_t i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (size_t c = 0; c < num_channels; c++) { t += (texels[4 * i + c] - mean[c]) * axis[c]; }
+    t /= axis_length2;
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  for (size_t c = 0; c < num_channels; c++) {
+    e0[c] = std::min(std::max(mean[c] + axis[c] * min_t, 0.0f), 255.0f);
+    e1[c] = std::min(std::max(mean[c] + axis[c] * max_t, 0.0f), 255.0f);
+  }
+}
+
+static uint16_t to_565(const float color[3]) {
+  const uint32_t r = uint32_t(std::lround(color[0] * 31.0f / 255.0f));
+  const uint32_t g = uint32_t(std::lround(color[1] * 63.0f / 255.0f));
+  const uint32_t b = uint32_t(std::lround(color[2] * 31.0f / 255.0f));
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void from_565(const uint16_t color, int32_t rgb[3]) {
+  const int32_t r = (color >> 11) & 31;
+  const int32_t g = (color >> 5) & 63;
+  const int32_t b = color & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+/// Selects the nearest color of the four color palette for every texel, returns the squared error
+static uint32_t bc1_indices(const uint8_t texels[64], const uint16_t c0, const uint16_t c1, uint8_t indices[16]) {
+  int32_t palette[4][3];
+  from_565(c0, palette[0]);
+  from_565(c1, palette[1]);
+  for (size_t c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  uint32_t error = 0;
+  for (size_t i = 0; i < 16; i++) {
+    uint32_t best = UINT32_MAX;
+    for (uint8_t p = 0; p < 4; p++) {
+      uint32_t distance = 0;
+      for (size_t c = 0; c < 3; c++) {
+        const int32_t d = int32_t(texels[4 * i + c]) - palette[p][c];
+        distance += uint32_t(d * d);
+      }
+      if (distance < best) {
+        best = distance;
+        indices[i] = p;
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+/// Least squares fit of the endpoints given the palette indices, returns false if the system is singular
+static bool bc1_refit(const uint8_t texels[64], const uint8_t indices[16], float e0[3], float e1[3]) {
+  static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f}; // Weight of c0 per index
+  float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+  float ax[3] = {}, bx[3] = {};
+  for (size_t i = 0; i < 16; i++) {
+    const float a = weights[indices[i]];
+    const float b = 1.0f - a;
+    aa += a * a;
+    bb += b * b;
+    ab += a * b;
+    for (size_t c = 0; c < 3; c++) {
+      ax[c] += a * texels[4 * i + c];
+      bx[c] += b * texels[4 * i + c];
+    }
+  }
+  const float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f) { return false; }
+  for (size_t c = 0; c < 3; c++) {
+    e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+/// Four color block (c0 > c1) such that it is valid both as BC1 and as the color of BC3
+void TextureEncoder::encode_bc1_block(const uint8_t texels[64], uint8_t block[8]) {
+  float e0[4], e1[4];
+  principal_endpoints(texels, 3, e0, e1);
+
+  uint16_t c0 = to_565(e1);
+  uint16_t c1 = to_565(e0);
+  uint8_t indices[16];
+  uint32_t error = bc1_indices(texels, c0, c1, indices);
+
+  float r0[3], r1[3];
+  if (error > 0 && bc1_refit(texels, indices, r0, r1)) {
+    const uint16_t refit_c0 = to_565(r0);
+    const uint16_t refit_c1 = to_565(r1);
+    uint8_t refit_indices[16];
+    const uint32_t refit_error = bc1_indices(texels, refit_c0, refit_c1, refit_indices);
+    if (refit_error < error) {
+      c0 = refit_c0;
+      c1 = refit_c1;
+      error = refit_error;
+      std::memcpy(indices, refit_indices, sizeof(indices));
+    }
+  }
+
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    static const uint8_t swapped[4] = {1, 0, 3, 2};
+    for (uint8_t& index : indices) { index = swapped[index]; }
+  } else if (c0 == c1) {
+    std::memset(indices, 0, sizeof(indices));
+  }
+
+  uint32_t bits = 0;
+  for (size_t i = 0; i < 16; i++) { bits |= uint32_t(indices[i]) << (2 * i); }
+  block[0] = uint8_t(c0 & 0xFF); block[1] = uint8_t(c0 >> 8);
+  block[2] = uint8_t(c1 & 0xFF); block[3] = uint8_t(c1 >> 8);
+  for (size_t i = 0; i < 4; i++) { block[4 + i] = uint8_t(bits >> (8 * i)); }
+}
+
+/// Eight value block (a0 > a1) of one channel of the texels
+static void encode_bc4_block(const uint8_t texels[64], const size_t channel, uint8_t block[8]) {
+  uint8_t a0 = 0;
+  uint8_t a1 = 255;
+  for (size_t i = 0; i < 16; i++) {
+    a0 = std::max(a0, texels[4 * i + channel]);
+    a1 = std::min(a1, texels[4 * i + channel]);
+  }
+
+  uint64_t bits = 0;
+  if (a0 != a1) {
+    int32_t palette[8] = {a0, a1};
+    for (int32_t p = 2; p < 8; p++) { palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7; }
+    for (size_t i = 0; i < 16; i++) {
+      const int32_t value = texels[4 * i + channel];
+      uint64_t best_index = 0;
+      int32_t best = INT32_MAX;
+      for (uint64_t p = 0; p < 8; p++) {
+        const int32_t distance = std::abs(value - palette[p]);
+        if (distance < best) {
+          best = distance;
+          best_index = p;
+        }
+      }
+      bits |= best_index << (3 * i);
+    }
+  }
+
+  block[0] = a0;
+  block[1] = a1;
+  for (size_t i = 0; i < 6; i++) { block[2 + i] = uint8_t(bits >> (8 * i)); }
+}
+
+void TextureEncoder::encode_bc3_block(const uint8_t texels[64], uint8_t block[16]) {
+  encode_bc4_block(texels, 3, block);
+  encode_bc1_block(texels, block + 8);
+}
+
+void TextureEncoder::encode_bc5_block(const uint8_t texels[64], uint8_t block[16]) {
+  encode_bc4_block(texels, 0, block);
+  encode_bc4_block(texels, 1, block + 8);
+}
+
+/// Writes bits in LSB first order as laid out by BC7
+struct BitWriter {
+  uint8_t* data;
+  size_t position = 0;
+
+  void write(const uint32_t value, const size_t num_bits) {
+    for (size_t i = 0; i < num_bits; i++) {
+      if ((value >> i) & 1) { data[position / 8] |= uint8_t(1 << (position % 8)); }
+      position++;
+    }
+  }
+};
+
+/// Mode 6 block: one subset, RGBA endpoints of 7 bits and a unique p-bit each, 4 bit indices
+void TextureEncoder::encode_bc7_block(const uint8_t texels[64], uint8_t block[16]) {
+  static const int32_t weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+  float e[2][4];
+  principal_endpoints(texels, 4, e[0], e[1]);
+
+  // Picks the p-bit per endpoint which quantizes it with the least error
+  uint32_t q[2][4];
+  uint32_t p[2];
+  for (size_t endpoint = 0; endpoint < 2; endpoint++) {
+    float best = INFINITY;
+    for (uint32_t pbit = 0; pbit < 2; pbit++) {
+      uint32_t candidate[4];
+      float error = 0.0f;
+      for (size_t c = 0; c < 4; c++) {
+        const float value = std::round((e[endpoint][c] - float(pbit)) / 2.0f);
+        candidate[c] = uint32_t(std::min(std::max(value, 0.0f), 127.0f));
+        const float d = float((candidate[c] << 1) | pbit) - e[endpoint][c];
+        error += d * d;
+      }
+      if (error < best) {
+        best = error;
+        std::memcpy(q[endpoint], candidate, sizeof(candidate));
+        p[endpoint] = pbit;
+      }
+    }
+  }
+
+  int32_t palette[16][4];
+  for (size_t c = 0; c < 4; c++) {
+    const int32_t v0 = int32_t((q[0][c] << 1) | p[0]);
+    const int32_t v1 = int32_t((q[1][c] << 1) | p[1]);
+    for (size_t i = 0; i < 16; i++) { palette[i][c] = ((64 - weights[i]) * v0 + weights[i] * v1 + 32) >> 6; }
+  }
+
+  uint32_t indices[16];
+  for (size_t i = 0; i < 16; i++) {
+    int32_t best = INT32_MAX;
+    for (uint32_t j = 0; j < 16; j++) {
+      int32_t distance = 0;
+      for (size_t c = 0; c < 4; c++) {
+        const int32_t d = int32_t(texels[4 * i + c]) - palette[j][c];
+        distance += d * d;
+      }
+      if (distance < best) {
+        best = distance;
+        indices[i] = j;
+      }
+    }
+  }
+
+  // NOTE: The most significant bit of the anchor index is implicitly zero
+  if (indices[0] & 8) {
+    std::swap(q[0], q[1]);
+    std::swap(p[0], p[1]);
+    for (uint32_t& index : indices) { index = 15 - index; }
+  }
+
+  std::memset(block, 0, 16);
+  BitWriter writer{block};
+  writer.write(1 << 6, 7); // Mode 6
+  for (size_t c = 0; c < 4; c++) {
+    writer.write(q[0][c], 7);
+    writer.write(q[1][c], 7);
+  }
+  writer.write(p[0], 1);
+  writer.write(p[1], 1);
+  writer.write(indices[0], 3);
+  for (size_t i = 1; i < 16; i++) { writer.write(indices[i], 4); }
+}
+
+/// sRGB <-> linear conversion tables, linear values are quantized to LINEAR_STEPS steps on the way back to sRGB
+static const size_t LINEAR_STEPS = 16384;
+
+struct ColorTables {
+  float srgb_to_linear[256];
+  float unorm_to_linear[256];               // Channels which are not sRGB encoded (alpha, linear textures)
+  uint8_t linear_to_srgb[LINEAR_STEPS + 1];
+
+  ColorTables() {
+    for (size_t i = 0; i < 256; i++) {
+      const float c = float(i) / 255.0f;
+      srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      unorm_to_linear[i] = c;
+    }
+    for (size_t i = 0; i <= LINEAR_STEPS; i++) {
+      const float c = float(i) / float(LINEAR_STEPS);
+      const float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+      linear_to_srgb[i] = uint8_t(std::lround(std::min(std::max(srgb, 0.0f), 1.0f) * 255.0f));
+    }
+  }
+};
+
+static const ColorTables& color_tables() {
+  static const ColorTables tables;
+  return tables;
+}
+
+/// Average of the 2x2 RGBA texels
+static inline void box_filter(const float* a0, const float* a1, const float* b0, const float* b1, float* out) {
+#if defined(MEINEKRAFT_SSE2)
+  const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a0), _mm_loadu_ps(a1)), _mm_add_ps(_mm_loadu_ps(b0), _mm_loadu_ps(b1)));
+  _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+  for (size_t c = 0; c < 4; c++) { out[c] = 0.25f * (a0[c] + a1[c] + b0[c] + b1[c]); }
+#endif
+}
+
+/// Filters two linear RGBA rows of width texels into one row of half the width, odd edges are clamped
+static void filter_rows(const float* row0, const float* row1, const uint32_t width, float* out) {
+  const uint32_t out_width = std::max(width / 2, 1u);
+  for (uint32_t x = 0; x < out_width; x++) {
+    const uint32_t x0 = std::min(2 * x, width - 1);
+    const uint32_t x1 = std::min(2 * x + 1, width - 1);
+    box_filter(row0 + 4 * x0, row0 + 4 * x1, row1 + 4 * x0, row1 + 4 * x1, out + 4 * x);
+  }
+}
+
+/// Converts a row of RGB8/RGBA8 texels into linear RGBA, alpha defaults to one
+static void to_linear(const uint8_t* src, const uint32_t width, const uint8_t bytes_per_pixel, const bool is_sRGB, float* out) {
+  const ColorTables& tables = color_tables();
+  const float* color = is_sRGB ? tables.srgb_to_linear : tables.unorm_to_linear;
+  for (uint32_t x = 0; x < width; x++) {
+    const uint8_t* texel = src + size_t(x) * bytes_per_pixel;
+    out[4 * x + 0] = color[texel[0]];
+    out[4 * x + 1] = color[texel[1]];
+    out[4 * x + 2] = color[texel[2]];
+    out[4 * x + 3] = bytes_per_pixel == 4 ? tables.unorm_to_linear[texel[3]] : 1.0f;
+  }
+}
+
+/// Converts linear RGBA texels back into RGB8/RGBA8
+static void from_linear(const float* linear, const size_t num_texels, const uint8_t bytes_per_pixel, const bool is_sRGB, uint8_t* dst) {
+  const ColorTables& tables = color_tables();
+  for (size_t i = 0; i < num_texels; i++) {
+    int32_t steps[4];   // Quantized to LINEAR_STEPS for the sRGB table
+    int32_t unorm[4];   // Quantized to 8 bits for linear channels
+#if defined(MEINEKRAFT_SSE2)
+    const __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(linear + 4 * i), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(steps), _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(float(LINEAR_STEPS)))));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(unorm), _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(255.0f))));
+#else
+    for (size_t c = 0; c < 4; c++) {
+      const float value = std::min(std::max(linear[4 * i + c], 0.0f), 1.0f);
+      steps[c] = int32_t(std::lround(value * float(LINEAR_STEPS)));
+      unorm[c] = int32_t(std::lround(value * 255.0f));
+    }
+#endif
+    uint8_t* texel = dst + i * bytes_per_pixel;
+    for (size_t c = 0; c < 3; c++) {
+      texel[c] = is_sRGB ? tables.linear_to_srgb[steps[c]] : uint8_t(unorm[c]);
+    }
+    if (bytes_per_pixel == 4) { texel[3] = uint8_t(unorm[3]); }
+  }
+}
+
+#if defined(MEINEKRAFT_SSSE3_DISPATCH)
+/// Expands 16 texels per iteration, returns the number of texels expanded
+__attribute__((target("ssse3")))
+static size_t expand_rgb_to_rgba_ssse3(const uint8_t* rgb, const size_t num_texels, uint8_t* rgba) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32(int32_t(0xFF000000));
+  size_t i = 0;
+  // NOTE: Each load reads 16 bytes of which 12 are used, the last iteration stops short of the end
+  for (; i + 17 < num_texels; i += 16) {
+    const uint8_t* src = rgb + 3 * i;
+    __m128i* dst = reinterpret_cast<__m128i*>(rgba + 4 * i);
+    _mm_storeu_si128(dst + 0, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0)), shuffle), alpha));
+    _mm_storeu_si128(dst + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12)), shuffle), alpha));
+    _mm_storeu_si128(dst + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24)), shuffle), alpha));
+    _mm_storeu_si128(dst + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 36)), shuffle), alpha));
+  }
+  return i;
+}
+#endif
+
+void TextureEncoder::expand_rgb_to_rgba(const uint8_t* rgb, const size_t num_texels, uint8_t* rgba) {
+  size_t i = 0;
+#if defined(MEINEKRAFT_SSSE3_DISPATCH)
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  if (has_ssse3) { i = expand_rgb_to_rgba_ssse3(rgb, num_texels, rgba); }
+#endif
+  for (; i < num_texels; i++) {
+    rgba[4 * i + 0] = rgb[3 * i + 0];
+    rgba[4 * i + 1] = rgb[3 * i + 1];
+    rgba[4 * i + 2] = rgb[3 * i + 2];
+    rgba[4 * i + 3] = 255;
+  }
+}
+
+size_t TextureEncoder::level_byte_size(const RawTexture& texture, const uint32_t level) {
+  if (texture.format != BlockFormat::None) {
+    return level_byte_size(texture.format, texture.width, texture.height, level);
+  }
+  return size_t(std::max(texture.width >> level, 1u)) * std::max(texture.height >> level, 1u) * texture.bytes_per_pixel;
+}
+
+size_t TextureEncoder::level_offset(const RawTexture& texture, const uint32_t level) {
+  size_t offset = 0;
+  for (uint32_t l = texture.base_level; l < level; l++) { offset += level_byte_size(texture, l) * texture.faces; }
+  return offset;
+}
+
+uint32_t TextureEncoder::tail_level(const uint32_t width, const uint32_t height, const uint32_t size) {
+  uint32_t level = 0;
+  while (std::max(width >> level, height >> level) > std::max(size, 1u)) { level++; }
+  return level;
+}
+
+RawTexture TextureEncoder::copy_levels(const RawTexture& texture, const uint32_t first, const uint32_t last) {
+  if (!texture.pixels || first < texture.base_level || last > texture.base_level + texture.levels || first >= last) {
+    return RawTexture();
+  }
+  RawTexture copy = texture;
+  copy.base_level = first;
+  copy.levels = last - first;
+  copy.size = 0;
+  for (uint32_t level = first; level < last; level++) { copy.size += uint32_t(level_byte_size(texture, level)); }
+  copy.pixels = TexturePool::allocate(size_t(copy.size) * texture.faces);
+  if (!copy.pixels) { return RawTexture(); }
+  std::memcpy(copy.pixels, texture.pixels + level_offset(texture, first), size_t(copy.size) * texture.faces);
+  return copy;
+}
+
+/// Offsets of face 0 of every level in the pixels of the texture, returns the byte size per face of all the levels
+static size_t level_offsets_of(const RawTexture& texture, std::vector<size_t>& offsets) {
+  offsets.resize(texture.levels);
+  size_t size = 0;
+  for (uint32_t level = 0; level < texture.levels; level++) {
+    offsets[level] = size * texture.faces;
+    size += TextureEncoder::level_byte_size(texture, level);
+  }
+  return size;
+}
+
+RawTexture TextureEncoder::generate_mips(const RawTexture& texture, const bool is_sRGB) {
+  ProfileScope scope("texture_mips");
+  if (!texture.pixels || texture.format != BlockFormat::None || texture.levels != 1 ||
+      (texture.bytes_per_pixel != 3 && texture.bytes_per_pixel != 4) || texture.width == 0 || texture.height == 0) {
+    Log::warn("Can not generate mips of texture (" + std::to_string(texture.bytes_per_pixel) + " bytes per pixel)");
+    return RawTexture();
+  }
+
+  RawTexture chain = texture;
+  chain.levels = num_levels(texture.width, texture.height);
+  std::vector<size_t> offsets;
+  const size_t size = level_offsets_of(chain, offsets);
+  chain.size = uint32_t(size);
+  chain.pixels = TexturePool::allocate(size * texture.faces);
+  if (!chain.pixels) { return RawTexture(); }
+
+  const uint8_t bpp = texture.bytes_per_pixel;
+  for (uint32_t face = 0; face < texture.faces; face++) {
+    const uint8_t* base = texture.pixels + size_t(texture.size) * face;
+    std::memcpy(chain.pixels + offsets[0] + level_byte_size(chain, 0) * face, base, level_byte_size(chain, 0));
+    if (chain.levels == 1) { continue; }
+
+    // NOTE: Level 1 is filtered from the base level two rows at a time, the following levels from the linear previous level
+    uint32_t width = texture.width;
+    uint32_t height = texture.height;
+    std::vector<float> rows(2 * size_t(width) * 4);
+    std::vector<float> level(size_t(std::max(width / 2, 1u)) * std::max(height / 2, 1u) * 4);
+    for (uint32_t y = 0; y < std::max(height / 2, 1u); y++) {
+      const uint32_t y0 = std::min(2 * y, height - 1);
+      const uint32_t y1 = std::min(2 * y + 1, height - 1);
+      to_linear(base + size_t(y0) * width * bpp, width, bpp, is_sRGB, rows.data());
+      to_linear(base + size_t(y1) * width * bpp, width, bpp, is_sRGB, rows.data() + size_t(width) * 4);
+      filter_rows(rows.data(), rows.data() + size_t(width) * 4, width, level.data() + size_t(y) * std::max(width / 2, 1u) * 4);
+    }
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+
+    for (uint32_t l = 1; l < chain.levels; l++) {
+      from_linear(level.data(), size_t(width) * height, bpp, is_sRGB, chain.pixels + offsets[l] + level_byte_size(chain, l) * face);
+      if (l + 1 == chain.levels) { break; }
+
+      const uint32_t next_width = std::max(width / 2, 1u);
+      const uint32_t next_height = std::max(height / 2, 1u);
+      std::vector<float> next(size_t(next_width) * next_height * 4);
+      for (uint32_t y = 0; y < next_height; y++) {
+        const uint32_t y0 = std::min(2 * y, height - 1);
+        const uint32_t y1 = std::min(2 * y + 1, height - 1);
+        filter_rows(level.data() + size_t(y0) * width * 4, level.data() + size_t(y1) * width * 4, width, next.data() + size_t(y) * next_width * 4);
+      }
+      level = std::move(next);
+      width = next_width;
+      height = next_height;
+    }
+  }
+
+  return chain;
+}
+
+RawTexture TextureEncoder::encode(const RawTexture& texture, const BlockFormat format) {
+  ProfileScope scope("texture_encode");
+  if (!texture.pixels || texture.format != BlockFormat::None || format == BlockFormat::None ||
+      (texture.bytes_per_pixel != 3 && texture.bytes_per_pixel != 4) || texture.width == 0 || texture.height == 0) {
+    Log::warn("Texture can not be block compressed (" + std::to_string(texture.bytes_per_pixel) + " bytes per pixel)");
+    return RawTexture();
+  }
+
+  RawTexture encoded = texture;
+  encoded.format = format;
+  std::vector<size_t> level_offsets;
+  const size_t size = level_offsets_of(encoded, level_offsets);
+  encoded.size = uint32_t(size);
+  encoded.pixels = TexturePool::allocate(size * texture.faces);
+  if (!encoded.pixels) { return RawTexture(); }
+
+  std::vector<size_t> source_offsets;
+  level_offsets_of(texture, source_offsets);
+
+  const uint8_t bpp = texture.bytes_per_pixel;
+  const uint32_t block_size = block_byte_size(format);
+  for (uint32_t face = 0; face < texture.faces; face++) {
+    for (uint32_t l = 0; l < encoded.levels; l++) {
+      const uint32_t width = std::max(texture.width >> l, 1u);
+      const uint32_t height = std::max(texture.height >> l, 1u);
+      const uint8_t* src = texture.pixels + source_offsets[l] + level_byte_size(texture, l) * face;
+      uint8_t* dst = encoded.pixels + level_offsets[l] + level_byte_size(encoded, l) * face;
+      for (uint32_t by = 0; by < (height + 3) / 4; by++) {
+        for (uint32_t bx = 0; bx < (width + 3) / 4; bx++) {
+          uint8_t texels[64];
+          for (uint32_t y = 0; y < 4; y++) {
+            for (uint32_t x = 0; x < 4; x++) {
+              const uint32_t sx = std::min(4 * bx + x, width - 1);
+              const uint32_t sy = std::min(4 * by + y, height - 1);
+              const uint8_t* texel = src + (size_t(sy) * width + sx) * bpp;
+              uint8_t* rgba = &texels[4 * (4 * y + x)];
+              rgba[0] = texel[0];
+              rgba[1] = texel[1];
+              rgba[2] = texel[2];
+              rgba[3] = bpp == 4 ? texel[3] : 255;
+            }
+          }
+          switch (format) {
+            case BlockFormat::BC1: encode_bc1_block(texels, dst); break;
+            case BlockFormat::BC3: encode_bc3_block(texels, dst); break;
+            case BlockFormat::BC5: encode_bc5_block(texels, dst); break;
+            case BlockFormat::BC7: encode_bc7_block(texels, dst); break;
+            default: break;
+          }
+          dst += block_size;
+        }
+      }
+    }
+  }
+
+  return encoded;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef MEINEKRAFT_TEXTUREENCODER_HPP
+#define MEINEKRAFT_TEXTUREENCODER_HPP
+
+#include "texture.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/// CPU mip chain generator and encoder of block compressed textures (BC1, BC3, BC5 and BC7)
+/// Blocks are 4x4 texels, texels outside of the texture are clamped to the edge
+/// NOTE: Color is encoded as is, sRGB textures are encoded in sRGB space which is what the GPU decodes
+struct TextureEncoder {
+  /// Bytes per 4x4 block of the format
+  static uint32_t block_byte_size(BlockFormat format);
+
+  /// Number of levels in the full mip chain down to 1x1
+  static uint32_t num_levels(uint32_t width, uint32_t height);
+
+  /// Byte size of one face of the level
+  static size_t level_byte_size(BlockFormat format, uint32_t width, uint32_t height, uint32_t level);
+
+  /// Byte size of one face of the level of the texture (block compressed or not)
+  static size_t level_byte_size(const RawTexture& texture, uint32_t level);
+
+  /// Byte offset of face 0 of the level in the pixels of the texture (see RawTexture::base_level)
+  static size_t level_offset(const RawTexture& texture, uint32_t level);
+
+  /// Finest level of the mip chain of at most size texels in width and height
+  static uint32_t tail_level(uint32_t width, uint32_t height, uint32_t size);
+
+  /// Copies the levels [first, last) held by the texture into a new texture, pixels are allocated from the TexturePool
+  static RawTexture copy_levels(const RawTexture& texture, uint32_t first, uint32_t last);
+
+  /// Encodes one block of 16 RGBA8 texels in row major order
+  static void encode_bc1_block(const uint8_t texels[64], uint8_t block[8]);
+  static void encode_bc3_block(const uint8_t texels[64], uint8_t block[16]);
+  static void encode_bc5_block(const uint8_t texels[64], uint8_t block[16]);
+  static void encode_bc7_block(const uint8_t texels[64], uint8_t block[16]);
+
+  /// Expands RGB8 texels to RGBA8 with opaque alpha, rgb and rgba must not overlap
+  static void expand_rgb_to_rgba(const uint8_t* rgb, size_t num_texels, uint8_t* rgba);
+
+  /// Generates the full mip chain (see num_levels) of the texture (RGB8 or RGBA8) with a box filter in linear space
+  /// sRGB textures are converted to linear before filtering and back afterwards, alpha is always linear
+  /// Returns an empty RawTexture on failure, the pixels are allocated from the TexturePool
+  static RawTexture generate_mips(const RawTexture& texture, bool is_sRGB);
+
+  /// Encodes every level of the texture (RGB8 or RGBA8, see generate_mips) in the format
+  /// Returns an empty RawTexture if the texture can not be encoded, the pixels are allocated from the TexturePool
+  static RawTexture encode(const RawTexture& texture, BlockFormat format);
+};
+
+#endif // MEINEKRAFT_TEXTUREENCODER_HPP
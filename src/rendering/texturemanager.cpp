@@ -0,0 +1,198 @@
+#include "texturemanager.hpp"
+#include "texturepool.hpp"
+#include "../util/logging.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+struct TextureEntry {
+  TextureResource resource{std::vector<std::string>{}}; // Normalized files, compared on lookup in order to detect key collisions
+  RawTexture data;
+  uint32_t refcount = 0;
+  uint32_t pending_uploads = 0; // References not yet uploaded
+  bool decoded = false;         // False while a thread is decoding the texture
+  bool released = false;        // Pixels released after upload
+  bool keep_resident = false;
+};
+
+/// NOTE: Entries are only erased once released thus references to entries stay valid while a reference is held
+static std::unordered_map<ID, TextureEntry> textures;
+static std::mutex mutex;
+static std::condition_variable decoded;   // Signaled whenever decodes finish
+static size_t num_shared = 0;
+static size_t shared_bytes = 0;
+static size_t released_bytes = 0;
+
+/// Same file referenced through different paths (e.g "a/./b.png" and "a/b.png") results in the same key
+static TextureResource normalized(const TextureResource& resource) {
+  TextureResource normalized = resource;
+  for (auto& file : normalized.files) {
+    file = std::filesystem::path(file).lexically_normal().generic_string();
+  }
+  return normalized;
+}
+
+static size_t byte_size(const RawTexture& data) {
+  return data.pixels ? size_t(data.size) * data.faces : 0;
+}
+
+/// Returns the pixels to the TexturePool once every reference has been uploaded (or released without being uploaded)
+static void release_pixels_if_uploaded(TextureEntry& entry) {
+  if (entry.pending_uploads == 0 && entry.decoded && !entry.keep_resident && entry.data.pixels) {
+    released_bytes += byte_size(entry.data);
+    TexturePool::release(entry.data.pixels);
+    entry.data.pixels = nullptr;
+    entry.released = true;
+  }
+}
+
+static bool same_resource(const TextureResource& a, const TextureResource& b) {
+  return a.files == b.files && a.encoding == b.encoding && a.is_sRGB == b.is_sRGB;
+}
+
+/// ID of the texture of the normalized resource, key collisions are stored under the next free ID
+/// NOTE: Requires the mutex to be held
+static ID id_of(const TextureResource& key) {
+  ID id = key.to_hash();
+  for (auto it = textures.find(id); it != textures.end() && !same_resource(it->second.resource, key); it = textures.find(id)) {
+    Log::warn("Texture key collision between " + key.files.front() + " and " + it->second.resource.files.front());
+    if (++id == 0) { id++; } // NOTE: 0 is no texture
+  }
+  return id;
+}
+
+std::vector<Texture> TextureManager::load(const std::vector<TextureResource>& resources) {
+  std::vector<TextureResource> keys(resources.size(), TextureResource{std::vector<std::string>{}});
+  std::vector<ID> ids(resources.size());
+  std::vector<size_t> decodes;           // Indices of the resources decoded by this call
+  std::vector<TextureResource> to_decode;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < resources.size(); i++) {
+      keys[i] = normalized(resources[i]);
+      ids[i] = id_of(keys[i]);
+      auto it = textures.find(ids[i]);
+      if (it == textures.end()) {
+        TextureEntry& entry = textures[ids[i]];
+        entry.resource = keys[i];
+        entry.refcount = 1;
+        entry.pending_uploads = 1;
+        entry.keep_resident = keys[i].keep_resident;
+        decodes.push_back(i);
+        to_decode.push_back(keys[i]);
+      } else {
+        TextureEntry& entry = it->second;
+        entry.refcount++;
+        entry.pending_uploads++;
+        entry.keep_resident = entry.keep_resident || keys[i].keep_resident;
+        if (entry.decoded && entry.released) { // Uploaded and released, decoded again for the new reference
+          entry.decoded = false;
+          entry.released = false;
+          decodes.push_back(i);
+          to_decode.push_back(keys[i]);
+        }
+      }
+    }
+  }
+
+  std::vector<RawTexture> decoded_textures = Texture::load_textures(to_decode);
+
+  std::vector<Texture> loaded(resources.size());
+  std::unique_lock<std::mutex> lock(mutex);
+  for (size_t i = 0; i < decodes.size(); i++) {
+    TextureEntry& entry = textures[ids[decodes[i]]];
+    entry.data = decoded_textures[i];
+    entry.decoded = true;
+  }
+  decoded.notify_all();
+
+  for (size_t i = 0; i < resources.size(); i++) {
+    loaded[i].id = ids[i];
+    // NOTE: Another thread might still be decoding a texture this call shares
+    const TextureEntry& entry = textures[ids[i]];
+    decoded.wait(lock, [&]() { return entry.decoded; });
+    loaded[i].data = entry.data;
+  }
+
+  // Loads not decoded by this call are served by an already decoded texture
+  std::vector<uint8_t> decoded_here(resources.size(), 0);
+  for (const size_t i : decodes) { decoded_here[i] = 1; }
+  for (size_t i = 0; i < resources.size(); i++) {
+    if (decoded_here[i]) { continue; }
+    num_shared++;
+    shared_bytes += byte_size(loaded[i].data);
+  }
+  return loaded;
+}
+
+Texture TextureManager::load(const TextureResource& resource) {
+  return load(std::vector<TextureResource>{resource}).front();
+}
+
+void TextureManager::retain(const ID id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = textures.find(id);
+  if (it == textures.end()) {
+    Log::warn("Tried to retain texture with unknown ID: " + std::to_string(id));
+    return;
+  }
+  it->second.refcount++;
+  it->second.pending_uploads++;
+}
+
+void TextureManager::release(const ID id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = textures.find(id);
+  if (it == textures.end() || it->second.refcount == 0) {
+    Log::warn("Tried to release texture with unknown ID: " + std::to_string(id));
+    return;
+  }
+  TextureEntry& entry = it->second;
+  entry.refcount--;
+  // NOTE: More pending uploads than references means that the released reference was never uploaded
+  entry.pending_uploads = std::min(entry.pending_uploads, entry.refcount);
+  if (entry.refcount == 0 && entry.decoded) {
+    TexturePool::release(entry.data.pixels);
+    textures.erase(it);
+  } else {
+    release_pixels_if_uploaded(entry);
+  }
+}
+
+void TextureManager::uploaded(const ID id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = textures.find(id);
+  if (it == textures.end() || it->second.pending_uploads == 0) {
+    Log::warn("Tried to confirm upload of texture with unknown ID: " + std::to_string(id));
+    return;
+  }
+  it->second.pending_uploads--;
+  release_pixels_if_uploaded(it->second);
+}
+
+bool TextureManager::resource_of(const ID id, TextureResource& resource) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = textures.find(id);
+  if (it == textures.end()) { return false; }
+  resource = it->second.resource;
+  return true;
+}
+
+TextureStatistics TextureManager::statistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  TextureStatistics statistics;
+  for (const auto& pair : textures) {
+    const TextureEntry& entry = pair.second;
+    if (!entry.decoded) { continue; }
+    statistics.num_textures++;
+    statistics.num_references += entry.refcount;
+    statistics.bytes += byte_size(entry.data);
+  }
+  statistics.num_shared = num_shared;
+  statistics.shared_bytes = shared_bytes;
+  statistics.released_bytes = released_bytes;
+  return statistics;
+}
@@ -5,7 +5,42 @@
 #include "primitives.hpp"
 #include "texture.hpp"
 
-#include <unordered_map>
+#include <vector>
 
+struct TextureStatistics {
+  size_t num_textures = 0;   // Unique textures held
+  size_t num_references = 0; // References held to the textures
+  size_t num_shared = 0;     // Loads served by an already decoded texture
+  size_t bytes = 0;          // Decoded pixel data resident on the CPU
+  size_t released_bytes = 0; // Pixel data released after upload
+  size_t shared_bytes = 0;   // Pixel data of the loads served by an already decoded texture
+};
 
-#endif // MEINEKRAFT_TEXTUREMANAGER_HPP
\ No newline at end of file
+/// Owns every decoded texture, each unique list of files is decoded once and shared between its users
+/// Texture IDs are the key of the files (see TextureResource::to_hash), the files are checked on lookup to detect collisions
+/// and a colliding texture is stored under the next free ID
+/// Every reference is expected to be uploaded once (see uploaded), the pixels are released when all of them are
+/// NOTE: Loaded Textures view the pixels owned by the TextureManager, valid until the reference is uploaded or released
+/// Loading a texture again once its pixels have been released decodes it again
+struct TextureManager {
+  // Decodes the resources not yet loaded in parallel (see Texture::load_textures) and adds a reference to each, blocking
+  // Resources which fail to decode result in a Texture without pixels
+  static std::vector<Texture> load(const std::vector<TextureResource>& resources);
+  static Texture load(const TextureResource& resource);
+
+  // Adds a reference to the texture, textures are freed when their last reference is released
+  static void retain(ID id);
+  static void release(ID id);
+
+  // Called by the Renderer once a reference has been uploaded, the pixels are returned to the TexturePool
+  // once every reference has been uploaded unless the texture is kept resident (see TextureResource::keep_resident)
+  static void uploaded(ID id);
+
+  // Resource the texture was loaded from, used to load its levels again (see TextureStreamer), false if unknown
+  static bool resource_of(ID id, TextureResource& resource);
+
+  // Memory held by the decoded textures
+  static TextureStatistics statistics();
+};
+
+#endif // MEINEKRAFT_TEXTUREMANAGER_HPP
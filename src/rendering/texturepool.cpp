@@ -0,0 +1,87 @@
+#include "texturepool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/// Precedes every block, keeps the pixels 16 byte aligned
+struct alignas(16) BlockHeader {
+  size_t size = 0;
+};
+
+static std::unordered_map<size_t, std::vector<BlockHeader*>> pooled; // Released blocks by size
+static std::mutex mutex;
+static TexturePoolStatistics pool_statistics;
+
+static inline uint8_t* pixels_of(BlockHeader* header) {
+  return reinterpret_cast<uint8_t*>(header) + sizeof(BlockHeader);
+}
+
+static inline BlockHeader* header_of(uint8_t* pixels) {
+  return reinterpret_cast<BlockHeader*>(pixels - sizeof(BlockHeader));
+}
+
+uint8_t* TexturePool::allocate(const size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pool_statistics.num_allocations++;
+    auto it = pooled.find(size);
+    if (it != pooled.end() && !it->second.empty()) {
+      BlockHeader* header = it->second.back();
+      it->second.pop_back();
+      pool_statistics.pooled_bytes -= size;
+      pool_statistics.allocated_bytes += size;
+      pool_statistics.num_reused++;
+      return pixels_of(header);
+    }
+  }
+
+  // NOTE: Allocated outside of the lock, large blocks are page faulted in by the caller
+  BlockHeader* header = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+  if (!header) { return nullptr; }
+  header->size = size;
+  std::lock_guard<std::mutex> lock(mutex);
+  pool_statistics.allocated_bytes += size;
+  return pixels_of(header);
+}
+
+uint8_t* TexturePool::reallocate(uint8_t* pixels, const size_t size) {
+  if (!pixels) { return allocate(size); }
+  uint8_t* resized = allocate(size);
+  if (!resized) { return nullptr; }
+  std::memcpy(resized, pixels, std::min(header_of(pixels)->size, size));
+  release(pixels);
+  return resized;
+}
+
+void TexturePool::release(uint8_t* pixels) {
+  if (!pixels) { return; }
+  BlockHeader* header = header_of(pixels);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pool_statistics.allocated_bytes -= header->size;
+    if (header->size >= MIN_POOLED_SIZE && pool_statistics.pooled_bytes + header->size <= MAX_POOLED_BYTES) {
+      pooled[header->size].push_back(header);
+      pool_statistics.pooled_bytes += header->size;
+      return;
+    }
+  }
+  std::free(header);
+}
+
+void TexturePool::trim() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& pair : pooled) {
+    for (BlockHeader* header : pair.second) { std::free(header); }
+  }
+  pooled.clear();
+  pool_statistics.pooled_bytes = 0;
+}
+
+TexturePoolStatistics TexturePool::statistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pool_statistics;
+}
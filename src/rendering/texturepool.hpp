@@ -0,0 +1,42 @@
+#pragma once
+#ifndef MEINEKRAFT_TEXTUREPOOL_HPP
+#define MEINEKRAFT_TEXTUREPOOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/// Memory held by the TexturePool
+struct TexturePoolStatistics {
+  size_t allocated_bytes = 0; // Handed out and not yet released
+  size_t pooled_bytes = 0;    // Released and kept for reuse
+  size_t num_allocations = 0;
+  size_t num_reused = 0;      // Allocations served by a pooled block
+};
+
+/// Pooled allocator of the pixel storage of textures (see RawTexture), thread safe
+/// Released blocks are kept per byte size and handed out to the next allocation of the same size
+/// NOTE: Textures of a scene share a handful of sizes and decoding releases its intermediate buffers per texture
+/// (decoded base level, mip chain) thus exact sizes are reused well without any waste
+struct TexturePool {
+  /// Upper bound of the bytes kept for reuse, blocks released beyond it are freed
+  static const size_t MAX_POOLED_BYTES = 256 * 1024 * 1024;
+
+  /// Blocks smaller than this are freed on release, scratch memory of the decoders is not worth keeping
+  static const size_t MIN_POOLED_SIZE = 64 * 1024;
+
+  /// Uninitialized block of size bytes (16 byte aligned), nullptr on failure
+  static uint8_t* allocate(size_t size);
+
+  /// Resizes the block keeping its contents like std::realloc, the block is left as is on failure
+  static uint8_t* reallocate(uint8_t* pixels, size_t size);
+
+  /// Returns the block to the pool, nullptr is ignored
+  static void release(uint8_t* pixels);
+
+  /// Frees every pooled block, called once the scene has been decoded (see SceneLoader::update)
+  static void trim();
+
+  static TexturePoolStatistics statistics();
+};
+
+#endif // MEINEKRAFT_TEXTUREPOOL_HPP
@@ -0,0 +1,364 @@
+#include "texturestreamer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+
+#ifdef WIN32
+#include <glew.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "../nodes/model.hpp"
+#include "../util/jobsystem.hpp"
+#include "../util/logging.hpp"
+#include "../util/profiler.hpp"
+#include "graphicsbatch.hpp"
+#include "renderer.hpp"
+#include "textureencoder.hpp"
+#include "texturearrayallocator.hpp"
+#include "texturemanager.hpp"
+#include "texturepool.hpp"
+
+/// Level loaded for every layer of a texture of a batch or of a TextureArray
+struct LoadedLevel {
+  size_t owner = 0; // Index of the batch, of the TextureArray for TextureSlot::Diffuse
+  TextureSlot slot = TextureSlot::Diffuse;
+  uint64_t generation = 0;
+  uint32_t level = 0;
+  std::vector<RawTexture> layers; // Empty RawTexture for the layers which failed to load
+};
+
+/// Levels loaded by the JobSystem waiting to be uploaded
+struct LoadQueue {
+  std::mutex mutex;
+  std::vector<LoadedLevel> loaded;
+};
+
+/// NOTE: Unique across every residency such that loads of reindexed or replaced batches are never mistaken as current
+static uint64_t generation_counter = 1;
+
+uint64_t TextureStreamer::next_generation() {
+  return generation_counter++;
+}
+
+/// Streamed texture of a batch or a TextureArray
+struct TextureStreamer::Streamed {
+  TextureSlot slot;
+  size_t owner;           // See LoadedLevel::owner
+  TextureStorage storage;
+};
+
+size_t TextureResidency::byte_size(const uint32_t base_level, const uint32_t num_layers) const {
+  size_t size = 0;
+  for (uint32_t level = base_level; level < num_levels; level++) { size += TextureEncoder::level_byte_size(layout, level); }
+  return size * layout.faces * num_layers;
+}
+
+/// Finest level of the texture worth holding when drawn screen_size pixels in size, roughly one texel per pixel
+static uint32_t desired_level_of(const TextureResidency& residency, const float screen_size) {
+  if (screen_size <= 0.0f) { return residency.tail_level; }
+  const float texels = float(std::max(residency.layout.width, residency.layout.height));
+  if (texels <= screen_size) { return 0; }
+  const uint32_t level = uint32_t(std::floor(std::log2(texels / screen_size)));
+  return std::min(level, residency.tail_level);
+}
+
+TextureStreamer::TextureStreamer(): queue(std::make_shared<LoadQueue>()) {}
+
+TextureResidency TextureStreamer::residency_of(const Texture& texture, const uint32_t internal_format) {
+  TextureResidency residency;
+  residency.target = texture.gl_texture_target;
+  residency.internal_format = internal_format;
+  residency.layout = texture.data;
+  residency.layout.pixels = nullptr;
+  residency.num_levels = texture.data.base_level + texture.data.levels;
+  residency.base_level = texture.data.base_level;
+  residency.tail_level = texture.data.base_level;
+  residency.desired_level = texture.data.base_level;
+  residency.generation = next_generation();
+
+  TextureResource resource{std::vector<std::string>{}};
+  if (TextureManager::resource_of(texture.id, resource)) { residency.layers.push_back(resource); }
+  residency.streamed = texture.data.base_level > 0 && !residency.layers.empty();
+  return residency;
+}
+
+uint32_t TextureStreamer::create_storage(const TextureResidency& residency, const uint32_t base_level, const uint32_t num_layers,
+                                         const uint32_t gl_texture_unit) {
+  const uint32_t levels = residency.num_levels - base_level;
+  const uint32_t width = std::max(residency.layout.width >> base_level, 1u);
+  const uint32_t height = std::max(residency.layout.height >> base_level, 1u);
+
+  uint32_t gl_texture = 0;
+  glGenTextures(1, &gl_texture);
+  glActiveTexture(GL_TEXTURE0 + gl_texture_unit);
+  glBindTexture(residency.target, gl_texture);
+  if (residency.target == GL_TEXTURE_2D) {
+    glTexStorage2D(residency.target, levels, residency.internal_format, width, height);
+  } else {
+    glTexStorage3D(residency.target, levels, residency.internal_format, width, height, residency.layout.faces * num_layers); // depth = layer faces
+    float aniso = 0.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &aniso);
+    glTexParameterf(residency.target, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+  }
+  glTexParameteri(residency.target, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(residency.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  return gl_texture;
+}
+
+void TextureStreamer::reallocate(const TextureStorage& storage, const uint32_t base_level, const uint32_t num_layers) {
+  TextureResidency& residency = *storage.residency;
+  uint32_t* gl_texture = storage.gl_texture;
+  const uint32_t copied_depth = residency.layout.faces * std::min(num_layers, storage.num_layers);
+  const uint32_t gl_new_texture = create_storage(residency, base_level, num_layers, storage.gl_texture_unit);
+
+  for (uint32_t level = std::max(base_level, residency.base_level); level < residency.num_levels; level++) {
+    const uint32_t level_width = std::max(residency.layout.width >> level, 1u);
+    const uint32_t level_height = std::max(residency.layout.height >> level, 1u);
+    glCopyImageSubData(*gl_texture, residency.target, level - residency.base_level, 0, 0, 0, // src parameters
+      gl_new_texture, residency.target, level - base_level, 0, 0, 0, level_width, level_height, residency.target == GL_TEXTURE_2D ? 1 : copied_depth);
+  }
+
+  glDeleteTextures(1, gl_texture);
+  *gl_texture = gl_new_texture;
+  residency.base_level = base_level;
+  residency.generation = next_generation();
+  residency.pending = false;
+}
+
+void TextureStreamer::upload_level(const TextureResidency& residency, const uint32_t level, const uint32_t layer, const uint8_t* pixels) {
+  const RawTexture& layout = residency.layout;
+  const uint32_t gl_level = level - residency.base_level;
+  const uint32_t width = std::max(layout.width >> level, 1u);
+  const uint32_t height = std::max(layout.height >> level, 1u);
+  const GLsizei level_size = GLsizei(TextureEncoder::level_byte_size(layout, level) * layout.faces);
+  const bool compressed = layout.format != BlockFormat::None;
+  const GLuint texture_format = layout.bytes_per_pixel == 3 ? GL_RGB : GL_RGBA;
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows of the smaller levels are not 4 byte aligned
+  if (residency.target == GL_TEXTURE_2D) {
+    if (compressed) {
+      glCompressedTexSubImage2D(residency.target, gl_level, 0, 0, width, height, residency.internal_format, level_size, pixels);
+    } else {
+      glTexSubImage2D(residency.target, gl_level, 0, 0, width, height, texture_format, GL_UNSIGNED_BYTE, pixels);
+    }
+  } else {
+    const uint32_t zoffset = layer * layout.faces; // zoffset = layer face
+    if (compressed) {
+      glCompressedTexSubImage3D(residency.target, gl_level, 0, 0, zoffset, width, height, layout.faces, residency.internal_format, level_size, pixels);
+    } else {
+      glTexSubImage3D(residency.target, gl_level, 0, 0, zoffset, width, height, layout.faces, texture_format, GL_UNSIGNED_BYTE, pixels);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+/// Uploads the level of every layer into the storage of the texture of the slot (see TextureStreamer::reallocate)
+static void upload_loaded_level(const TextureStorage& storage, const LoadedLevel& loaded) {
+  glActiveTexture(GL_TEXTURE0 + storage.gl_texture_unit);
+  glBindTexture(storage.residency->target, *storage.gl_texture);
+  for (size_t layer = 0; layer < loaded.layers.size(); layer++) {
+    TextureStreamer::upload_level(*storage.residency, loaded.level, uint32_t(layer), loaded.layers[layer].pixels);
+  }
+}
+
+static void release_pixels(LoadedLevel& loaded) {
+  for (RawTexture& layer : loaded.layers) { TexturePool::release(layer.pixels); }
+  loaded.layers.clear();
+}
+
+bool TextureStreamer::make_room(std::vector<Streamed>& streamed, const size_t bytes, const float screen_size, const TextureResidency* refined) {
+  const size_t vram_budget = Texture::streaming_settings.vram_budget;
+  while (stats.resident_bytes + bytes > vram_budget) {
+    // Unneeded levels of any texture first, then the finest levels of the texture smallest on screen
+    Streamed* victim = nullptr;
+    bool victim_unneeded = false;
+    float victim_size = FLT_MAX;
+    for (Streamed& texture : streamed) {
+      const TextureResidency& residency = *texture.storage.residency;
+      if (!residency.streamed || &residency == refined || residency.base_level >= residency.tail_level) { continue; }
+      const bool unneeded = residency.base_level < residency.desired_level;
+      if (!unneeded && residency.screen_size >= screen_size) { continue; }
+      if ((unneeded && !victim_unneeded) || (unneeded == victim_unneeded && residency.screen_size < victim_size)) {
+        victim = &texture;
+        victim_unneeded = unneeded;
+        victim_size = residency.screen_size;
+      }
+    }
+    if (!victim) { return false; }
+
+    const TextureResidency& residency = *victim->storage.residency;
+    const uint32_t num_layers = victim->storage.num_layers;
+    const size_t evicted = residency.byte_size(residency.base_level, num_layers) - residency.byte_size(residency.base_level + 1, num_layers);
+    reallocate(victim->storage, residency.base_level + 1, num_layers);
+    stats.resident_bytes -= evicted;
+    stats.evicted_bytes += evicted;
+  }
+  return true;
+}
+
+void TextureStreamer::update(Renderer& renderer) {
+  if (Texture::streaming_settings.tail_size == 0) { return; }
+  ProfileScope scope("texture_streaming");
+
+  // Screen size of the batches, the largest of their instances given their bounding spheres
+  // NOTE: The projected diameter is 2r/d in NDC scaled by the projection (cot(fov/2)) and half the screen height
+  // Diffuse arrays are shared between batches and take the largest screen size of the batches drawing them
+  const Vec3f camera = renderer.scene->camera.position;
+  const float scale = renderer.projection_matrix[1][1] * float(renderer.screen.height);
+  std::vector<TextureArray>& arrays = renderer.texture_arrays->arrays;
+  for (TextureArray& array : arrays) { array.residency.screen_size = 0.0f; }
+  std::vector<Streamed> streamed;
+  for (size_t i = 0; i < renderer.graphics_batches.size(); i++) {
+    GraphicsBatch& batch = renderer.graphics_batches[i];
+    float screen_size = 0.0f;
+    for (const BoundingVolume& bounding_volume : batch.objects.bounding_volumes) {
+      const float distance = (bounding_volume.position - camera).length();
+      if (distance <= bounding_volume.radius) { screen_size = FLT_MAX; break; } // Camera inside
+      screen_size = std::max(screen_size, bounding_volume.radius / distance * scale);
+    }
+    if (batch.diffuse_array < arrays.size()) {
+      TextureResidency& residency = arrays[batch.diffuse_array].residency;
+      residency.screen_size = std::max(residency.screen_size, screen_size);
+    }
+    for (uint32_t s = 1; s < NUM_TEXTURE_SLOTS; s++) { // NOTE: Diffuse textures are held by the arrays
+      const TextureSlot slot = TextureSlot(s);
+      TextureResidency& residency = batch.residency(slot);
+      if (!residency.streamed) { continue; }
+      residency.screen_size = screen_size;
+      TextureStorage storage;
+      storage.residency = &residency;
+      storage.gl_texture = batch.gl_texture(slot);
+      storage.gl_texture_unit = batch.gl_texture_unit(slot);
+      streamed.push_back({slot, i, storage});
+    }
+  }
+  for (size_t i = 0; i < arrays.size(); i++) {
+    if (arrays[i].residency.streamed && arrays[i].count > 0) { streamed.push_back({TextureSlot::Diffuse, i, arrays[i].storage()}); }
+  }
+  stats.resident_bytes = 0;
+  stats.num_streamed = streamed.size();
+  for (Streamed& texture : streamed) {
+    TextureResidency& residency = *texture.storage.residency;
+    residency.desired_level = desired_level_of(residency, residency.screen_size);
+    stats.resident_bytes += residency.byte_size(residency.base_level, texture.storage.num_layers);
+  }
+
+  // Upload the loaded levels largest on screen first within the frame budget, the rest waits for the next frame
+  std::vector<LoadedLevel> loaded;
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    loaded.swap(queue->loaded);
+  }
+  auto current = [&](const LoadedLevel& level) -> Streamed* {
+    for (Streamed& texture : streamed) {
+      if (texture.slot == level.slot && texture.owner == level.owner) {
+        return texture.storage.residency->generation == level.generation ? &texture : nullptr;
+      }
+    }
+    return nullptr;
+  };
+  std::sort(loaded.begin(), loaded.end(), [&](const LoadedLevel& a, const LoadedLevel& b) {
+    const Streamed* ta = current(a);
+    const Streamed* tb = current(b);
+    return (ta ? ta->storage.residency->screen_size : -1.0f) > (tb ? tb->storage.residency->screen_size : -1.0f);
+  });
+
+  size_t uploaded_bytes = 0;
+  std::vector<LoadedLevel> deferred;
+  for (LoadedLevel& level : loaded) {
+    Streamed* texture = current(level);
+    TextureResidency* residency = texture ? texture->storage.residency : nullptr;
+    if (!residency || residency->base_level != level.level + 1) { release_pixels(level); continue; } // Stale
+
+    // NOTE: The cache might have been written with different import settings since the tail was loaded
+    const RawTexture& layout = residency->layout;
+    const bool failed = std::any_of(level.layers.begin(), level.layers.end(), [&](const RawTexture& layer) {
+      return !layer.pixels || layer.format != layout.format || layer.width != layout.width || layer.height != layout.height ||
+        layer.faces != layout.faces || layer.bytes_per_pixel != layout.bytes_per_pixel;
+    });
+    if (failed || level.layers.size() != residency->layers.size()) {
+      Log::warn("Failed to stream level " + std::to_string(level.level) + " of " + residency->layers.front().files.front() + ", no longer streamed");
+      residency->streamed = false;
+      residency->pending = false;
+      release_pixels(level);
+      continue;
+    }
+
+    const size_t level_bytes = TextureEncoder::level_byte_size(residency->layout, level.level) * residency->layout.faces * level.layers.size();
+    if (uploaded_bytes > 0 && uploaded_bytes + level_bytes > Texture::streaming_settings.frame_upload_budget) {
+      deferred.push_back(std::move(level));
+      continue;
+    }
+
+    const uint32_t num_layers = texture->storage.num_layers;
+    const size_t grown_bytes = residency->byte_size(level.level, num_layers) - residency->byte_size(residency->base_level, num_layers);
+    if (!make_room(streamed, grown_bytes, residency->screen_size, residency)) {
+      residency->pending = false;
+      release_pixels(level);
+      continue;
+    }
+
+    reallocate(texture->storage, level.level, num_layers);
+    upload_loaded_level(texture->storage, level);
+    release_pixels(level);
+    uploaded_bytes += level_bytes;
+    stats.resident_bytes += grown_bytes;
+    stats.uploaded_bytes += level_bytes;
+  }
+  if (!deferred.empty()) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    for (LoadedLevel& level : deferred) { queue->loaded.push_back(std::move(level)); }
+  }
+
+  // Over budget (e.g newly added batches), evict unneeded levels and those of the textures smallest on screen
+  make_room(streamed, 0, FLT_MAX, nullptr);
+
+  // Request the next finer level of the textures largest on screen which want it
+  std::vector<Streamed*> requests;
+  size_t num_pending = 0;
+  for (Streamed& texture : streamed) {
+    const TextureResidency& residency = *texture.storage.residency;
+    if (!residency.streamed) { continue; }
+    if (residency.pending) { num_pending++; continue; }
+    if (residency.desired_level < residency.base_level) { requests.push_back(&texture); }
+  }
+  stats.num_pending = num_pending;
+  std::sort(requests.begin(), requests.end(), [](const Streamed* a, const Streamed* b) {
+    return a->storage.residency->screen_size > b->storage.residency->screen_size;
+  });
+
+  for (Streamed* request : requests) {
+    if (stats.num_pending >= MAX_PENDING_LOADS) { break; }
+    TextureResidency& residency = *request->storage.residency;
+    const uint32_t level = residency.base_level - 1;
+    const uint32_t num_layers = request->storage.num_layers;
+    const size_t grown_bytes = residency.byte_size(level, num_layers) - residency.byte_size(residency.base_level, num_layers);
+    if (!make_room(streamed, grown_bytes, residency.screen_size, &residency)) { continue; }
+
+    residency.pending = true;
+    stats.num_pending++;
+    LoadedLevel pending;
+    pending.owner = request->owner;
+    pending.slot = request->slot;
+    pending.generation = residency.generation;
+    pending.level = level;
+    const std::vector<TextureResource> layers = residency.layers;
+    const std::shared_ptr<LoadQueue> load_queue = queue;
+    JobSystem::instance().execute([load_queue, layers, pending]() mutable {
+      for (const TextureResource& layer : layers) {
+        RawTexture texture = Texture::load_levels(layer, pending.level, pending.level + 1);
+        if (texture.pixels && texture.base_level != pending.level) {
+          TexturePool::release(texture.pixels);
+          texture = RawTexture();
+        }
+        pending.layers.push_back(texture);
+      }
+      std::lock_guard<std::mutex> lock(load_queue->mutex);
+      load_queue->loaded.push_back(std::move(pending));
+    });
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef MEINEKRAFT_TEXTURESTREAMER_HPP
+#define MEINEKRAFT_TEXTURESTREAMER_HPP
+
+#include "texture.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct Renderer;
+struct GraphicsBatch;
+
+/// Textures of a GraphicsBatch
+enum class TextureSlot: uint32_t {
+  Diffuse,           // Layer of a TextureArray shared between batches (see TextureArrayAllocator)
+  MetallicRoughness,
+  TangentNormal,
+  Emissive
+};
+
+static const uint32_t NUM_TEXTURE_SLOTS = 4;
+
+/// Mip levels of a texture (array) of a GraphicsBatch held on the GPU
+/// NOTE: The GPU storage holds the levels [base_level, num_levels) of the chain, level base_level being GL level 0
+struct TextureResidency {
+  bool streamed = false;           // Levels finer than the tail are streamed in on demand (see TextureStreamer)
+  uint32_t target = 0;             // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY
+  uint32_t internal_format = 0;
+  RawTexture layout;               // Format, dimensions and faces of the textures, without pixels
+  uint32_t num_levels = 0;         // Levels of the full chain
+  uint32_t base_level = 0;         // Finest level held
+  uint32_t tail_level = 0;         // Levels from the tail on are always held
+  std::vector<TextureResource> layers; // Resource of every layer in layer order, loaded from when streaming
+
+  /// Streaming state, see TextureStreamer::update
+  float screen_size = 0.0f;        // Largest size in pixels on screen of the instances of the batch
+  uint32_t desired_level = 0;      // Finest level worth holding given the screen size
+  uint64_t generation = 0;         // Changes with the storage, loads requested by an older generation are dropped
+  bool pending = false;            // A load of the next finer level is in flight
+
+  /// Byte size of the storage of the levels from base_level on of num_layers layers
+  size_t byte_size(uint32_t base_level, uint32_t num_layers) const;
+};
+
+/// GPU storage of a texture (array) and the levels it holds, owned by a GraphicsBatch or a TextureArray
+struct TextureStorage {
+  TextureResidency* residency = nullptr;
+  uint32_t* gl_texture = nullptr; // OpenGL handle, replaced whenever the storage is reallocated
+  uint32_t gl_texture_unit = 0;   // Used while uploading
+  uint32_t num_layers = 1;        // Layers allocated
+};
+
+struct TextureStreamingStatistics {
+  size_t resident_bytes = 0;  // GPU memory of the streamed textures
+  size_t uploaded_bytes = 0;  // Levels streamed in since startup
+  size_t evicted_bytes = 0;   // Levels evicted since startup
+  size_t num_pending = 0;     // Level loads in flight
+  size_t num_streamed = 0;    // Streamed textures (arrays counted once)
+};
+
+/// Streams the mip levels finer than the tail of the textures of the GraphicsBatches and the TextureArrays (see TextureStreamingSettings)
+/// Textures are uploaded with their tail, finer levels are loaded one at a time on the JobSystem in order of the screen
+/// size of the batches drawing them and uploaded within a per frame budget, levels are evicted under the VRAM budget
+/// NOTE: Texture storage is immutable (glTexStorage) thus a change of levels moves the texture to new storage,
+/// the levels held by both are copied on the GPU
+struct TextureStreamer {
+  TextureStreamer();
+
+  /// Residency of the texture as uploaded by the Renderer (see RawTexture::base_level), streamed if loaded as a tail
+  static TextureResidency residency_of(const Texture& texture, uint32_t internal_format);
+
+  /// New texture bound to the texture unit with immutable storage of the levels from base_level on of the residency and
+  /// num_layers layers (ignored by 2D textures), the levels are left undefined for the caller to upload
+  static uint32_t create_storage(const TextureResidency& residency, uint32_t base_level, uint32_t num_layers, uint32_t gl_texture_unit);
+
+  /// Moves the texture to storage of the levels from base_level on and num_layers layers, the layers and levels held by
+  /// both are copied, finer levels and new layers are left undefined for the caller to upload
+  static void reallocate(const TextureStorage& storage, uint32_t base_level, uint32_t num_layers);
+
+  /// Uploads the level of the layer (every face of it) to the bound texture of the residency, pixels in the layout of the
+  /// residency (see TextureEncoder::level_byte_size)
+  static void upload_level(const TextureResidency& residency, uint32_t level, uint32_t layer, const uint8_t* pixels);
+
+  /// Generation of a changed storage (see TextureResidency::generation)
+  static uint64_t next_generation();
+
+  /// Prioritizes, uploads loaded levels, evicts and requests the next levels, called once per frame before rendering
+  void update(Renderer& renderer);
+
+  TextureStreamingStatistics statistics() const { return stats; }
+
+  /// Level loads in flight at most
+  static const size_t MAX_PENDING_LOADS = 4;
+
+private:
+  std::shared_ptr<struct LoadQueue> queue; // Shared with the loads in flight
+  TextureStreamingStatistics stats;
+
+  struct Streamed;
+
+  /// Evicts levels of other streamed textures until bytes more fit the VRAM budget, unneeded levels first
+  /// then those of textures smaller on screen than screen_size, returns false if they do not fit
+  bool make_room(std::vector<Streamed>& streamed, size_t bytes, float screen_size, const TextureResidency* refined);
+};
+
+#endif // MEINEKRAFT_TEXTURESTREAMER_HPP
@@ -0,0 +1,178 @@
+#include "sceneloader.hpp"
+
+#include "../nodes/model.hpp"
+#include "../nodes/transform.hpp"
+#include "../rendering/meshmanager.hpp"
+#include "../rendering/renderer.hpp"
+#include "../rendering/shadercache.hpp"
+#include "../rendering/texturearrayallocator.hpp"
+#include "../rendering/texturemanager.hpp"
+#include "../rendering/texturepool.hpp"
+#include "../util/jobsystem.hpp"
+#include "../meinekraft.hpp"
+
+#include <deque>
+#include <mutex>
+
+struct SceneLoader::State {
+  std::mutex mutex;
+  std::deque<Item> items;      // FIFO of RenderComponents ready to be added
+  size_t num_instances = 0;    // Number of mesh instances in the scene, known once meshes_loaded
+  bool meshes_loaded = false;
+  AABB aabb;                   // Scene AABB, valid once meshes_loaded
+  TextureArrayPlan texture_array_plan; // Diffuse texture array layers of the scene, valid once meshes_loaded
+};
+
+/// Material used while the textures of a mesh are being decoded
+static RenderComponent placeholder_from(const RenderComponent& component) {
+  RenderComponent placeholder;
+  placeholder.mesh_id = component.mesh_id;
+  placeholder.shading_model = ShadingModel::PhysicallyBasedScalars;
+  placeholder.diffuse_scalars = Vec3f(0.5f);
+  placeholder.pbr_scalar_parameters = Vec3f(0.0f, 0.8f, 0.0f); // (unused, roughness, metallic)
+  return placeholder;
+}
+
+static double milliseconds_since(const std::chrono::high_resolution_clock::time_point& start) {
+  const auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+SceneLoader::SceneLoader(Scene* scene, const std::string& directory, const std::string& file, const float frame_budget_ms)
+  : state(std::make_shared<State>()), scene(scene), frame_budget_ms(frame_budget_ms), start(std::chrono::high_resolution_clock::now()) {
+  Log::info("Streaming scene: " + directory + file);
+
+  std::shared_ptr<State> state = this->state;
+  JobSystem::instance().execute([=]() {
+    std::vector<std::vector<std::pair<Texture::Type, std::string>>> texture_infos;
+    std::vector<ID> mesh_ids;
+    std::vector<MeshInstance> instances;
+    std::tie(mesh_ids, texture_infos) = MeshManager::load_meshes(directory, file, &instances);
+
+    std::vector<RenderComponent> components(mesh_ids.size());
+    for (size_t i = 0; i < mesh_ids.size(); i++) {
+      components[i].mesh_id = mesh_ids[i];
+      components[i].set_shading_model(ShadingModel::PhysicallyBased);
+    }
+
+    // Instances of each mesh, receive the final material once the textures of the mesh are decoded
+    std::vector<std::vector<size_t>> mesh_instances(mesh_ids.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+      mesh_instances[instances[i].mesh_idx].push_back(i);
+    }
+
+    // Texture arrays are sized for every diffuse texture of the scene before any of them is decoded
+    std::vector<std::vector<std::pair<Texture::Type, std::string>>> manifest;
+    for (size_t i = 0; i < texture_infos.size(); i++) {
+      if (!mesh_instances[i].empty()) { manifest.push_back(texture_infos[i]); }
+    }
+    const TextureArrayPlan texture_array_plan = TextureArrayAllocator::plan(manifest);
+
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->num_instances = instances.size();
+      state->aabb = instances.empty() ? AABB() : Scene::compute_aabb_from(components, instances);
+      state->texture_array_plan = texture_array_plan;
+      state->meshes_loaded = true;
+
+      // Untextured meshes are final as is, textured meshes are shown with a placeholder until decoded
+      for (size_t i = 0; i < instances.size(); i++) {
+        const size_t mesh_idx = instances[i].mesh_idx;
+        Item item;
+        item.idx = i;
+        item.placeholder = !texture_infos[mesh_idx].empty();
+        item.component = item.placeholder ? placeholder_from(components[mesh_idx]) : components[mesh_idx];
+        item.transform = compute_transform_component(instances[i]);
+        state->items.push_back(item);
+      }
+    }
+
+    // NOTE: Textures are decoded once per mesh regardless of the number of instances
+    for (size_t i = 0; i < components.size(); i++) {
+      if (texture_infos[i].empty() || mesh_instances[i].empty()) { continue; }
+      const RenderComponent component = components[i];
+      const auto texture_info = texture_infos[i];
+      const auto instance_idxs = mesh_instances[i];
+      JobSystem::instance().execute([=]() {
+        RenderComponent textured = component;
+        textured.load_textures(texture_info);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (size_t i = 0; i < instance_idxs.size(); i++) {
+          if (i > 0) { textured.retain_textures(); } // One reference per instance (see TextureManager::uploaded)
+          Item item;
+          item.idx = instance_idxs[i];
+          item.component = textured;
+          state->items.push_back(item);
+        }
+      });
+    }
+  });
+}
+
+void SceneLoader::update() {
+  if (done) { return; }
+
+  num_frames++;
+  if (num_frames == 1) {
+    time_to_first_frame_ms = milliseconds_since(start);
+  }
+
+  Renderer* renderer = MeineKraft::instance().renderer;
+  const auto frame_start = std::chrono::high_resolution_clock::now();
+  size_t num_added = 0;
+  while (true) {
+    Item item;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->meshes_loaded && !scene_aabb_set) {
+        // NOTE: Clipmaps are placed from the scene AABB which is only known once the meshes are loaded
+        scene->aabb = state->aabb;
+        renderer->update_clipmaps();
+        entity_ids.resize(state->num_instances, 0);
+        renderer->texture_arrays->reserve(state->texture_array_plan);
+        scene_aabb_set = true;
+      }
+
+      // NOTE: At least one item per frame such that loading always progresses
+      if (state->items.empty() || (num_added > 0 && milliseconds_since(frame_start) >= frame_budget_ms)) { break; }
+      item = std::move(state->items.front());
+      state->items.pop_front();
+    }
+
+    ID& entity_id = entity_ids[item.idx];
+    if (entity_id == 0) {
+      Model model(item.component, item.transform);
+      NameSystem::instance().add_name_to_entity("mesh-" + std::to_string(item.idx), model.id);
+      entity_id = model.id;
+    } else {
+      // Swap the placeholder for the final material
+      renderer->remove_component(entity_id);
+      renderer->add_component(item.component, entity_id);
+    }
+
+    if (!item.placeholder) { num_final++; }
+    num_added++;
+  }
+
+  if (scene_aabb_set && num_final == entity_ids.size()) {
+    done = true;
+    time_to_full_scene_ms = milliseconds_since(start);
+    Log::info("✓ scene streamed in: " + std::to_string(entity_ids.size()) + " mesh instances over " + std::to_string(num_frames) + " frames");
+    Log::info_indent(1, "Time to first frame: " + std::to_string(time_to_first_frame_ms) + " ms");
+    Log::info_indent(1, "Time to full scene: " + std::to_string(time_to_full_scene_ms) + " ms");
+    // NOTE: Released pixels are kept by the TexturePool for the next decode until trimmed, decoding the scene is done
+    const size_t pooled_bytes = TexturePool::statistics().pooled_bytes;
+    TexturePool::trim();
+    const TextureStatistics texture_statistics = TextureManager::statistics();
+    Log::info_indent(1, "Resident texture memory: " + std::to_string(texture_statistics.bytes / (1024 * 1024)) + " MB (" +
+                        std::to_string(texture_statistics.released_bytes / (1024 * 1024)) + " MB released after upload, " +
+                        std::to_string(pooled_bytes / (1024 * 1024)) + " MB of it pooled until now)");
+    const TextureArrayStatistics array_statistics = renderer->texture_arrays->statistics();
+    Log::info_indent(1, "Texture arrays: " + std::to_string(array_statistics.num_arrays) + " holding " + std::to_string(array_statistics.num_layers) +
+                        " / " + std::to_string(array_statistics.capacity) + " layers, " + std::to_string(array_statistics.num_grows) + " grown while loading");
+    const ShaderCacheStatistics shader_statistics = ShaderCache::statistics();
+    Log::info_indent(1, "Shader programs: " + std::to_string(shader_statistics.num_programs) + " (" + std::to_string(shader_statistics.num_compiled) +
+                        " compiled, " + std::to_string(shader_statistics.num_loaded) + " loaded from binaries, " +
+                        std::to_string(shader_statistics.num_shared) + " compilations shared)");
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef MEINEKRAFT_SCENELOADER_HPP
+#define MEINEKRAFT_SCENELOADER_HPP
+
+#include "../rendering/rendercomponent.hpp"
+#include "../nodes/transform.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Scene;
+
+/// Streams a scene in while the engine keeps rendering
+/// Meshes are imported and textures decoded on the JobSystem, finished RenderComponents are queued and
+/// handed to the Renderer on the main thread within a per frame time budget
+/// Textured meshes are first added with a placeholder material which is swapped once their textures are decoded
+struct SceneLoader {
+  SceneLoader(Scene* scene, const std::string& directory, const std::string& file, const float frame_budget_ms);
+
+  /// Adds queued RenderComponents to the Renderer, called on the main thread once per frame after rendering
+  void update();
+
+  /// True once every RenderComponent of the scene has been added with its final material
+  bool is_done() const { return done; }
+
+  /// Time from the start of loading to the first rendered frame
+  double time_to_first_frame_ms = 0.0;
+  /// Time from the start of loading until every RenderComponent has its final material
+  double time_to_full_scene_ms = 0.0;
+
+private:
+  /// RenderComponent ready to be added to the Renderer
+  struct Item {
+    size_t idx = 0;           // Index of the mesh instance in the scene
+    bool placeholder = false; // Textures are still being decoded
+    RenderComponent component;
+    TransformComponent transform; // Only used when the instance is added
+  };
+
+  /// State shared with the jobs such that the loader may be destroyed while they are running
+  struct State;
+
+  std::shared_ptr<State> state;
+  Scene* scene = nullptr;
+  float frame_budget_ms = 4.0f;
+  std::vector<ID> entity_ids;  // Entity of each mesh instance once added (0 means not yet added)
+  size_t num_final = 0;        // RenderComponents added with their final material
+  size_t num_frames = 0;       // Frames rendered while loading
+  bool done = false;
+  bool scene_aabb_set = false;
+  std::chrono::high_resolution_clock::time_point start;
+};
+
+#endif // MEINEKRAFT_SCENELOADER_HPP
@@ -0,0 +1,392 @@
+#include "benchmark.hpp"
+#include "logging.hpp"
+#include "../rendering/meshmanager.hpp"
+#include "../rendering/meshcache.hpp"
+#include "../rendering/meshoptimizer.hpp"
+#include "../rendering/clusterculling.hpp"
+#include "../rendering/graphicsbatch.hpp"
+#include "../rendering/renderer.hpp"
+#include "../nodes/model.hpp"
+#include "../nodes/transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+/// Wall clock time in seconds of executing the function
+template<typename Function>
+static double time_in_seconds(Function function) {
+  const auto start = std::chrono::high_resolution_clock::now();
+  function();
+  const auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+}
+
+/// Loads the meshes of the scene under IDs of their own, never shared with the (uploaded) meshes of the scene being rendered
+static std::vector<ID> load_meshes(const std::string& directory, const std::string& file) {
+  return MeshManager::load_meshes(directory, file, nullptr, false).first;
+}
+
+/// Frees the meshes loaded by a benchmark
+static void release_meshes(const std::vector<ID>& mesh_ids) {
+  for (const ID mesh_id : mesh_ids) {
+    MeshManager::retain(mesh_id);
+    MeshManager::release(mesh_id);
+  }
+}
+
+/// Meshes of the scene loaded for a benchmark adding entities to the Renderer, the entities added and the meshes are
+/// freed once the benchmark is done
+struct EntityFixture {
+  EntityFixture(const std::string& directory, const std::string& file): mesh_ids(load_meshes(directory, file)) {
+    if (mesh_ids.empty()) { Log::warn("No meshes in the scene"); }
+  }
+
+  ~EntityFixture() {
+    for (const ID entity_id : entity_ids) {
+      renderer->remove_component(entity_id);
+      TransformSystem::instance().remove_component(entity_id);
+    }
+    release_meshes(mesh_ids);
+  }
+
+  /// Entity with a transform placed on a grid by its index, the transforms do not affect the lookup of batches
+  static ID grid_entity(const size_t n) {
+    TransformComponent transform;
+    transform.position = Vec3f(float(n % 100), float((n / 100) % 100), float(n / 10000)) * 10.0f;
+    Entity entity;
+    entity.attach_component(transform);
+    return entity.id;
+  }
+
+  std::vector<ID> mesh_ids;
+  std::vector<ID> entity_ids; // Added to the Renderer by the benchmark
+  Renderer* renderer = MeineKraft::instance().renderer;
+};
+
+bool Benchmark::run(const std::string& name, const std::string& directory, const std::string& file) {
+  if (name == "mesh_cache") {
+    mesh_cache(directory, file);
+  } else if (name == "vertex_layout") {
+    vertex_layout(directory, file);
+  } else if (name == "cluster_culling") {
+    cluster_culling(directory, file);
+  } else if (name == "component_adds") {
+    component_adds(directory, file);
+  } else if (name == "entity_churn") {
+    entity_churn(directory, file);
+  } else if (name == "transform_updates") {
+    transform_updates(directory, file);
+  } else {
+    Log::warn("Unknown benchmark: " + name);
+    return false;
+  }
+  return true;
+}
+
+void Benchmark::mesh_cache(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: mesh cache (" + directory + file + ")");
+
+  // NOTE: Every load adds the meshes to the MeshManager, this benchmark is not meant to be run during gameplay
+  MeshCache::invalidate(directory + file);
+  std::vector<ID> cold_meshes;
+  const double cold = time_in_seconds([&]() {
+    cold_meshes = load_meshes(directory, file);
+  });
+
+  std::vector<ID> warm_meshes;
+  const double warm = time_in_seconds([&]() {
+    warm_meshes = load_meshes(directory, file);
+  });
+  release_meshes(cold_meshes);
+  release_meshes(warm_meshes);
+
+  if (cold_meshes.size() != warm_meshes.size()) {
+    Log::error("Mesh cache returned " + std::to_string(warm_meshes.size()) + " meshes, expected " + std::to_string(cold_meshes.size()));
+  }
+
+  Log::info_indent(1, "cold (Assimp + cache write): " + std::to_string(cold) + " seconds");
+  Log::info_indent(1, "warm (memory mapped cache):  " + std::to_string(warm) + " seconds");
+  Log::info_indent(1, "speedup: " + std::to_string(warm > 0.0 ? cold / warm : 0.0) + "x");
+}
+
+void Benchmark::vertex_layout(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: vertex layout (" + directory + file + ")");
+
+  // NOTE: Forces quantization on for the load, the cache of the scene is rewritten if it was imported without it
+  const MeshImportSettings settings = MeshManager::import_settings;
+  MeshManager::import_settings.quantize_vertices = true;
+  const std::vector<ID> mesh_ids = load_meshes(directory, file);
+  MeshManager::import_settings = settings;
+
+  // NOTE: Every vertex transformed is fetched once per pass drawing it (geometry, shadow and voxelization)
+  const size_t NUM_PASSES = 3;
+  size_t num_vertices = 0;
+  size_t index_bytes = 0;
+  double transformed_vertices = 0.0;
+  float max_position_error = 0.0f; // Relative to the largest extent of the mesh
+  float max_normal_error = 0.0f;   // Radians
+  for (const ID mesh_id : mesh_ids) {
+    const Mesh* mesh = MeshManager::mesh_ptr_from_id(mesh_id);
+    if (!mesh->has_packed_vertices()) { continue; }
+    num_vertices += mesh->num_vertices();
+    index_bytes += mesh->byte_size_of_indices();
+
+    const std::vector<uint32_t> indices(mesh->index_data(), mesh->index_data() + mesh->num_indices());
+    const auto statistics = MeshOptimizer::analyze_vertex_cache(indices, mesh->num_vertices());
+    transformed_vertices += double(statistics.acmr) * double(mesh->num_indices() / 3);
+
+    const AABB aabb = MeshManager::aabb_from_id(mesh_id);
+    const Vec3f extent = MeshOptimizer::quantization_extent(aabb);
+    const float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+    for (size_t i = 0; i < mesh->num_vertices(); i++) {
+      const Vertex& vertex = mesh->vertex_data()[i];
+      const PackedVertex& packed = mesh->packed_vertex_data()[i];
+      const Vec3f position(aabb.min.x + packed.position[0] / 65535.0f * extent.x,
+                           aabb.min.y + packed.position[1] / 65535.0f * extent.y,
+                           aabb.min.z + packed.position[2] / 65535.0f * extent.z);
+      const Vec3f error = position - vertex.position;
+      max_position_error = std::max(max_position_error, std::max(std::abs(error.x), std::max(std::abs(error.y), std::abs(error.z))) / max_extent);
+
+      if (vertex.normal.length() == 0.0f) { continue; }
+      const Vec3f normal = MeshOptimizer::octahedral_decode(Vec2f(packed.normal[0] / 32767.0f, packed.normal[1] / 32767.0f));
+      const float cos_angle = std::min(std::max(normal.dot(Vec3f(vertex.normal).normalize()), -1.0f), 1.0f);
+      max_normal_error = std::max(max_normal_error, std::acos(cos_angle));
+    }
+  }
+
+  auto megabytes = [](const double bytes) { return std::to_string(bytes / (1024.0 * 1024.0)) + " MB"; };
+  const double full_vertex_bytes = double(num_vertices) * sizeof(Vertex);
+  const double packed_vertex_bytes = double(num_vertices) * sizeof(PackedVertex);
+  Log::info_indent(1, "# meshes " + std::to_string(mesh_ids.size()) + ", # vertices " + std::to_string(num_vertices) + ", indices " + megabytes(double(index_bytes)));
+  Log::info_indent(1, "Vertex (" + std::to_string(sizeof(Vertex)) + " B): " + megabytes(full_vertex_bytes) + " VBO, " +
+                      megabytes(transformed_vertices * sizeof(Vertex) * NUM_PASSES) + " fetched per frame");
+  Log::info_indent(1, "PackedVertex (" + std::to_string(sizeof(PackedVertex)) + " B): " + megabytes(packed_vertex_bytes) + " VBO, " +
+                      megabytes(transformed_vertices * sizeof(PackedVertex) * NUM_PASSES) + " fetched per frame");
+  Log::info_indent(1, "reduction: " + std::to_string(packed_vertex_bytes > 0.0 ? full_vertex_bytes / packed_vertex_bytes : 0.0) + "x");
+  Log::info_indent(1, "max position error: " + std::to_string(max_position_error) + " (of mesh extent), max normal error: " + std::to_string(max_normal_error) + " rad");
+  release_meshes(mesh_ids);
+}
+
+void Benchmark::cluster_culling(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: cluster culling (" + directory + file + ")");
+
+  // NOTE: Forces meshlets on for the load, the cache of the scene is rewritten if it was imported without them
+  const MeshImportSettings settings = MeshManager::import_settings;
+  MeshManager::import_settings.build_meshlets = true;
+  const std::vector<ID> mesh_ids = load_meshes(directory, file);
+  MeshManager::import_settings = settings;
+
+  AABB scene(Vec3f(std::numeric_limits<float>::max()), Vec3f(std::numeric_limits<float>::lowest()));
+  size_t num_meshlets = 0;
+  size_t num_triangles = 0;
+  for (const ID mesh_id : mesh_ids) {
+    const AABB aabb = MeshManager::aabb_from_id(mesh_id);
+    scene.min = Vec3f(std::min(scene.min.x, aabb.min.x), std::min(scene.min.y, aabb.min.y), std::min(scene.min.z, aabb.min.z));
+    scene.max = Vec3f(std::max(scene.max.x, aabb.max.x), std::max(scene.max.y, aabb.max.y), std::max(scene.max.z, aabb.max.z));
+    num_meshlets += MeshManager::mesh_ptr_from_id(mesh_id)->meshlets.size();
+    num_triangles += MeshManager::mesh_ptr_from_id(mesh_id)->num_indices() / 3;
+  }
+  if (num_meshlets == 0) {
+    Log::warn("No meshlets in the scene");
+    release_meshes(mesh_ids);
+    return;
+  }
+  Log::info_indent(1, "# meshes " + std::to_string(mesh_ids.size()) + ", # meshlets " + std::to_string(num_meshlets) +
+                      ", # triangles " + std::to_string(num_triangles));
+
+  // Views from the inside of the scene (e.g Sponza) and from the outside looking at it, along each axis
+  const Vec3f center = (scene.min + scene.max) / 2.0f;
+  const float extent = scene.max_axis();
+  const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 4.0f * extent);
+  const Vec3f directions[6] = {{1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+
+  const Mat4f model; // Identity, meshes are placed as imported
+  std::vector<uint32_t> visible;
+  for (const float distance : {0.0f, 1.5f}) {
+    size_t visible_meshlets = 0;
+    size_t visible_triangles = 0;
+    double seconds = 0.0;
+    for (const Vec3f& direction : directions) {
+      const Vec3f eye = center + direction * (distance * extent);
+      const Vec3f target = distance == 0.0f ? eye + direction : center;
+      const Vec3f up = std::abs(direction.y) > 0.5f ? Vec3f(0.0f, 0.0f, 1.0f) : Vec3f(0.0f, 1.0f, 0.0f);
+      const glm::mat4 view = glm::lookAt(glm::vec3(eye.x, eye.y, eye.z), glm::vec3(target.x, target.y, target.z), glm::vec3(up.x, up.y, up.z));
+      const glm::mat4 projection_view = projection * view;
+      Mat4f matrix;
+      for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) { matrix[i][j] = projection_view[i][j]; }
+      }
+      const ClusterCulling::Frustum frustum = ClusterCulling::frustum_planes(matrix);
+
+      seconds += time_in_seconds([&]() {
+        for (const ID mesh_id : mesh_ids) {
+          visible_triangles += ClusterCulling::cull(*MeshManager::mesh_ptr_from_id(mesh_id), model, eye, frustum, visible);
+          visible_meshlets += visible.size();
+        }
+      });
+    }
+
+    const double num_views = double(sizeof(directions) / sizeof(directions[0]));
+    Log::info_indent(1, std::string(distance == 0.0f ? "inside" : "outside") + " views: " +
+                        std::to_string(100.0 * (1.0 - double(visible_meshlets) / (num_views * num_meshlets))) + "% meshlets culled, " +
+                        std::to_string(100.0 * (1.0 - double(visible_triangles) / (num_views * num_triangles))) + "% triangles culled, " +
+                        std::to_string(seconds * 1e9 / (num_views * num_meshlets)) + " ns/meshlet");
+  }
+  release_meshes(mesh_ids);
+}
+
+void Benchmark::component_adds(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: component adds (" + directory + file + ")");
+  EntityFixture fixture(directory, file);
+  if (fixture.mesh_ids.empty()) { return; }
+
+  // Untextured components of every mesh in a few shader configurations, each pair of mesh and configuration is a batch
+  const size_t num_configurations = 4;
+  std::vector<RenderComponent> components;
+  for (const ID mesh_id : fixture.mesh_ids) {
+    for (size_t i = 0; i < num_configurations; i++) {
+      RenderComponent component;
+      component.mesh_id = mesh_id;
+      component.set_shading_model(ShadingModel::PhysicallyBasedScalars);
+      if (i & 1) { component.diffuse_scalars = Vec3f(0.5f); }
+      if (i & 2) { component.emissive_scalars = Vec3f(0.1f); }
+      components.push_back(component);
+    }
+  }
+
+  Renderer* renderer = fixture.renderer;
+  auto add = [&](const RenderComponent& component) {
+    const ID entity_id = EntityFixture::grid_entity(fixture.entity_ids.size());
+    renderer->add_component(component, entity_id);
+    fixture.entity_ids.push_back(entity_id);
+  };
+
+  // First add of each batch compiles its shader and allocates its buffers, timed apart from the adds to existing batches
+  const size_t num_batches = renderer->graphics_batches.size();
+  const double batch_seconds = time_in_seconds([&]() {
+    for (const RenderComponent& component : components) { add(component); }
+  });
+  Log::info_indent(1, "# meshes " + std::to_string(fixture.mesh_ids.size()) + ", # batches created " + std::to_string(renderer->graphics_batches.size() - num_batches) +
+                      " in " + std::to_string(batch_seconds) + " seconds");
+
+  const size_t num_entities = 100000;
+  const double seconds = time_in_seconds([&]() {
+    for (size_t i = 0; i < num_entities; i++) { add(components[i % components.size()]); }
+  });
+  Log::info_indent(1, std::to_string(num_entities) + " entities added in " + std::to_string(seconds) + " seconds, " +
+                      std::to_string(seconds > 0.0 ? num_entities / seconds : 0.0) + " component adds/s");
+
+  // Same number of entities through the bulk API, which grows each batch once up front
+  std::vector<RenderComponent> bulk_components;
+  std::vector<ID> bulk_entity_ids;
+  for (size_t i = 0; i < num_entities; i++) {
+    bulk_components.push_back(components[i % components.size()]);
+    bulk_entity_ids.push_back(EntityFixture::grid_entity(fixture.entity_ids.size() + i));
+  }
+  const double bulk_seconds = time_in_seconds([&]() {
+    renderer->add_components(bulk_components, bulk_entity_ids);
+  });
+  fixture.entity_ids.insert(fixture.entity_ids.end(), bulk_entity_ids.begin(), bulk_entity_ids.end());
+  Log::info_indent(1, std::to_string(num_entities) + " entities bulk added in " + std::to_string(bulk_seconds) + " seconds, " +
+                      std::to_string(bulk_seconds > 0.0 ? num_entities / bulk_seconds : 0.0) + " component adds/s");
+}
+
+void Benchmark::entity_churn(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: entity churn (" + directory + file + ")");
+  EntityFixture fixture(directory, file);
+  if (fixture.mesh_ids.empty()) { return; }
+
+  std::vector<RenderComponent> components;
+  for (const ID mesh_id : fixture.mesh_ids) {
+    RenderComponent component;
+    component.mesh_id = mesh_id;
+    component.set_shading_model(ShadingModel::PhysicallyBasedScalars);
+    component.diffuse_scalars = Vec3f(0.5f);
+    components.push_back(component);
+  }
+
+  // Population of entities to churn through, the oldest entity is despawned as a new one spawns in its place
+  Renderer* renderer = fixture.renderer;
+  const size_t num_entities = 10000;
+  size_t num_spawned = 0;
+  auto spawn = [&]() {
+    const ID entity_id = EntityFixture::grid_entity(num_spawned % 10000);
+    renderer->add_component(components[num_spawned % components.size()], entity_id);
+    if (fixture.entity_ids.size() < num_entities) {
+      fixture.entity_ids.push_back(entity_id);
+    } else {
+      fixture.entity_ids[num_spawned % num_entities] = entity_id;
+    }
+    num_spawned++;
+  };
+  for (size_t i = 0; i < num_entities; i++) { spawn(); }
+  const size_t num_batches = renderer->graphics_batches.size();
+
+  const size_t churn_per_second = 10000;
+  const size_t fps = 60;
+  const size_t num_frames = 10 * fps;
+  double total_seconds = 0.0;
+  double max_seconds = 0.0;
+  for (size_t frame = 0; frame < num_frames; frame++) {
+    const size_t churn = churn_per_second * (frame + 1) / fps - churn_per_second * frame / fps;
+    const double seconds = time_in_seconds([&]() {
+      for (size_t i = 0; i < churn; i++) {
+        const ID oldest = fixture.entity_ids[num_spawned % num_entities];
+        renderer->remove_component(oldest);
+        TransformSystem::instance().remove_component(oldest);
+        spawn();
+      }
+    });
+    total_seconds += seconds;
+    max_seconds = std::max(max_seconds, seconds);
+  }
+
+  const double churned = double(churn_per_second * num_frames / fps);
+  Log::info_indent(1, "# meshes " + std::to_string(fixture.mesh_ids.size()) + ", # entities " + std::to_string(num_entities) +
+                      ", # batches " + std::to_string(num_batches) + " (" + std::to_string(renderer->graphics_batches.size()) + " after churning)");
+  Log::info_indent(1, std::to_string(churn_per_second) + " entities despawned and spawned per second at " + std::to_string(fps) + " fps: " +
+                      std::to_string(total_seconds * 1000.0 / num_frames) + " ms per frame on average, " + std::to_string(max_seconds * 1000.0) +
+                      " ms at most, " + std::to_string(churned / total_seconds) + " entities churned/s at most");
+}
+
+void Benchmark::transform_updates(const std::string& directory, const std::string& file) {
+  Log::info("Benchmark: transform updates (" + directory + file + ")");
+  EntityFixture fixture(directory, file);
+  if (fixture.mesh_ids.empty()) { return; }
+
+  // 100k entities spread over the meshes, the first N of them move every frame
+  const size_t num_entities = 100000;
+  std::vector<RenderComponent> components;
+  for (size_t i = 0; i < num_entities; i++) {
+    RenderComponent component;
+    component.mesh_id = fixture.mesh_ids[i % fixture.mesh_ids.size()];
+    component.set_shading_model(ShadingModel::PhysicallyBasedScalars);
+    components.push_back(component);
+    fixture.entity_ids.push_back(EntityFixture::grid_entity(i));
+  }
+  Renderer* renderer = fixture.renderer;
+  renderer->add_components(components, fixture.entity_ids);
+  TransformSystem::instance().reset_dirty();
+
+  const size_t num_frames = 60;
+  for (const size_t num_moving : {size_t(1000), size_t(10000), size_t(100000)}) {
+    double mark_seconds = 0.0;
+    double update_seconds = 0.0;
+    for (size_t frame = 0; frame < num_frames; frame++) {
+      mark_seconds += time_in_seconds([&]() {
+        for (size_t i = 0; i < num_moving; i++) {
+          TransformComponent* transform = TransformSystem::instance().lookup_referenced(fixture.entity_ids[i]);
+          transform->position.y += 0.1f;
+          transform->rotation.y += 1.0f;
+        }
+      });
+      update_seconds += time_in_seconds([&]() { renderer->update_transforms(); });
+      TransformSystem::instance().reset_dirty();
+    }
+    Log::info_indent(1, std::to_string(num_moving) + " moving entities: " + std::to_string(update_seconds * 1000.0 / num_frames) +
+                        " ms per frame to update the batches, " + std::to_string(mark_seconds * 1000.0 / num_frames) + " ms per frame to move them");
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef MEINEKRAFT_BENCHMARK_HPP
+#define MEINEKRAFT_BENCHMARK_HPP
+
+#include <string>
+
+/// Engine benchmarks, enabled by listing them under "benchmarks" in config.json
+/// Results are logged, run with the scene given in config.json
+struct Benchmark {
+  /// Runs the benchmark with the name on the scene, returns false if no such benchmark exists
+  static bool run(const std::string& name, const std::string& directory, const std::string& file);
+
+  /// Scene load time with a cold mesh cache (Assimp import) versus a warm mesh cache (memory mapped)
+  static void mesh_cache(const std::string& directory, const std::string& file);
+
+  /// Vertex buffer size and estimated vertex fetch bandwidth of the full versus the quantized vertex layout
+  static void vertex_layout(const std::string& directory, const std::string& file);
+
+  /// Clusters and triangles culled by the CPU reference of the cluster culling from views around the scene
+  static void cluster_culling(const std::string& directory, const std::string& file);
+
+  /// Component adds per second of 100k entities spread over the batches of the meshes of the scene (a few per mesh)
+  static void component_adds(const std::string& directory, const std::string& file);
+
+  /// Frame time of despawning and spawning 10k entities per second (at 60 fps) among the meshes of the scene
+  static void entity_churn(const std::string& directory, const std::string& file);
+
+  /// Frame time of uploading the transforms of 1k, 10k and 100k moving entities out of 100k (see Renderer::update_transforms)
+  static void transform_updates(const std::string& directory, const std::string& file);
+};
+
+#endif // MEINEKRAFT_BENCHMARK_HPP
@@ -5,8 +5,17 @@
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <regex>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "logging.hpp"
 #include "../math/vector.hpp"
@@ -46,6 +55,44 @@ namespace Filesystem {
     std::filesystem::create_directory(filepath);
   }
 
+  /// Writes the parts (data, byte size) in order to a temporary file which is renamed to the filepath, a crash or a failed
+  /// write never leaves a partial file behind, returns true on success
+  /// NOTE: The temporary file is unique per process and call such that concurrent writers of the same file never interleave
+  inline bool write_atomically(const std::string& filepath, const std::vector<std::pair<const void*, size_t>>& parts) {
+    static std::atomic<uint64_t> num_writes{0};
+#if defined(_WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+    const std::string tmp_filepath = filepath + "." + std::to_string(pid) + "." + std::to_string(num_writes++) + ".tmp";
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(filepath).parent_path(), error);
+
+    std::ofstream ofs(tmp_filepath, std::ios::binary | std::ios::trunc);
+    for (const auto& part : parts) {
+      if (!ofs.write(reinterpret_cast<const char*>(part.first), part.second)) {
+        Log::warn("Failed to write " + tmp_filepath);
+        ofs.close();
+        std::filesystem::remove(tmp_filepath, error);
+        return false;
+      }
+    }
+    ofs.close();
+
+    std::filesystem::rename(tmp_filepath, filepath, error);
+    if (error) {
+      Log::warn("Failed to write " + filepath + " (" + error.message() + ")");
+      std::filesystem::remove(tmp_filepath, error);
+      return false;
+    }
+    return true;
+  }
+
+  inline bool write_atomically(const std::string& filepath, const void* data, const size_t size) {
+    return write_atomically(filepath, {{data, size}});
+  }
+
   inline std::string save_image_as_png(const std::string filename, const Vec3f* pixels, const size_t w, const size_t h, const float downsample_factor = 1.0f, const TextureFormat fmt = TextureFormat::RGB32F) {
     assert(downsample_factor >= 1.0f && "Downsample factor must be larger or equal to 1.0");
     assert(false && "Unimplemented PNG support");
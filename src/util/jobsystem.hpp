@@ -0,0 +1,140 @@
+#pragma once
+#ifndef MEINEKRAFT_JOBSYSTEM_HPP
+#define MEINEKRAFT_JOBSYSTEM_HPP
+
+#include "logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Pool of worker threads executing jobs in FIFO order
+struct JobSystem {
+  /// Singleton instance
+  static JobSystem& instance() {
+    static JobSystem instance;
+    return instance;
+  }
+
+  JobSystem() {
+    const size_t num_threads = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+    Log::info("JobSystem using " + std::to_string(num_threads) + " workers");
+    for (size_t i = 0; i < num_threads; i++) {
+      thread_pool.emplace_back(&JobSystem::work, this);
+    }
+  }
+
+  ~JobSystem() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      exit = true;
+    }
+    job_available.notify_all();
+    for (auto& thread : thread_pool) { thread.join(); }
+  }
+
+  /// Number of worker threads
+  size_t num_workers() const { return thread_pool.size(); }
+
+  /// Queues the function for execution on a worker, returns Job ID
+  uint64_t execute(const std::function<void()>& func) {
+    uint64_t id = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      id = next_job_id++;
+      jobs.push_back(func);
+    }
+    job_available.notify_one();
+    return id;
+  }
+
+  // Blocking, waits until every queued job has been executed
+  void wait_on_all() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [&]() { return jobs.empty() && active_jobs == 0; });
+  }
+
+  /// Calls func(i) for every i in [0, count) spread across the workers and the calling thread, blocking
+  /// max_concurrency limits the number of threads used (0 means all of them)
+  /// NOTE: The calling thread participates so nested calls from within jobs never deadlock
+  void parallel_for(const size_t count, const std::function<void(size_t)>& func, const size_t max_concurrency = 0) {
+    if (count == 0) { return; }
+
+    const size_t threads = max_concurrency == 0 ? thread_pool.size() + 1 : max_concurrency;
+    const size_t helpers = std::min(std::min(threads, count) - 1, thread_pool.size());
+    if (helpers == 0) {
+      for (size_t i = 0; i < count; i++) { func(i); }
+      return;
+    }
+
+    // NOTE: Shared since helpers might start after every index already has been processed
+    struct State {
+      std::function<void(size_t)> func;
+      size_t count = 0;
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> completed{0};
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+    auto state = std::make_shared<State>();
+    state->func = func;
+    state->count = count;
+
+    auto process = [](State& state) {
+      size_t i = 0;
+      while ((i = state.next.fetch_add(1)) < state.count) {
+        state.func(i);
+        if (state.completed.fetch_add(1) + 1 == state.count) {
+          std::lock_guard<std::mutex> lock(state.mutex);
+          state.done.notify_all();
+        }
+      }
+    };
+
+    for (size_t i = 0; i < helpers; i++) {
+      execute([state, process]() { process(*state); });
+    }
+    process(*state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&]() { return state->completed.load() == state->count; });
+  }
+
+private:
+  std::vector<std::thread> thread_pool;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable job_available;
+  std::condition_variable all_done;
+  size_t active_jobs = 0;
+  uint64_t next_job_id = 0;
+  bool exit = false;
+
+  void work() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_available.wait(lock, [&]() { return exit || !jobs.empty(); });
+        if (exit && jobs.empty()) { return; }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        active_jobs++;
+      }
+      job();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        active_jobs--;
+        if (jobs.empty() && active_jobs == 0) { all_done.notify_all(); }
+      }
+    }
+  }
+};
+
+#endif // MEINEKRAFT_JOBSYSTEM_HPP
@@ -0,0 +1,86 @@
+#include "mappedfile.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+bool MappedFile::open(const std::string& filepath) {
+  close();
+
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) { return false; }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return false;
+  }
+
+  const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  file_handle = file;
+  mapping_handle = mapping;
+  data = static_cast<const uint8_t*>(view);
+  size = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data) { UnmapViewOfFile(data); }
+  if (mapping_handle) { CloseHandle(mapping_handle); }
+  if (file_handle) { CloseHandle(file_handle); }
+  data = nullptr;
+  size = 0;
+  mapping_handle = nullptr;
+  file_handle = nullptr;
+}
+#else
+bool MappedFile::open(const std::string& filepath) {
+  close();
+
+  const int fd = ::open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) { return false; }
+
+  struct stat stats;
+  if (fstat(fd, &stats) != 0 || stats.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void* view = mmap(nullptr, size_t(stats.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // NOTE: The mapping keeps its own reference to the file
+  if (view == MAP_FAILED) { return false; }
+
+  data = static_cast<const uint8_t*>(view);
+  size = size_t(stats.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data) { munmap(const_cast<uint8_t*>(data), size); }
+  data = nullptr;
+  size = 0;
+}
+#endif
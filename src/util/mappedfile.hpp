@@ -0,0 +1,35 @@
+#pragma once
+#ifndef MEINEKRAFT_MAPPEDFILE_HPP
+#define MEINEKRAFT_MAPPEDFILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/// Read-only memory mapping of a whole file, unmapped when destroyed
+struct MappedFile {
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// Maps the file at filepath, returns false if the file could not be opened or mapped
+  bool open(const std::string& filepath);
+
+  /// Unmaps the file (if mapped)
+  void close();
+
+  inline bool is_open() const { return data != nullptr; }
+
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+private:
+#if defined(_WIN32) || defined(_WIN64)
+  void* file_handle = nullptr;
+  void* mapping_handle = nullptr;
+#endif
+};
+
+#endif // MEINEKRAFT_MAPPEDFILE_HPP
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef MEINEKRAFT_PROFILER_HPP
+#define MEINEKRAFT_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+/// Accumulates the wall clock time and number of calls of named stages, callable from all threads
+/// Disabled by default such that instrumented code only pays for a branch (see ProfileScope)
+/// NOTE: Stages run on multiple threads at once accumulate the time of every thread
+struct Profiler {
+  /// Singleton instance
+  static Profiler& instance() {
+    static Profiler instance;
+    return instance;
+  }
+
+  struct Stage {
+    double milliseconds = 0.0;
+    uint64_t calls = 0;
+  };
+
+  std::atomic<bool> enabled{false};
+
+  /// Adds the time of one call to the stage
+  void add(const char* stage, const double milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stage& s = stages[stage];
+    s.milliseconds += milliseconds;
+    s.calls++;
+  }
+
+  /// Accumulated stages ordered by name
+  std::map<std::string, Stage> snapshot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stages;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.clear();
+  }
+
+private:
+  std::mutex mutex;
+  std::map<std::string, Stage> stages;
+};
+
+/// Times its own lifetime as one call of the stage when the Profiler is enabled
+struct ProfileScope {
+  explicit ProfileScope(const char* stage): stage(stage), active(Profiler::instance().enabled) {
+    if (active) { start = std::chrono::high_resolution_clock::now(); }
+  }
+
+  ~ProfileScope() {
+    if (!active) { return; }
+    const auto end = std::chrono::high_resolution_clock::now();
+    Profiler::instance().add(stage, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  const char* stage;
+  const bool active;
+  std::chrono::high_resolution_clock::time_point start;
+};
+
+#endif // MEINEKRAFT_PROFILER_HPP
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef MEINEKRAFT_SIMD_HPP
+#define MEINEKRAFT_SIMD_HPP
+
+/// Instruction sets of the SIMD code paths, each path falls back to scalar code when its instruction set is missing
+/// MEINEKRAFT_SSE2: part of the x86-64 baseline, used unconditionally
+/// MEINEKRAFT_SSSE3_DISPATCH: not part of the x86-64 baseline thus compiled per function and selected at runtime
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MEINEKRAFT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MEINEKRAFT_SSSE3_DISPATCH
+#include <tmmintrin.h>
+#endif
+
+#endif // MEINEKRAFT_SIMD_HPP
@@ -0,0 +1,94 @@
+// Unit test of the CPU reference of the culling performed in shaders/culling.comp.glsl (see ClusterCulling)
+#include "../src/rendering/clusterculling.hpp"
+#include "../src/util/logging.hpp"
+#include "test.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <vector>
+
+/// Frustum of a camera at the origin looking down -z with a 90 degree field of view and the far plane at 100
+static ClusterCulling::Frustum camera_frustum() {
+  const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+  const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  const glm::mat4 projection_view = projection * view;
+  Mat4f matrix;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) { matrix[i][j] = projection_view[i][j]; }
+  }
+  return ClusterCulling::frustum_planes(matrix);
+}
+
+static Meshlet meshlet_at(const Vec3f& center, const float radius, const Vec3f& cone_axis, const float cone_cutoff) {
+  Meshlet meshlet;
+  meshlet.center = center;
+  meshlet.radius = radius;
+  meshlet.cone_axis = cone_axis;
+  meshlet.cone_cutoff = cone_cutoff;
+  meshlet.num_indices = 3 * Meshlet::MAX_TRIANGLES;
+  return meshlet;
+}
+
+int main() {
+  const ClusterCulling::Frustum frustum = camera_frustum();
+  const Vec3f camera_position(0.0f, 0.0f, 0.0f);
+
+  // Per instance sphere test, every plane rejects the spheres entirely on its outside
+  check(ClusterCulling::is_inside(Vec4f(0.0f, 0.0f, -10.0f, 1.0f), frustum), "sphere in front of the camera is inside");
+  check(!ClusterCulling::is_inside(Vec4f(0.0f, 0.0f, 10.0f, 1.0f), frustum), "sphere behind the camera is outside");
+  check(!ClusterCulling::is_inside(Vec4f(0.0f, 0.0f, -110.0f, 1.0f), frustum), "sphere beyond the far plane is outside");
+  check(!ClusterCulling::is_inside(Vec4f(-30.0f, 0.0f, -10.0f, 1.0f), frustum), "sphere left of the frustum is outside");
+  check(!ClusterCulling::is_inside(Vec4f(30.0f, 0.0f, -10.0f, 1.0f), frustum), "sphere right of the frustum is outside");
+  check(!ClusterCulling::is_inside(Vec4f(0.0f, -30.0f, -10.0f, 1.0f), frustum), "sphere below the frustum is outside");
+  check(!ClusterCulling::is_inside(Vec4f(0.0f, 30.0f, -10.0f, 1.0f), frustum), "sphere above the frustum is outside");
+  check(ClusterCulling::is_inside(Vec4f(-10.5f, 0.0f, -10.0f, 1.0f), frustum), "sphere intersecting the left plane is inside");
+  check(ClusterCulling::is_inside(Vec4f(0.0f, 0.0f, 0.5f, 1.0f), frustum), "sphere intersecting the near plane is inside");
+
+  // Meshlets are culled by the frustum and their backface normal cones
+  const Mat4f identity;
+  const Vec3f towards_camera(0.0f, 0.0f, 1.0f);
+  const Vec3f away_from_camera(0.0f, 0.0f, -1.0f);
+  check(ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, towards_camera, 0.5f), identity, camera_position, frustum),
+        "meshlet facing the camera is visible");
+  check(!ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, away_from_camera, 0.5f), identity, camera_position, frustum),
+        "meshlet facing away from the camera is culled");
+  check(ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, away_from_camera, 1.0f), identity, camera_position, frustum),
+        "meshlet without a normal cone is never backface culled");
+  check(!ClusterCulling::is_visible(meshlet_at(Vec3f(30.0f, 0.0f, -10.0f), 1.0f, towards_camera, 0.5f), identity, camera_position, frustum),
+        "meshlet outside the frustum is culled");
+
+  // Meshlets are placed by the model matrix of the instance
+  Mat4f model;
+  model[3][0] = 30.0f; // Translation along x
+  check(!ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, towards_camera, 0.5f), model, camera_position, frustum),
+        "meshlet moved outside the frustum by the model matrix is culled");
+
+  // Non-uniformly scaled instances bound the meshlets by their largest scale and are never backface culled
+  Mat4f scaled_y;
+  scaled_y[1][1] = 10.0f;
+  check(ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 1.5f, -10.0f), 1.0f, towards_camera, 0.5f), scaled_y, camera_position, frustum),
+        "meshlet stretched into the frustum by the model matrix is visible");
+  Mat4f scaled_x;
+  scaled_x[0][0] = 10.0f;
+  const Vec3f tilted_axis = Vec3f(1.0f, 0.0f, 1.0f).normalize(); // Faces the camera once scaled along x
+  check(ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 0.01f, tilted_axis, -0.5f), scaled_x, camera_position, frustum),
+        "meshlet of a non-uniformly scaled instance is never backface culled");
+  Mat4f scaled_uniformly;
+  for (int i = 0; i < 3; i++) { scaled_uniformly[i][i] = 2.0f; }
+  check(!ClusterCulling::is_visible(meshlet_at(Vec3f(0.0f, 0.0f, -5.0f), 0.5f, away_from_camera, 0.5f), scaled_uniformly, camera_position, frustum),
+        "meshlet of a uniformly scaled instance facing away from the camera is culled");
+
+  Mesh mesh;
+  mesh.meshlets = {meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, towards_camera, 0.5f),
+                   meshlet_at(Vec3f(0.0f, 0.0f, 10.0f), 1.0f, towards_camera, 0.5f),
+                   meshlet_at(Vec3f(0.0f, 0.0f, -10.0f), 1.0f, away_from_camera, 0.5f),
+                   meshlet_at(Vec3f(5.0f, 0.0f, -20.0f), 1.0f, towards_camera, 1.0f)};
+  std::vector<uint32_t> visible;
+  const size_t num_triangles = ClusterCulling::cull(mesh, identity, camera_position, frustum, visible);
+  check(visible == std::vector<uint32_t>({0, 3}), "visible meshlets of the mesh");
+  check(num_triangles == 2 * Meshlet::MAX_TRIANGLES, "visible triangles of the mesh");
+
+  return test_result("ClusterCulling");
+}
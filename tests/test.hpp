@@ -0,0 +1,24 @@
+#pragma once
+#ifndef MEINEKRAFT_TEST_HPP
+#define MEINEKRAFT_TEST_HPP
+
+// Minimal harness shared by the unit tests, every failed check is logged and counted
+#include "../src/util/logging.hpp"
+
+#include <string>
+
+inline size_t num_failures = 0;
+
+inline void check(const bool condition, const std::string& msg) {
+  if (condition) { return; }
+  Log::error("FAILED: " + msg);
+  num_failures++;
+}
+
+/// Exit code of the test, logs the test as passed when none of its checks failed
+inline int test_result(const std::string& name) {
+  if (num_failures == 0) { Log::info(name + " test passed"); }
+  return num_failures == 0 ? 0 : 1;
+}
+
+#endif // MEINEKRAFT_TEST_HPP
@@ -0,0 +1,77 @@
+// Unit test of the texture references held by the instances of a scene (see TextureManager and RenderComponent)
+// Decoded pixels are expected to be released once the upload of every instance has been confirmed
+#include "../src/rendering/rendercomponent.hpp"
+#include "../src/rendering/texturemanager.hpp"
+#include "../src/util/logging.hpp"
+#include "test.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// Writes a binary PPM of the size filled with the color, returns its filepath
+static std::string write_ppm(const std::string& filename, const uint32_t size, const uint8_t color) {
+  const std::string filepath = (std::filesystem::temp_directory_path() / filename).generic_string();
+  std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+  ofs << "P6\n" << size << " " << size << "\n255\n";
+  const std::vector<char> pixels(size * size * 3, char(color));
+  ofs.write(pixels.data(), pixels.size());
+  return filepath;
+}
+
+/// Confirms the upload of the instances as the Renderer does (see Renderer::add_components)
+static void upload(const std::vector<RenderComponent>& components, const std::vector<MeshInstance>& instances) {
+  for (const MeshInstance& instance : instances) {
+    for (const Texture* texture : components[instance.mesh_idx].textures()) {
+      if (texture->id != 0) { TextureManager::uploaded(texture->id); }
+    }
+  }
+}
+
+int main() {
+  const std::string instanced_file = write_ppm("meinekraft-texturemanager-test-0.ppm", 16, 64);
+  const std::string unused_file = write_ppm("meinekraft-texturemanager-test-1.ppm", 16, 128);
+
+  // Two meshes loaded with a texture each (see RenderComponent::load_scene_models), only the first is placed in the scene
+  std::vector<RenderComponent> components(2);
+  components[0].load_textures({{Texture::Type::Diffuse, instanced_file}});
+  components[1].load_textures({{Texture::Type::Diffuse, unused_file}});
+  check(components[0].diffuse_texture.data.pixels != nullptr, "texture decoded");
+  check(TextureManager::statistics().bytes > 0, "pixels resident before upload");
+
+  const size_t NUM_INSTANCES = 16;
+  std::vector<MeshInstance> instances(NUM_INSTANCES);
+  RenderComponent::share_textures_with_instances(components, instances);
+
+  TextureStatistics statistics = TextureManager::statistics();
+  check(statistics.num_textures == 1, "texture of the mesh without instances freed");
+  check(statistics.num_references == NUM_INSTANCES, "one reference per instance");
+
+  upload(components, std::vector<MeshInstance>(instances.begin(), instances.end() - 1));
+  check(TextureManager::statistics().bytes > 0, "pixels resident until every instance is uploaded");
+
+  upload(components, std::vector<MeshInstance>(instances.end() - 1, instances.end()));
+  statistics = TextureManager::statistics();
+  check(statistics.bytes == 0, "pixels released once every instance is uploaded");
+  check(statistics.released_bytes > 0, "released pixels accounted for");
+
+  for (size_t i = 0; i < NUM_INSTANCES; i++) { components[0].release_textures(); }
+  check(TextureManager::statistics().num_textures == 0, "texture freed with its last reference");
+
+  // A reference released without being uploaded no longer holds back the pixels of the uploaded ones
+  RenderComponent component;
+  component.load_textures({{Texture::Type::Diffuse, instanced_file}});
+  component.retain_textures();
+  component.release_textures();
+  check(TextureManager::statistics().bytes > 0, "pixels resident while a reference is pending");
+  TextureManager::uploaded(component.diffuse_texture.id);
+  check(TextureManager::statistics().bytes == 0, "pixels released once the remaining reference is uploaded");
+  component.release_textures();
+
+  std::remove(instanced_file.c_str());
+  std::remove(unused_file.c_str());
+
+  return test_result("TextureManager");
+}
@@ -0,0 +1,202 @@
+/// Headless scene import profiler, loads a scene the same way as the engine without creating a window
+/// Usage: ImportProfiler [<directory> <file>] [--cold] [--decoder <stb_image|sdl_image>] [--output <file.json>]
+///   <directory> <file>  scene to load, defaults to the scene in config.json
+///   --cold              invalidates the mesh and texture caches first such that everything is imported from the sources
+///   --decoder           image decoder of the textures (see TextureDecoder), defaults to texture_import.decoder in config.json
+///   --output            writes the JSON report to the file instead of stdout
+/// Reports the time of every import stage, peak RSS and the bytes allocated as JSON
+
+#include "../src/rendering/rendercomponent.hpp"
+#include "../src/rendering/meshmanager.hpp"
+#include "../src/rendering/meshcache.hpp"
+#include "../src/rendering/texturemanager.hpp"
+#include "../src/rendering/texturecache.hpp"
+#include "../src/rendering/texturepool.hpp"
+#include "../src/util/config.hpp"
+#include "../src/util/filesystem.hpp"
+#include "../src/util/logging.hpp"
+#include "../src/util/profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/// Allocations through operator new, C allocations (SDL_image, calloc) are not included
+static std::atomic<uint64_t> bytes_allocated{0};
+static std::atomic<uint64_t> num_allocations{0};
+
+void* operator new(size_t size) {
+  bytes_allocated += size;
+  num_allocations++;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+/// Peak resident set size of the process in bytes
+static uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return counters.PeakWorkingSetSize; }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#if defined(__APPLE__)
+  return uint64_t(usage.ru_maxrss);        // Bytes on macOS
+#else
+  return uint64_t(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  bool success = false;
+  const auto config = Config::load_config(success);
+
+  std::string directory;
+  std::string file;
+  std::string output;
+  bool cold = false;
+  std::string decoder;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--cold") {
+      cold = true;
+    } else if (arg == "--decoder" && i + 1 < argc) {
+      decoder = argv[++i];
+    } else if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (directory.empty()) {
+      directory = arg;
+    } else if (file.empty()) {
+      file = arg;
+    } else {
+      Log::error("Unknown argument: " + arg);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (success && config.contains("mesh_import")) {
+    const auto& mesh_import = config["mesh_import"];
+    MeshManager::import_settings.optimize_vertex_cache = mesh_import.value("optimize_vertex_cache", false);
+    MeshManager::import_settings.quantize_vertices = mesh_import.value("quantize_vertices", false);
+    MeshManager::import_settings.generate_lods = mesh_import.value("generate_lods", false);
+    MeshManager::import_settings.build_meshlets = mesh_import.value("build_meshlets", false);
+  }
+
+  if (success && config.contains("texture_import")) {
+    const auto& texture_import = config["texture_import"];
+    Texture::import_settings.decode_concurrency = texture_import.value("decode_concurrency", size_t(0));
+    Texture::import_settings.compress = texture_import.value("compress", false);
+    Texture::import_settings.high_quality = texture_import.value("high_quality", false);
+    Texture::import_settings.rgba = texture_import.value("rgba", false);
+    if (decoder.empty()) { decoder = texture_import.value("decoder", std::string("stb_image")); }
+  }
+  Texture::import_settings.decoder = decoder == "sdl_image" ? TextureDecoder::SDLImage : TextureDecoder::STBImage;
+  // NOTE: Only the tails are loaded when streaming, the rest of the chains is cached
+  if (success && config.contains("texture_streaming")) {
+    Texture::streaming_settings.tail_size = config["texture_streaming"].value("tail_size", uint32_t(0));
+  }
+
+  if (directory.empty() || file.empty()) {
+    if (!success || !config.contains("scene")) {
+      Log::error("No scene given and no scene in config.json");
+      return EXIT_FAILURE;
+    }
+    directory = Filesystem::home + config["scene"]["path"].get<std::string>();
+    file = config["scene"]["name"].get<std::string>();
+  }
+
+  Filesystem::create_directory(Filesystem::tmp);
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  if (cold) {
+    MeshCache::invalidate(directory + file);
+    TextureCache::invalidate_all();
+  }
+
+  Profiler::instance().enabled = true;
+  const uint64_t bytes_allocated_before = bytes_allocated;
+  const uint64_t num_allocations_before = num_allocations;
+  const auto start = std::chrono::high_resolution_clock::now();
+  std::vector<MeshInstance> instances;
+  const std::vector<RenderComponent> components = RenderComponent::load_scene_models(directory, file, &instances);
+  const auto end = std::chrono::high_resolution_clock::now();
+  Profiler::instance().enabled = false;
+
+  const MeshStatistics mesh_statistics = MeshManager::statistics();
+  const TextureStatistics texture_statistics = TextureManager::statistics();
+
+  // NOTE: Headless thus the upload of every instance is confirmed as the Renderer would (see TextureManager::uploaded)
+  RenderComponent::share_textures_with_instances(components, instances);
+  for (const MeshInstance& instance : instances) {
+    const RenderComponent& component = components[instance.mesh_idx];
+    for (const Texture* texture : component.textures()) {
+      if (texture->id != 0) { TextureManager::uploaded(texture->id); }
+    }
+  }
+  const TextureStatistics uploaded_statistics = TextureManager::statistics();
+  const TexturePoolStatistics pool_statistics = TexturePool::statistics();
+  nlohmann::json report;
+  report["scene"] = directory + file;
+  report["import_flags"] = MeshManager::import_flags();
+  report["texture_decode_concurrency"] = Texture::import_settings.decode_concurrency;
+  report["texture_decoder"] = Texture::import_settings.decoder == TextureDecoder::SDLImage ? "sdl_image" : "stb_image";
+  report["texture_compression"] = Texture::import_settings.compress ? (Texture::import_settings.high_quality ? "bc7" : "bc1/bc3/bc5") : "none";
+  report["total_ms"] = std::chrono::duration<double, std::milli>(end - start).count();
+  const auto stages = Profiler::instance().snapshot();
+  for (const auto& stage : stages) {
+    report["stages"][stage.first] = { {"ms", stage.second.milliseconds}, {"calls", stage.second.calls} };
+  }
+  report["mesh_cache_hit"] = stages.count("assimp_parse") == 0;
+  report["meshes"] = components.size();
+  report["instances"] = instances.size();
+  report["mesh_owned_bytes"] = mesh_statistics.owned_bytes;
+  report["mesh_mapped_bytes"] = mesh_statistics.mapped_bytes;
+  report["mesh_duplicates"] = mesh_statistics.num_duplicates;
+  report["mesh_duplicate_bytes"] = mesh_statistics.duplicate_bytes;
+  report["textures"] = texture_statistics.num_textures;
+  report["texture_references"] = texture_statistics.num_references;
+  report["texture_bytes"] = texture_statistics.bytes;
+  report["texture_shared_bytes"] = texture_statistics.shared_bytes;
+  report["texture_resident_bytes_before_upload"] = texture_statistics.bytes;
+  report["texture_resident_bytes_after_upload"] = uploaded_statistics.bytes;
+  report["texture_pool_reused"] = pool_statistics.num_reused;
+  report["texture_pool_allocations"] = pool_statistics.num_allocations;
+  report["peak_rss_bytes"] = peak_rss_bytes();
+  report["bytes_allocated"] = bytes_allocated - bytes_allocated_before;
+  report["allocations"] = num_allocations - num_allocations_before;
+
+  if (output.empty()) {
+    std::cout << report.dump(2) << std::endl;
+  } else {
+    std::ofstream ofs(output);
+    ofs << report.dump(2) << std::endl;
+    if (!ofs.good()) {
+      Log::error("Failed to write report to " + output);
+      return EXIT_FAILURE;
+    }
+    Log::info("Import profile written to " + output);
+  }
+
+  IMG_Quit();
+  return components.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}